@@ -22,7 +22,8 @@ namespace olib
 			m_ignore_this_log(false),
 			m_context( new exception_context()),
             mlog_level( log_level::info),
-            m_log_hint( log_target::not_set )
+            m_log_hint( log_target::not_set ),
+            m_thread_id( 0 )
         {
         }
 
@@ -32,7 +33,9 @@ namespace olib
 			m_ignore_this_log(o.m_ignore_this_log),
 			m_context(o.m_context),
             mlog_level(o.mlog_level),
-            m_log_hint( o.m_log_hint )
+            m_log_hint( o.m_log_hint ),
+            m_time( o.m_time ),
+            m_thread_id( o.m_thread_id )
         {
             o.m_ignore_this_log = true;
         }
@@ -40,7 +43,8 @@ namespace olib
         // This constructor is only used by the trace_logger class.
         logger::logger( boost::shared_ptr<exception_context> ctx, log_level::severity lvl )
             :   ARLOG_A(*this), 
-            ARLOG_B(*this )
+            ARLOG_B(*this ),
+            m_thread_id( 0 )
         {
             m_ignore_this_log = true;
             m_context = ctx;
@@ -77,6 +81,8 @@ namespace olib
             mlog_level = o.mlog_level;
             m_ignore_this_log = o.m_ignore_this_log;
             m_log_hint = o.m_log_hint;
+            m_time = o.m_time;
+            m_thread_id = o.m_thread_id;
             o.m_ignore_this_log = true;
             return *this;
         }
@@ -3,6 +3,7 @@
 
 #include "basic_enums.hpp"
 #include "time_helpers.hpp"
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 namespace olib
 {
@@ -153,6 +154,18 @@ namespace olib
 
             /// Get the internal log context.
             boost::shared_ptr<exception_context> get_context() const { return m_context; }
+
+            /// Local time at which the request was made.
+            /** Only set when the request was queued by an asynchronous 
+                log_handler, otherwise boost::posix_time::not_a_date_time - 
+                log_targets should use the current time in that case. */
+            const boost::posix_time::ptime& time() const { return m_time; }
+
+            /// Id of the thread which made the request.
+            /** Only set when the request was queued by an asynchronous 
+                log_handler, otherwise 0 - log_targets should use the current 
+                thread's id in that case. */
+            boost::uint64_t thread_id() const { return m_thread_id; }
 			
 			void operator++( )
 			{
@@ -165,7 +178,10 @@ namespace olib
 			void handle_log();
 			log_level::severity mlog_level;
             log_target::hint m_log_hint;
+            boost::posix_time::ptime m_time;
+            boost::uint64_t m_thread_id;
 			friend class scope_logger;
+			friend class async_log_writer;
             logger( boost::shared_ptr<exception_context> ctx, log_level::severity lvl );
 		};
 
@@ -5,6 +5,11 @@
 
 #include <boost/ref.hpp>
 #include <boost/bind.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
 
 #include "logtarget.hpp"
 #include "loghandler.hpp"
@@ -12,6 +17,9 @@
 #include "str_util.hpp"
 #include "assert.hpp"
 #include "base_exception.hpp"
+#include "exception_context.hpp"
+#include "spsc_queue.hpp"
+#include "thread_name.hpp"
 
 namespace olib
 {
@@ -19,6 +27,268 @@ namespace olib
 	{
 		typedef Loki::SingletonHolder<	log_handler > the_internal_log_handler;
 
+		namespace
+		{
+			// A log request captured on the thread which made it
+			struct log_record
+			{
+				log_record( ) : level( log_level::info ), hint( log_target::not_set ), thread_id( 0 ) { }
+
+				boost::posix_time::ptime time;
+				boost::uint64_t thread_id;
+				log_level::severity level;
+				log_target::hint hint;
+				boost::shared_ptr< exception_context > context;
+				t_string source;
+			};
+
+			bool earlier( const log_record &a, const log_record &b )
+			{
+				return a.time < b.time;
+			}
+
+			// The requests queued by a single thread
+			typedef spsc_queue< log_record > record_queue;
+			typedef boost::shared_ptr< record_queue > record_queue_ptr;
+		}
+
+		/// Background writer used by log_handler::set_async.
+		/** Each logging thread owns a bounded ring of captured requests, so 
+			queueing a request takes no lock. The writer thread wakes periodically 
+			(or when a flush is requested), drains all rings, sorts the requests 
+			by time and passes them to the logtargets. The writer is created once 
+			and lives as long as the log_handler, since the per-thread rings are 
+			keyed on it. */
+		class async_log_writer : public boost::noncopyable
+		{
+		public:
+			async_log_writer( log_handler &handler, size_t capacity )
+				: handler_( handler )
+				, capacity_( capacity < 1 ? 1 : capacity )
+				, running_( 0 )
+				, dropped_( 0 )
+				, queuing_( 0 )
+				, requested_( 0 )
+				, served_( 0 )
+			{
+			}
+
+			~async_log_writer( )
+			{
+				stop( );
+			}
+
+			void start( )
+			{
+				boost::mutex::scoped_lock control( control_ );
+				if ( thread_ )
+					return;
+
+				{
+					boost::mutex::scoped_lock lock( mutex_ );
+					detail::store_release( running_, 1 );
+				}
+
+				thread_.reset( new boost::thread( boost::bind( &async_log_writer::run, this ) ) );
+			}
+
+			// Drains everything queued before the thread exits
+			void stop( )
+			{
+				boost::mutex::scoped_lock control( control_ );
+				if ( !thread_ )
+					return;
+
+				{
+					boost::mutex::scoped_lock lock( mutex_ );
+					detail::store_release( running_, 0 );
+					wake_.notify_all( );
+				}
+
+				thread_->join( );
+
+				// A thread which saw running before it was cleared may still be pushing -
+				// wait for it and pass on what arrived after the writer's last drain
+				detail::full_fence( );
+				while ( long( queuing_ ) != 0 )
+					boost::this_thread::yield( );
+				drain( );
+
+				thread_.reset( );
+			}
+
+			bool running( ) const
+			{
+				return detail::load_acquire( running_ ) != 0;
+			}
+
+			// Capture the request on the calling thread - returns false if it should be logged synchronously
+			bool queue( logger &lg, const TCHAR *log_source )
+			{
+				if ( !running( ) || on_writer( ) )
+					return false;
+
+				log_record record;
+				record.time = boost::posix_time::microsec_clock::universal_time( );
+				record.thread_id = utilities::get_current_thread_id( );
+				record.level = lg.level( );
+				record.hint = lg.log_hint( );
+				record.context = lg.get_context( );
+				record.source = log_source;
+
+				// stop waits for queuing_ to clear after running is reset, so either the
+				// request is refused here or stop sees it in the ring
+				++ queuing_;
+				if ( !running( ) )
+				{
+					-- queuing_;
+					return false;
+				}
+
+				if ( !local( ).try_push( record ) )
+					++ dropped_;
+
+				-- queuing_;
+				return true;
+			}
+
+			// Wait for the writer to pass on everything queued before this call
+			void flush( )
+			{
+				if ( on_writer( ) )
+					return;
+
+				boost::mutex::scoped_lock lock( mutex_ );
+				if ( !running( ) )
+					return;
+
+				const boost::int64_t ticket = ++ requested_;
+				wake_.notify_all( );
+				while ( served_ < ticket )
+					done_.wait( lock );
+			}
+
+			boost::int64_t dropped( ) const
+			{
+				return boost::int64_t( long( dropped_ ) );
+			}
+
+		private:
+			// Only the writer thread sets its flag, so this needs no synchronisation
+			bool on_writer( ) const
+			{
+				return writer_.get( ) != 0;
+			}
+
+			record_queue &local( )
+			{
+				record_queue_ptr *queue = local_.get( );
+				if ( queue == 0 )
+				{
+					queue = new record_queue_ptr( new record_queue( capacity_ ) );
+					local_.reset( queue );
+
+					boost::mutex::scoped_lock lock( mutex_ );
+					queues_.push_back( *queue );
+				}
+				return **queue;
+			}
+
+			void run( )
+			{
+				set_thread_name( _CT( "log writer" ) );
+				writer_.reset( new bool( true ) );
+
+				bool active = true;
+				while ( active )
+				{
+					boost::int64_t requested;
+					{
+						boost::mutex::scoped_lock lock( mutex_ );
+						if ( requested_ == served_ && running( ) )
+							wake_.timed_wait( lock, boost::posix_time::milliseconds( 20 ) );
+						requested = requested_;
+						active = running( );
+					}
+
+					drain( );
+
+					{
+						boost::mutex::scoped_lock lock( mutex_ );
+						served_ = requested;
+						done_.notify_all( );
+					}
+				}
+
+				writer_.reset( );
+			}
+
+			void drain( )
+			{
+				std::vector< record_queue_ptr > queues;
+				{
+					boost::mutex::scoped_lock lock( mutex_ );
+					queues = queues_;
+				}
+
+				log_record record;
+				for ( std::vector< record_queue_ptr >::iterator it = queues.begin( ); it != queues.end( ); ++it )
+					while ( ( *it )->try_pop( record ) )
+						batch_.push_back( record );
+
+				std::stable_sort( batch_.begin( ), batch_.end( ), earlier );
+
+				for ( std::vector< log_record >::iterator it = batch_.begin( ); it != batch_.end( ); ++it )
+					deliver( *it );
+
+				batch_.clear( );
+				queues.clear( );
+
+				// Forget the rings of threads which have exited once they are empty
+				boost::mutex::scoped_lock lock( mutex_ );
+				for ( std::vector< record_queue_ptr >::iterator it = queues_.begin( ); it != queues_.end( ); )
+				{
+					if ( it->unique( ) && ( *it )->empty( ) )
+						it = queues_.erase( it );
+					else
+						++it;
+				}
+			}
+
+			void deliver( const log_record &record )
+			{
+				try
+				{
+					logger lg( record.context, record.level );
+					lg.m_log_hint = record.hint;
+					lg.m_time = boost::date_time::c_local_adjustor< boost::posix_time::ptime >::utc_to_local( record.time );
+					lg.m_thread_id = record.thread_id;
+					handler_.dispatch( lg, record.source.c_str( ) );
+				}
+				catch ( ... )
+				{
+					// swallow any exceptions that occur, as logger::handle_log does
+				}
+			}
+
+			log_handler &handler_;
+			const size_t capacity_;
+			volatile int running_;
+			boost::detail::atomic_count dropped_;
+			boost::detail::atomic_count queuing_;
+			boost::int64_t requested_;
+			boost::int64_t served_;
+			boost::thread_specific_ptr< bool > writer_;
+			boost::thread_specific_ptr< record_queue_ptr > local_;
+			std::vector< record_queue_ptr > queues_;
+			std::vector< log_record > batch_;
+			boost::mutex mutex_;
+			boost::condition_variable wake_;
+			boost::condition_variable done_;
+			boost::mutex control_;
+			boost::scoped_ptr< boost::thread > thread_;
+		};
+
 		log_handler& the_log_handler::instance()
 		{
 			return the_internal_log_handler::Instance();
@@ -45,17 +315,25 @@ namespace olib
 			return false;
 		}
 
-        log_handler::log_handler() : m_log(true), m_global_log_level(log_level::warning)
+        log_handler::log_handler() : m_log(true), m_global_log_level(log_level::warning), m_async(0)
 		{
 			
 		}
 
 		log_handler::~log_handler()
 		{
+			if( m_async ) m_async->stop();
+			delete m_async;
+		}
+
+		async_log_writer* log_handler::async_writer() const
+		{
+			return detail::load_acquire( m_async );
 		}
 
 		void log_handler::log( invoke_assert& a, const TCHAR* log_source ) 
 		{
+			if( async_log_writer* writer = async_writer() ) writer->flush();
 			boost::recursive_mutex::scoped_lock lck( m_Mtx );
 			if( m_log ) 
 			{
@@ -67,6 +345,7 @@ namespace olib
 
 		void log_handler::log( base_exception& e, const TCHAR* log_source ) 
 		{
+			if( async_log_writer* writer = async_writer() ) writer->flush();
 			boost::recursive_mutex::scoped_lock lck( m_Mtx );
 			if( m_log ) 
 			{
@@ -77,6 +356,19 @@ namespace olib
 		}
 
 		void log_handler::log( logger& lg, const TCHAR* log_source )
+		{
+			async_log_writer* writer = async_writer();
+			if( m_log && writer && writer->queue( lg, log_source ) )
+			{
+				// Serious problems are written before the caller carries on
+				if( lg.level() <= log_level::error ) writer->flush();
+				return;
+			}
+
+			dispatch( lg, log_source );
+		}
+
+		void log_handler::dispatch( logger& lg, const TCHAR* log_source )
 		{
 			boost::recursive_mutex::scoped_lock lck( m_Mtx );
 			if( m_log ) 
@@ -97,5 +389,36 @@ namespace olib
 			boost::recursive_mutex::scoped_lock lck( m_Mtx );
 			m_log = v;
 		}
+
+		void log_handler::set_async( bool v, size_t capacity )
+		{
+			async_log_writer* writer = 0;
+			{
+				// Logging threads read the writer without the lock, so it's published once complete
+				boost::recursive_mutex::scoped_lock lck( m_Mtx );
+				if( !m_async && v ) detail::store_release( m_async, new async_log_writer( *this, capacity ) );
+				writer = m_async;
+			}
+
+			if( writer && v ) writer->start();
+			else if( writer ) writer->stop();
+		}
+
+		bool log_handler::get_async() const
+		{
+			async_log_writer* writer = async_writer();
+			return writer && writer->running();
+		}
+
+		void log_handler::flush()
+		{
+			if( async_log_writer* writer = async_writer() ) writer->flush();
+		}
+
+		boost::int64_t log_handler::get_dropped() const
+		{
+			async_log_writer* writer = async_writer();
+			return writer ? writer->dropped() : 0;
+		}
 	}
 }
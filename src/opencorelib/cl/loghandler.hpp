@@ -3,6 +3,7 @@
 
 #include "./typedefs.hpp"
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/cstdint.hpp>
 #include <vector>
 
 namespace olib
@@ -13,6 +14,7 @@ namespace olib
         class logger;
         class base_exception;
         class logtarget;
+        class async_log_writer;
 
 		/// Handles logging of assertions, throwing of CBase_exceptions and log-requests using the CLogger class. 
 		/** This should be a singleton in the system. Access the 
@@ -94,13 +96,46 @@ namespace olib
                 return m_global_log_level;
             }
 
+            /// Hand log requests to a background writer instead of the logtargets.
+            /** When enabled, log( logger&, ... ) only captures the request (time, 
+                level, source and message) in a bounded buffer owned by the calling 
+                thread. A background thread drains the buffers and passes the requests 
+                on to the logtargets in time order, so formatting and writing never 
+                happens on the thread that logs. Requests which arrive when the buffer 
+                is full are dropped and counted. Requests at log_level::error or worse, 
+                assertions and exceptions flush everything queued before they are 
+                delivered synchronously. Disabling drains all buffers before returning.
+                Change this at startup or shutdown rather than while threads are logging.
+                @param v true to enable the background writer.
+                @param capacity Maximum number of requests queued per thread. */
+            void set_async( bool v, size_t capacity = 4096 );
+
+            /// Is the background writer enabled?
+            bool get_async() const;
+
+            /// Wait until every request queued so far has been passed to the logtargets.
+            void flush();
+
+            /// Number of requests dropped because a thread's buffer was full.
+            boost::int64_t get_dropped() const;
+
 		private:
+			friend class async_log_writer;
+
+			// Pass a log request to the registered logtargets
+			void dispatch( logger& lg, const TCHAR* log_source );
+
+			// The background writer (null until set_async is first enabled)
+			async_log_writer* async_writer() const;
+
 			boost::recursive_mutex m_Mtx;
 			bool m_log;
 			t_string m_output_filename;
 			typedef std::vector< logtarget_ptr > target_vec;
 			target_vec m_log_targets;
             log_level::severity m_global_log_level;
+			// Created once by set_async and kept until destruction - logging threads read it without m_Mtx
+			async_log_writer* volatile m_async;
 		};
 
 		/// The one and only log_hander in the system.
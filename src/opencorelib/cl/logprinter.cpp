@@ -47,7 +47,9 @@ namespace olib
 
         t_string log_utilities::get_log_prefix_string( log_level::severity lvl, 
                                                        t_stringstream &ss,
-                                                       logoutput::options log_options )
+                                                       logoutput::options log_options,
+                                                       const boost::posix_time::ptime &when,
+                                                       boost::uint64_t thread_id )
         {
             using namespace boost::date_time;
             using namespace boost::posix_time;
@@ -56,14 +58,14 @@ namespace olib
             ss.str(_CT(""));
             ss.clear();
 
-            ptime now = boost::posix_time::microsec_clock::local_time();
+            ptime now = when.is_special() ? boost::posix_time::microsec_clock::local_time() : when;
             std::locale loc = ss.getloc();
             if( std::has_facet<       t_date_facet >( loc ) ) ss << now.date();
             if( std::has_facet< t_local_time_facet >( loc ) ) ss << now.time_of_day();
             
             if( log_options & logoutput::current_thread_id  )
             {
-                boost::uint64_t thread_id = utilities::get_current_thread_id();
+                if( thread_id == 0 ) thread_id = utilities::get_current_thread_id();
                 t_format thread_fmt(_CT(" (%08x)"));
                 ss << (thread_fmt % thread_id).str();
             }
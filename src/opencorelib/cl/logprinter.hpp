@@ -56,10 +56,18 @@ namespace olib
                         could look like this: "11:11:20.218 (00000fe0) [info]". 
                         The first value is the time, followed by the time in milli 
                         seconds, followed by the current thread's id, followed by the
-                        log_level. */
+                        log_level. 
+                @param when The local time to output. Defaults to the current time
+                        (pass logger::time() to output the time of the request when
+                        logging asynchronously). 
+                @param thread_id The thread id to output. Defaults to the current 
+                        thread (pass logger::thread_id() to output the thread which
+                        made the request when logging asynchronously). */
             CORE_API t_string get_log_prefix_string( log_level::severity lvl, 
                                                      t_stringstream &ss,
-                                                     logoutput::options log_options );
+                                                     logoutput::options log_options,
+                                                     const boost::posix_time::ptime &when = boost::posix_time::ptime( ),
+                                                     boost::uint64_t thread_id = 0 );
 
             /// Creates a stream that is useful for log output.
             /** The function returns a stream object to log_file_path. 
@@ -0,0 +1,47 @@
+// LRU - A Templated least recently used structure for threaded evaluation
+
+// Copyright (C) 2011 Vizrt
+// Released under the LGPL.
+
+#include "precompiled_headers.hpp"
+#include "lru.hpp"
+
+#include <boost/detail/atomic_count.hpp>
+
+namespace olib { namespace opencorelib {
+
+namespace
+{
+	boost::detail::atomic_count lru_hits_( 0 );
+	boost::detail::atomic_count lru_misses_( 0 );
+	boost::int64_t lru_hits_base_ = 0;
+	boost::int64_t lru_misses_base_ = 0;
+}
+
+void lru_statistics::hit( )
+{
+	++ lru_hits_;
+}
+
+void lru_statistics::miss( )
+{
+	++ lru_misses_;
+}
+
+boost::int64_t lru_statistics::hits( )
+{
+	return boost::int64_t( lru_hits_ ) - lru_hits_base_;
+}
+
+boost::int64_t lru_statistics::misses( )
+{
+	return boost::int64_t( lru_misses_ ) - lru_misses_base_;
+}
+
+void lru_statistics::reset( )
+{
+	lru_hits_base_ = boost::int64_t( lru_hits_ );
+	lru_misses_base_ = boost::int64_t( lru_misses_ );
+}
+
+} }
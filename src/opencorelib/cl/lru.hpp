@@ -9,11 +9,35 @@
 #include "export_defines.hpp"
 
 #include <boost/thread.hpp>
+#include <boost/cstdint.hpp>
 #include <map>
 #include <list>
 
 namespace olib { namespace opencorelib {
 
+/// Process wide counters of lru lookups - these are aggregated over every lru
+/// instance and are intended for reporting purposes only (see amlbatch's 
+/// --perf-report option).
+
+class CORE_API lru_statistics
+{
+	public:
+		/// Record a lookup which found the requested item
+		static void hit( );
+
+		/// Record a lookup which failed to find the requested item
+		static void miss( );
+
+		/// Total number of successful lookups
+		static boost::int64_t hits( );
+
+		/// Total number of failed lookups
+		static boost::int64_t misses( );
+
+		/// Reset the counters
+		static void reset( );
+};
+
 /// Provides a generic mechanism for controlling collections of objects based 
 /// on usage - the least recently used objects will be automatically discarded
 /// as new objects are added.
@@ -38,6 +62,8 @@ class CORE_API lru
 
 		lru( size_t size = 50 )
 		: size_( size )
+		, hits_( 0 )
+		, misses_( 0 )
 		{
 		}
 
@@ -73,7 +99,7 @@ class CORE_API lru
 			else
 			{
 				queue_[ index ] = value;
-				fetch( index );
+				touch( index );
 			}
 			cond_.notify_all( );
 		}
@@ -82,14 +108,8 @@ class CORE_API lru
 		val_type fetch( key_type index )
 		{
 			boost::recursive_mutex::scoped_lock lock( mutex_ );
-			val_type result;
-			iterator iter = queue_.find( index );
-			if ( iter != queue_.end( ) )
-			{
-				result = iter->second;
-				lru_.remove( index );
-				lru_.push_back( index );
-			}
+			val_type result = touch( index );
+			count( result );
 			return result;
 		}
 
@@ -109,6 +129,7 @@ class CORE_API lru
 					lru_.push_back( iter->first );
 				}
 			}
+			count( result );
 			return result;
 		}
 
@@ -118,9 +139,10 @@ class CORE_API lru
 			boost::recursive_mutex::scoped_lock lock( mutex_ );
 			val_type result;
 			boost::system_time timeout = boost::get_system_time( ) + time;
-			while( !( result = fetch( index ) ) )
+			while( !( result = touch( index ) ) )
 				if ( !cond_.timed_wait( lock, timeout ) )
 					break;
+			count( result );
 			return result;
 		}
 
@@ -197,6 +219,33 @@ class CORE_API lru
 			return queue_.size( ) < size;
 		}
 
+		/// Remove the least recently used item and return it (an empty value when there are none)
+		val_type pop( )
+		{
+			boost::recursive_mutex::scoped_lock lock( mutex_ );
+			val_type result;
+			if ( !lru_.empty( ) )
+			{
+				iterator iter = queue_.find( *( lru_.begin( ) ) );
+				result = iter->second;
+				queue_.erase( iter );
+				lru_.pop_front( );
+				space_.notify_all( );
+			}
+			return result;
+		}
+
+		/// Pass each object held to the function given, from the least to the most 
+		/// recently used, without changing the lru state - the lru is locked 
+		/// throughout, so the function must not block
+		template < typename F >
+		void each( F &function ) const
+		{
+			boost::recursive_mutex::scoped_lock lock( mutex_ );
+			for ( typename list::const_iterator iter = lru_.begin( ); iter != lru_.end( ); ++ iter )
+				function( queue_.find( *iter )->second );
+		}
+
 		/// Remove all items stored
 		void clear( )
 		{
@@ -206,13 +255,58 @@ class CORE_API lru
 			space_.notify_all( );
 		}
 
+		/// Number of successful fetches from this lru
+		boost::int64_t hits( ) const
+		{
+			boost::recursive_mutex::scoped_lock lock( mutex_ );
+			return hits_;
+		}
+
+		/// Number of failed fetches from this lru
+		boost::int64_t misses( ) const
+		{
+			boost::recursive_mutex::scoped_lock lock( mutex_ );
+			return misses_;
+		}
+
 	private:
+		/// Obtain the object and make it the most recently used without affecting the counters
+		val_type touch( key_type index )
+		{
+			val_type result;
+			iterator iter = queue_.find( index );
+			if ( iter != queue_.end( ) )
+			{
+				result = iter->second;
+				lru_.remove( index );
+				lru_.push_back( index );
+			}
+			return result;
+		}
+
+		/// Update the hit/miss counters
+		void count( const val_type &result )
+		{
+			if ( result )
+			{
+				hits_ ++;
+				lru_statistics::hit( );
+			}
+			else
+			{
+				misses_ ++;
+				lru_statistics::miss( );
+			}
+		}
+
 		mutable boost::recursive_mutex mutex_;
 		boost::condition_variable_any cond_;
 		boost::condition_variable_any space_;
 		map queue_;
 		list lru_;
 		size_t size_;
+		boost::int64_t hits_;
+		boost::int64_t misses_;
 };
 
 } }
@@ -0,0 +1,321 @@
+// SPSC Queue - A bounded single producer/single consumer ring buffer
+
+// Copyright (C) 2011 Vizrt
+// Released under the LGPL.
+
+#ifndef CORE_SPSC_QUEUE_H_
+#define CORE_SPSC_QUEUE_H_
+
+#include <boost/thread.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <vector>
+
+#if defined( WIN32 )
+#include <intrin.h>
+#endif
+
+namespace olib { namespace opencorelib {
+
+namespace detail {
+
+/// Minimal memory ordering primitives for the ring buffer indexes.
+
+template< typename T > inline T load_acquire( const volatile T &value )
+{
+#if defined( __ATOMIC_ACQUIRE )
+	return __atomic_load_n( &value, __ATOMIC_ACQUIRE );
+#elif defined( WIN32 )
+	T result = value;
+	_ReadWriteBarrier( );
+	return result;
+#else
+	T result = value;
+	__sync_synchronize( );
+	return result;
+#endif
+}
+
+template< typename T > inline void store_release( volatile T &value, T update )
+{
+#if defined( __ATOMIC_RELEASE )
+	__atomic_store_n( &value, update, __ATOMIC_RELEASE );
+#elif defined( WIN32 )
+	_ReadWriteBarrier( );
+	value = update;
+#else
+	__sync_synchronize( );
+	value = update;
+#endif
+}
+
+inline void full_fence( )
+{
+#if defined( __ATOMIC_SEQ_CST )
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+#elif defined( WIN32 )
+	_mm_mfence( );
+#else
+	__sync_synchronize( );
+#endif
+}
+
+}
+
+/// Counters maintained by an spsc_queue - stall times are in microseconds.
+
+struct spsc_queue_statistics
+{
+	spsc_queue_statistics( )
+		: pushes( 0 )
+		, pops( 0 )
+		, max_depth( 0 )
+		, producer_stalls( 0 )
+		, producer_stall_time( 0 )
+		, consumer_stalls( 0 )
+		, consumer_stall_time( 0 )
+	{ }
+
+	boost::int64_t pushes;
+	boost::int64_t pops;
+	boost::int64_t max_depth;
+	boost::int64_t producer_stalls;
+	boost::int64_t producer_stall_time;
+	boost::int64_t consumer_stalls;
+	boost::int64_t consumer_stall_time;
+};
+
+/// A bounded ring which allows one thread to push and another to pop without
+/// taking a lock.
+///
+/// Notes:
+///
+/// * try_push and try_pop never block - when the ring is full or empty they
+///   return false.
+/// * push and pop spin briefly before falling back to a condition wait which
+///   is bounded by the timeout provided.
+/// * only one thread may push and only one thread may pop at any given time -
+///   use the lru for anything with multiple consumers.
+/// * the capacity is rounded up to a power of 2.
+
+template< typename val_type >
+class spsc_queue : public boost::noncopyable
+{
+	public:
+		explicit spsc_queue( size_t capacity = 50 )
+			: head_( 0 )
+			, tail_( 0 )
+			, producer_waiting_( 0 )
+			, consumer_waiting_( 0 )
+		{
+			size_t size = 2;
+			while ( size < capacity )
+				size <<= 1;
+			slots_.resize( size );
+			mask_ = size - 1;
+			capacity_ = capacity < 1 ? 1 : capacity;
+		}
+
+		/// Maximum number of items which can be queued
+		size_t capacity( ) const
+		{
+			return capacity_;
+		}
+
+		/// Number of items currently queued (approximate when called from a third thread)
+		size_t size( ) const
+		{
+			return size_t( detail::load_acquire( tail_ ) - detail::load_acquire( head_ ) );
+		}
+
+		bool empty( ) const
+		{
+			return size( ) == 0;
+		}
+
+		/// Producer: queue an item if there's space
+		bool try_push( const val_type &value )
+		{
+			const size_t tail = tail_;
+			const size_t depth = tail - detail::load_acquire( head_ );
+			if ( depth >= capacity_ )
+				return false;
+
+			slots_[ tail & mask_ ] = value;
+			detail::store_release( tail_, tail + 1 );
+
+			add( producer_.pushes, 1 );
+			if ( boost::int64_t( depth + 1 ) > producer_.max_depth )
+				detail::store_release( producer_.max_depth, boost::int64_t( depth + 1 ) );
+
+			wake( consumer_waiting_ );
+			return true;
+		}
+
+		/// Consumer: obtain the oldest item if there is one
+		bool try_pop( val_type &value )
+		{
+			const size_t head = head_;
+			if ( head == detail::load_acquire( tail_ ) )
+				return false;
+
+			val_type &slot = slots_[ head & mask_ ];
+			value = slot;
+			slot = val_type( );
+			detail::store_release( head_, head + 1 );
+
+			add( consumer_.pops, 1 );
+
+			wake( producer_waiting_ );
+			return true;
+		}
+
+		/// Producer: queue an item, waiting up to the timeout for space
+		bool push( const val_type &value, boost::posix_time::time_duration timeout )
+		{
+			if ( try_push( value ) || ( spin( &spsc_queue::can_push ) && try_push( value ) ) )
+				return true;
+
+			boost::system_time start = boost::get_system_time( );
+			bool result = wait( producer_waiting_, &spsc_queue::can_push, start + timeout );
+			if ( result )
+				result = try_push( value );
+
+			add( producer_.stalls, 1 );
+			add( producer_.stall_time, ( boost::get_system_time( ) - start ).total_microseconds( ) );
+			return result;
+		}
+
+		/// Consumer: obtain the oldest item, waiting up to the timeout for one to arrive
+		bool pop( val_type &value, boost::posix_time::time_duration timeout )
+		{
+			if ( try_pop( value ) || ( spin( &spsc_queue::can_pop ) && try_pop( value ) ) )
+				return true;
+
+			boost::system_time start = boost::get_system_time( );
+			bool result = wait( consumer_waiting_, &spsc_queue::can_pop, start + timeout );
+			if ( result )
+				result = try_pop( value );
+
+			add( consumer_.stalls, 1 );
+			add( consumer_.stall_time, ( boost::get_system_time( ) - start ).total_microseconds( ) );
+			return result;
+		}
+
+		/// Snapshot of the counters - may be taken from any thread
+		spsc_queue_statistics statistics( ) const
+		{
+			spsc_queue_statistics result;
+			result.pushes = detail::load_acquire( producer_.pushes );
+			result.pops = detail::load_acquire( consumer_.pops );
+			result.max_depth = detail::load_acquire( producer_.max_depth );
+			result.producer_stalls = detail::load_acquire( producer_.stalls );
+			result.producer_stall_time = detail::load_acquire( producer_.stall_time );
+			result.consumer_stalls = detail::load_acquire( consumer_.stalls );
+			result.consumer_stall_time = detail::load_acquire( consumer_.stall_time );
+			return result;
+		}
+
+	private:
+		typedef bool ( spsc_queue::*predicate )( ) const;
+
+		// Counters which are only written by the producer
+		struct producer_counters
+		{
+			producer_counters( ) : pushes( 0 ), max_depth( 0 ), stalls( 0 ), stall_time( 0 ) { }
+			volatile boost::int64_t pushes;
+			volatile boost::int64_t max_depth;
+			volatile boost::int64_t stalls;
+			volatile boost::int64_t stall_time;
+		};
+
+		// Counters which are only written by the consumer
+		struct consumer_counters
+		{
+			consumer_counters( ) : pops( 0 ), stalls( 0 ), stall_time( 0 ) { }
+			volatile boost::int64_t pops;
+			volatile boost::int64_t stalls;
+			volatile boost::int64_t stall_time;
+		};
+
+		// Each counter has a single writer, so the update doesn't need to be atomic -
+		// the release only ensures that statistics( ) sees whole values
+		static void add( volatile boost::int64_t &counter, boost::int64_t value )
+		{
+			detail::store_release( counter, boost::int64_t( counter + value ) );
+		}
+
+		bool can_push( ) const
+		{
+			return tail_ - detail::load_acquire( head_ ) < capacity_;
+		}
+
+		bool can_pop( ) const
+		{
+			return head_ != detail::load_acquire( tail_ );
+		}
+
+		// Short busy wait for the common case where the other thread is just behind
+		bool spin( predicate ready ) const
+		{
+			for ( int i = 0; i < 64; i ++ )
+			{
+				if ( ( this->*ready )( ) )
+					return true;
+				boost::this_thread::yield( );
+			}
+			return false;
+		}
+
+		// Blocking fallback - the waiting flag is raised before the final check so
+		// that the other side either sees it and notifies, or we see its update
+		bool wait( volatile int &waiting, predicate ready, const boost::system_time &until )
+		{
+			boost::mutex::scoped_lock lock( mutex_ );
+			bool result = false;
+			while ( true )
+			{
+				detail::store_release( waiting, 1 );
+				detail::full_fence( );
+				if ( ( result = ( this->*ready )( ) ) )
+					break;
+				boost::system_time slice = boost::get_system_time( ) + boost::posix_time::milliseconds( 10 );
+				if ( !cond_.timed_wait( lock, slice < until ? slice : until ) && boost::get_system_time( ) >= until )
+				{
+					result = ( this->*ready )( );
+					break;
+				}
+			}
+			detail::store_release( waiting, 0 );
+			return result;
+		}
+
+		void wake( volatile int &waiting )
+		{
+			detail::full_fence( );
+			if ( detail::load_acquire( waiting ) )
+			{
+				boost::mutex::scoped_lock lock( mutex_ );
+				cond_.notify_all( );
+			}
+		}
+
+		// Consumer owned index and counters followed by the producer owned ones on separate cache lines
+		volatile size_t head_;
+		consumer_counters consumer_;
+		char pad_head_[ 64 ];
+		volatile size_t tail_;
+		producer_counters producer_;
+		char pad_tail_[ 64 ];
+		volatile int producer_waiting_;
+		volatile int consumer_waiting_;
+		size_t mask_;
+		size_t capacity_;
+		std::vector< val_type > slots_;
+		boost::mutex mutex_;
+		boost::condition_variable cond_;
+};
+
+} }
+
+#endif
@@ -0,0 +1,348 @@
+// ml - A media library representation.
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#include "analyse_sidecar.hpp"
+#include "analyse.hpp"
+#include "stream.hpp"
+
+#include <opencorelib/cl/core.hpp>
+#include <opencorelib/cl/log_defines.hpp>
+#include <opencorelib/cl/str_util.hpp>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <string.h>
+#include <time.h>
+
+namespace pl = olib::openpluginlib;
+namespace cl = olib::opencorelib;
+namespace ipc = boost::interprocess;
+
+namespace olib { namespace openmedialib { namespace ml {
+
+namespace
+{
+	// Bits of the present byte
+	const boost::uint8_t has_temporal_reference = 1;
+	const boost::uint8_t has_picture_coding_type = 2;
+	const boost::uint8_t has_vbv_delay = 4;
+	const boost::uint8_t has_gop = 8;
+	const boost::uint8_t has_top_field_first = 16;
+	const boost::uint8_t has_progressive_frame = 32;
+
+	// Bits of the flags byte
+	const boost::uint8_t flag_valid = 1;
+	const boost::uint8_t flag_closed_gop = 2;
+	const boost::uint8_t flag_broken_link = 4;
+	const boost::uint8_t flag_top_field_first = 8;
+	const boost::uint8_t flag_progressive_frame = 16;
+
+	inline void put_int32( boost::uint8_t *p, boost::int32_t value )
+	{
+		p[ 0 ] = boost::uint8_t( ( value >> 24 ) & 0xff );
+		p[ 1 ] = boost::uint8_t( ( value >> 16 ) & 0xff );
+		p[ 2 ] = boost::uint8_t( ( value >> 8 ) & 0xff );
+		p[ 3 ] = boost::uint8_t( value & 0xff );
+	}
+
+	inline void put_int16( boost::uint8_t *p, boost::int16_t value )
+	{
+		p[ 0 ] = boost::uint8_t( ( value >> 8 ) & 0xff );
+		p[ 1 ] = boost::uint8_t( value & 0xff );
+	}
+
+	inline void put_int64( boost::uint8_t *p, boost::int64_t value )
+	{
+		put_int32( p, boost::int32_t( value >> 32 ) );
+		put_int32( p + 4, boost::int32_t( value & 0xffffffff ) );
+	}
+
+	inline boost::int32_t get_int32( const boost::uint8_t *p )
+	{
+		return boost::int32_t( ( boost::uint32_t( p[ 0 ] ) << 24 ) | ( p[ 1 ] << 16 ) | ( p[ 2 ] << 8 ) | p[ 3 ] );
+	}
+
+	inline boost::int64_t get_int64( const boost::uint8_t *p )
+	{
+		return boost::int64_t( ( boost::uint64_t( boost::uint32_t( get_int32( p ) ) ) << 32 ) | boost::uint32_t( get_int32( p + 4 ) ) );
+	}
+
+	inline boost::int16_t get_int16( const boost::uint8_t *p )
+	{
+		return boost::int16_t( ( p[ 0 ] << 8 ) | p[ 1 ] );
+	}
+
+	// Obtain an int property from the stream - returns false if the analyser didn't provide it
+	bool stream_int( const stream_type_ptr &stream, const pl::pcos::key &key, int &value )
+	{
+		pl::pcos::property prop = stream->properties( ).get_property_with_key( key );
+		if ( !prop.valid( ) || !prop.is_a< int >( ) )
+			return false;
+		value = prop.value< int >( );
+		return true;
+	}
+
+	// Size and modification time of the media - both -1 when it isn't a local file
+	void stamp( const std::string &media, boost::int64_t &size, boost::int64_t &modified )
+	{
+		boost::system::error_code error;
+		size = modified = -1;
+		if ( media == "" )
+			return;
+		size = boost::int64_t( boost::filesystem::file_size( media, error ) );
+		if ( !error )
+			modified = boost::int64_t( boost::filesystem::last_write_time( media, error ) );
+		if ( error )
+			size = modified = -1;
+	}
+}
+
+struct analyse_sidecar::mapping
+{
+	mapping( const std::string &path )
+		: file( path.c_str( ), ipc::read_only )
+		, region( file, ipc::read_only )
+	{ }
+
+	ipc::file_mapping file;
+	ipc::mapped_region region;
+};
+
+analyse_sidecar::analyse_sidecar( )
+	: records_( 0 )
+	, frames_( 0 )
+{
+}
+
+analyse_sidecar::~analyse_sidecar( )
+{
+}
+
+analyse_sidecar_ptr analyse_sidecar::open( const std::string &path, int frames, const std::string &media )
+{
+	analyse_sidecar_ptr result;
+
+	if ( path == "" || frames <= 0 || !boost::filesystem::exists( path ) )
+		return result;
+
+	boost::int64_t media_size, media_modified;
+	stamp( media, media_size, media_modified );
+
+	try
+	{
+		boost::scoped_ptr< mapping > map( new mapping( path ) );
+		const boost::uint8_t *data = static_cast< const boost::uint8_t * >( map->region.get_address( ) );
+		const size_t size = map->region.get_size( );
+
+		if ( size < analyse_sidecar_header_size || memcmp( data, "AWA2", 4 ) != 0 )
+		{
+			ARLOG_WARN( "Ignoring %1% - not an analysis sidecar" )( path );
+		}
+		else if ( get_int32( data + 8 ) != frames || get_int32( data + 12 ) != analyse_sidecar_record_size )
+		{
+			ARLOG_WARN( "Ignoring %1% - it describes %2% frames, the media has %3%" )( path )( get_int32( data + 8 ) )( frames );
+		}
+		else if ( get_int64( data + 16 ) != media_size || get_int64( data + 24 ) != media_modified )
+		{
+			ARLOG_WARN( "Ignoring %1% - the media has changed since it was written" )( path );
+		}
+		else if ( size < analyse_sidecar_header_size + size_t( frames ) * analyse_sidecar_record_size )
+		{
+			ARLOG_WARN( "Ignoring %1% - the file is truncated" )( path );
+		}
+		else
+		{
+			result.reset( new analyse_sidecar( ) );
+			result->records_ = data + analyse_sidecar_header_size;
+			result->frames_ = frames;
+			result->mapping_.swap( map );
+		}
+	}
+	catch( const std::exception &e )
+	{
+		ARLOG_WARN( "Unable to map the analysis sidecar %1%: %2%" )( path )( e.what( ) );
+		result.reset( );
+	}
+
+	return result;
+}
+
+std::string analyse_sidecar::media_for( const std::wstring &resource )
+{
+	std::wstring file = resource;
+
+	if ( file.find( L"avformat:" ) == 0 )
+		file = file.substr( 9 );
+	if ( file.find( L"file:" ) == 0 )
+		file = file.substr( 5 );
+
+	// Only local files can carry a sidecar
+	if ( file == L"" || file.find( L"://" ) != std::wstring::npos || file.find( L':' ) == 0 )
+		return "";
+
+	return cl::str_util::to_string( file );
+}
+
+std::string analyse_sidecar::path_for( const std::wstring &resource )
+{
+	const std::string file = media_for( resource );
+	return file == "" ? "" : file + ".awa";
+}
+
+bool analyse_sidecar::apply( int position, const stream_type_ptr &stream ) const
+{
+	if ( position < 0 || position >= frames_ || !stream )
+		return false;
+
+	const boost::uint8_t *record = records_ + size_t( position ) * analyse_sidecar_record_size;
+	const boost::uint8_t present = record[ 15 ];
+	const boost::uint8_t flags = record[ 16 ];
+
+	// The packets must be the ones which were analysed
+	if ( !( flags & flag_valid ) || get_int32( record ) != stream->key( ) || get_int32( record + 8 ) != int( stream->length( ) ) )
+		return false;
+
+	pl::pcos::property_container properties = stream->properties( );
+
+	if ( present & has_temporal_reference )
+		properties.append( pl::pcos::property( analyse_type::key_temporal_reference_ ) = int( get_int16( record + 12 ) ) );
+	if ( present & has_picture_coding_type )
+		properties.append( pl::pcos::property( analyse_type::key_picture_coding_type_ ) = int( record[ 14 ] ) );
+	if ( present & has_vbv_delay )
+		properties.append( pl::pcos::property( analyse_type::key_vbv_delay_ ) = int( get_int32( record + 4 ) ) );
+	if ( present & has_gop )
+	{
+		properties.append( pl::pcos::property( analyse_type::key_closed_gop_ ) = ( flags & flag_closed_gop ) ? 1 : 0 );
+		properties.append( pl::pcos::property( analyse_type::key_broken_link_ ) = ( flags & flag_broken_link ) ? 1 : 0 );
+	}
+	if ( present & has_top_field_first )
+		properties.append( pl::pcos::property( analyse_type::key_top_field_first_ ) = ( flags & flag_top_field_first ) ? 1 : 0 );
+	if ( present & has_progressive_frame )
+		properties.append( pl::pcos::property( analyse_type::key_progressive_frame_ ) = ( flags & flag_progressive_frame ) ? 1 : 0 );
+
+	properties.append( pl::pcos::property( analyse_type::key_analysed_ ) = 1 );
+
+	return true;
+}
+
+analyse_sidecar_writer::analyse_sidecar_writer( int frames, const std::string &media )
+	: frames_( std::max< int >( frames, 0 ) )
+	, recorded_( 0 )
+	, media_size_( -1 )
+	, media_modified_( -1 )
+	, records_( size_t( frames_ ) * analyse_sidecar_record_size, 0 )
+	, seen_( frames_, false )
+{
+	stamp( media, media_size_, media_modified_ );
+}
+
+void analyse_sidecar_writer::record( int position, const stream_type_ptr &stream )
+{
+	if ( position < 0 || position >= frames_ || !stream )
+		return;
+
+	boost::uint8_t *record = &records_[ size_t( position ) * analyse_sidecar_record_size ];
+	boost::uint8_t present = 0;
+	boost::uint8_t flags = flag_valid;
+	int value = 0;
+	int other = 0;
+
+	memset( record, 0, analyse_sidecar_record_size );
+	put_int32( record, stream->key( ) );
+	put_int32( record + 8, boost::int32_t( stream->length( ) ) );
+
+	if ( stream_int( stream, analyse_type::key_vbv_delay_, value ) )
+	{
+		put_int32( record + 4, value );
+		present |= has_vbv_delay;
+	}
+	if ( stream_int( stream, analyse_type::key_temporal_reference_, value ) )
+	{
+		put_int16( record + 12, boost::int16_t( value ) );
+		present |= has_temporal_reference;
+	}
+	if ( stream_int( stream, analyse_type::key_picture_coding_type_, value ) )
+	{
+		record[ 14 ] = boost::uint8_t( value );
+		present |= has_picture_coding_type;
+	}
+	if ( stream_int( stream, analyse_type::key_closed_gop_, value ) && stream_int( stream, analyse_type::key_broken_link_, other ) )
+	{
+		flags |= ( value ? flag_closed_gop : 0 ) | ( other ? flag_broken_link : 0 );
+		present |= has_gop;
+	}
+	if ( stream_int( stream, analyse_type::key_top_field_first_, value ) )
+	{
+		flags |= value ? flag_top_field_first : 0;
+		present |= has_top_field_first;
+	}
+	if ( stream_int( stream, analyse_type::key_progressive_frame_, value ) )
+	{
+		flags |= value ? flag_progressive_frame : 0;
+		present |= has_progressive_frame;
+	}
+
+	record[ 15 ] = present;
+	record[ 16 ] = flags;
+
+	if ( !seen_[ position ] )
+	{
+		seen_[ position ] = true;
+		recorded_ ++;
+	}
+}
+
+bool analyse_sidecar_writer::write( const std::string &path ) const
+{
+	if ( path == "" || !complete( ) )
+		return false;
+
+	boost::uint8_t header[ analyse_sidecar_header_size ];
+	memset( header, 0, sizeof( header ) );
+	memcpy( header, "AWA2", 4 );
+	put_int32( header + 4, boost::int32_t( time( 0 ) ) );
+	put_int32( header + 8, frames_ );
+	put_int32( header + 12, analyse_sidecar_record_size );
+	put_int64( header + 16, media_size_ );
+	put_int64( header + 24, media_modified_ );
+
+	// Concurrent processes may write the same sidecar, so each writes its own temporary file
+	boost::system::error_code error;
+	const std::string temp = path + "." + boost::filesystem::unique_path( "%%%%%%%%", error ).string( );
+	if ( error )
+		return false;
+
+	{
+		std::ofstream file( temp.c_str( ), std::ios::binary | std::ios::trunc );
+		file.write( reinterpret_cast< const char * >( header ), sizeof( header ) );
+		file.write( reinterpret_cast< const char * >( &records_[ 0 ] ), std::streamsize( records_.size( ) ) );
+		if ( !file.good( ) )
+		{
+			ARLOG_WARN( "Unable to write the analysis sidecar %1%" )( temp );
+			file.close( );
+			boost::system::error_code ignored;
+			boost::filesystem::remove( temp, ignored );
+			return false;
+		}
+	}
+
+	// Readers only ever see a complete file
+	boost::filesystem::rename( temp, path, error );
+	if ( error )
+	{
+		ARLOG_WARN( "Unable to rename %1% to %2%: %3%" )( temp )( path )( error.message( ) );
+		boost::system::error_code ignored;
+		boost::filesystem::remove( temp, ignored );
+		return false;
+	}
+
+	return true;
+}
+
+} } }
@@ -0,0 +1,113 @@
+// ml - A media library representation.
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#ifndef ML_ANALYSE_SIDECAR_
+#define ML_ANALYSE_SIDECAR_
+
+#include <openmedialib/ml/config.hpp>
+#include <openmedialib/ml/types.hpp>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+namespace olib { namespace openmedialib { namespace ml {
+
+/// The per frame results of the analyse_type analysers can be kept in a file
+/// next to the media (like the awi index), so that opening the media again
+/// doesn't require every packet to be parsed.
+///
+/// Layout (all values big endian, as in the awi files):
+///
+/// * header (32 bytes) - "AWA", version '2', created (int32), frames (int32),
+///   record size (int32), media size (int64) and media modification time
+///   (int64) - both -1 when the media isn't a local file
+/// * one record (20 bytes) per frame - key (int32), vbv_delay (int32),
+///   packet length (int32), temporal_reference (int16), picture_coding_type
+///   (uint8), present (uint8 - which of the fields the analyser provided),
+///   flags (uint8 - closed_gop, broken_link, top_field_first and
+///   progressive_frame) and 3 reserved bytes
+///
+/// The file is written in one go when every frame has been analysed, so its
+/// existence implies that it's complete. It's only used while the size and
+/// modification time of the media match those it was written from. Only per
+/// frame values are kept - sequence level values (dimensions, bit rate etc)
+/// are not restored.
+
+#define analyse_sidecar_header_size 32
+#define analyse_sidecar_record_size 20
+
+class analyse_sidecar;
+typedef boost::shared_ptr< analyse_sidecar > analyse_sidecar_ptr;
+
+/// A memory mapped sidecar file.
+
+class ML_DECLSPEC analyse_sidecar : public boost::noncopyable
+{
+	public:
+		/// Map the sidecar at path - returns an empty pointer when the file is
+		/// missing, malformed, doesn't describe the given number of frames or
+		/// was written from a different version of the media file
+		static analyse_sidecar_ptr open( const std::string &path, int frames, const std::string &media );
+
+		/// Local file of a media resource - empty for anything else
+		static std::string media_for( const std::wstring &resource );
+
+		/// Sidecar file name for a media resource (ie: /path/file.mxf.awa)
+		static std::string path_for( const std::wstring &resource );
+
+		~analyse_sidecar( );
+
+		int frames( ) const { return frames_; }
+
+		/// Attach the stored analysis to the stream and mark it as analysed -
+		/// returns false if position has no record
+		bool apply( int position, const stream_type_ptr &stream ) const;
+
+	private:
+		analyse_sidecar( );
+
+		struct mapping;
+		boost::scoped_ptr< mapping > mapping_;
+		const boost::uint8_t *records_;
+		int frames_;
+};
+
+/// Collects analysed streams and writes the sidecar once all frames are known.
+
+class ML_DECLSPEC analyse_sidecar_writer : public boost::noncopyable
+{
+	public:
+		/// The size and modification time of media are taken now, before
+		/// any of it is analysed
+		analyse_sidecar_writer( int frames, const std::string &media );
+
+		/// Store the analysis of the stream (which must have been analysed)
+		void record( int position, const stream_type_ptr &stream );
+
+		/// True when every frame has been recorded
+		bool complete( ) const { return frames_ > 0 && recorded_ == frames_; }
+
+		/// Write the sidecar (via a temporary file which is then renamed)
+		bool write( const std::string &path ) const;
+
+	private:
+		int frames_;
+		int recorded_;
+		boost::int64_t media_size_;
+		boost::int64_t media_modified_;
+		std::vector< boost::uint8_t > records_;
+		std::vector< bool > seen_;
+};
+
+typedef boost::shared_ptr< analyse_sidecar_writer > analyse_sidecar_writer_ptr;
+
+} } }
+
+#endif
@@ -0,0 +1,316 @@
+// ml::audio - pooled allocation of audio sample buffers
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#include <openmedialib/ml/audio_pool.hpp>
+
+#include <opencorelib/cl/spsc_queue.hpp>
+#include <opencorelib/cl/utilities.hpp>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace olib { namespace openmedialib { namespace ml { namespace audio {
+
+namespace cl = olib::opencorelib;
+
+namespace
+{
+	// Space in front of each buffer which holds the size class (keeps the 16 byte alignment)
+	const size_t header_size = 16;
+
+	// Size classes run from 256 bytes to 64MB with 4 classes per power of 2
+	const int smallest_power = 8;
+	const int class_count = ( 26 - smallest_power ) * 4 + 1;
+
+	// Marks a buffer which bypassed the pool
+	const int unpooled = -1;
+
+	// Bounds on what each thread holds on to
+	const size_t thread_blocks_per_class = 8;
+	const size_t thread_bytes = 32 * 1024 * 1024;
+
+	size_t class_size( int index )
+	{
+		const int power = smallest_power + index / 4;
+		const int quarter = index % 4;
+		return size_t( 4 + quarter ) << ( power - 2 );
+	}
+
+	int size_class( size_t size )
+	{
+		if ( size <= class_size( 0 ) )
+			return 0;
+
+		int power = 0;
+		for ( size_t value = size - 1; value > 1; value >>= 1 )
+			power ++;
+
+		const int quarter = int( ( size - 1 ) >> ( power - 2 ) ) - 3;
+		return ( power - smallest_power ) * 4 + quarter;
+	}
+
+	bool pool_enabled( )
+	{
+		static const bool enabled = getenv( "AML_AUDIO_POOL" ) == 0 || std::string( getenv( "AML_AUDIO_POOL" ) ) != "0";
+		return enabled;
+	}
+
+	// Only the owning thread updates a counter, but pool_stats reads them from any thread
+	inline void count( volatile boost::int64_t &counter )
+	{
+		cl::detail::store_release( counter, counter + 1 );
+	}
+
+	// The counters of a single thread
+	struct thread_stats
+	{
+		thread_stats( )
+			: requests( 0 )
+			, thread_hits( 0 )
+			, shared_hits( 0 )
+			, system_allocations( 0 )
+			, releases( 0 )
+			, system_frees( 0 )
+		{ }
+
+		void add_to( pool_stats_type &result ) const
+		{
+			result.requests += cl::detail::load_acquire( requests );
+			result.thread_hits += cl::detail::load_acquire( thread_hits );
+			result.shared_hits += cl::detail::load_acquire( shared_hits );
+			result.system_allocations += cl::detail::load_acquire( system_allocations );
+			result.releases += cl::detail::load_acquire( releases );
+			result.system_frees += cl::detail::load_acquire( system_frees );
+		}
+
+		volatile boost::int64_t requests;
+		volatile boost::int64_t thread_hits;
+		volatile boost::int64_t shared_hits;
+		volatile boost::int64_t system_allocations;
+		volatile boost::int64_t releases;
+		volatile boost::int64_t system_frees;
+	};
+
+	struct thread_cache;
+
+	// The free lists shared between all threads
+	struct shared_pool
+	{
+		shared_pool( )
+			: retained( 0 )
+			, retention( 64 * 1024 * 1024 )
+		{ }
+
+		boost::mutex mutex;
+		std::vector< unsigned char * > lists[ class_count ];
+		size_t retained;
+		size_t retention;
+		std::set< thread_cache * > caches;
+		pool_stats_type retired;
+
+		// Release the buffers which exceed the retention limit - mutex must be held
+		void shrink( pool_stats_type &stats )
+		{
+			for ( int index = class_count - 1; index >= 0 && retained > retention; index -- )
+			{
+				while ( !lists[ index ].empty( ) && retained > retention )
+				{
+					cl::utilities::aligned_free( lists[ index ].back( ) );
+					lists[ index ].pop_back( );
+					retained -= class_size( index );
+					stats.system_frees ++;
+				}
+			}
+		}
+	};
+
+	// Never destroyed - threads may still release buffers during static destruction
+	shared_pool &shared( )
+	{
+		static shared_pool *instance = new shared_pool( );
+		return *instance;
+	}
+
+	// The free lists and counters owned by a single thread
+	struct thread_cache
+	{
+		thread_cache( )
+			: bytes( 0 )
+		{
+			shared_pool &pool = shared( );
+			boost::mutex::scoped_lock lock( pool.mutex );
+			pool.caches.insert( this );
+		}
+
+		// Hand everything over to the shared pool when the thread exits
+		~thread_cache( )
+		{
+			shared_pool &pool = shared( );
+			boost::mutex::scoped_lock lock( pool.mutex );
+			for ( int index = 0; index < class_count; index ++ )
+			{
+				std::vector< unsigned char * > &list = lists[ index ];
+				pool.lists[ index ].insert( pool.lists[ index ].end( ), list.begin( ), list.end( ) );
+				pool.retained += list.size( ) * class_size( index );
+			}
+			pool.shrink( pool.retired );
+
+			stats.add_to( pool.retired );
+			pool.caches.erase( this );
+		}
+
+		std::vector< unsigned char * > lists[ class_count ];
+		size_t bytes;
+		thread_stats stats;
+	};
+
+	thread_cache &local( )
+	{
+		static boost::thread_specific_ptr< thread_cache > *caches = new boost::thread_specific_ptr< thread_cache >( );
+		thread_cache *cache = caches->get( );
+		if ( cache == 0 )
+		{
+			cache = new thread_cache( );
+			caches->reset( cache );
+		}
+		return *cache;
+	}
+
+	void *prepare( unsigned char *block, int index )
+	{
+		*reinterpret_cast< int * >( block ) = index;
+		return block + header_size;
+	}
+}
+
+ML_DECLSPEC void *pool_allocate( size_t size )
+{
+	if ( !pool_enabled( ) )
+		return cl::utilities::aligned_alloc( 16, size );
+
+	thread_cache &cache = local( );
+	count( cache.stats.requests );
+
+	int index = size_class( size );
+	size_t bytes = size;
+
+	if ( index < class_count )
+	{
+		bytes = class_size( index );
+
+		std::vector< unsigned char * > &list = cache.lists[ index ];
+		if ( !list.empty( ) )
+		{
+			unsigned char *block = list.back( );
+			list.pop_back( );
+			cache.bytes -= bytes;
+			count( cache.stats.thread_hits );
+			return prepare( block, index );
+		}
+
+		shared_pool &pool = shared( );
+		boost::mutex::scoped_lock lock( pool.mutex );
+		if ( !pool.lists[ index ].empty( ) )
+		{
+			unsigned char *block = pool.lists[ index ].back( );
+			pool.lists[ index ].pop_back( );
+			pool.retained -= bytes;
+			count( cache.stats.shared_hits );
+			return prepare( block, index );
+		}
+	}
+	else
+	{
+		index = unpooled;
+	}
+
+	unsigned char *block = static_cast< unsigned char * >( cl::utilities::aligned_alloc( 16, bytes + header_size ) );
+	if ( block == 0 )
+		return 0;
+
+	count( cache.stats.system_allocations );
+	return prepare( block, index );
+}
+
+ML_DECLSPEC void pool_release( void *buffer )
+{
+	if ( buffer == 0 )
+		return;
+
+	if ( !pool_enabled( ) )
+	{
+		cl::utilities::aligned_free( buffer );
+		return;
+	}
+
+	unsigned char *block = static_cast< unsigned char * >( buffer ) - header_size;
+	const int index = *reinterpret_cast< int * >( block );
+
+	thread_cache &cache = local( );
+	count( cache.stats.releases );
+
+	if ( index != unpooled )
+	{
+		const size_t bytes = class_size( index );
+
+		std::vector< unsigned char * > &list = cache.lists[ index ];
+		if ( list.size( ) < thread_blocks_per_class && cache.bytes + bytes <= thread_bytes )
+		{
+			list.push_back( block );
+			cache.bytes += bytes;
+			return;
+		}
+
+		shared_pool &pool = shared( );
+		boost::mutex::scoped_lock lock( pool.mutex );
+		if ( pool.retained + bytes <= pool.retention )
+		{
+			pool.lists[ index ].push_back( block );
+			pool.retained += bytes;
+			return;
+		}
+	}
+
+	cl::utilities::aligned_free( block );
+	count( cache.stats.system_frees );
+}
+
+ML_DECLSPEC pool_stats_type pool_stats( )
+{
+	shared_pool &pool = shared( );
+	boost::mutex::scoped_lock lock( pool.mutex );
+
+	pool_stats_type result = pool.retired;
+	for ( std::set< thread_cache * >::const_iterator i = pool.caches.begin( ); i != pool.caches.end( ); ++i )
+		( *i )->stats.add_to( result );
+	result.retained_bytes = boost::int64_t( pool.retained );
+
+	return result;
+}
+
+ML_DECLSPEC void pool_set_retention( size_t bytes )
+{
+	shared_pool &pool = shared( );
+	boost::mutex::scoped_lock lock( pool.mutex );
+	pool.retention = bytes;
+	pool.shrink( pool.retired );
+}
+
+ML_DECLSPEC void pool_trim( )
+{
+	shared_pool &pool = shared( );
+	boost::mutex::scoped_lock lock( pool.mutex );
+	const size_t retention = pool.retention;
+	pool.retention = 0;
+	pool.shrink( pool.retired );
+	pool.retention = retention;
+}
+
+} } } }
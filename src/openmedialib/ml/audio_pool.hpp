@@ -0,0 +1,81 @@
+// ml::audio - pooled allocation of audio sample buffers
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#ifndef AML_AUDIO_POOL_H_
+#define AML_AUDIO_POOL_H_
+
+#include <openmedialib/ml/config.hpp>
+#include <boost/cstdint.hpp>
+#include <cstddef>
+
+namespace olib { namespace openmedialib { namespace ml { namespace audio {
+
+// Audio buffers are short lived and come in a handful of sizes (one frame of
+// samples for each channel count and format in the graph), so they are
+// recycled rather than returned to the system.
+//
+// Requests are rounded up to a size class (4 classes per power of 2, so at
+// most 25% is wasted). Released buffers go to a free list for their class
+// on the releasing thread, which is bounded by count and bytes - the excess
+// moves to a shared free list (bounded by the retention limit) and anything
+// beyond that is freed. Allocations are served from the calling thread's
+// free list first, then the shared one and finally the system.
+//
+// Buffers are 16 byte aligned. Requests larger than the biggest size class
+// bypass the pool. Setting the AML_AUDIO_POOL environment variable to 0
+// disables pooling altogether (useful with memory checkers).
+
+struct pool_stats_type
+{
+	pool_stats_type( )
+		: requests( 0 )
+		, thread_hits( 0 )
+		, shared_hits( 0 )
+		, system_allocations( 0 )
+		, releases( 0 )
+		, system_frees( 0 )
+		, retained_bytes( 0 )
+	{ }
+
+	// Buffers requested from the pool
+	boost::int64_t requests;
+
+	// Requests served from the calling thread's free lists
+	boost::int64_t thread_hits;
+
+	// Requests served from the shared free lists
+	boost::int64_t shared_hits;
+
+	// Requests which required a new buffer from the system
+	boost::int64_t system_allocations;
+
+	// Buffers returned to the pool
+	boost::int64_t releases;
+
+	// Buffers returned to the system because the free lists were full
+	boost::int64_t system_frees;
+
+	// Bytes currently held on the shared free lists
+	boost::int64_t retained_bytes;
+};
+
+// Obtain a 16 byte aligned buffer of at least size bytes
+extern ML_DECLSPEC void *pool_allocate( size_t size );
+
+// Return a buffer obtained from pool_allocate
+extern ML_DECLSPEC void pool_release( void *buffer );
+
+// Snapshot of the counters aggregated over all threads
+extern ML_DECLSPEC pool_stats_type pool_stats( );
+
+// Maximum bytes held on the shared free lists (defaults to 64MB)
+extern ML_DECLSPEC void pool_set_retention( size_t bytes );
+
+// Return everything on the shared free lists to the system
+extern ML_DECLSPEC void pool_trim( );
+
+} } } }
+
+#endif
@@ -0,0 +1,322 @@
+// ml::audio - polyphase windowed sinc resampling
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#ifdef WIN32
+#define _USE_MATH_DEFINES
+#endif
+
+#include <openmedialib/ml/audio_resampler.hpp>
+#include <openmedialib/ml/audio.hpp>
+#include <openmedialib/ml/utilities.hpp>
+
+#include <opencorelib/cl/core.hpp>
+#include <opencorelib/cl/enforce_defines.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifndef M_PI
+#	define M_PI 3.14159265358979323846
+#endif
+
+#if defined( __SSE__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 1 )
+#define AML_RESAMPLER_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace olib { namespace openmedialib { namespace ml { namespace audio {
+
+namespace
+{
+	// Phases beyond this are interpolated rather than tabulated
+	const boost::int64_t max_phases = 256;
+
+	// Kaiser window shape - roughly 90dB of stop band attenuation
+	const double kaiser_beta = 9.0;
+
+	// Fraction of the lower Nyquist frequency which is passed
+	const double pass_band = 0.91;
+
+	// Zeroth order modified Bessel function of the first kind
+	double bessel_i0( double x )
+	{
+		double sum = 1.0;
+		double term = 1.0;
+		for ( int k = 1; k < 50; k ++ )
+		{
+			term *= ( x / ( 2.0 * k ) ) * ( x / ( 2.0 * k ) );
+			sum += term;
+			if ( term < sum * 1e-12 )
+				break;
+		}
+		return sum;
+	}
+
+	// Multiply and accumulate taps values - taps is always a multiple of 4
+	inline float dot( const float *samples, const float *coefficients, int taps, bool simd )
+	{
+#ifdef AML_RESAMPLER_SSE
+		if ( simd )
+		{
+			__m128 a = _mm_setzero_ps( );
+			__m128 b = _mm_setzero_ps( );
+			int i = 0;
+			for ( ; i + 8 <= taps; i += 8 )
+			{
+				a = _mm_add_ps( a, _mm_mul_ps( _mm_loadu_ps( samples + i ), _mm_loadu_ps( coefficients + i ) ) );
+				b = _mm_add_ps( b, _mm_mul_ps( _mm_loadu_ps( samples + i + 4 ), _mm_loadu_ps( coefficients + i + 4 ) ) );
+			}
+			if ( i < taps )
+				a = _mm_add_ps( a, _mm_mul_ps( _mm_loadu_ps( samples + i ), _mm_loadu_ps( coefficients + i ) ) );
+
+			a = _mm_add_ps( a, b );
+			a = _mm_add_ps( a, _mm_movehl_ps( a, a ) );
+			a = _mm_add_ss( a, _mm_shuffle_ps( a, a, 1 ) );
+			return _mm_cvtss_f32( a );
+		}
+#endif
+		float a = 0.0f, b = 0.0f, c = 0.0f, d = 0.0f;
+		for ( int i = 0; i < taps; i += 4 )
+		{
+			a += samples[ i ] * coefficients[ i ];
+			b += samples[ i + 1 ] * coefficients[ i + 1 ];
+			c += samples[ i + 2 ] * coefficients[ i + 2 ];
+			d += samples[ i + 3 ] * coefficients[ i + 3 ];
+		}
+		return ( a + b ) + ( c + d );
+	}
+}
+
+class resampler_impl : public resampler
+{
+	public:
+		resampler_impl( int in_frequency, int out_frequency, int channels, int taps )
+			: in_frequency_( in_frequency )
+			, out_frequency_( out_frequency )
+			, channels_( channels )
+			, up_( out_frequency )
+			, down_( in_frequency )
+			, reach_( 0 )
+			, taps_( 0 )
+			, phases_( 0 )
+			, first_( 0 )
+			, next_( 0 )
+			, buffers_( channels )
+		{
+			ARENFORCE_MSG( in_frequency > 0 && out_frequency > 0 && channels > 0 && taps > 0, "Invalid resampler configuration %1%hz to %2%hz, %3% channels, %4% taps" )
+				( in_frequency )( out_frequency )( channels )( taps );
+
+			remove_gcd( up_, down_ );
+
+			// When downsampling, the cut off moves down and the filter lengthens to keep the same transition
+			const double scale = std::min< double >( 1.0, double( up_ ) / double( down_ ) );
+			const double cutoff = 0.5 * scale * pass_band;
+
+			// The reach is even so that the taps are a multiple of 4 for the inner loop
+			reach_ = int( std::ceil( taps / ( 2.0 * scale ) ) );
+			reach_ += reach_ % 2;
+			taps_ = 2 * reach_;
+
+			phases_ = std::min< boost::int64_t >( up_, max_phases );
+
+			// Phase p is the filter for an output at fraction p / phases_ past an input sample - the
+			// extra phase (a whole sample) allows interpolation of the last one
+			const double i0_beta = bessel_i0( kaiser_beta );
+			coefficients_.resize( size_t( phases_ + 1 ) * taps_ );
+
+			for ( boost::int64_t p = 0; p <= phases_; p ++ )
+			{
+				float *phase = &coefficients_[ size_t( p ) * taps_ ];
+				const double fraction = double( p ) / double( phases_ );
+				double sum = 0.0;
+
+				for ( int k = 0; k < taps_; k ++ )
+				{
+					const double x = double( k - reach_ + 1 ) - fraction;
+					const double r = x / reach_;
+					const double window = r * r < 1.0 ? bessel_i0( kaiser_beta * std::sqrt( 1.0 - r * r ) ) / i0_beta : 0.0;
+					const double arg = 2.0 * cutoff * x;
+					const double sinc = std::fabs( arg ) < 1e-9 ? 1.0 : std::sin( M_PI * arg ) / ( M_PI * arg );
+					const double value = 2.0 * cutoff * sinc * window;
+					phase[ k ] = float( value );
+					sum += value;
+				}
+
+				// Unity gain at DC for every phase
+				for ( int k = 0; k < taps_; k ++ )
+					phase[ k ] = float( phase[ k ] / sum );
+			}
+
+			reset( 0 );
+		}
+
+		virtual int in_frequency( ) const { return in_frequency_; }
+		virtual int out_frequency( ) const { return out_frequency_; }
+		virtual int channels( ) const { return channels_; }
+		virtual int reach( ) const { return reach_; }
+
+		virtual boost::int64_t reset( boost::int64_t output_sample )
+		{
+			next_ = output_sample;
+			first_ = input_for( output_sample ) - reach_ + 1;
+
+			for ( int c = 0; c < channels_; c ++ )
+				buffers_[ c ].clear( );
+
+			// Silence before the start of the stream
+			if ( first_ < 0 )
+				push_silence( int( -first_ ) );
+
+			return end( );
+		}
+
+		virtual void push( const audio_type_ptr &audio, int offset )
+		{
+			if ( !audio || offset >= audio->samples( ) )
+				return;
+
+			ARENFORCE_MSG( audio->frequency( ) == in_frequency_ && audio->channels( ) == channels_, "Resampler expects %1%hz %2% channel audio, received %3%hz %4% channels" )
+				( in_frequency_ )( channels_ )( audio->frequency( ) )( audio->channels( ) );
+
+			offset = std::max< int >( offset, 0 );
+			const audio_type_ptr input = coerce( float_id, audio );
+			const float *src = static_cast< const float * >( input->pointer( ) ) + size_t( offset ) * channels_;
+			const int samples = input->samples( ) - offset;
+
+			for ( int c = 0; c < channels_; c ++ )
+			{
+				std::vector< float > &buffer = buffers_[ c ];
+				const size_t start = buffer.size( );
+				buffer.resize( start + samples );
+				for ( int i = 0; i < samples; i ++ )
+					buffer[ start + i ] = src[ size_t( i ) * channels_ + c ];
+			}
+		}
+
+		virtual void push_silence( int samples )
+		{
+			for ( int c = 0; c < channels_; c ++ )
+				buffers_[ c ].resize( buffers_[ c ].size( ) + std::max< int >( samples, 0 ), 0.0f );
+		}
+
+		virtual int available( ) const
+		{
+			// Output n needs the inputs up to input_for( n ) + reach_, so it's available while
+			// n * down_ < ( end - reach_ ) * up_
+			const boost::int64_t limit = end( ) - reach_;
+			if ( limit <= 0 )
+				return 0;
+			const boost::int64_t count = ( limit * up_ + down_ - 1 ) / down_ - next_;
+			return int( std::max< boost::int64_t >( count, 0 ) );
+		}
+
+		virtual boost::int64_t position( ) const
+		{
+			return next_;
+		}
+
+		virtual audio_type_ptr pull( identity id, int samples )
+		{
+			samples = std::max< int >( std::min< int >( samples, available( ) ), 0 );
+
+			floats_ptr output( new floats( out_frequency_, channels_, samples, false ) );
+			float *dst = output->data( );
+			const bool simd = simd_enabled( );
+
+			for ( int n = 0; n < samples; n ++, next_ ++ )
+			{
+				const boost::int64_t time = next_ * down_;
+				const boost::int64_t index = time / up_ - reach_ + 1 - first_;
+				const boost::int64_t remainder = time % up_;
+
+				if ( phases_ == up_ )
+				{
+					const float *phase = &coefficients_[ size_t( remainder ) * taps_ ];
+					for ( int c = 0; c < channels_; c ++ )
+						*dst ++ = dot( &buffers_[ c ][ size_t( index ) ], phase, taps_, simd );
+				}
+				else
+				{
+					// Interpolate between the neighbouring phases
+					const double position = double( remainder ) * phases_ / up_;
+					const boost::int64_t p = std::min< boost::int64_t >( boost::int64_t( position ), phases_ - 1 );
+					const float weight = float( position - p );
+					const float *lower = &coefficients_[ size_t( p ) * taps_ ];
+					const float *upper = lower + taps_;
+					for ( int c = 0; c < channels_; c ++ )
+					{
+						const float *src = &buffers_[ c ][ size_t( index ) ];
+						const float a = dot( src, lower, taps_, simd );
+						const float b = dot( src, upper, taps_, simd );
+						*dst ++ = a + weight * ( b - a );
+					}
+				}
+			}
+
+			// Drop the input which no later output depends on
+			const boost::int64_t keep = input_for( next_ ) - reach_ + 1;
+			if ( keep > first_ )
+			{
+				const size_t drop = size_t( std::min< boost::int64_t >( keep - first_, boost::int64_t( buffers_[ 0 ].size( ) ) ) );
+				for ( int c = 0; c < channels_; c ++ )
+					buffers_[ c ].erase( buffers_[ c ].begin( ), buffers_[ c ].begin( ) + drop );
+				first_ += drop;
+			}
+
+			return coerce( id, output );
+		}
+
+	private:
+		// The input sample at or before output sample n
+		boost::int64_t input_for( boost::int64_t n ) const
+		{
+			const boost::int64_t time = n * down_;
+			return time >= 0 ? time / up_ : -( ( -time + up_ - 1 ) / up_ );
+		}
+
+		// Index of the next input sample to be pushed
+		boost::int64_t end( ) const
+		{
+			return first_ + boost::int64_t( buffers_[ 0 ].size( ) );
+		}
+
+		int in_frequency_;
+		int out_frequency_;
+		int channels_;
+		boost::int64_t up_;
+		boost::int64_t down_;
+		int reach_;
+		int taps_;
+		boost::int64_t phases_;
+		std::vector< float > coefficients_;
+		boost::int64_t first_;
+		boost::int64_t next_;
+		std::vector< std::vector< float > > buffers_;
+};
+
+ML_DECLSPEC resampler_ptr create_resampler( int in_frequency, int out_frequency, int channels, int taps )
+{
+	return resampler_ptr( new resampler_impl( in_frequency, out_frequency, channels, taps ) );
+}
+
+ML_DECLSPEC audio_type_ptr resample( const audio_type_ptr &audio, int frequency, int taps )
+{
+	if ( !audio || frequency <= 0 || audio->frequency( ) == frequency )
+		return audio;
+
+	const int samples = int( ( boost::int64_t( audio->samples( ) ) * frequency + audio->frequency( ) / 2 ) / audio->frequency( ) );
+
+	resampler_ptr r = create_resampler( audio->frequency( ), frequency, audio->channels( ), taps );
+	r->push( audio );
+	while ( r->available( ) < samples )
+		r->push_silence( r->reach( ) + 1 );
+
+	audio_type_ptr result = r->pull( audio->id( ), samples );
+	result->set_position( audio->position( ) );
+	return result;
+}
+
+} } } }
@@ -0,0 +1,76 @@
+// ml::audio - polyphase windowed sinc resampling
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#ifndef AML_AUDIO_RESAMPLER_H_
+#define AML_AUDIO_RESAMPLER_H_
+
+#include <openmedialib/ml/types.hpp>
+#include <openmedialib/ml/audio_types.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace olib { namespace openmedialib { namespace ml { namespace audio {
+
+// Converts a stream of audio from one sample rate to another.
+//
+// The input is filtered by a Kaiser windowed sinc low pass filter which is
+// precomputed as a set of phases - one for each distinct fractional position
+// an output sample can have relative to the input (up to 256, beyond which
+// adjacent phases are interpolated). The cut off is just below the lower of
+// the two Nyquist frequencies.
+//
+// State is carried from one push to the next, so audio which is split into
+// frames is resampled as a continuous stream. Samples are processed as float
+// internally and any of the four sample types can be pushed or pulled.
+//
+// Output sample n lies at input sample n * in / out. It depends on the input
+// samples up to reach( ) either side, so it's only available once those have
+// been pushed - the end of a stream is flushed by pushing silence.
+
+class ML_DECLSPEC resampler
+{
+	public:
+		virtual ~resampler( ) { }
+
+		virtual int in_frequency( ) const = 0;
+		virtual int out_frequency( ) const = 0;
+		virtual int channels( ) const = 0;
+
+		// Number of input samples either side of an output sample's position which contribute to it
+		virtual int reach( ) const = 0;
+
+		// Restart the stream so that the next sample pulled is output sample output_sample - returns the
+		// input sample which must be pushed next (the stream is assumed to be silent before sample 0)
+		virtual boost::int64_t reset( boost::int64_t output_sample = 0 ) = 0;
+
+		// Append the audio (skipping offset samples) - frequency and channels must match the resampler
+		virtual void push( const audio_type_ptr &audio, int offset = 0 ) = 0;
+
+		// Append silence
+		virtual void push_silence( int samples ) = 0;
+
+		// Number of output samples which can be pulled
+		virtual int available( ) const = 0;
+
+		// Position of the next output sample
+		virtual boost::int64_t position( ) const = 0;
+
+		// Produce up to samples output samples of the requested type
+		virtual audio_type_ptr pull( identity id, int samples ) = 0;
+};
+
+typedef boost::shared_ptr< resampler > resampler_ptr;
+
+// Create a resampler - taps is the length of the filter at or above the input rate (it's
+// increased in proportion when downsampling), higher values give a sharper cut off
+extern ML_DECLSPEC resampler_ptr create_resampler( int in_frequency, int out_frequency, int channels, int taps = 32 );
+
+// Resample a complete audio object (the stream is assumed to be silent either side) - the
+// result has the same sample type and round( samples * frequency / in_frequency ) samples
+extern ML_DECLSPEC audio_type_ptr resample( const audio_type_ptr &audio, int frequency, int taps = 32 );
+
+} } } }
+
+#endif
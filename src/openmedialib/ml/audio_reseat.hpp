@@ -1,4 +1,3 @@
-
 // ml::audio - reseating capabailities for frame rate conversion
 
 // Copyright (C) 2009 Ardendo
@@ -8,39 +7,73 @@
 #define AML_AUDIO_RESEAT_H_
 
 #include <openmedialib/ml/types.hpp>
+#include <openmedialib/ml/utilities.hpp>
 #include <opencorelib/cl/core.hpp>
 #include <opencorelib/cl/enforce_defines.hpp>
+#include <boost/integer_traits.hpp>
 #include <string.h>
+#include <algorithm>
+#include <vector>
 
 namespace olib { namespace openmedialib { namespace ml { namespace audio {
 
+// The reseat is called for every frame by the frame rate, locked audio and
+// decode paths, so appended audio is converted once into a circular buffer of
+// samples in the type of the first audio appended after the reseat was empty.
+// A retrieve is then a single allocation and at most two copies out of the
+// ring (the result can't be a view since the ring is overwritten later).
+//
+// The ring only grows (to the next power of 2 above the samples held) and is
+// retained by clear, so once the reseat has seen its largest backlog, no
+// further memory is requested from the system. Packets aren't retained, so
+// the begin/end iterators always describe an empty sequence.
+
 class reseat_impl : public reseat
 {
 	public:
-		reseat_impl( ) 
+		reseat_impl( )
 			: queue( )
-			, offset( 0 )
+			, id_( pcm16_id )
+			, frequency_( 0 )
+			, channels_( 0 )
+			, stride_( 0 )
+			, capacity_( 0 )
+			, head_( 0 )
 			, samples( 0 )
-		{ 
+		{
 		}
 
-		virtual ~reseat_impl( ) 
-		{ 
+		virtual ~reseat_impl( )
+		{
 		}
 
 		virtual bool append( audio_type_ptr audio, boost::uint32_t sample_offset = 0 )
 		{
-			// TODO: ensure that all audio packets are consistent and reject if not
 			if ( audio )
 			{
-				ARENFORCE_MSG( !( sample_offset > 0 && queue.size() > 0 ), "Cannot push partial audio object into an audio_reseat if the queue is non-empty" )( sample_offset );
-
-				queue.push_back( audio );
-				if( sample_offset > 0 )
-				{
-					offset = sample_offset;
-				}
-				samples += ( audio->samples( ) - sample_offset ) ;
+				ARENFORCE_MSG( !( sample_offset > 0 && samples > 0 ), "Cannot push partial audio object into an audio_reseat if the queue is non-empty" )( sample_offset );
+
+				// The first audio after the reseat empties determines the type of the ring
+				if ( samples == 0 && ( audio->id( ) != id_ || audio->channels( ) != channels_ || audio->frequency( ) != frequency_ ) )
+					reformat( audio );
+
+				ARENFORCE_MSG( audio->channels( ) == channels_, "Cannot append %1% channel audio to an audio_reseat holding %2% channels" )( audio->channels( ) )( channels_ );
+
+				const int count = audio->samples( ) - int( sample_offset );
+				if ( count <= 0 )
+					return true;
+
+				reserve( samples + count );
+
+				const boost::uint8_t *src = static_cast< const boost::uint8_t * >( audio->pointer( ) ) + size_t( sample_offset ) * channels_ * audio->sample_storage_size( );
+				const int tail = ( head_ + samples ) & ( capacity_ - 1 );
+				const int first = std::min< int >( count, capacity_ - tail );
+
+				write( &buffer_[ size_t( tail ) * stride_ ], audio->id( ), src, first );
+				if ( first < count )
+					write( &buffer_[ 0 ], audio->id( ), src + size_t( first ) * channels_ * audio->sample_storage_size( ), count - first );
+
+				samples += count;
 			}
 
 			return true;
@@ -49,55 +82,34 @@ class reseat_impl : public reseat
 		virtual audio_type_ptr retrieve( int requested, bool pad )
 		{
 			audio_type_ptr result;
-			if ( ( pad && queue.size( ) ) || has( requested ) )
+			if ( ( pad && samples > 0 ) || has( requested ) )
 			{
-				int index = 0;
-				audio_type_ptr audio = queue[ 0 ];
-				int channels = audio->channels( );
-
-				audio_type_ptr temp = allocate( audio, -1, -1, requested );
-				void *dst = temp->pointer( );
-
-				result = temp;
-
-				while( index != requested && queue.size( ) > 0 )
-				{
-					audio = audio::coerce( temp->id( ), queue[ 0 ] );
-
-					int remainder = audio->samples( ) - offset;
-					int samples_from_packet = requested - index < remainder ? requested - index : remainder;
-
-					void *src = ( void * )( ( boost::uint8_t * )audio->pointer( ) + offset * channels * audio->sample_storage_size( ) );
-					memcpy( dst, src, samples_from_packet * channels * audio->sample_storage_size( ) );
-
-					if ( samples_from_packet == remainder )
-					{
-						samples -= samples_from_packet;
-						queue.pop_front( );
-						offset = 0;
-					}
-					else
-					{
-						offset += samples_from_packet;
-						samples -= samples_from_packet;
-					}
-
-					index += samples_from_packet;
-					dst = ( void * )( ( boost::uint8_t * )( dst ) + samples_from_packet * channels * audio->sample_storage_size( ) );
-				}
-				
-				// If index < requested we did not have enough samples in our queue so we should silence the last samples
-				if( index < requested )
-					memset( dst, 0, ( requested - index ) * channels * audio->sample_storage_size( ) );
-				
+				result = allocate( id_, frequency_, channels_, requested, false );
+				boost::uint8_t *dst = static_cast< boost::uint8_t * >( result->pointer( ) );
+
+				const int count = std::min< int >( requested, samples );
+				const int first = std::min< int >( count, capacity_ - head_ );
+
+				if ( first > 0 )
+					memcpy( dst, &buffer_[ size_t( head_ ) * stride_ ], size_t( first ) * stride_ );
+				if ( first < count )
+					memcpy( dst + size_t( first ) * stride_, &buffer_[ 0 ], size_t( count - first ) * stride_ );
+
+				// If count < requested we did not have enough samples in the ring so we should silence the last samples
+				if ( count < requested )
+					memset( dst + size_t( count ) * stride_, 0, size_t( requested - count ) * stride_ );
+
+				head_ = ( head_ + count ) & ( capacity_ - 1 );
+				samples -= count;
+				if ( samples == 0 )
+					head_ = 0;
 			}
 			return result;
 		}
 
 		virtual void clear( )
 		{
-			queue.clear( );
-			offset = 0;
+			head_ = 0;
 			samples = 0;
 		}
 
@@ -111,6 +123,12 @@ class reseat_impl : public reseat
 			return samples;
 		}
 
+		// Number of samples the ring can hold without growing
+		int capacity( ) const
+		{
+			return capacity_;
+		}
+
 		virtual iterator begin( )
 		{
 			return queue.begin( );
@@ -132,12 +150,114 @@ class reseat_impl : public reseat
 		}
 
 	private:
+		// Adopt the type and layout of the audio - the ring is empty, so the storage is simply reinterpreted
+		void reformat( const audio_type_ptr &audio )
+		{
+			id_ = audio->id( );
+			frequency_ = audio->frequency( );
+			channels_ = audio->channels( );
+			stride_ = channels_ * audio->sample_storage_size( );
+			capacity_ = 0;
+			head_ = 0;
+
+			// Keep the largest power of 2 which fits in the existing storage
+			if ( stride_ > 0 )
+				while ( size_t( capacity_ == 0 ? 1 : capacity_ * 2 ) * stride_ <= buffer_.size( ) )
+					capacity_ = capacity_ == 0 ? 1 : capacity_ * 2;
+		}
+
+		// Ensure the ring can hold required samples, moving the held samples to the start of the new storage
+		void reserve( int required )
+		{
+			if ( required <= capacity_ )
+				return;
+
+			int capacity = std::max< int >( capacity_, 1024 );
+			while ( capacity < required )
+				capacity *= 2;
+
+			std::vector< boost::uint8_t > buffer( size_t( capacity ) * stride_ );
+			const int first = std::min< int >( samples, capacity_ - head_ );
+			if ( first > 0 )
+				memcpy( &buffer[ 0 ], &buffer_[ size_t( head_ ) * stride_ ], size_t( first ) * stride_ );
+			if ( first < samples )
+				memcpy( &buffer[ size_t( first ) * stride_ ], &buffer_[ 0 ], size_t( samples - first ) * stride_ );
+
+			buffer_.swap( buffer );
+			capacity_ = capacity;
+			head_ = 0;
+		}
+
+		// Store count samples of type id at dst, converting to the type of the ring
+		void write( boost::uint8_t *dst, identity id, const boost::uint8_t *src, int count )
+		{
+			const size_t values = size_t( count ) * channels_;
+
+			if ( id == id_ || ( id != pcm16_id && id != float_id && id_ != pcm16_id && id_ != float_id ) )
+			{
+				// pcm24 is held in 32 bits like pcm32, so they're interchangeable
+				memcpy( dst, src, size_t( count ) * stride_ );
+			}
+			else if ( id == pcm16_id && id_ == float_id )
+				to_float( reinterpret_cast< float * >( dst ), reinterpret_cast< const boost::int16_t * >( src ), values );
+			else if ( id != float_id && id_ == float_id )
+				to_float( reinterpret_cast< float * >( dst ), reinterpret_cast< const boost::int32_t * >( src ), values );
+			else if ( id == float_id && id_ == pcm16_id )
+				from_float( reinterpret_cast< boost::int16_t * >( dst ), reinterpret_cast< const float * >( src ), values );
+			else if ( id == float_id )
+				from_float( reinterpret_cast< boost::int32_t * >( dst ), reinterpret_cast< const float * >( src ), values );
+			else if ( id == pcm16_id )
+			{
+				boost::int32_t *out = reinterpret_cast< boost::int32_t * >( dst );
+				const boost::int16_t *in = reinterpret_cast< const boost::int16_t * >( src );
+				for ( size_t i = 0; i < values; i ++ )
+					out[ i ] = boost::int32_t( in[ i ] ) << 16;
+			}
+			else
+			{
+				boost::int16_t *out = reinterpret_cast< boost::int16_t * >( dst );
+				const boost::int32_t *in = reinterpret_cast< const boost::int32_t * >( src );
+				for ( size_t i = 0; i < values; i ++ )
+					out[ i ] = boost::int16_t( in[ i ] >> 16 );
+			}
+		}
+
+		// As convert_dst_is_float
+		template < typename S >
+		static void to_float( float *dst, const S *src, size_t count )
+		{
+			const float scale = -float( boost::integer_traits< S >::const_min );
+			for ( size_t i = 0; i < count; i ++ )
+				dst[ i ] = float( src[ i ] ) / scale;
+		}
+
+		// As convert_src_is_float
+		template < typename D >
+		static void from_float( D *dst, const float *src, size_t count )
+		{
+			const float scale = -float( boost::integer_traits< D >::const_min );
+			for ( size_t i = 0; i < count; i ++ )
+			{
+				boost::int64_t value = boost::int64_t( src[ i ] * scale );
+				if ( value < boost::integer_traits< D >::const_min )
+					value = boost::integer_traits< D >::const_min;
+				if ( value > boost::integer_traits< D >::const_max )
+					value = boost::integer_traits< D >::const_max;
+				dst[ i ] = D( value );
+			}
+		}
+
 		bucket queue;
-		int offset;
+		identity id_;
+		int frequency_;
+		int channels_;
+		int stride_;
+		int capacity_;
+		int head_;
 		int samples;
+		std::vector< boost::uint8_t > buffer_;
 };
 
 } } } }
 
 #endif
-
@@ -8,6 +8,8 @@
 #define AML_AUDIO_TEMPLATE_H_
 
 #include <openmedialib/ml/types.hpp>
+#include <openmedialib/ml/statistics.hpp>
+#include <openmedialib/ml/audio_pool.hpp>
 #include <string.h>
 #include <string>
 
@@ -56,7 +58,7 @@ class ML_DECLSPEC template_ : public base
 
 		virtual ~template_( )
 		{
-			opencorelib::utilities::aligned_free( data_ );
+			pool_release( data_ );
 		}
 
 		static const sample_type min_sample( )
@@ -147,7 +149,8 @@ class ML_DECLSPEC template_ : public base
 			}
 			else
 			{
-				data_ = static_cast< sample_type * >( opencorelib::utilities::aligned_alloc( 16, data_size_ ) );
+				data_ = static_cast< sample_type * >( pool_allocate( data_size_ ) );
+				count_audio_allocation( data_size_ );
 
 				if( init_to_zero )
 					memset( data_, 0, data_size_ );
@@ -18,6 +18,14 @@
 #include <openmedialib/ml/audio_volume.hpp>
 #include <emmintrin.h>
 
+#if defined( _MSC_VER )
+#include <intrin.h>
+#elif defined( __GNUC__ ) && ( defined( __i386__ ) || defined( __x86_64__ ) )
+#include <cpuid.h>
+#endif
+
+#include <cstdlib>
+
 namespace olib { namespace openmedialib { namespace ml { namespace audio {
 
 // Look up table for ids
@@ -486,10 +494,65 @@ ML_DECLSPEC uint32_t bswap_32( const uint32_t src )
 	return ((src >> 24) & 0xff) | ((src >>  8) & 0xff00) | ((src <<  8) & 0xff0000) | ((src << 24) & 0xff000000);
 }
 
+namespace ssse3 {
+
+// Implemented in audio_utilities_ssse3.cpp - each returns the samples (or bytes) it handled
+uint32_t pack_aiff24_from_pcm32( uint8_t *dest, const uint8_t *src, const uint32_t count );
+uint32_t pack_pcm24_from_pcm32( uint8_t *dest, const uint8_t *src, const uint32_t count );
+uint32_t unpack_pcm24( uint32_t *dest, const uint8_t *src, const uint32_t count );
+int32_t byteswap16_inplace( uint8_t *data, int32_t num_bytes );
+
+}
+
+namespace {
+
+bool cpu_has_ssse3( )
+{
+#if defined( _MSC_VER )
+	int info[ 4 ];
+	__cpuid( info, 1 );
+	return ( info[ 2 ] & ( 1 << 9 ) ) != 0;
+#elif defined( __GNUC__ ) && ( defined( __i386__ ) || defined( __x86_64__ ) )
+	unsigned int eax, ebx, ecx, edx;
+	return __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) && ( ecx & bit_SSSE3 ) != 0;
+#else
+	return false;
+#endif
+}
+
+// The SSSE3 functions are used when the cpu supports them, unless AML_AUDIO_SIMD is set to 0
+bool &simd_state( )
+{
+	static bool state = cpu_has_ssse3( ) && ( getenv( "AML_AUDIO_SIMD" ) == 0 || std::string( getenv( "AML_AUDIO_SIMD" ) ) != "0" );
+	return state;
+}
+
+}
+
+ML_DECLSPEC bool simd_enabled( )
+{
+	return simd_state( );
+}
+
+ML_DECLSPEC bool set_simd_enabled( bool enabled )
+{
+	simd_state( ) = enabled && cpu_has_ssse3( );
+	return simd_state( );
+}
+
 // aiff is stored reversed. so reverse every 4-byte word, then copy first 3 bytes of the result onto the output.
 ML_DECLSPEC void pack_aiff24_from_pcm32( uint8_t *dest, const uint8_t *src, const uint32_t samples, const uint32_t channels )
 {
-	for( uint32_t i = 0; i < samples * channels; ++i, src += 4, dest += 3 )
+	uint32_t i = 0;
+
+	if ( simd_state( ) )
+	{
+		i = ssse3::pack_aiff24_from_pcm32( dest, src, samples * channels );
+		src += i * 4;
+		dest += i * 3;
+	}
+
+	for( ; i < samples * channels; ++i, src += 4, dest += 3 )
 	{
 		uint32_t unswapped = *reinterpret_cast< const uint32_t * >( src );
 		uint32_t swapped = bswap_32( unswapped );
@@ -500,8 +563,17 @@ ML_DECLSPEC void pack_aiff24_from_pcm32( uint8_t *dest, const uint8_t *src, cons
 // just copy the last 3 bytes of every 4 bytes onto the output buffer
 ML_DECLSPEC void pack_pcm24_from_pcm32( uint8_t *dest, const uint8_t *src, const uint32_t samples, const uint32_t channels )
 {
+	uint32_t i = 0;
+
+	if ( simd_state( ) )
+	{
+		i = ssse3::pack_pcm24_from_pcm32( dest, src, samples * channels );
+		src += i * 4;
+		dest += i * 3;
+	}
+
 	src++;	// instead of having to do a +1 for every memcpy, just start from an offsetted location and increase by 4 each time.
-	for( uint32_t i = 0; i < samples * channels; ++i, src += 4, dest += 3 )
+	for( ; i < samples * channels; ++i, src += 4, dest += 3 )
 	{
 		memcpy( dest, src, 3 );
 	}
@@ -509,7 +581,16 @@ ML_DECLSPEC void pack_pcm24_from_pcm32( uint8_t *dest, const uint8_t *src, const
 
 ML_DECLSPEC void unpack_pcm24( uint32_t *dest, const uint8_t *src, const uint32_t samples, const uint32_t channels )
 {
-	for( uint32_t i = 0; i < samples * channels; ++i )
+	uint32_t i = 0;
+
+	if ( simd_state( ) )
+	{
+		i = ssse3::unpack_pcm24( dest, src, samples * channels );
+		src += i * 3;
+		dest += i;
+	}
+
+	for( ; i < samples * channels; ++i )
 	{
 		*dest ++ = uint32_t( src[ 0 ] << 8 | src[ 1 ] << 16 | src[ 2 ] << 24 );
 		src += 3;
@@ -520,7 +601,12 @@ ML_DECLSPEC void unpack_pcm24( uint32_t *dest, const uint8_t *src, const uint32_
 // pcm to aiff16. byteswap16_inplace
 ML_DECLSPEC void byteswap16_inplace( uint8_t *data, int32_t num_bytes )
 {		
-	for( int i = 0; i < num_bytes; i += 16 )
+	int i = 0;
+
+	if ( simd_state( ) )
+		i = ssse3::byteswap16_inplace( data, num_bytes );
+
+	for( ; i < num_bytes; i += 16 )
 	{
 		__m128i s = _mm_load_si128(  reinterpret_cast< const __m128i * >( &data[ i ] ) );		// load data
 		s = _mm_or_si128( _mm_slli_epi16( s, 8 ), _mm_srli_epi16( s, 8 ) );						// shift left, shift right, OR
@@ -127,6 +127,15 @@ extern ML_DECLSPEC void unpack_pcm24( uint32_t *dest, const uint8_t *src, const
 // num_bytes should be the total number of bytes in the buffer (data). It should be divisible by 16.
 extern ML_DECLSPEC void byteswap16_inplace( uint8_t *data, int32_t num_bytes );
 
+// The packing, unpacking and byte swapping functions above use SSSE3 shuffles when
+// the cpu supports them (the output is identical to the plain versions). Setting
+// the AML_AUDIO_SIMD environment variable to 0 disables them.
+extern ML_DECLSPEC bool simd_enabled( );
+
+// Enable or disable the SSSE3 versions (mainly for tests and benchmarks) - returns
+// the resulting state, which is always false when the cpu doesn't support SSSE3
+extern ML_DECLSPEC bool set_simd_enabled( bool enabled );
+
 } } } }
 
 #endif
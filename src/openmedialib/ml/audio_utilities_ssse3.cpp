@@ -0,0 +1,111 @@
+// ml::audio - SSSE3 versions of the 24 bit packing and byte swapping functions
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+//
+// This file is compiled with SSSE3 enabled (-mssse3 on gcc) and the functions
+// here must only be called when the cpu supports it - audio_utilities.cpp
+// selects between these and the plain C versions at run time.
+//
+// Each function handles as many whole blocks as it can and returns the number
+// of samples (or bytes) it processed, leaving the remainder to the caller.
+//
+// Only minimal headers are included - inline functions from other headers could
+// otherwise be compiled with SSSE3 here and picked up by the linker for use in
+// code which runs on any cpu.
+
+#include <boost/cstdint.hpp>
+#include <tmmintrin.h>
+
+using boost::uint8_t;
+using boost::uint32_t;
+using boost::int32_t;
+
+namespace olib { namespace openmedialib { namespace ml { namespace audio { namespace ssse3 {
+
+// pcm32 to pcm24 - drop the low byte of each sample
+uint32_t pack_pcm24_from_pcm32( uint8_t *dest, const uint8_t *src, const uint32_t count )
+{
+	const __m128i mask = _mm_setr_epi8( 1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1 );
+	uint32_t i = 0;
+
+	// 16 samples in (64 bytes) to 48 bytes out
+	for ( ; i + 16 <= count; i += 16, src += 64, dest += 48 )
+	{
+		__m128i a = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i * >( src ) ), mask );
+		__m128i b = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i * >( src + 16 ) ), mask );
+		__m128i c = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i * >( src + 32 ) ), mask );
+		__m128i d = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i * >( src + 48 ) ), mask );
+
+		// Each shuffled register holds 12 bytes - stitch them into 3 full registers
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( dest ), _mm_or_si128( a, _mm_slli_si128( b, 12 ) ) );
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( dest + 16 ), _mm_or_si128( _mm_srli_si128( b, 4 ), _mm_slli_si128( c, 8 ) ) );
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( dest + 32 ), _mm_or_si128( _mm_srli_si128( c, 8 ), _mm_slli_si128( d, 4 ) ) );
+	}
+
+	return i;
+}
+
+// pcm32 to big endian aiff24 - drop the low byte and reverse the remaining 3
+uint32_t pack_aiff24_from_pcm32( uint8_t *dest, const uint8_t *src, const uint32_t count )
+{
+	const __m128i mask = _mm_setr_epi8( 3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, -1, -1, -1, -1 );
+	uint32_t i = 0;
+
+	for ( ; i + 16 <= count; i += 16, src += 64, dest += 48 )
+	{
+		__m128i a = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i * >( src ) ), mask );
+		__m128i b = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i * >( src + 16 ) ), mask );
+		__m128i c = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i * >( src + 32 ) ), mask );
+		__m128i d = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast< const __m128i * >( src + 48 ) ), mask );
+
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( dest ), _mm_or_si128( a, _mm_slli_si128( b, 12 ) ) );
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( dest + 16 ), _mm_or_si128( _mm_srli_si128( b, 4 ), _mm_slli_si128( c, 8 ) ) );
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( dest + 32 ), _mm_or_si128( _mm_srli_si128( c, 8 ), _mm_slli_si128( d, 4 ) ) );
+	}
+
+	return i;
+}
+
+// pcm24 to pcm32 - each sample moves to the top 3 bytes with a zero low byte
+uint32_t unpack_pcm24( uint32_t *dest, const uint8_t *src, const uint32_t count )
+{
+	const __m128i mask = _mm_setr_epi8( -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11 );
+	uint32_t i = 0;
+
+	// 48 bytes in to 16 samples out - the last load reads 4 bytes beyond the block,
+	// so stop while at least 2 more samples remain in the source
+	for ( ; i + 18 <= count; i += 16, src += 48, dest += 16 )
+	{
+		__m128i a = _mm_loadu_si128( reinterpret_cast< const __m128i * >( src ) );
+		__m128i b = _mm_loadu_si128( reinterpret_cast< const __m128i * >( src + 12 ) );
+		__m128i c = _mm_loadu_si128( reinterpret_cast< const __m128i * >( src + 24 ) );
+		__m128i d = _mm_loadu_si128( reinterpret_cast< const __m128i * >( src + 36 ) );
+
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( dest ), _mm_shuffle_epi8( a, mask ) );
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( dest + 4 ), _mm_shuffle_epi8( b, mask ) );
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( dest + 8 ), _mm_shuffle_epi8( c, mask ) );
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( dest + 12 ), _mm_shuffle_epi8( d, mask ) );
+	}
+
+	return i;
+}
+
+// Swap the bytes of each 16 bit word - data must be 16 byte aligned
+int32_t byteswap16_inplace( uint8_t *data, int32_t num_bytes )
+{
+	const __m128i mask = _mm_setr_epi8( 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 );
+	int32_t i = 0;
+
+	for ( ; i + 32 <= num_bytes; i += 32 )
+	{
+		__m128i a = _mm_load_si128( reinterpret_cast< const __m128i * >( &data[ i ] ) );
+		__m128i b = _mm_load_si128( reinterpret_cast< const __m128i * >( &data[ i + 16 ] ) );
+		_mm_store_si128( reinterpret_cast< __m128i * >( &data[ i ] ), _mm_shuffle_epi8( a, mask ) );
+		_mm_store_si128( reinterpret_cast< __m128i * >( &data[ i + 16 ] ), _mm_shuffle_epi8( b, mask ) );
+	}
+
+	return i;
+}
+
+} } } } }
@@ -63,8 +63,192 @@ namespace
 		*ptr ++ = boost::uint8_t( ( value >> 8 ) & 0xff );
 		*ptr ++ = boost::uint8_t( value & 0xff );
 	}
+
+	inline boost::uint16_t read16( const boost::uint8_t *ptr )
+	{
+		return boost::uint16_t( ( ptr[ 0 ] << 8 ) | ptr[ 1 ] );
+	}
+
+	inline boost::uint32_t read32( const boost::uint8_t *ptr )
+	{
+		return ( boost::uint32_t( ptr[ 0 ] ) << 24 ) | ( boost::uint32_t( ptr[ 1 ] ) << 16 ) | ( boost::uint32_t( ptr[ 2 ] ) << 8 ) | boost::uint32_t( ptr[ 3 ] );
+	}
+
+	inline boost::uint64_t read64( const boost::uint8_t *ptr )
+	{
+		return ( boost::uint64_t( read32( ptr ) ) << 32 ) | boost::uint64_t( read32( ptr + 4 ) );
+	}
+
+	// Records arrive in ascending order when an index is read or generated, so appending after the
+	// last key is done with a hinted insert - returns true if the key was not already present
+	template < typename K, typename V >
+	bool ordered_insert( std::map< K, V > &map, const K &key, const V &value, bool replace )
+	{
+		if ( map.empty( ) || map.rbegin( )->first < key )
+		{
+			map.insert( map.end( ), std::make_pair( key, value ) );
+			return true;
+		}
+
+		std::pair< typename std::map< K, V >::iterator, bool > result = map.insert( std::make_pair( key, value ) );
+		if ( !result.second && replace )
+			result.first->second = value;
+		return result.second;
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+// The buffer provides the parsers with a read cursor over the data passed to
+// them - bytes are only copied when a record spans two parse calls.
+
+awi_buffer::awi_buffer( )
+	: pending_( )
+	, ptr_( 0 )
+	, end_( 0 )
+	, owned_( false )
+{
+}
+
+// Make the data available for reading - if a partial record is pending, the
+// data is appended to it, otherwise it's read in place
+
+void awi_buffer::attach( const boost::uint8_t *data, size_t length )
+{
+	owned_ = !pending_.empty( );
+
+	if ( owned_ )
+	{
+		const size_t current = pending_.size( );
+		pending_.resize( current + length );
+		if ( length )
+			memcpy( &pending_[ current ], data, length );
+		ptr_ = &pending_[ 0 ];
+		end_ = ptr_ + pending_.size( );
+	}
+	else
+	{
+		ptr_ = data;
+		end_ = data + length;
+	}
+}
+
+// Keep the unread bytes for the next attach
+
+void awi_buffer::retain( )
+{
+	if ( ptr_ == end_ )
+		pending_.clear( );
+	else if ( owned_ )
+		pending_.erase( pending_.begin( ), pending_.begin( ) + ( ptr_ - &pending_[ 0 ] ) );
+	else
+		pending_.assign( ptr_, end_ );
+
+	ptr_ = end_ = 0;
+	owned_ = false;
 }
 
+void awi_buffer::skip( size_t bytes )
+{
+	ptr_ += std::min( bytes, available( ) );
+}
+
+// Read a fixed length character array
+
+bool awi_buffer::read( char *data, size_t length )
+{
+	bool result = available( ) >= length;
+	if ( result )
+	{
+		memcpy( data, ptr_, length );
+		ptr_ += length;
+	}
+	return result;
+}
+
+bool awi_buffer::read( boost::uint8_t &value )
+{
+	bool result = available( ) >= 1;
+	if ( result )
+		value = *ptr_ ++;
+	return result;
+}
+
+bool awi_buffer::read( boost::int16_t &value )
+{
+	bool result = available( ) >= 2;
+	if ( result )
+	{
+		value = boost::int16_t( read16( ptr_ ) );
+		ptr_ += 2;
+	}
+	return result;
+}
+
+bool awi_buffer::read( boost::uint16_t &value )
+{
+	bool result = available( ) >= 2;
+	if ( result )
+	{
+		value = read16( ptr_ );
+		ptr_ += 2;
+	}
+	return result;
+}
+
+bool awi_buffer::read( boost::int32_t &value )
+{
+	bool result = available( ) >= 4;
+	if ( result )
+	{
+		value = boost::int32_t( read32( ptr_ ) );
+		ptr_ += 4;
+	}
+	return result;
+}
+
+bool awi_buffer::read( boost::uint32_t &value )
+{
+	bool result = available( ) >= 4;
+	if ( result )
+	{
+		value = read32( ptr_ );
+		ptr_ += 4;
+	}
+	return result;
+}
+
+bool awi_buffer::read( boost::int64_t &value )
+{
+	bool result = available( ) >= 8;
+	if ( result )
+	{
+		value = boost::int64_t( read64( ptr_ ) );
+		ptr_ += 8;
+	}
+	return result;
+}
+
+// Read a 16 bit int and leave it in place
+
+bool awi_buffer::peek( boost::int16_t &value ) const
+{
+	bool result = available( ) >= 2;
+	if ( result )
+		value = boost::int16_t( read16( ptr_ ) );
+	return result;
+}
+
+bool awi_buffer::peek( boost::uint16_t &value ) const
+{
+	bool result = available( ) >= 2;
+	if ( result )
+		value = read16( ptr_ );
+	return result;
+}
+
+// ----------------------------------------------------------------------------
+
 // AWI Index holder - provides a means to register awi header, items and footer
 // records and subsequently query the index to allow quick determination of 
 // I frames and GOPs.
@@ -96,11 +280,9 @@ void awi_index_v2::set( const awi_item &value )
 	boost::recursive_mutex::scoped_lock lock( mutex_ );
 	if ( value.length != 0 )
 	{
-		if ( items_.find( value.frame ) == items_.end( ) )
+		if ( ordered_insert( items_, value.frame, value, true ) )
 			frames_ += value.frames;
-		items_[ value.frame ] = value;
-		if ( offsets_.find( value.offset ) == offsets_.end( ) )
-			offsets_[ value.offset ] = value;
+		ordered_insert( offsets_, value.offset, value, false );
 	}
 }
 
@@ -304,18 +486,19 @@ awi_parser_v2::~awi_parser_v2( )
 
 bool awi_parser_v2::parse( const boost::uint8_t *data, const size_t length )
 {
-	bool result = state_ == awi_state::header || state_ == awi_state::item;
+	const bool active = state_ == awi_state::header || state_ == awi_state::item;
+	bool result = active;
 
-	// Append data to internal buffer
-	if ( result )
-		append( data, length );
+	// Read the data in place (after any incomplete record from the previous call)
+	if ( active )
+		buffer_.attach( data, length );
 
 	while( result )
 	{
 		switch( state_ )
 		{
 			case awi_state::header:
-				if ( buffer_.size( ) >= awi_header_size )
+				if ( buffer_.available( ) >= awi_header_size )
 				{
 					result = parse_header( );
 					state_ = result ? awi_state::item : awi_state::error;
@@ -327,12 +510,12 @@ bool awi_parser_v2::parse( const boost::uint8_t *data, const size_t length )
 				break;
 
 			case awi_state::item:
-				if ( buffer_.size( ) >= awi_item_size && is_item( ) )
+				if ( buffer_.available( ) >= awi_item_size && is_item( ) )
 				{
 					result = parse_item( );
 					state_ = result ? awi_state::item : awi_state::error;
 				}
-				else if ( buffer_.size( ) == awi_footer_size && !is_item( ) )
+				else if ( buffer_.available( ) == awi_footer_size && !is_item( ) )
 				{
 					result = parse_footer( );
 					state_ = result ? awi_state::footer : awi_state::error;
@@ -351,26 +534,21 @@ bool awi_parser_v2::parse( const boost::uint8_t *data, const size_t length )
 		}
 	}
 
-	return result;
-}
-
-// Append passed data into an internal buffer.
+	// Keep any incomplete record for the next call
+	if ( active )
+		buffer_.retain( );
 
-void awi_parser_v2::append( const boost::uint8_t *data, const size_t length )
-{
-	size_t current = buffer_.size( );
-	buffer_.resize( current + length );
-	memcpy( &buffer_[ current ], data, length );
+	return result;
 }
 
-// Attempt to read a header and remove it from the internal buffer
+// Attempt to read a header from the buffer
 
 bool awi_parser_v2::parse_header( )
 {
 	bool result = false;
 
 	awi_header header;
-	result = read( header.id, 3 ) && read( header.ver, 1 ) && read( header.created );
+	result = buffer_.read( header.id, 3 ) && buffer_.read( header.ver, 1 ) && buffer_.read( header.created );
 	result &= !memcmp( header.id, "AWI", 3 ) && !memcmp( header.ver, "2", 1 );
 
 	if ( result )
@@ -384,18 +562,18 @@ bool awi_parser_v2::parse_header( )
 bool awi_parser_v2::is_item( )
 {
 	awi_item item;
-	return peek( item.reserved ) && item.reserved == 0;
+	return buffer_.peek( item.reserved ) && item.reserved == 0;
 }
 
-// Attempt to parse an item and remove it from the internal buffer
+// Attempt to parse an item from the buffer
 
 bool awi_parser_v2::parse_item( )
 {
 	awi_item item;
-	bool result = peek( item.reserved );
+	bool result = buffer_.peek( item.reserved );
 
 	if ( result && item.reserved == 0 )
-		result = read( item.reserved ) && read( item.frames ) && read( item.frame ) && read( item.offset ) && read( item.length );
+		result = buffer_.read( item.reserved ) && buffer_.read( item.frames ) && buffer_.read( item.frame ) && buffer_.read( item.offset ) && buffer_.read( item.length );
 
 	if ( result )
 		set( item );
@@ -403,14 +581,14 @@ bool awi_parser_v2::parse_item( )
 	return result;
 }
 
-// Attempt to parse a footer and remove it from the internal buffer
+// Attempt to parse a footer from the buffer
 
 bool awi_parser_v2::parse_footer( )
 {
 	bool result = false;
 
 	awi_footer footer;
-	result = read( footer.reserved ) && read( footer.closed ) && read( footer.id, 3 ) && read( footer.ver, 1 );
+	result = buffer_.read( footer.reserved ) && buffer_.read( footer.closed ) && buffer_.read( footer.id, 3 ) && buffer_.read( footer.ver, 1 );
 	result &= !memcmp( footer.id, "AWI", 3 ) && !memcmp( footer.ver, "2", 1 );
 
 	if ( result )
@@ -419,75 +597,6 @@ bool awi_parser_v2::parse_footer( )
 	return result;
 }
 
-// Read a fixed length character array from the internal buffer and remove it
-
-bool awi_parser_v2::read( char *data, size_t length )
-{
-	bool result = buffer_.size( ) >= length;
-	if ( result )
-	{
-		memcpy( data, &buffer_[ 0 ], length );
-		buffer_.erase( buffer_.begin( ), buffer_.begin( ) + length );
-	}
-	return result;
-}
-
-// Read a 16 bit int from the internal buffer and remove it
-
-bool awi_parser_v2::read( boost::int16_t &value )
-{
-	bool result = buffer_.size( ) >= 2;
-	if ( result )
-	{
-		value = ( buffer_[ 0 ] << 8 ) | buffer_[ 1 ];
-		buffer_.erase( buffer_.begin( ), buffer_.begin( ) + 2 );
-	}
-	return result;
-}
-
-// Read a 32 bit int from the internal buffer and remove it
-
-bool awi_parser_v2::read( boost::int32_t &value )
-{
-	bool result = buffer_.size( ) >= 4;
-	if ( result )
-	{
-		value = ( buffer_[ 0 ] << 24 ) | ( buffer_[ 1 ] << 16 ) | ( buffer_[ 2 ] << 8 ) | buffer_[ 3 ];
-		buffer_.erase( buffer_.begin( ), buffer_.begin( ) + 4 );
-	}
-	return result;
-}
-
-// Read a 64 bit int from the internal buffer and remove it
-
-bool awi_parser_v2::read( boost::int64_t &value )
-{
-	bool result = buffer_.size( ) >= 8;
-	if ( result )
-	{
-		value = boost::int64_t( buffer_[ 0 ] ) << 56LL;
-		value |= boost::int64_t( buffer_[ 1 ] ) << 48LL;
-		value |= boost::int64_t( buffer_[ 2 ] ) << 40LL;
-		value |= boost::int64_t( buffer_[ 3 ] ) << 32LL;
-		value |= boost::int64_t( buffer_[ 4 ] ) << 24LL;
-		value |= boost::int64_t( buffer_[ 5 ] ) << 16LL;
-		value |= boost::int64_t( buffer_[ 6 ] ) << 8LL;
-		value |= boost::int64_t( buffer_[ 7 ] );
-		buffer_.erase( buffer_.begin( ), buffer_.begin( ) + 8 );
-	}
-	return result;
-}
-
-// Reads a 16 bit int from the buffer and leaves it in place
-
-bool awi_parser_v2::peek( boost::int16_t &value )
-{
-	bool result = buffer_.size( ) >= 2;
-	if ( result )
-		value = ( buffer_[ 0 ] << 8 ) | buffer_[ 1 ];
-	return result;
-}
-
 // ----------------------------------------------------------------------------
 
 // The generator class provides a means to build an index (either during 
@@ -683,11 +792,9 @@ void awi_index_v3::set( const awi_item_v3 &value )
 	boost::recursive_mutex::scoped_lock lock( mutex_ );
 	if ( value.length != 0 )
 	{
-		if ( items_.find( value.frame ) == items_.end( ) )
+		if ( ordered_insert( items_, value.frame, value, true ) )
 			frames_ += value.frames;
-		items_[ value.frame ] = value;
-		if ( offsets_.find( value.offset ) == offsets_.end( ) )
-			offsets_[ value.offset ] = value;
+		ordered_insert( offsets_, value.offset, value, false );
 	}
 }
 
@@ -973,11 +1080,12 @@ awi_parser_v3::~awi_parser_v3( )
 
 bool awi_parser_v3::parse( const boost::uint8_t *data, const size_t length )
 {
-	bool result = state_ == awi_state::header || state_ == awi_state::item;
+	const bool active = state_ == awi_state::header || state_ == awi_state::item;
+	bool result = active;
 
-	// Append data to internal buffer
-	if ( result )
-		append( data, length );
+	// Read the data in place (after any incomplete record from the previous call)
+	if ( active )
+		buffer_.attach( data, length );
 
 	// We need to ensure that we have the minimum length of the smallest record
 	while( result )
@@ -986,7 +1094,7 @@ bool awi_parser_v3::parse( const boost::uint8_t *data, const size_t length )
 		{
 			case awi_state::header:
 				// Make sure that we have enough data for the header
-				if ( buffer_.size( ) >= awi_header_size_v3 )
+				if ( buffer_.available( ) >= awi_header_size_v3 )
 				{
 					result = parse_header( );
 					state_ = result ? awi_state::item : awi_state::error;
@@ -999,12 +1107,12 @@ bool awi_parser_v3::parse( const boost::uint8_t *data, const size_t length )
 				break;
 
 			case awi_state::item:
-				if ( buffer_.size( ) >= awi_item_size_v3 && is_item( ) )
+				if ( buffer_.available( ) >= awi_item_size_v3 && is_item( ) )
 				{
 					result = parse_item( );
 					state_ = result ? awi_state::item : awi_state::error;
 				}
-				else if ( buffer_.size( ) == awi_footer_size_v3 && !is_item( ) )
+				else if ( buffer_.available( ) == awi_footer_size_v3 && !is_item( ) )
 				{
 					result = parse_footer( );
 					state_ = result ? awi_state::footer : awi_state::error;
@@ -1023,53 +1131,48 @@ bool awi_parser_v3::parse( const boost::uint8_t *data, const size_t length )
 		}
 	}
 
-	return result;
-}
+	// Keep any incomplete record for the next call
+	if ( active )
+		buffer_.retain( );
 
-// Append passed data into an internal buffer.
-
-void awi_parser_v3::append( const boost::uint8_t *data, const size_t length )
-{
-	size_t current = buffer_.size( );
-	buffer_.resize( current + length );
-	memcpy( &buffer_[ current ], data, length );
+	return result;
 }
 
-// Attempt to read a header and remove it from the internal buffer
+// Attempt to read a header from the buffer
 
 bool awi_parser_v3::parse_header( )
 {
 	bool result = false;
 
 	awi_header_v3 header;
-	result = read( header.id, 3 ) && read( header.ver, 1 ) && read( header.created );
+	result = buffer_.read( header.id, 3 ) && buffer_.read( header.ver, 1 ) && buffer_.read( header.created );
 	result &= !memcmp( header.id, "AWI", 3 ) && !memcmp( header.ver, "3", 1 );
 
 	if ( result )
 	{
-		result = read( header.wrapper, 4 ) && 
-			read( header.video_type ) &&
-			read( header.video_progressive ) &&
-			read( header.video_flags ) &&
-			read( header.video_fps_num ) &&
-			read( header.video_fps_den ) &&
-			read( header.video_bitrate ) &&
-			read( header.video_width ) &&
-			read( header.video_height ) &&
-			read( header.video_chroma ) &&
-			read( header.video_gop ) &&
-			read( header.video_rpp ) &&
-			read( header.video_ar_num ) &&
-			read( header.video_ar_den ) &&
-			read( header.video_sar_num ) &&
-			read( header.video_sar_den ) &&
-			read( header.reserved1, 6 ) &&
-			read( header.audio_type ) &&
-			read( header.audio_channels ) &&
-			read( header.audio_bits ) &&
-			read( header.audio_store_bits ) &&
-			read( header.audio_frequency ) &&
-			read( header.reserved2, 4 );
+		result = buffer_.read( header.wrapper, 4 ) && 
+			buffer_.read( header.video_type ) &&
+			buffer_.read( header.video_progressive ) &&
+			buffer_.read( header.video_flags ) &&
+			buffer_.read( header.video_fps_num ) &&
+			buffer_.read( header.video_fps_den ) &&
+			buffer_.read( header.video_bitrate ) &&
+			buffer_.read( header.video_width ) &&
+			buffer_.read( header.video_height ) &&
+			buffer_.read( header.video_chroma ) &&
+			buffer_.read( header.video_gop ) &&
+			buffer_.read( header.video_rpp ) &&
+			buffer_.read( header.video_ar_num ) &&
+			buffer_.read( header.video_ar_den ) &&
+			buffer_.read( header.video_sar_num ) &&
+			buffer_.read( header.video_sar_den ) &&
+			buffer_.read( header.reserved1, 6 ) &&
+			buffer_.read( header.audio_type ) &&
+			buffer_.read( header.audio_channels ) &&
+			buffer_.read( header.audio_bits ) &&
+			buffer_.read( header.audio_store_bits ) &&
+			buffer_.read( header.audio_frequency ) &&
+			buffer_.read( header.reserved2, 4 );
 		
 		if ( result )
 			set( header );
@@ -1083,18 +1186,18 @@ bool awi_parser_v3::parse_header( )
 bool awi_parser_v3::is_item( )
 {
 	awi_item_v3 item;
-	return peek( item.type ) && ( ( item.type & 0xfffc ) == 0);
+	return buffer_.peek( item.type ) && ( ( item.type & 0xfffc ) == 0);
 }
 
-// Attempt to parse an item and remove it from the internal buffer
+// Attempt to parse an item from the buffer
 
 bool awi_parser_v3::parse_item( )
 {
 	awi_item_v3 item;
-	bool result = peek( item.type );
+	bool result = buffer_.peek( item.type );
 
 	if ( result && ( ( item.type & 0xfffc ) == 0) )
-		result = read( item.type ) && read( item.frames ) && read( item.frame ) && read( item.offset ) && read( item.length );
+		result = buffer_.read( item.type ) && buffer_.read( item.frames ) && buffer_.read( item.frame ) && buffer_.read( item.offset ) && buffer_.read( item.length );
 
 	if ( result )
 		set( item );
@@ -1102,14 +1205,14 @@ bool awi_parser_v3::parse_item( )
 	return result;
 }
 
-// Attempt to parse a footer and remove it from the internal buffer
+// Attempt to parse a footer from the buffer
 
 bool awi_parser_v3::parse_footer( )
 {
 	bool result = false;
 
 	awi_footer_v3 footer;
-	result = read( footer.type ) && read( footer.reserved1, 6 ) && read( footer.closed ) && read( footer.max_gop ) && read( footer.footer_flags ) && read( footer.id, 3 ) && read( footer.ver, 1 );
+	result = buffer_.read( footer.type ) && buffer_.read( footer.reserved1, 6 ) && buffer_.read( footer.closed ) && buffer_.read( footer.max_gop ) && buffer_.read( footer.footer_flags ) && buffer_.read( footer.id, 3 ) && buffer_.read( footer.ver, 1 );
 	result &= !memcmp( footer.id, "AWI", 3 ) && !memcmp( footer.ver, "3", 1 );
 
 	if ( result )
@@ -1118,108 +1221,6 @@ bool awi_parser_v3::parse_footer( )
 	return result;
 }
 
-// Read a fixed length character array from the internal buffer and remove it
-
-bool awi_parser_v3::read( char *data, size_t length )
-{
-	bool result = buffer_.size( ) >= length;
-	if ( result )
-	{
-		memcpy( data, &buffer_[ 0 ], length );
-		buffer_.erase( buffer_.begin( ), buffer_.begin( ) + length );
-	}
-	return result;
-}
-	
-bool awi_parser_v3::read( boost::uint8_t &value )
-{
-	char ret;
-	if ( read( &ret, 1 ) )
-	{
-		value = static_cast<boost::uint8_t> ( ret );
-		return true;
-	}
-	return false;
-}
-
-// Read a 16 bit int from the internal buffer and remove it
-
-bool awi_parser_v3::read( boost::int16_t &value )
-{
-	bool result = buffer_.size( ) >= 2;
-	if ( result )
-	{
-		value = ( buffer_[ 0 ] << 8 ) | buffer_[ 1 ];
-		buffer_.erase( buffer_.begin( ), buffer_.begin( ) + 2 );
-	}
-	return result;
-}
-
-bool awi_parser_v3::read( boost::uint16_t &value )
-{
-	boost::int16_t ret;
-	if ( read( ret ) )
-	{
-		value = static_cast<boost::uint16_t> ( ret );
-		return true;
-	}
-	return false;
-}
-	
-// Read a 32 bit int from the internal buffer and remove it
-
-bool awi_parser_v3::read( boost::int32_t &value )
-{
-	bool result = buffer_.size( ) >= 4;
-	if ( result )
-	{
-		value = ( buffer_[ 0 ] << 24 ) | ( buffer_[ 1 ] << 16 ) | ( buffer_[ 2 ] << 8 ) | buffer_[ 3 ];
-		buffer_.erase( buffer_.begin( ), buffer_.begin( ) + 4 );
-	}
-	return result;
-}
-
-bool awi_parser_v3::read( boost::uint32_t &value )
-{
-	boost::int32_t ret;
-	if ( read( ret ) )
-	{
-		value = static_cast<boost::uint32_t> ( ret );
-		return true;
-	}
-	return false;
-}
-	
-// Read a 64 bit int from the internal buffer and remove it
-
-bool awi_parser_v3::read( boost::int64_t &value )
-{
-	bool result = buffer_.size( ) >= 8;
-	if ( result )
-	{
-		value = boost::int64_t( buffer_[ 0 ] ) << 56LL;
-		value |= boost::int64_t( buffer_[ 1 ] ) << 48LL;
-		value |= boost::int64_t( buffer_[ 2 ] ) << 40LL;
-		value |= boost::int64_t( buffer_[ 3 ] ) << 32LL;
-		value |= boost::int64_t( buffer_[ 4 ] ) << 24LL;
-		value |= boost::int64_t( buffer_[ 5 ] ) << 16LL;
-		value |= boost::int64_t( buffer_[ 6 ] ) << 8LL;
-		value |= boost::int64_t( buffer_[ 7 ] );
-		buffer_.erase( buffer_.begin( ), buffer_.begin( ) + 8 );
-	}
-	return result;
-}
-
-// Reads a 16 bit int from the buffer and leaves it in place
-
-bool awi_parser_v3::peek( boost::int16_t &value )
-{
-	bool result = buffer_.size( ) >= 2;
-	if ( result )
-		value = ( buffer_[ 0 ] << 8 ) | buffer_[ 1 ];
-	return result;
-}
-
 // ----------------------------------------------------------------------------
 
 // The generator class provides a means to build an index (either during 
@@ -1418,11 +1419,9 @@ void awi_index_v4::set( const awi_item_v4 &value )
 	boost::recursive_mutex::scoped_lock lock( mutex_ );
 	if ( value.length != 0 )
 	{
-		if ( items_.find( value.frame ) == items_.end( ) )
+		if ( ordered_insert( items_, value.frame, value, true ) )
 			frames_ += value.frames;
-		items_[ value.frame ] = value;
-		if ( offsets_.find( value.offset ) == offsets_.end( ) )
-			offsets_[ value.offset ] = value;
+		ordered_insert( offsets_, value.offset, value, false );
 	}
 }
 
@@ -1604,6 +1603,39 @@ int awi_index_v4::total_frames( ) const
 	return frames_;
 }
 
+void awi_index_v4::items( std::vector< awi_item_v4 > &by_frame, std::vector< awi_item_v4 > &by_offset ) const
+{
+	boost::recursive_mutex::scoped_lock lock( mutex_ );
+
+	by_frame.clear( );
+	by_frame.reserve( items_.size( ) );
+	for ( std::map< boost::int32_t, awi_item_v4 >::const_iterator iter = items_.begin( ); iter != items_.end( ); ++iter )
+		by_frame.push_back( iter->second );
+
+	by_offset.clear( );
+	by_offset.reserve( offsets_.size( ) );
+	for ( std::map< boost::int64_t, awi_item_v4 >::const_iterator iter = offsets_.begin( ); iter != offsets_.end( ); ++iter )
+		by_offset.push_back( iter->second );
+}
+
+void awi_index_v4::details( std::vector< awi_item_v4 > &by_frame ) const
+{
+	boost::recursive_mutex::scoped_lock lock( mutex_ );
+
+	by_frame.clear( );
+	by_frame.reserve( details_.size( ) );
+	for ( std::map< boost::int32_t, awi_detail >::const_iterator iter = details_.begin( ); iter != details_.end( ); ++iter )
+	{
+		awi_item_v4 item;
+		memset( &item, 0, sizeof( item ) );
+		item.frame = iter->first;
+		item.frames = 1;
+		item.offset = iter->second.offset;
+		item.length = iter->second.length;
+		by_frame.push_back( item );
+	}
+}
+
 
 
 
@@ -1625,15 +1657,16 @@ awi_parser_v4::~awi_parser_v4( )
 
 bool awi_parser_v4::parse( const boost::uint8_t *data, const size_t length )
 {
-	bool result = state_ == awi_state::header || state_ == awi_state::item;
+	const bool active = state_ == awi_state::header || state_ == awi_state::item;
+	bool result = active;
 
-	// Append data to internal buffer
-	if ( result )
-		append( data, length );
+	// Read the data in place (after any incomplete record from the previous call)
+	if ( active )
+		buffer_.attach( data, length );
 
 	while( result )
 	{
-		if ( buffer_.size( ) < awi_entry_size_v4 )
+		if ( buffer_.available( ) < awi_entry_size_v4 )
 			break;
 
 		switch( state_ )
@@ -1657,16 +1690,9 @@ bool awi_parser_v4::parse( const boost::uint8_t *data, const size_t length )
 					result = parse_footer( );
 					state_ = result ? awi_state::footer : awi_state::error;
 				}
-				else if ( entry_is_type( entry_type_to_read_ ) )
-				{
-					result = parse_item( );
-					state_ = result ? awi_state::item : awi_state::error;
-				}
 				else
 				{
-					//Entry type that we're not interested in, or entry type
-					//from a newer index version. Either way, we will just ignore it.
-					skip( awi_entry_size_v4 );
+					parse_items( );
 				}
 				break;
 
@@ -1677,32 +1703,27 @@ bool awi_parser_v4::parse( const boost::uint8_t *data, const size_t length )
 		}
 	}
 
-	return result;
-}
-
-// Append passed data into an internal buffer.
+	// Keep any incomplete record for the next call
+	if ( active )
+		buffer_.retain( );
 
-void awi_parser_v4::append( const boost::uint8_t *data, const size_t length )
-{
-	size_t current = buffer_.size( );
-	buffer_.resize( current + length );
-	memcpy( &buffer_[ current ], data, length );
+	return result;
 }
 
 bool awi_parser_v4::entry_is_type( boost::uint16_t type )
 {
 	boost::uint16_t read_type;
-	return peek( read_type ) && read_type == type;
+	return buffer_.peek( read_type ) && read_type == type;
 }
 
-// Attempt to read a header and remove it from the internal buffer
+// Attempt to read a header from the buffer
 
 bool awi_parser_v4::parse_header( )
 {
 	bool result = false;
 
 	awi_header_v4 header;
-	result = read( header.type ) && read( header.id, 3 ) && read( header.ver, 1 ) && read( header.created ) && read( header.reserved, sizeof( header.reserved ) );
+	result = buffer_.read( header.type ) && buffer_.read( header.id, 3 ) && buffer_.read( header.ver, 1 ) && buffer_.read( header.created ) && buffer_.read( header.reserved, sizeof( header.reserved ) );
 	result &= !memcmp( header.id, "AWI", 3 ) && header.ver[0] >= '4';
 
 	if ( result )
@@ -1712,27 +1733,45 @@ bool awi_parser_v4::parse_header( )
 }
 
 
-// Attempt to parse an item and remove it from the internal buffer
+// Decode all the complete entries up to the footer in one pass - entries of
+// other types (or from a newer index version) are ignored
 
-bool awi_parser_v4::parse_item( )
+void awi_parser_v4::parse_items( )
 {
+	boost::recursive_mutex::scoped_lock lock( mutex_ );
+
+	const boost::uint8_t *ptr = buffer_.data( );
+	const boost::uint8_t *end = ptr + buffer_.available( ) / awi_entry_size_v4 * awi_entry_size_v4;
 	awi_item_v4 item;
-	bool result = read( item.type ) && read( item.frames ) && read( item.frame ) && read( item.offset ) && read( item.length );
 
-	if ( result )
-		set( item );
+	for ( ; ptr < end; ptr += awi_entry_size_v4 )
+	{
+		item.type = read16( ptr );
 
-	return result;
+		if ( item.type == AWI_V4_TYPE_FOOTER )
+			break;
+
+		if ( item.type == entry_type_to_read_ )
+		{
+			item.frames = boost::int16_t( read16( ptr + 2 ) );
+			item.frame = boost::int32_t( read32( ptr + 4 ) );
+			item.offset = boost::int64_t( read64( ptr + 8 ) );
+			item.length = boost::int32_t( read32( ptr + 16 ) );
+			set( item );
+		}
+	}
+
+	buffer_.skip( size_t( ptr - buffer_.data( ) ) );
 }
 
-// Attempt to parse a footer and remove it from the internal buffer
+// Attempt to parse a footer from the buffer
 
 bool awi_parser_v4::parse_footer( )
 {
 	bool result = false;
 
 	awi_footer_v4 footer;
-	result = read( footer.type ) && read( footer.closed ) && read( footer.id, 3 ) && read( footer.ver, 1 ) && read( footer.reserved, sizeof( footer.reserved ) );
+	result = buffer_.read( footer.type ) && buffer_.read( footer.closed ) && buffer_.read( footer.id, 3 ) && buffer_.read( footer.ver, 1 ) && buffer_.read( footer.reserved, sizeof( footer.reserved ) );
 	result &= !memcmp( footer.id, "AWI", 3 ) && footer.ver[0] >= '4';
 
 	if ( result )
@@ -1741,93 +1780,6 @@ bool awi_parser_v4::parse_footer( )
 	return result;
 }
 
-// Read a fixed length character array from the internal buffer and remove it
-
-bool awi_parser_v4::read( char *data, size_t length )
-{
-	bool result = buffer_.size( ) >= length;
-	if ( result )
-	{
-		memcpy( data, &buffer_[ 0 ], length );
-		buffer_.erase( buffer_.begin( ), buffer_.begin( ) + length );
-	}
-	return result;
-}
-
-// Read a 16 bit int from the internal buffer and remove it
-
-bool awi_parser_v4::read( boost::int16_t &value )
-{
-	bool result = buffer_.size( ) >= 2;
-	if ( result )
-	{
-		value = ( buffer_[ 0 ] << 8 ) | buffer_[ 1 ];
-		buffer_.erase( buffer_.begin( ), buffer_.begin( ) + 2 );
-	}
-	return result;
-}
-
-bool awi_parser_v4::read( boost::uint16_t &value )
-{
-	bool result = buffer_.size( ) >= 2;
-	if ( result )
-	{
-		value = ( buffer_[ 0 ] << 8 ) | buffer_[ 1 ];
-		buffer_.erase( buffer_.begin( ), buffer_.begin( ) + 2 );
-	}
-	return result;
-}
-
-// Read a 32 bit int from the internal buffer and remove it
-
-bool awi_parser_v4::read( boost::int32_t &value )
-{
-	bool result = buffer_.size( ) >= 4;
-	if ( result )
-	{
-		value = ( buffer_[ 0 ] << 24 ) | ( buffer_[ 1 ] << 16 ) | ( buffer_[ 2 ] << 8 ) | buffer_[ 3 ];
-		buffer_.erase( buffer_.begin( ), buffer_.begin( ) + 4 );
-	}
-	return result;
-}
-
-// Read a 64 bit int from the internal buffer and remove it
-
-bool awi_parser_v4::read( boost::int64_t &value )
-{
-	bool result = buffer_.size( ) >= 8;
-	if ( result )
-	{
-		value = boost::int64_t( buffer_[ 0 ] ) << 56LL;
-		value |= boost::int64_t( buffer_[ 1 ] ) << 48LL;
-		value |= boost::int64_t( buffer_[ 2 ] ) << 40LL;
-		value |= boost::int64_t( buffer_[ 3 ] ) << 32LL;
-		value |= boost::int64_t( buffer_[ 4 ] ) << 24LL;
-		value |= boost::int64_t( buffer_[ 5 ] ) << 16LL;
-		value |= boost::int64_t( buffer_[ 6 ] ) << 8LL;
-		value |= boost::int64_t( buffer_[ 7 ] );
-		buffer_.erase( buffer_.begin( ), buffer_.begin( ) + 8 );
-	}
-	return result;
-}
-
-// Reads a 16 bit int from the buffer and leaves it in place
-
-bool awi_parser_v4::peek( boost::uint16_t &value )
-{
-	bool result = buffer_.size( ) >= 2;
-	if ( result )
-		value = ( buffer_[ 0 ] << 8 ) | buffer_[ 1 ];
-	return result;
-}
-
-void awi_parser_v4::skip( boost::uint16_t bytes )
-{
-	buffer_.erase(buffer_.begin( ), buffer_.begin( ) + bytes );
-}
-
-
-
 
 awi_generator_v4::awi_generator_v4( boost::uint16_t type_to_write, bool complete )
 	: awi_index_v4( type_to_write )
@@ -150,6 +150,51 @@ namespace  awi_state
 	};
 }
 
+/// Byte source for the parsers - the data passed to each parse call is read in
+/// place and only an incomplete record at its end is copied (to be completed by
+/// the next call), so an index held in memory is parsed without copying and the
+/// periodic reads of a growing index never move the records already consumed.
+
+class ML_DECLSPEC awi_buffer
+{
+	public:
+		awi_buffer( );
+
+		/// Makes the data available for reading after any pending bytes
+		void attach( const boost::uint8_t *data, size_t length );
+
+		/// Retains the unread bytes for the next attach - must be called before the data goes away
+		void retain( );
+
+		/// Number of bytes which can be read
+		size_t available( ) const { return size_t( end_ - ptr_ ); }
+
+		/// The next byte to be read
+		const boost::uint8_t *data( ) const { return ptr_; }
+
+		/// Discards bytes (at most those available)
+		void skip( size_t bytes );
+
+		/// Big endian reads - each returns false and consumes nothing if insufficient bytes are available
+		bool read( char *data, size_t length );
+		bool read( boost::uint8_t &value );
+		bool read( boost::int16_t &value );
+		bool read( boost::uint16_t &value );
+		bool read( boost::int32_t &value );
+		bool read( boost::uint32_t &value );
+		bool read( boost::int64_t &value );
+
+		/// As read, but the bytes are left in place
+		bool peek( boost::int16_t &value ) const;
+		bool peek( boost::uint16_t &value ) const;
+
+	private:
+		std::vector< boost::uint8_t > pending_;
+		const boost::uint8_t *ptr_;
+		const boost::uint8_t *end_;
+		bool owned_;
+};
+
 class ML_DECLSPEC awi_index
 {
 	public:
@@ -258,18 +303,12 @@ class ML_DECLSPEC awi_parser_v2 : public awi_index_v2
 		bool parse( const boost::uint8_t *data, const size_t length );
 
 	private:
-		void append( const boost::uint8_t *data, const size_t length );
 		bool parse_header( );
 		bool is_item( );
 		bool parse_item( );
 		bool parse_footer( );
-		bool read( char *data, size_t length );
-		bool read( boost::int16_t &value );
-		bool read( boost::int32_t &value );
-		bool read( boost::int64_t &value );
-		bool peek( boost::int16_t &value );
 
-		std::vector< boost::uint8_t > buffer_;
+		awi_buffer buffer_;
 };
 
 /// Generator for an index - as with the parser, physical storage is left
@@ -359,21 +398,12 @@ class ML_DECLSPEC awi_parser_v3 : public awi_index_v3
 		bool parse( const boost::uint8_t *data, const size_t length );
 
 	private:
-		void append( const boost::uint8_t *data, const size_t length );
 		bool parse_header( );
 		bool is_item( );
 		bool parse_item( );
 		bool parse_footer( );
-		bool read( char *data, size_t length );
-		bool read( boost::uint8_t &value );
-		bool read( boost::int16_t &value );
-		bool read( boost::uint16_t &value );
-		bool read( boost::int32_t &value );
-		bool read( boost::uint32_t &value );
-		bool read( boost::int64_t &value );
-		bool peek( boost::int16_t &value );
 
-		std::vector< boost::uint8_t > buffer_;
+		awi_buffer buffer_;
 };
 
 /// Generator for an index - as with the parser, physical storage is left
@@ -427,6 +457,12 @@ class ML_DECLSPEC awi_index_v4 : public awi_index
 		virtual int length( int position ) const;
 		virtual boost::int64_t offset( int position ) const;
 
+		/// Copies of the items in frame and offset order (used to write the mapped form of a finished index)
+		void items( std::vector< awi_item_v4 > &by_frame, std::vector< awi_item_v4 > &by_offset ) const;
+
+		/// Copies of the per frame details in frame order (frames is 1 for each)
+		void details( std::vector< awi_item_v4 > &by_frame ) const;
+
 	protected:
 		mutable boost::recursive_mutex mutex_;
 		int position_;
@@ -450,20 +486,12 @@ class ML_DECLSPEC awi_parser_v4 : public awi_index_v4
 		bool parse( const boost::uint8_t *data, const size_t length );
 
 	private:
-		void append( const boost::uint8_t *data, const size_t length );
 		bool entry_is_type( boost::uint16_t type );
 		bool parse_header( );
-		bool parse_item( );
+		void parse_items( );
 		bool parse_footer( );
-		bool read( char *data, size_t length );
-		bool read( boost::int16_t &value );
-		bool read( boost::uint16_t &value );
-		bool read( boost::int32_t &value );
-		bool read( boost::int64_t &value );
-		bool peek( boost::uint16_t &value );
-		void skip( boost::uint16_t bytes );
 
-		std::vector< boost::uint8_t > buffer_;
+		awi_buffer buffer_;
 		boost::uint16_t entry_type_to_read_;
 };
 
@@ -0,0 +1,376 @@
+// ml - A media library representation.
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#include "awi_mapped.hpp"
+
+#include <opencorelib/cl/core.hpp>
+#include <opencorelib/cl/logprinter.hpp>
+#include <opencorelib/cl/logger.hpp>
+#include <opencorelib/cl/log_defines.hpp>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <fstream>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+
+namespace fs = boost::filesystem;
+namespace ipc = boost::interprocess;
+
+namespace olib { namespace openmedialib { namespace ml {
+
+namespace
+{
+	inline void put_int32( boost::uint8_t *p, boost::int32_t value )
+	{
+		p[ 0 ] = boost::uint8_t( ( value >> 24 ) & 0xff );
+		p[ 1 ] = boost::uint8_t( ( value >> 16 ) & 0xff );
+		p[ 2 ] = boost::uint8_t( ( value >> 8 ) & 0xff );
+		p[ 3 ] = boost::uint8_t( value & 0xff );
+	}
+
+	inline void put_int64( boost::uint8_t *p, boost::int64_t value )
+	{
+		put_int32( p, boost::int32_t( value >> 32 ) );
+		put_int32( p + 4, boost::int32_t( value & 0xffffffff ) );
+	}
+
+	inline boost::int32_t get_int32( const boost::uint8_t *p )
+	{
+		return boost::int32_t( ( boost::uint32_t( p[ 0 ] ) << 24 ) | ( p[ 1 ] << 16 ) | ( p[ 2 ] << 8 ) | p[ 3 ] );
+	}
+
+	inline boost::int64_t get_int64( const boost::uint8_t *p )
+	{
+		return boost::int64_t( ( boost::uint64_t( boost::uint32_t( get_int32( p ) ) ) << 32 ) | boost::uint32_t( get_int32( p + 4 ) ) );
+	}
+
+	// Field accessors of the i'th record of a table
+	inline boost::int32_t record_frame( const boost::uint8_t *table, size_t i )
+	{
+		return get_int32( table + i * awi_mapped_record_size );
+	}
+
+	inline boost::int32_t record_frames( const boost::uint8_t *table, size_t i )
+	{
+		return get_int32( table + i * awi_mapped_record_size + 4 );
+	}
+
+	inline boost::int64_t record_offset( const boost::uint8_t *table, size_t i )
+	{
+		return get_int64( table + i * awi_mapped_record_size + 8 );
+	}
+
+	inline boost::int32_t record_length( const boost::uint8_t *table, size_t i )
+	{
+		return get_int32( table + i * awi_mapped_record_size + 16 );
+	}
+
+	void put_records( std::vector< boost::uint8_t > &out, const std::vector< awi_item_v4 > &items )
+	{
+		const size_t start = out.size( );
+		out.resize( start + items.size( ) * awi_mapped_record_size, 0 );
+		for ( size_t i = 0; i < items.size( ); i ++ )
+		{
+			boost::uint8_t *p = &out[ start + i * awi_mapped_record_size ];
+			put_int32( p, items[ i ].frame );
+			put_int32( p + 4, items[ i ].frames );
+			put_int64( p + 8, items[ i ].offset );
+			put_int32( p + 16, items[ i ].length );
+		}
+	}
+
+	// The file name of a local index - empty for anything else
+	std::string local_file( const std::string &index )
+	{
+		const std::string file = index.find( "file:" ) == 0 ? index.substr( 5 ) : index;
+		if ( file == "" || file.find( "://" ) != std::string::npos || file.find( ':' ) == 0 )
+			return "";
+		return file;
+	}
+
+	// Size and modification time of the index - the sidecar is only valid for the index it was written from
+	bool stamp( const std::string &index, boost::int64_t &size, boost::int64_t &modified )
+	{
+		boost::system::error_code error;
+		size = boost::int64_t( fs::file_size( index, error ) );
+		if ( error )
+			return false;
+		modified = boost::int64_t( fs::last_write_time( index, error ) );
+		return !error;
+	}
+}
+
+struct awi_mapped_index::mapping
+{
+	mapping( const std::string &path )
+		: file( path.c_str( ), ipc::read_only )
+		, region( file, ipc::read_only )
+	{ }
+
+	ipc::file_mapping file;
+	ipc::mapped_region region;
+};
+
+awi_mapped_index::awi_mapped_index( )
+	: awi_index( )
+	, by_frame_( 0 )
+	, by_offset_( 0 )
+	, by_detail_( 0 )
+	, count_( 0 )
+	, offsets_( 0 )
+	, details_( 0 )
+	, entry_type_( 0 )
+	, frames_( 0 )
+	, bytes_( 0 )
+	, usable_( true )
+{
+}
+
+awi_mapped_index::~awi_mapped_index( )
+{
+}
+
+bool awi_mapped_index::enabled( )
+{
+	static const bool result = getenv( "AML_AWI_MAP" ) == 0 || std::string( getenv( "AML_AWI_MAP" ) ) != "0";
+	return result;
+}
+
+std::string awi_mapped_index::path_for( const std::string &index, boost::uint16_t entry_type )
+{
+	const std::string file = local_file( index );
+	return file == "" ? "" : file + "." + boost::lexical_cast< std::string >( entry_type ) + ".awm";
+}
+
+awi_mapped_index_ptr awi_mapped_index::open( const std::string &index, boost::uint16_t entry_type )
+{
+	awi_mapped_index_ptr result;
+	const std::string path = path_for( index, entry_type );
+	boost::int64_t size, modified;
+
+	if ( path == "" || !enabled( ) || !fs::exists( path ) || !stamp( local_file( index ), size, modified ) )
+		return result;
+
+	try
+	{
+		boost::scoped_ptr< mapping > map( new mapping( path ) );
+		const boost::uint8_t *data = static_cast< const boost::uint8_t * >( map->region.get_address( ) );
+		const size_t length = map->region.get_size( );
+
+		if ( length < awi_mapped_header_size || memcmp( data, "AWM2", 4 ) != 0 || get_int32( data + 4 ) != awi_mapped_header_size ||
+			 get_int32( data + 8 ) != awi_mapped_record_size || ( ( data[ 12 ] << 8 ) | data[ 13 ] ) != entry_type )
+		{
+			ARLOG_WARN( "Ignoring %1% - not a mapped index of type %2%" )( path )( entry_type );
+		}
+		else if ( get_int64( data + 32 ) != size || get_int64( data + 40 ) != modified )
+		{
+			ARLOG_DEBUG( "Ignoring %1% - the index has changed since it was written" )( path );
+		}
+		else if ( get_int32( data + 16 ) <= 0 || get_int32( data + 48 ) <= 0 || get_int32( data + 52 ) < 0 ||
+				  length < awi_mapped_header_size + ( size_t( get_int32( data + 16 ) ) + size_t( get_int32( data + 48 ) ) + size_t( get_int32( data + 52 ) ) ) * awi_mapped_record_size )
+		{
+			ARLOG_WARN( "Ignoring %1% - the file is truncated" )( path );
+		}
+		else
+		{
+			result.reset( new awi_mapped_index( ) );
+			result->count_ = size_t( get_int32( data + 16 ) );
+			result->offsets_ = size_t( get_int32( data + 48 ) );
+			result->by_frame_ = data + awi_mapped_header_size;
+			result->details_ = size_t( get_int32( data + 52 ) );
+			result->by_offset_ = result->by_frame_ + result->count_ * awi_mapped_record_size;
+			result->by_detail_ = result->by_offset_ + result->offsets_ * awi_mapped_record_size;
+			result->entry_type_ = entry_type;
+			result->frames_ = get_int32( data + 20 );
+			result->bytes_ = get_int64( data + 24 );
+			result->state_ = awi_state::footer;
+			result->mapping_.swap( map );
+		}
+	}
+	catch( const std::exception &e )
+	{
+		ARLOG_WARN( "Unable to map the index %1%: %2%" )( path )( e.what( ) );
+		result.reset( );
+	}
+
+	return result;
+}
+
+bool awi_mapped_index::write( const std::string &index, awi_index_v4 &source )
+{
+	const std::string path = path_for( index, source.type( ) );
+	boost::int64_t size, modified;
+
+	if ( path == "" || !enabled( ) || !source.finished( ) || source.total_frames( ) <= 0 || !stamp( local_file( index ), size, modified ) )
+		return false;
+
+	std::vector< awi_item_v4 > by_frame, by_offset, details;
+	source.items( by_frame, by_offset );
+	source.details( details );
+	if ( by_frame.empty( ) || by_offset.empty( ) )
+		return false;
+
+	std::vector< boost::uint8_t > out( awi_mapped_header_size, 0 );
+	memcpy( &out[ 0 ], "AWM2", 4 );
+	put_int32( &out[ 4 ], awi_mapped_header_size );
+	put_int32( &out[ 8 ], awi_mapped_record_size );
+	out[ 12 ] = boost::uint8_t( source.type( ) >> 8 );
+	out[ 13 ] = boost::uint8_t( source.type( ) & 0xff );
+	put_int32( &out[ 16 ], boost::int32_t( by_frame.size( ) ) );
+	put_int32( &out[ 20 ], source.total_frames( ) );
+	put_int64( &out[ 24 ], source.bytes( ) );
+	put_int64( &out[ 32 ], size );
+	put_int64( &out[ 40 ], modified );
+	put_int32( &out[ 48 ], boost::int32_t( by_offset.size( ) ) );
+	put_int32( &out[ 52 ], boost::int32_t( details.size( ) ) );
+	put_records( out, by_frame );
+	put_records( out, by_offset );
+	put_records( out, details );
+
+	// Concurrent processes may write the same sidecar, so each writes its own
+	// temporary file and readers only ever see a complete one
+	boost::system::error_code error;
+	const std::string temp = path + "." + fs::unique_path( "%%%%%%%%", error ).string( );
+	if ( error )
+		return false;
+
+	{
+		std::ofstream file( temp.c_str( ), std::ios::binary | std::ios::trunc );
+		file.write( reinterpret_cast< const char * >( &out[ 0 ] ), std::streamsize( out.size( ) ) );
+		if ( !file.good( ) )
+		{
+			// Media is often held on read only storage, so this isn't worth a warning
+			ARLOG_DEBUG( "Unable to write the mapped index %1%" )( temp );
+			file.close( );
+			fs::remove( temp, error );
+			return false;
+		}
+	}
+
+	fs::rename( temp, path, error );
+	if ( error )
+	{
+		ARLOG_WARN( "Unable to rename %1% to %2%: %3%" )( temp )( path )( error.message( ) );
+		fs::remove( temp, error );
+		return false;
+	}
+
+	return true;
+}
+
+size_t awi_mapped_index::floor_by_frame( int position ) const
+{
+	// First record whose frame is greater than position
+	size_t lo = 0, hi = count_;
+	while ( lo < hi )
+	{
+		const size_t mid = lo + ( hi - lo ) / 2;
+		if ( record_frame( by_frame_, mid ) <= position )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo > 0 ? lo - 1 : 0;
+}
+
+// Determine the file offset of the GOP associated to the position
+boost::int64_t awi_mapped_index::find( int position )
+{
+	return record_offset( by_frame_, floor_by_frame( position ) );
+}
+
+size_t awi_mapped_index::find_detail( int position ) const
+{
+	// First record whose frame is not smaller than position
+	size_t lo = 0, hi = details_;
+	while ( lo < hi )
+	{
+		const size_t mid = lo + ( hi - lo ) / 2;
+		if ( record_frame( by_detail_, mid ) < position )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < details_ && record_frame( by_detail_, lo ) == position ? lo : details_;
+}
+
+// Key frames are looked up first and then the per frame details (as awi_index_v4)
+boost::int64_t awi_mapped_index::offset( int position ) const
+{
+	const size_t i = floor_by_frame( position );
+	if ( record_frame( by_frame_, i ) == position )
+		return record_offset( by_frame_, i );
+	const size_t d = find_detail( position );
+	return d < details_ ? record_offset( by_detail_, d ) : 0;
+}
+
+int awi_mapped_index::length( int position ) const
+{
+	const size_t i = floor_by_frame( position );
+	if ( record_frame( by_frame_, i ) == position )
+		return record_length( by_frame_, i );
+	const size_t d = find_detail( position );
+	return d < details_ ? record_length( by_detail_, d ) : 0;
+}
+
+// Derive the frame count from the file size given (as awi_index_v4::calculate)
+int awi_mapped_index::calculate( boost::int64_t size )
+{
+	if ( size >= bytes_ )
+		return frames_;
+
+	// First record whose offset is not smaller than the file size
+	size_t lo = 0, hi = offsets_;
+	while ( lo < hi )
+	{
+		const size_t mid = lo + ( hi - lo ) / 2;
+		if ( record_offset( by_offset_, mid ) < size )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if ( lo == 0 )
+		return 0;
+
+	// The previous record may not be fully available
+	size_t prev = lo - 1;
+	if ( record_offset( by_offset_, prev ) + record_length( by_offset_, prev ) > size )
+	{
+		if ( prev == 0 )
+			return 0;
+		-- prev;
+	}
+
+	return record_frame( by_offset_, prev ) + record_frames( by_offset_, prev );
+}
+
+// Determine the I frame of the given position
+int awi_mapped_index::key_frame_of( int position )
+{
+	return record_frame( by_frame_, floor_by_frame( position ) );
+}
+
+// Determine the I frame from the offset provided
+int awi_mapped_index::key_frame_from( boost::int64_t offset )
+{
+	size_t lo = 0, hi = offsets_;
+	while ( lo < hi )
+	{
+		const size_t mid = lo + ( hi - lo ) / 2;
+		if ( record_offset( by_offset_, mid ) <= offset )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return record_frame( by_offset_, lo > 0 ? lo - 1 : 0 );
+}
+
+} } }
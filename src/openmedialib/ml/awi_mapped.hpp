@@ -0,0 +1,108 @@
+// ml - A media library representation.
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#ifndef OPENMEDIALIB_AWI_MAPPED_INC_
+#define OPENMEDIALIB_AWI_MAPPED_INC_
+
+#include <openmedialib/ml/config.hpp>
+#include <openmedialib/ml/awi.hpp>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+namespace olib { namespace openmedialib { namespace ml {
+
+/// Once a v4 index is finished it never changes, so rather than parsing it
+/// into maps in every process which opens the media (and locking them on every
+/// look up), the entries of one type are written once to a sidecar file next
+/// to the index and memory mapped from there. The mapping is read only, so any
+/// number of threads and processes can share it without locking.
+///
+/// Layout (all values big endian, as in the awi files):
+///
+/// * header (64 bytes) - "AWM", version '2', header size (int32), record size
+///   (int32), entry type (uint16), 2 reserved bytes, frame order record count
+///   (int32), total frames (int32), bytes (int64), size (int64) and modified
+///   time (int64) of the index the sidecar was written from, offset order
+///   record count (int32), detail record count (int32) and 8 reserved bytes
+/// * records (24 bytes) in frame order - frame (int32), frames (int32), offset
+///   (int64), length (int32) and 4 reserved bytes
+/// * records in offset order (as above)
+/// * per frame detail records in frame order (as above, with frames of 1) -
+///   these provide the offset and length of positions which aren't key frames
+///
+/// All tables are sorted, so every query is a binary search of the mapping.
+/// The sidecar is ignored (and rewritten) when the index has changed since it
+/// was written. Setting AML_AWI_MAP=0 in the environment disables its use.
+
+#define awi_mapped_header_size 64
+#define awi_mapped_record_size 24
+
+class awi_mapped_index;
+typedef boost::shared_ptr< awi_mapped_index > awi_mapped_index_ptr;
+
+class ML_DECLSPEC awi_mapped_index : public awi_index, public boost::noncopyable
+{
+	public:
+		/// Indicates if sidecars should be used (see AML_AWI_MAP above)
+		static bool enabled( );
+
+		/// Sidecar file name for the entry type of a local index (ie: /path/file.awi.1.awm) -
+		/// empty if the index isn't a local file
+		static std::string path_for( const std::string &index, boost::uint16_t entry_type );
+
+		/// Map the sidecar of the index - returns an empty pointer when the sidecar is
+		/// missing, malformed or older than the index
+		static awi_mapped_index_ptr open( const std::string &index, boost::uint16_t entry_type );
+
+		/// Write the sidecar of a finished index (via a temporary file which is then renamed)
+		static bool write( const std::string &index, awi_index_v4 &source );
+
+		virtual ~awi_mapped_index( );
+
+		virtual bool finished( ) { return true; }
+		virtual boost::int64_t find( int position );
+		virtual int frames( int ) { return frames_; }
+		virtual boost::int64_t bytes( ) { return bytes_; }
+		virtual int calculate( boost::int64_t size );
+		virtual bool usable( ) { return usable_; }
+		virtual void set_usable( bool value ) { usable_ = value; }
+		virtual int key_frame_of( int position );
+		virtual int key_frame_from( boost::int64_t offset );
+		virtual int total_frames( ) const { return frames_; }
+		virtual const boost::uint16_t type( ) const { return entry_type_; }
+		virtual int length( int position ) const;
+		virtual boost::int64_t offset( int position ) const;
+
+	private:
+		awi_mapped_index( );
+
+		// Index of the last record in frame order whose frame is <= position (0 if there's none)
+		size_t floor_by_frame( int position ) const;
+
+		// Index of the detail record of position (details_ if there's none)
+		size_t find_detail( int position ) const;
+
+		struct mapping;
+		boost::scoped_ptr< mapping > mapping_;
+		const boost::uint8_t *by_frame_;
+		const boost::uint8_t *by_offset_;
+		const boost::uint8_t *by_detail_;
+		size_t count_;
+		size_t offsets_;
+		size_t details_;
+		boost::uint16_t entry_type_;
+		int frames_;
+		boost::int64_t bytes_;
+		bool usable_;
+};
+
+} } }
+
+#endif
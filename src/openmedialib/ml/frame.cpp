@@ -397,5 +397,23 @@ int frame_type::samples( ) const
 	return 0;
 }
 
+/// Bytes held by the components of the frame and its attached frames
+boost::int64_t frame_type::memory_usage( ) const
+{
+	boost::int64_t result = 0;
+	if ( image_ )
+		result += image_->size( );
+	if ( alpha_ )
+		result += alpha_->size( );
+	if ( audio_ )
+		result += audio_->size( );
+	if ( stream_ )
+		result += boost::int64_t( stream_->length( ) );
+	for ( std::deque< frame_type_ptr >::const_iterator iter = queue_.begin( ); iter != queue_.end( ); ++ iter )
+		if ( *iter )
+			result += ( *iter )->memory_usage( );
+	return result;
+}
+
 } } }
 
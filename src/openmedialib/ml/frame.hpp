@@ -189,6 +189,10 @@ namespace olib { namespace openmedialib { namespace ml {
 		/// Obtain samples from packet or audio
 		int samples( ) const;
 
+		/// Bytes held by the image, alpha, audio and packet of this frame and of
+		/// its attached frames (nothing is decoded to determine this)
+		boost::int64_t memory_usage( ) const;
+
 		/// Indicates if the frame is deferred
 		bool is_deferred( ) const { return queue_.size( ) > 0; }
 
@@ -6,6 +6,7 @@
 
 #include <openmedialib/ml/image/image_interface.hpp>
 #include <openmedialib/ml/image/ffmpeg_utility.hpp>
+#include <openmedialib/ml/statistics.hpp>
 
 #include <opencorelib/cl/log_defines.hpp>
 
@@ -345,6 +346,8 @@ protected:
 
 		ARENFORCE_MSG( size_ >= 0, "Unable to alloctate %1% at %2% x %3%" )( AVpixfmt_ )( width_ )( height_ );
 
+		count_image_allocation( size_ );
+
 		utility_av_pix_fmt_get_chroma_sub_sample( AVpixfmt_, &chroma_w_, &chroma_h_ );
 
 		for ( int i = 0; i < 4; i ++ )
@@ -13,6 +13,11 @@
 #include <boost/assign/list_of.hpp>
 #include <map>
 
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define AML_IMAGE_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace cl = olib::opencorelib;
 namespace ml = olib::openmedialib::ml;
 namespace image = olib::openmedialib::ml::image;
@@ -728,6 +733,106 @@ ML_DECLSPEC image_type_ptr deinterlace( const image_type_ptr &im )
 	return result;
 }
 
+// Weighted average of two scan lines of 8 bit samples
+inline void blend_line( boost::uint8_t *dst, const boost::uint8_t *a, const boost::uint8_t *b, int count, int weight )
+{
+	int i = 0;
+#ifdef AML_IMAGE_SSE2
+	// The products fit in 16 bits unsigned (255 * 256), so the wrapping 16 bit multiply is exact
+	const __m128i zero = _mm_setzero_si128( );
+	const __m128i wa = _mm_set1_epi16( short( 256 - weight ) );
+	const __m128i wb = _mm_set1_epi16( short( weight ) );
+	const __m128i round = _mm_set1_epi16( 128 );
+	for ( ; i + 16 <= count; i += 16 )
+	{
+		const __m128i va = _mm_loadu_si128( reinterpret_cast< const __m128i * >( a + i ) );
+		const __m128i vb = _mm_loadu_si128( reinterpret_cast< const __m128i * >( b + i ) );
+		__m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( va, zero ), wa ), _mm_mullo_epi16( _mm_unpacklo_epi8( vb, zero ), wb ) );
+		__m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( va, zero ), wa ), _mm_mullo_epi16( _mm_unpackhi_epi8( vb, zero ), wb ) );
+		lo = _mm_srli_epi16( _mm_add_epi16( lo, round ), 8 );
+		hi = _mm_srli_epi16( _mm_add_epi16( hi, round ), 8 );
+		_mm_storeu_si128( reinterpret_cast< __m128i * >( dst + i ), _mm_packus_epi16( lo, hi ) );
+	}
+#endif
+	for ( ; i < count; i ++ )
+		dst[ i ] = boost::uint8_t( ( a[ i ] * ( 256 - weight ) + b[ i ] * weight + 128 ) >> 8 );
+}
+
+// Weighted average of two scan lines of 16 bit samples
+inline void blend_line( boost::uint16_t *dst, const boost::uint16_t *a, const boost::uint16_t *b, int count, int weight )
+{
+	for ( int i = 0; i < count; i ++ )
+		dst[ i ] = boost::uint16_t( ( boost::uint32_t( a[ i ] ) * ( 256 - weight ) + boost::uint32_t( b[ i ] ) * weight + 128 ) >> 8 );
+}
+
+template< typename T >
+void blend( const image_type_ptr &dst, const image_type_ptr &a, const image_type_ptr &b, int first, int second, int slice, int slices )
+{
+	boost::shared_ptr< T > d = ml::image::coerce< T >( dst );
+	boost::shared_ptr< T > x = ml::image::coerce< T >( a );
+	boost::shared_ptr< T > y = ml::image::coerce< T >( b );
+	ARENFORCE_MSG( d && x && y, "Unable to blend images of different types" );
+
+	// The scan lines of the first field are the odd ones when the bottom field is first
+	const int parity = dst->field_order( ) == bottom_field_first ? 1 : 0;
+
+	for ( int i = 0; i < dst->plane_count( ); i ++ )
+	{
+		const int height = dst->height( i );
+		const int start = int( boost::int64_t( height ) * slice / slices );
+		const int end = int( boost::int64_t( height ) * ( slice + 1 ) / slices );
+		const int count = dst->linesize( i ) / int( sizeof( typename T::data_type ) );
+
+		for ( int h = start; h < end; h ++ )
+		{
+			typename T::data_type *out = reinterpret_cast< typename T::data_type * >( reinterpret_cast< boost::uint8_t * >( d->data( i ) ) + h * dst->pitch( i ) );
+			const typename T::data_type *in_a = reinterpret_cast< const typename T::data_type * >( reinterpret_cast< const boost::uint8_t * >( x->data( i ) ) + h * a->pitch( i ) );
+			const typename T::data_type *in_b = reinterpret_cast< const typename T::data_type * >( reinterpret_cast< const boost::uint8_t * >( y->data( i ) ) + h * b->pitch( i ) );
+			blend_line( out, in_a, in_b, count, ( h & 1 ) == parity ? first : second );
+		}
+	}
+}
+
+// Sample types which can't be averaged get each scan line from the source with the larger weight
+void blend_nearest( const image_type_ptr &dst, const image_type_ptr &a, const image_type_ptr &b, int first, int second, int slice, int slices )
+{
+	const int parity = dst->field_order( ) == bottom_field_first ? 1 : 0;
+
+	for ( int i = 0; i < dst->plane_count( ); i ++ )
+	{
+		const int height = dst->height( i );
+		const int start = int( boost::int64_t( height ) * slice / slices );
+		const int end = int( boost::int64_t( height ) * ( slice + 1 ) / slices );
+
+		for ( int h = start; h < end; h ++ )
+		{
+			const image_type_ptr &source = ( ( h & 1 ) == parity ? first : second ) <= 128 ? a : b;
+			memcpy( static_cast< boost::uint8_t * >( dst->ptr( i ) ) + h * dst->pitch( i ), static_cast< const boost::uint8_t * >( source->ptr( i ) ) + h * source->pitch( i ), dst->linesize( i ) );
+		}
+	}
+}
+
+ML_DECLSPEC void blend( const image_type_ptr &dst, const image_type_ptr &a, const image_type_ptr &b, int first, int second, int slice, int slices )
+{
+	ARENFORCE_MSG( dst && a && b, "Blending requires three images" );
+	ARENFORCE_MSG( a->ml_pixel_format( ) == dst->ml_pixel_format( ) && b->ml_pixel_format( ) == dst->ml_pixel_format( ) &&
+				   a->width( ) == dst->width( ) && b->width( ) == dst->width( ) && a->height( ) == dst->height( ) && b->height( ) == dst->height( ),
+				   "Unable to blend %1% %2%x%3% and %4% %5%x%6% into %7% %8%x%9%" )
+				 ( cl::str_util::to_string( a->pf( ) ) )( a->width( ) )( a->height( ) )
+				 ( cl::str_util::to_string( b->pf( ) ) )( b->width( ) )( b->height( ) )
+				 ( cl::str_util::to_string( dst->pf( ) ) )( dst->width( ) )( dst->height( ) );
+
+	first = first < 0 ? 0 : first > 256 ? 256 : first;
+	second = second < 0 ? 0 : second > 256 ? 256 : second;
+
+	if ( ml::image::coerce< ml::image::image_type_8 >( dst ) )
+		blend< ml::image::image_type_8 >( dst, a, b, first, second, slice, slices );
+	else if ( ml::image::coerce< ml::image::image_type_16 >( dst ) )
+		blend< ml::image::image_type_16 >( dst, a, b, first, second, slice, slices );
+	else
+		blend_nearest( dst, a, b, first, second, slice, slices );
+}
+
 inline unsigned char clamp_sample( const int v ) { return ( unsigned char )( v < 0 ? 0 : v > 255 ? 255 : v ); }
 
 inline void yuv444_to_rgb( unsigned char *&dst, const int y, const int rc, const int gc, const int bc )
@@ -221,6 +221,12 @@ ML_DECLSPEC image_type_ptr merge_alpha( image_type_ptr im, image_type_ptr alpha
 /// Deinterlaces the image in place (does not copy im first)
 ML_DECLSPEC image_type_ptr deinterlace( const image_type_ptr &im );
 
+/// Blends a and b into dst (all of the same format and size) - the weights are the contribution of b in 
+/// 256ths for the scan lines of the first and second fields of dst (equal for progressive images). Only 
+/// the scan lines in the slice of each plane are written, so slices can be blended by different threads.
+/// Images which are neither 8 nor 16 bit take each scan line from the source with the larger weight.
+ML_DECLSPEC void blend( const image_type_ptr &dst, const image_type_ptr &a, const image_type_ptr &b, int first, int second, int slice = 0, int slices = 1 );
+
 /// Converts yuv to rgb values
 inline void yuv444_to_rgb24( int &r, int &g, int &b, unsigned char y, unsigned char u, unsigned char v )
 {
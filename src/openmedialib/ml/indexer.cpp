@@ -7,6 +7,7 @@
 #include <openmedialib/ml/indexer.hpp>
 #include <openmedialib/ml/stream.hpp>
 #include <openmedialib/ml/awi.hpp>
+#include <openmedialib/ml/awi_mapped.hpp>
 #include <openmedialib/ml/utilities.hpp>
 #include <openmedialib/ml/io.hpp>
 
@@ -143,10 +144,23 @@ aml_index_reader_ptr create( const std::string& indexname, boost::uint16_t v4_in
 
 	if ( v4_index_entry_type != 0 )
 	{
+		// A finished V4 index is mapped from its sidecar when available
+		result = awi_mapped_index::open( indexname, v4_index_entry_type );
+		if ( result )
+			return result;
+
 		// Try V4 Index
-		result = aml_index_reader_ptr( new aml_index_reader< awi_parser_v4 >( indexname, v4_index_entry_type ) );
-		if ( result->total_frames( ) == 0 )
-			result = aml_index_reader_ptr( );
+		boost::shared_ptr< aml_index_reader< awi_parser_v4 > > parser( new aml_index_reader< awi_parser_v4 >( indexname, v4_index_entry_type ) );
+		if ( parser->total_frames( ) != 0 )
+			result = parser;
+
+		// Write the sidecar once the index is complete so that it can be shared without parsing or locking
+		if ( result && parser->finished( ) && awi_mapped_index::write( indexname, *parser ) )
+		{
+			aml_index_reader_ptr mapped = awi_mapped_index::open( indexname, v4_index_entry_type );
+			if ( mapped )
+				result = mapped;
+		}
 	}
 
 	if ( !result )
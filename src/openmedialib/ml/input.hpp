@@ -10,6 +10,7 @@
 
 #include <openmedialib/ml/types.hpp>
 #include <openmedialib/ml/frame.hpp>
+#include <openmedialib/ml/statistics.hpp>
 
 #include <openpluginlib/pl/pcos/property_container.hpp>
 #include <openpluginlib/pl/log.hpp>
@@ -20,6 +21,7 @@
 #include <opencorelib/cl/log_defines.hpp>
 
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace olib { namespace openmedialib { namespace ml {
 
@@ -151,6 +153,7 @@ class ML_DECLSPEC input_type : public boost::enable_shared_from_this< input_type
 		{
 			frame_type_ptr result;
 			exception_ptr exception;
+			boost::int64_t start = fetch_stats_enabled( ) ? fetch_begin( ) : 0;
 
 			try
 			{
@@ -174,6 +177,9 @@ class ML_DECLSPEC input_type : public boost::enable_shared_from_this< input_type
 			if ( !report_exceptions_ )
 				result->clear_exceptions( );
 
+			if ( start )
+				update_fetch_stats( fetch_end( this, start ), result );
+
 			return result;
 		}
 
@@ -207,6 +213,20 @@ class ML_DECLSPEC input_type : public boost::enable_shared_from_this< input_type
 		// updated upon sync.
 		virtual bool complete( ) const { return complete_; }
 
+		// Obtain the fetch statistics gathered for this node
+		fetch_stats_type fetch_stats( ) const
+		{
+			boost::mutex::scoped_lock lock( fetch_stats_mutex_ );
+			return fetch_stats_;
+		}
+
+		// Clear the fetch statistics gathered for this node
+		void reset_fetch_stats( )
+		{
+			boost::mutex::scoped_lock lock( fetch_stats_mutex_ );
+			fetch_stats_ = fetch_stats_type( );
+		}
+
 	protected:
 		// Virtual method for initialization
 		virtual bool initialize( ) { return true; }
@@ -224,10 +244,30 @@ class ML_DECLSPEC input_type : public boost::enable_shared_from_this< input_type
 		bool complete_;
 
 	private:
+		void update_fetch_stats( const fetch_sample_type &sample, const frame_type_ptr &frame )
+		{
+			// Avoid the virtual accessors here since they would force evaluation of lazy frames
+			image_type_ptr image = frame->frame_type::get_image( );
+			audio_type_ptr audio = frame->frame_type::get_audio( );
+
+			boost::mutex::scoped_lock lock( fetch_stats_mutex_ );
+			fetch_stats_.calls ++;
+			fetch_stats_.elapsed += sample.inclusive;
+			fetch_stats_.self += sample.exclusive;
+			if ( sample.inclusive > fetch_stats_.maximum )
+				fetch_stats_.maximum = sample.inclusive;
+			if ( image )
+				fetch_stats_.image_bytes += image->size( );
+			if ( audio )
+				fetch_stats_.audio_bytes += audio->size( );
+		}
+
 		bool initialized_;
 		olib::openpluginlib::pcos::property prop_debug_;
 		int process_;
 		bool report_exceptions_;
+		mutable boost::mutex fetch_stats_mutex_;
+		fetch_stats_type fetch_stats_;
 };
 
 } } }
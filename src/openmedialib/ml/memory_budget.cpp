@@ -0,0 +1,132 @@
+// ml - A media library representation.
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#include "memory_budget.hpp"
+
+#include <openmedialib/ml/input.hpp>
+
+#include <algorithm>
+#include <set>
+
+namespace olib { namespace openmedialib { namespace ml {
+
+namespace
+{
+	struct report_state
+	{
+		std::set< input_type * > nodes;
+		std::set< memory_consumer * > consumers;
+	};
+
+	// Shared consumers may also be nodes of the graph, so each consumer is only added once
+	void add( std::vector< memory_usage_type > &result, report_state &state, const input_type_ptr &node, memory_consumer *consumer )
+	{
+		if ( !consumer || !state.consumers.insert( consumer ).second )
+			return;
+
+		memory_usage_type usage;
+		usage.node = node;
+		usage.consumer = consumer;
+		usage.bytes = consumer->memory_usage( );
+		usage.priority = consumer->memory_priority( );
+		result.push_back( usage );
+	}
+
+	void walk( const input_type_ptr &node, report_state &state, std::vector< memory_usage_type > &result )
+	{
+		if ( !node || !state.nodes.insert( node.get( ) ).second )
+			return;
+
+		memory_consumer *consumer = dynamic_cast< memory_consumer * >( node.get( ) );
+		if ( consumer )
+		{
+			add( result, state, node, consumer );
+
+			std::vector< memory_consumer * > shared;
+			consumer->memory_shared( shared );
+			for ( std::vector< memory_consumer * >::const_iterator iter = shared.begin( ); iter != shared.end( ); ++ iter )
+				add( result, state, node, *iter );
+
+			// Upstream consumers are in use by the node's worker threads
+			if ( consumer->memory_threaded( ) )
+				return;
+		}
+
+		for ( size_t i = 0; i < node->slot_count( ); i ++ )
+			if ( !consumer || !consumer->memory_threaded_slot( i ) )
+				walk( node->fetch_slot( i ), state, result );
+	}
+
+	// Lowest priority first, then the biggest first
+	bool release_order( const memory_usage_type &a, const memory_usage_type &b )
+	{
+		return a.priority != b.priority ? a.priority < b.priority : a.bytes > b.bytes;
+	}
+}
+
+void memory_report( const input_type_ptr &graph, std::vector< memory_usage_type > &result )
+{
+	report_state state;
+	result.clear( );
+	walk( graph, state, result );
+}
+
+boost::int64_t graph_memory_usage( const input_type_ptr &graph )
+{
+	std::vector< memory_usage_type > report;
+	memory_report( graph, report );
+
+	boost::int64_t result = 0;
+	for ( std::vector< memory_usage_type >::const_iterator iter = report.begin( ); iter != report.end( ); ++ iter )
+		result += iter->bytes;
+	return result;
+}
+
+boost::int64_t node_memory_usage( const input_type_ptr &node )
+{
+	memory_consumer *consumer = dynamic_cast< memory_consumer * >( node.get( ) );
+	if ( !consumer )
+		return 0;
+
+	boost::int64_t result = consumer->memory_usage( );
+
+	std::vector< memory_consumer * > shared;
+	consumer->memory_shared( shared );
+	for ( std::vector< memory_consumer * >::const_iterator iter = shared.begin( ); iter != shared.end( ); ++ iter )
+		if ( *iter )
+			result += ( *iter )->memory_usage( );
+
+	return result;
+}
+
+boost::int64_t enforce_memory_budget( const input_type_ptr &graph, boost::int64_t limit )
+{
+	std::vector< memory_usage_type > report;
+	memory_report( graph, report );
+
+	boost::int64_t usage = 0;
+	for ( std::vector< memory_usage_type >::const_iterator iter = report.begin( ); iter != report.end( ); ++ iter )
+		usage += iter->bytes;
+
+	if ( usage <= limit )
+		return usage;
+
+	std::sort( report.begin( ), report.end( ), release_order );
+
+	for ( std::vector< memory_usage_type >::iterator iter = report.begin( ); usage > limit && iter != report.end( ); ++ iter )
+	{
+		if ( iter->bytes <= 0 )
+			continue;
+
+		// The consumer is measured again rather than trusting the bytes released, since
+		// other threads may have changed it since the report was taken
+		iter->consumer->memory_release( std::min( usage - limit, iter->bytes ) );
+		usage -= iter->bytes - iter->consumer->memory_usage( );
+	}
+
+	return usage;
+}
+
+} } }
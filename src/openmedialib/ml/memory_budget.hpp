@@ -0,0 +1,148 @@
+// ml - A media library representation.
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#ifndef OPENMEDIALIB_MEMORY_BUDGET_INC_
+#define OPENMEDIALIB_MEMORY_BUDGET_INC_
+
+#include <openmedialib/ml/config.hpp>
+#include <openmedialib/ml/types.hpp>
+#include <openmedialib/ml/frame.hpp>
+#include <openmedialib/ml/stream.hpp>
+
+#include <boost/cstdint.hpp>
+
+#include <vector>
+
+namespace olib { namespace openmedialib { namespace ml {
+
+/// Accounting of the memory held by the nodes of a graph, and enforcement of
+/// a budget for it.
+///
+/// Frames in flight are short lived, so what matters is the memory which nodes
+/// hold on to between fetches - frame caches, read ahead queues and packet
+/// caches. Nodes which hold such memory implement memory_consumer alongside
+/// input_type and the usage of a graph is the sum over the distinct nodes found
+/// by walking its slots. Consumers which are shared by several nodes (such as
+/// a scope cache) are reported by each node using them and counted once.
+///
+/// When a budget is enforced, consumers are asked to release memory in order of
+/// priority (lowest first and, within a priority, the biggest first) until the
+/// graph is under the limit again. Consumers which can't drop what they hold
+/// safely (because it belongs to a worker thread, say) only report it.
+///
+/// Nodes whose inputs are fetched by worker threads (such as threader, lock and
+/// playlist) end the walk, and slots which other threads reach (such as the
+/// input of a fork) aren't followed - the consumers upstream of them are in use
+/// by those threads, so they are neither measured nor released.
+///
+/// Memory is measured rather than charged as it's allocated, so a component
+/// which is held by more than one cache (via shallow copies of a frame) is
+/// counted by each of them - the totals are an upper bound.
+
+namespace memory {
+
+enum priority
+{
+	cache = 10,			// frames which can be fetched again from upstream
+	packets = 20,		// packets which the demuxer reads again when they're needed
+	pipeline = 100		// work in progress which is only reported
+};
+
+}
+
+class memory_consumer;
+
+/// Usage of one consumer in a graph
+struct memory_usage_type
+{
+	memory_usage_type( )
+		: consumer( 0 )
+		, bytes( 0 )
+		, priority( memory::pipeline )
+	{ }
+
+	input_type_ptr node;
+	memory_consumer *consumer;
+	boost::int64_t bytes;
+	int priority;
+};
+
+class ML_DECLSPEC memory_consumer
+{
+	public:
+		virtual ~memory_consumer( ) { }
+
+		/// Bytes currently held
+		virtual boost::int64_t memory_usage( ) const = 0;
+
+		/// Release at least the bytes requested where possible - returns the bytes released
+		virtual boost::int64_t memory_release( boost::int64_t ) { return 0; }
+
+		/// Consumers with a lower priority are asked to release first
+		virtual int memory_priority( ) const { return memory::pipeline; }
+
+		/// Append the consumers which this one uses but shares with other nodes
+		virtual void memory_shared( std::vector< memory_consumer * > & ) const { }
+
+		/// Indicates that the inputs of the node are fetched by other threads, so the walk stops here
+		virtual bool memory_threaded( ) const { return false; }
+
+		/// Indicates that the input connected to the slot is fetched by other threads, so the walk doesn't follow it
+		virtual bool memory_threaded_slot( size_t ) const { return false; }
+};
+
+/// Usage of each consumer in the graph - every node and shared consumer appears once
+extern ML_DECLSPEC void memory_report( const input_type_ptr &graph, std::vector< memory_usage_type > &result );
+
+/// Total usage of the graph
+extern ML_DECLSPEC boost::int64_t graph_memory_usage( const input_type_ptr &graph );
+
+/// Usage of a single node, including the shared consumers it uses (0 if the node isn't a consumer)
+extern ML_DECLSPEC boost::int64_t node_memory_usage( const input_type_ptr &node );
+
+/// Ask the consumers of the graph to release memory until its usage is at or below the
+/// limit - returns the usage afterwards (which may still exceed the limit)
+extern ML_DECLSPEC boost::int64_t enforce_memory_budget( const input_type_ptr &graph, boost::int64_t limit );
+
+/// Bytes held by the values which caches store
+inline boost::int64_t memory_bytes( const frame_type_ptr &frame ) { return frame ? frame->memory_usage( ) : 0; }
+inline boost::int64_t memory_bytes( const stream_type_ptr &stream ) { return stream ? boost::int64_t( stream->length( ) ) : 0; }
+inline boost::int64_t memory_bytes( const image_type_ptr &image ) { return image ? image->size( ) : 0; }
+inline boost::int64_t memory_bytes( const audio_type_ptr &audio ) { return audio ? audio->size( ) : 0; }
+
+/// Sums the bytes of the values passed to it (see cl::lru::each)
+struct memory_sum
+{
+	memory_sum( ) : bytes( 0 ) { }
+
+	template < typename V >
+	void operator ( )( const V &value ) { bytes += memory_bytes( value ); }
+
+	boost::int64_t bytes;
+};
+
+/// Bytes held by an lru
+template < typename K, typename V >
+boost::int64_t lru_memory_usage( const olib::opencorelib::lru< K, V > &lru )
+{
+	memory_sum sum;
+	lru.each( sum );
+	return sum.bytes;
+}
+
+/// Drop the least recently used values of an lru until the bytes requested are released
+/// or it's empty - returns the bytes released
+template < typename K, typename V >
+boost::int64_t lru_memory_release( olib::opencorelib::lru< K, V > &lru, boost::int64_t bytes )
+{
+	boost::int64_t released = 0;
+	while ( released < bytes && lru.count( ) > 0 )
+		released += memory_bytes( lru.pop( ) );
+	return released;
+}
+
+} } }
+
+#endif
@@ -8,6 +8,7 @@
 #include <openmedialib/ml/ml.hpp>
 #include <opencorelib/cl/thread_monitor.hpp>
 #include <opencorelib/cl/thread_cache.hpp>
+#include <cstdlib>
 
 namespace cl = olib::opencorelib;
 
@@ -18,6 +19,9 @@ ML_DECLSPEC bool init( )
 
 ML_DECLSPEC bool uninit( )
 {
+	if ( getenv( "AML_FETCH_TRACE" ) && fetch_trace_enabled( ) )
+		write_fetch_trace( std::string( getenv( "AML_FETCH_TRACE" ) ) );
+
 	indexer_shutdown( );
 	cl::thread_monitor::destroy( );
 	cl::thread_cache::destroy( );
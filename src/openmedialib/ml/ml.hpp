@@ -17,6 +17,7 @@
 #include <openmedialib/ml/store.hpp>
 #include <openmedialib/ml/utilities.hpp>
 #include <openmedialib/ml/indexer.hpp>
+#include <openmedialib/ml/statistics.hpp>
 
 namespace olib { namespace openmedialib { namespace ml {
 
@@ -0,0 +1,176 @@
+// ml - shared cache of rendered overlays
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#include <openmedialib/ml/overlay_cache.hpp>
+#include <openmedialib/ml/frame.hpp>
+
+#include <opencorelib/cl/str_util.hpp>
+
+#include <boost/thread/mutex.hpp>
+
+#include <cstdlib>
+#include <list>
+#include <map>
+
+namespace olib { namespace openmedialib { namespace ml {
+
+namespace cl = olib::opencorelib;
+
+namespace
+{
+	bool cache_enabled( )
+	{
+		static const bool enabled = getenv( "AML_OVERLAY_CACHE" ) == 0 || std::string( getenv( "AML_OVERLAY_CACHE" ) ) != "0";
+		return enabled;
+	}
+
+	struct entry_type
+	{
+		std::string key;
+		frame_type_ptr frame;
+		size_t bytes;
+	};
+
+	typedef std::list< entry_type > entry_list;
+
+	struct overlay_cache
+	{
+		overlay_cache( )
+			: limit( 64 * 1024 * 1024 )
+			, bytes( 0 )
+		{ }
+
+		// Evict the least recently used entries until the cache fits in the limit - mutex must be held
+		void trim( )
+		{
+			while ( bytes > limit && !entries.empty( ) )
+			{
+				bytes -= entries.back( ).bytes;
+				index.erase( entries.back( ).key );
+				entries.pop_back( );
+				stats.evictions ++;
+			}
+		}
+
+		boost::mutex mutex;
+		entry_list entries;
+		std::map< std::string, entry_list::iterator > index;
+		size_t limit;
+		size_t bytes;
+		overlay_cache_stats_type stats;
+	};
+
+	// Deliberately leaked so that renderers used during static destruction are safe
+	overlay_cache &cache( )
+	{
+		static overlay_cache *instance = new overlay_cache( );
+		return *instance;
+	}
+
+	size_t frame_bytes( const frame_type_ptr &frame )
+	{
+		size_t result = 0;
+		if ( frame->get_image( ) )
+			result += frame->get_image( )->size( );
+		if ( frame->get_alpha( ) )
+			result += frame->get_alpha( )->size( );
+		return result;
+	}
+}
+
+ML_DECLSPEC std::string overlay_cache_key( const std::string &renderer, const std::wstring &description )
+{
+	return renderer + ":" + cl::str_util::to_string( description );
+}
+
+ML_DECLSPEC std::string overlay_cache_key( const std::string &renderer, const std::string &description )
+{
+	return renderer + ":" + description;
+}
+
+ML_DECLSPEC frame_type_ptr overlay_cache_fetch( const std::string &key )
+{
+	if ( !cache_enabled( ) )
+		return frame_type_ptr( );
+
+	overlay_cache &c = cache( );
+	frame_type_ptr result;
+
+	{
+		boost::mutex::scoped_lock lock( c.mutex );
+		std::map< std::string, entry_list::iterator >::iterator iter = c.index.find( key );
+
+		if ( iter == c.index.end( ) )
+		{
+			c.stats.misses ++;
+			return result;
+		}
+
+		// Move to the front of the lru list
+		c.entries.splice( c.entries.begin( ), c.entries, iter->second );
+		result = iter->second->frame;
+		c.stats.hits ++;
+	}
+
+	return result->shallow( );
+}
+
+ML_DECLSPEC void overlay_cache_insert( const std::string &key, const frame_type_ptr &frame )
+{
+	if ( !cache_enabled( ) || !frame || !frame->get_image( ) )
+		return;
+
+	// The cache holds its own copy so that later changes to the caller's frame aren't seen
+	entry_type entry;
+	entry.key = key;
+	entry.frame = frame->shallow( );
+	entry.bytes = frame_bytes( frame );
+
+	overlay_cache &c = cache( );
+	boost::mutex::scoped_lock lock( c.mutex );
+
+	std::map< std::string, entry_list::iterator >::iterator iter = c.index.find( key );
+	if ( iter != c.index.end( ) )
+	{
+		c.bytes -= iter->second->bytes;
+		c.entries.erase( iter->second );
+		c.index.erase( iter );
+	}
+
+	c.entries.push_front( entry );
+	c.index[ key ] = c.entries.begin( );
+	c.bytes += entry.bytes;
+	c.stats.insertions ++;
+	c.trim( );
+}
+
+ML_DECLSPEC overlay_cache_stats_type overlay_cache_stats( )
+{
+	overlay_cache &c = cache( );
+	boost::mutex::scoped_lock lock( c.mutex );
+	overlay_cache_stats_type result = c.stats;
+	result.entries = boost::int64_t( c.entries.size( ) );
+	result.bytes = boost::int64_t( c.bytes );
+	return result;
+}
+
+ML_DECLSPEC void overlay_cache_set_limit( size_t bytes )
+{
+	overlay_cache &c = cache( );
+	boost::mutex::scoped_lock lock( c.mutex );
+	c.limit = bytes;
+	c.trim( );
+}
+
+ML_DECLSPEC void overlay_cache_clear( )
+{
+	overlay_cache &c = cache( );
+	boost::mutex::scoped_lock lock( c.mutex );
+	c.entries.clear( );
+	c.index.clear( );
+	c.bytes = 0;
+}
+
+} } }
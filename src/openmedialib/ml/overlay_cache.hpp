@@ -0,0 +1,78 @@
+// ml - shared cache of rendered overlays
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#ifndef AML_OVERLAY_CACHE_H_
+#define AML_OVERLAY_CACHE_H_
+
+#include <openmedialib/ml/config.hpp>
+#include <openmedialib/ml/types.hpp>
+#include <boost/cstdint.hpp>
+#include <cstddef>
+#include <string>
+
+namespace olib { namespace openmedialib { namespace ml {
+
+// Titles, lower thirds and clocks rasterise the same few documents over and
+// over again, so the frames produced by the text and svg renderers are kept
+// in a process wide cache rather than rendered for each use.
+//
+// The key is a string which describes everything the render depends on (the
+// document or text, font, size, colours, geometry and the pixel format the
+// overlay was converted to) - the renderers build it with overlay_cache_key.
+// Cached frames hold the overlay ready for the compositor (ie: already
+// converted to the pixel format of the background with the alpha separated),
+// and must not be modified - overlay_cache_fetch returns a shallow copy, so
+// the frame's properties, position and so on can be changed freely.
+//
+// The cache is bounded by the bytes of the images and alpha masks it holds
+// and the least recently used entries are evicted first. Setting the
+// AML_OVERLAY_CACHE environment variable to 0 disables it.
+
+struct overlay_cache_stats_type
+{
+	overlay_cache_stats_type( )
+		: hits( 0 )
+		, misses( 0 )
+		, insertions( 0 )
+		, evictions( 0 )
+		, entries( 0 )
+		, bytes( 0 )
+	{ }
+
+	// Lookups which found (or didn't find) the overlay
+	boost::int64_t hits;
+	boost::int64_t misses;
+
+	// Overlays added to and evicted from the cache
+	boost::int64_t insertions;
+	boost::int64_t evictions;
+
+	// Overlays and image bytes currently held
+	boost::int64_t entries;
+	boost::int64_t bytes;
+};
+
+// Compose a cache key from the renderer name and the values which describe the render
+extern ML_DECLSPEC std::string overlay_cache_key( const std::string &renderer, const std::wstring &description );
+extern ML_DECLSPEC std::string overlay_cache_key( const std::string &renderer, const std::string &description );
+
+// Obtain a shallow copy of the cached overlay (an empty pointer on a miss)
+extern ML_DECLSPEC frame_type_ptr overlay_cache_fetch( const std::string &key );
+
+// Add the overlay to the cache - it may be evicted immediately if it exceeds the limit
+extern ML_DECLSPEC void overlay_cache_insert( const std::string &key, const frame_type_ptr &frame );
+
+// Snapshot of the cache counters
+extern ML_DECLSPEC overlay_cache_stats_type overlay_cache_stats( );
+
+// Maximum bytes held by the cache (defaults to 64MB)
+extern ML_DECLSPEC void overlay_cache_set_limit( size_t bytes );
+
+// Remove everything from the cache
+extern ML_DECLSPEC void overlay_cache_clear( );
+
+} } }
+
+#endif
@@ -79,6 +79,50 @@ namespace olib { namespace openmedialib { namespace ml {
     {
         insert_resource( pos, i, images_ );
     }
+
+    namespace
+    {
+        template< typename T >
+        boost::int64_t map_memory( const std::map< lru_cache_type::key_type, T > &resource_map )
+        {
+            boost::int64_t result = 0;
+            for( typename std::map< lru_cache_type::key_type, T >::const_iterator it = resource_map.begin(); it != resource_map.end(); ++it )
+                result += memory_bytes( it->second );
+            return result;
+        }
+
+        template< typename T >
+        boost::int64_t erase_memory( const lru_cache_type::key_type &pos, std::map< lru_cache_type::key_type, T > &resource_map )
+        {
+            typename std::map< lru_cache_type::key_type, T >::iterator it = resource_map.find( pos );
+            if( it == resource_map.end() )
+                return 0;
+            boost::int64_t result = memory_bytes( it->second );
+            resource_map.erase( it );
+            return result;
+        }
+    }
+
+    boost::int64_t lru_cache_type::memory_usage( ) const
+    {
+        boost::mutex::scoped_lock lck( mutex_ );
+        return map_memory( frames_ ) + map_memory( images_ ) + map_memory( audios_ );
+    }
+
+    boost::int64_t lru_cache_type::memory_release( boost::int64_t bytes )
+    {
+        boost::mutex::scoped_lock lck( mutex_ );
+
+        boost::int64_t released = 0;
+        while( released < bytes && !lru_.empty() )
+        {
+            key_type k = lru_.back();
+            lru_.pop_back();
+            released += erase_memory( k, frames_ ) + erase_memory( k, audios_ ) + erase_memory( k, images_ );
+        }
+
+        return released;
+    }
     
 } /* ml */
 } /* openmedialib */
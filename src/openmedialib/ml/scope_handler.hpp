@@ -8,6 +8,7 @@
 #define LOKI_CLASS_LEVEL_THREADING
 #include <loki/Singleton.h>
 #include <openmedialib/ml/frame.hpp>
+#include <openmedialib/ml/memory_budget.hpp>
 #include <list>
 #include <map>
 #include <boost/thread.hpp>
@@ -15,7 +16,7 @@
 
 namespace olib { namespace openmedialib { namespace ml {
 
-class ML_DECLSPEC lru_cache_type : public boost::noncopyable
+class ML_DECLSPEC lru_cache_type : public boost::noncopyable, public memory_consumer
 {
 public:
     
@@ -40,6 +41,14 @@ public:
 		audios_.clear( );
 	}
 
+	/// Bytes held by the cached frames, images and audio
+	boost::int64_t memory_usage( ) const;
+
+	/// Drop the least recently used positions until the bytes requested are released
+	boost::int64_t memory_release( boost::int64_t bytes );
+
+	int memory_priority( ) const { return memory::cache; }
+
 private:
     
     void used( const key_type & pos );
@@ -62,10 +71,12 @@ private:
             
         if( map_it == resource_map.end() )
         {
+            olib::opencorelib::lru_statistics::miss( );
             return T();
         }
         else
         {
+            olib::opencorelib::lru_statistics::hit( );
             used( pos );
             return map_it->second;
         }
@@ -78,7 +89,7 @@ private:
     
     std::list< key_type > lru_;
     
-    boost::mutex mutex_;
+    mutable boost::mutex mutex_;
     
 };
 
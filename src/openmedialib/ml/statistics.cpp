@@ -0,0 +1,287 @@
+// ml - A media library representation.
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#include <openmedialib/ml/statistics.hpp>
+#include <openmedialib/ml/input.hpp>
+#include <openmedialib/ml/frame.hpp>
+
+#include <opencorelib/cl/str_util.hpp>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <time.h>
+#endif
+
+namespace olib { namespace openmedialib { namespace ml {
+
+namespace cl = olib::opencorelib;
+
+namespace
+{
+	// Determines if an environment variable is set to a non-zero value
+	bool env_enabled( const char *name )
+	{
+		const char *value = getenv( name );
+		return value != 0 && *value != '\0' && std::string( value ) != "0";
+	}
+
+	// Trace event as recorded when tracing is enabled
+	struct trace_event
+	{
+		std::string name;
+		int thread;
+		int position;
+		boost::int64_t start;
+		boost::int64_t duration;
+	};
+
+	volatile bool fetch_trace_enabled_ = getenv( "AML_FETCH_TRACE" ) != 0;
+	volatile bool fetch_stats_enabled_ = fetch_trace_enabled_ || env_enabled( "AML_FETCH_STATS" );
+
+	boost::mutex allocation_mutex_;
+	allocation_stats_type allocation_stats_;
+
+	// Per thread stack of the upstream time accumulated by the active fetches
+	boost::thread_specific_ptr< std::vector< boost::int64_t > > fetch_stack_;
+
+	boost::mutex trace_mutex_;
+	std::vector< trace_event > trace_events_;
+	size_t trace_limit_ = 1000000;
+	boost::int64_t trace_dropped_ = 0;
+	int trace_threads_ = 0;
+	boost::thread_specific_ptr< int > trace_thread_;
+
+	// Obtain a small integer which identifies the calling thread in the trace
+	int trace_thread_id( )
+	{
+		if ( trace_thread_.get( ) == 0 )
+		{
+			boost::mutex::scoped_lock lock( trace_mutex_ );
+			trace_thread_.reset( new int( ++ trace_threads_ ) );
+		}
+		return *trace_thread_;
+	}
+
+	void record_trace( input_type *input, boost::int64_t start, boost::int64_t duration )
+	{
+		trace_event event;
+		event.name = cl::str_util::to_string( input->get_uri( ) );
+		event.thread = trace_thread_id( );
+		event.position = input->get_position( );
+		event.start = start;
+		event.duration = duration;
+
+		boost::mutex::scoped_lock lock( trace_mutex_ );
+		if ( trace_events_.size( ) < trace_limit_ )
+			trace_events_.push_back( event );
+		else
+			trace_dropped_ ++;
+	}
+
+	std::string json_escape( const std::string &value )
+	{
+		std::string result;
+		for ( std::string::const_iterator i = value.begin( ); i != value.end( ); ++i )
+		{
+			if ( *i == '"' || *i == '\\' )
+				result += '\\';
+			if ( ( unsigned char )*i < 0x20 )
+				result += ' ';
+			else
+				result += *i;
+		}
+		return result;
+	}
+
+	void collect( input_type_ptr input, const std::string &path, std::set< input_type * > &visited, fetch_stats_list &result )
+	{
+		if ( !input || visited.find( input.get( ) ) != visited.end( ) )
+			return;
+
+		visited.insert( input.get( ) );
+
+		fetch_stats_node node;
+		node.path = path;
+		node.input = input;
+		node.stats = input->fetch_stats( );
+		result.push_back( node );
+
+		for ( size_t i = 0; i < input->slot_count( ); i ++ )
+		{
+			std::ostringstream slot;
+			slot << path << "." << i;
+			collect( input->fetch_slot( i ), slot.str( ), visited, result );
+		}
+	}
+
+	void reset( input_type_ptr input, std::set< input_type * > &visited )
+	{
+		if ( !input || visited.find( input.get( ) ) != visited.end( ) )
+			return;
+
+		visited.insert( input.get( ) );
+		input->reset_fetch_stats( );
+
+		for ( size_t i = 0; i < input->slot_count( ); i ++ )
+			reset( input->fetch_slot( i ), visited );
+	}
+}
+
+ML_DECLSPEC void enable_fetch_stats( bool enable )
+{
+	fetch_stats_enabled_ = enable;
+}
+
+ML_DECLSPEC bool fetch_stats_enabled( )
+{
+	return fetch_stats_enabled_;
+}
+
+ML_DECLSPEC boost::int64_t fetch_stats_clock( )
+{
+#ifdef WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency( &frequency );
+	QueryPerformanceCounter( &counter );
+	return boost::int64_t( counter.QuadPart / ( frequency.QuadPart / 1000000.0 ) );
+#elif defined( CLOCK_MONOTONIC )
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return boost::int64_t( now.tv_sec ) * 1000000 + now.tv_nsec / 1000;
+#else
+	struct timeval now;
+	gettimeofday( &now, NULL );
+	return boost::int64_t( now.tv_sec ) * 1000000 + now.tv_usec;
+#endif
+}
+
+ML_DECLSPEC boost::int64_t fetch_begin( )
+{
+	std::vector< boost::int64_t > *stack = fetch_stack_.get( );
+	if ( stack == 0 )
+	{
+		stack = new std::vector< boost::int64_t >( );
+		fetch_stack_.reset( stack );
+	}
+	stack->push_back( 0 );
+	return fetch_stats_clock( );
+}
+
+ML_DECLSPEC fetch_sample_type fetch_end( input_type *input, boost::int64_t start )
+{
+	fetch_sample_type result;
+	result.inclusive = fetch_stats_clock( ) - start;
+	result.exclusive = result.inclusive;
+
+	// Stats may have been enabled while this fetch was active
+	std::vector< boost::int64_t > *stack = fetch_stack_.get( );
+	if ( stack && !stack->empty( ) )
+	{
+		result.exclusive -= stack->back( );
+		stack->pop_back( );
+		if ( !stack->empty( ) )
+			stack->back( ) += result.inclusive;
+	}
+
+	if ( fetch_trace_enabled_ )
+		record_trace( input, start, result.inclusive );
+
+	return result;
+}
+
+ML_DECLSPEC fetch_stats_list collect_fetch_stats( input_type_ptr graph )
+{
+	fetch_stats_list result;
+	std::set< input_type * > visited;
+	collect( graph, "0", visited, result );
+	return result;
+}
+
+ML_DECLSPEC void reset_fetch_stats( input_type_ptr graph )
+{
+	std::set< input_type * > visited;
+	reset( graph, visited );
+}
+
+ML_DECLSPEC void enable_fetch_trace( bool enable, size_t max_events )
+{
+	boost::mutex::scoped_lock lock( trace_mutex_ );
+	trace_limit_ = max_events;
+	fetch_trace_enabled_ = enable;
+	if ( enable )
+		fetch_stats_enabled_ = true;
+}
+
+ML_DECLSPEC bool fetch_trace_enabled( )
+{
+	return fetch_trace_enabled_;
+}
+
+ML_DECLSPEC void clear_fetch_trace( )
+{
+	boost::mutex::scoped_lock lock( trace_mutex_ );
+	trace_events_.clear( );
+	trace_dropped_ = 0;
+}
+
+ML_DECLSPEC bool write_fetch_trace( std::ostream &stream )
+{
+	boost::mutex::scoped_lock lock( trace_mutex_ );
+
+	stream << "{\"traceEvents\":[" << std::endl;
+	for ( std::vector< trace_event >::const_iterator i = trace_events_.begin( ); i != trace_events_.end( ); ++i )
+	{
+		stream << ( i != trace_events_.begin( ) ? "," : "" )
+			   << "{\"name\":\"" << json_escape( i->name ) << "\",\"cat\":\"fetch\",\"ph\":\"X\""
+			   << ",\"ts\":" << i->start << ",\"dur\":" << i->duration
+			   << ",\"pid\":1,\"tid\":" << i->thread
+			   << ",\"args\":{\"position\":" << i->position << "}}" << std::endl;
+	}
+	stream << "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" << trace_dropped_ << "}}" << std::endl;
+
+	return stream.good( );
+}
+
+ML_DECLSPEC bool write_fetch_trace( const std::string &file )
+{
+	std::ofstream stream( file.c_str( ) );
+	return stream.good( ) && write_fetch_trace( stream );
+}
+
+ML_DECLSPEC void count_image_allocation( size_t bytes )
+{
+	if ( !fetch_stats_enabled_ )
+		return;
+	boost::mutex::scoped_lock lock( allocation_mutex_ );
+	allocation_stats_.images ++;
+	allocation_stats_.image_bytes += bytes;
+}
+
+ML_DECLSPEC void count_audio_allocation( size_t bytes )
+{
+	if ( !fetch_stats_enabled_ )
+		return;
+	boost::mutex::scoped_lock lock( allocation_mutex_ );
+	allocation_stats_.audios ++;
+	allocation_stats_.audio_bytes += bytes;
+}
+
+ML_DECLSPEC allocation_stats_type allocation_stats( )
+{
+	boost::mutex::scoped_lock lock( allocation_mutex_ );
+	return allocation_stats_;
+}
+
+} } }
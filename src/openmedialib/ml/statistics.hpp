@@ -0,0 +1,154 @@
+// ml - A media library representation.
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#ifndef OPENMEDIALIB_STATISTICS_INC_
+#define OPENMEDIALIB_STATISTICS_INC_
+
+#include <openmedialib/ml/config.hpp>
+#include <openmedialib/ml/types.hpp>
+#include <boost/cstdint.hpp>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace olib { namespace openmedialib { namespace ml {
+
+// Per node fetch instrumentation - statistics are only gathered while enabled
+// via enable_fetch_stats or by setting the AML_FETCH_STATS environment 
+// variable to a non-zero value. When disabled, the cost to input_type::fetch
+// is a single flag test. 
+//
+// Times are measured on a monotonic clock in microseconds. Inclusive time is 
+// the time spent in a node's fetch, including the fetches of the upstream 
+// nodes it invokes on the same thread. Exclusive time excludes those upstream
+// fetches - work done by upstream nodes on other threads (such as those driven
+// by the threader or distributor filters) is accounted to those nodes, but not
+// subtracted from the downstream node.
+
+struct fetch_stats_type
+{
+	fetch_stats_type( )
+		: calls( 0 )
+		, elapsed( 0 )
+		, self( 0 )
+		, maximum( 0 )
+		, image_bytes( 0 )
+		, audio_bytes( 0 )
+	{ }
+
+	// Number of fetches made
+	boost::int64_t calls;
+
+	// Total inclusive time in microseconds
+	boost::int64_t elapsed;
+
+	// Total exclusive time in microseconds
+	boost::int64_t self;
+
+	// Longest single inclusive fetch in microseconds
+	boost::int64_t maximum;
+
+	// Bytes of image data in the frames produced
+	boost::int64_t image_bytes;
+
+	// Bytes of audio data in the frames produced
+	boost::int64_t audio_bytes;
+};
+
+// Timing of a single fetch as returned by fetch_end
+struct fetch_sample_type
+{
+	boost::int64_t inclusive;
+	boost::int64_t exclusive;
+};
+
+// The statistics of a node as obtained by collect_fetch_stats - the path 
+// identifies the node by the slots traversed from the root of the graph 
+// (ie: "0.1.0" is the first slot of the second slot of the root).
+struct fetch_stats_node
+{
+	std::string path;
+	input_type_ptr input;
+	fetch_stats_type stats;
+};
+
+typedef std::vector< fetch_stats_node > fetch_stats_list;
+
+// Turn the collection of fetch statistics on or off globally
+ML_DECLSPEC void enable_fetch_stats( bool enable );
+
+// Determine if fetch statistics are being collected
+ML_DECLSPEC bool fetch_stats_enabled( );
+
+// Monotonic clock in microseconds used for fetch statistics
+ML_DECLSPEC boost::int64_t fetch_stats_clock( );
+
+// Marks the start of a fetch on the calling thread and returns the start time 
+// (only to be used when fetch statistics are enabled)
+ML_DECLSPEC boost::int64_t fetch_begin( );
+
+// Marks the end of the fetch started at the time given - the node is used to
+// record trace events when tracing
+ML_DECLSPEC fetch_sample_type fetch_end( input_type *input, boost::int64_t start );
+
+// Walk the graph and obtain the statistics of each node - nodes which are 
+// connected more than once are only reported once
+ML_DECLSPEC fetch_stats_list collect_fetch_stats( input_type_ptr graph );
+
+// Walk the graph and reset the statistics of each node
+ML_DECLSPEC void reset_fetch_stats( input_type_ptr graph );
+
+// Turn the recording of trace events on or off - enabling tracing implicitly
+// enables fetch statistics. Setting the AML_FETCH_TRACE environment variable
+// to a file name enables tracing for the life time of the process and the 
+// trace is written to that file on ml::uninit.
+ML_DECLSPEC void enable_fetch_trace( bool enable, size_t max_events = 1000000 );
+
+// Determine if trace events are being recorded
+ML_DECLSPEC bool fetch_trace_enabled( );
+
+// Discard all recorded trace events
+ML_DECLSPEC void clear_fetch_trace( );
+
+// Write the recorded trace events in the Chrome trace event format (as used
+// by chrome://tracing and compatible timeline viewers)
+ML_DECLSPEC bool write_fetch_trace( std::ostream &stream );
+
+// Write the recorded trace events to a file
+ML_DECLSPEC bool write_fetch_trace( const std::string &file );
+
+// Process wide counters of image and audio buffer allocations - only 
+// maintained while fetch statistics are enabled, since audio buffers are 
+// normally recycled by the pool (see audio_pool.hpp) and a lock per buffer
+// would cost more than the allocation itself.
+
+struct allocation_stats_type
+{
+	allocation_stats_type( )
+		: images( 0 )
+		, image_bytes( 0 )
+		, audios( 0 )
+		, audio_bytes( 0 )
+	{ }
+
+	boost::int64_t images;
+	boost::int64_t image_bytes;
+	boost::int64_t audios;
+	boost::int64_t audio_bytes;
+};
+
+// Record an image buffer allocation
+ML_DECLSPEC void count_image_allocation( size_t bytes );
+
+// Record an audio buffer allocation
+ML_DECLSPEC void count_audio_allocation( size_t bytes );
+
+// Obtain a snapshot of the allocation counters
+ML_DECLSPEC allocation_stats_type allocation_stats( );
+
+} } }
+
+#endif
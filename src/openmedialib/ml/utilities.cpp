@@ -20,12 +20,14 @@
 
 #include <openmedialib/ml/types.hpp>
 #include <openmedialib/ml/audio.hpp>
+#include <openmedialib/ml/audio_resampler.hpp>
 #include <openmedialib/ml/ml.hpp>
 #include <openmedialib/ml/openmedialib_plugin.hpp>
 #include <openmedialib/ml/input_creator_handler.hpp>
 
 #include <openpluginlib/pl/openpluginlib.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <cstdlib>
 #include <deque>
 
 namespace pl = olib::openpluginlib;
@@ -109,10 +111,21 @@ static boost::recursive_mutex mutex_;
 
 typedef boost::recursive_mutex::scoped_lock scoped_lock;
 
+// Plugins are resolved through the openpluginlib cache unless AML_PLUGIN_CACHE is set to 0
+static bool plugin_cache_enabled( )
+{
+	static const bool enabled = getenv( "AML_PLUGIN_CACHE" ) == 0 || std::string( getenv( "AML_PLUGIN_CACHE" ) ) != "0";
+	return enabled;
+}
+
 // Retrieve the first plugin which matches the resource and type (input or output)
 static openmedialib_plugin_ptr get_plug( const std::wstring &resource, const std::wstring type )
 {
+	if ( plugin_cache_enabled( ) )
+		return boost::dynamic_pointer_cast< openmedialib_plugin >( pl::resolve_plugin( L"openmedialib", type, resource ) );
+
 	typedef pl::discovery< ml_query_traits > discovery;
+	scoped_lock lock( mutex_ );
 	openmedialib_plugin_ptr result = openmedialib_plugin_ptr( );
 	ml_query_traits query( resource, type );
 	discovery plugins( query );
@@ -124,7 +137,6 @@ static openmedialib_plugin_ptr get_plug( const std::wstring &resource, const std
 // Check if a plugin is avaialble
 ML_DECLSPEC bool has_plugin_for( const std::wstring &resource, const std::wstring &type )
 {
-	scoped_lock lock( mutex_ );
 	openmedialib_plugin_ptr plug = get_plug( resource, type );
 	return plug != 0;
 }
@@ -132,7 +144,6 @@ ML_DECLSPEC bool has_plugin_for( const std::wstring &resource, const std::wstrin
 // Return the first matching input object
 ML_DECLSPEC input_type_ptr create_delayed_input( const std::wstring &resource )
 {
-	scoped_lock lock( mutex_ );
 	PL_LOG( pl::level::debug5, boost::format( "Looking for a plugin for: %1%" ) % cl::str_util::to_string( resource ) );
 	
 	input_creator_ptr creator = the_input_creator_handler::instance( ).input_creator_for_id( cl::str_util::to_t_string( resource ) );
@@ -144,8 +155,14 @@ ML_DECLSPEC input_type_ptr create_delayed_input( const std::wstring &resource )
 	
 	openmedialib_plugin_ptr plug = get_plug( resource, L"input" );
 	if ( plug == 0 )
+	{
 		PL_LOG( pl::level::error, boost::format( "Failed to find a plugin for: %1%" ) % cl::str_util::to_string( resource ) );
-	return plug == 0 ? input_type_ptr( ) : plug->input( resource );
+		return input_type_ptr( );
+	}
+
+	// The lookup is lock free, but inputs are still constructed one at a time
+	scoped_lock lock( mutex_ );
+	return plug->input( resource );
 }
 
 // Return the first matching input object
@@ -203,70 +220,8 @@ ML_DECLSPEC audio_type_ptr audio_resample(const audio_type_ptr& input_audio, int
 	if(input_audio->frequency() == sampling_freq)
 		return input_audio;
 	
-	int		samples_in			= input_audio->samples(),
-			channels_in			= input_audio->channels();
-	
-	double	num_samples			= (double(samples_in) * sampling_freq) / input_audio->frequency();
-	int		num_samples_rounded	= int(0.5 + num_samples);
-	
-	audio::pcm16_ptr output_audio = audio::pcm16_ptr(new audio::pcm16(sampling_freq, channels_in, num_samples_rounded, false));
-	
-	double ratio = double(samples_in) / num_samples;
-	
-	// This means of interpolation assumes that the first sample of input and output are in sync
-	// The reality is that this is unlikely.
-	
-	short	*in_ptr		= ((short*)input_audio->pointer()),
-			*out_ptr	= ((short*)output_audio->pointer());
-			
-	double	offset			= 0.0,
-			delta_offset	= 0.0;
-	int 	offset_rounded	= 0;
-	short	sample_a		= 0,
-			sample_b		= 0;
-	
-//#define USE_LP_FILTER
-#ifdef USE_LP_FILTER	
-	// upfront filter calcs
-	const double	cutoff_to_fs_ratio	= 0.5;
-	const double	exponent			= exp(-2.0 * M_PI * cutoff_to_fs_ratio);
-	const double	one_minus_exponent	= 1 - exponent;
-#endif
-	
-	for(int sample_idx = 0; sample_idx < num_samples_rounded; ++sample_idx)
-	{
-		for(int channel_idx = 0; channel_idx < channels_in; ++channel_idx)
-		{
-			if(sample_idx == 0)
-#ifndef USE_LP_FILTER
-				*(out_ptr + channel_idx) = *(in_ptr + channel_idx);
-#else
-				*(out_ptr + channel_idx) = short(one_minus_exponent * *(in_ptr + channel_idx));
-#endif
-			else
-			{
-				offset			= ratio * sample_idx;	// Number of input samples from 1st sample
-				offset_rounded	= int(offset);			// Number of input samples from 1st sample rounded down
-				delta_offset	= fmod(offset, 1);
-				
-				if(offset + 1.0 > double(samples_in))
-					*(out_ptr + (sample_idx * channels_in) + channel_idx) = *(in_ptr + ((samples_in - 1) * channels_in) + channel_idx);
-				else
-				{
-					sample_a = *(in_ptr + (offset_rounded * channels_in) + channel_idx);
-					sample_b = *(in_ptr + ((offset_rounded + 1) * channels_in) + channel_idx);
-					
-#ifndef USE_LP_FILTER					
-					*(out_ptr + (sample_idx * channels_in) + channel_idx) = short(sample_a + (delta_offset * (sample_b - sample_a)) + 0.5);
-#else
-					*(out_ptr + (sample_idx * channels_in) + channel_idx) = short(one_minus_exponent * (sample_a + (delta_offset * (sample_b - sample_a))) + exponent * *(out_ptr + ((sample_idx - 1) * channels_in) + channel_idx) + 0.5);
-#endif					
-				}
-			}
-		}
-	}
-	
-	return output_audio;
+	// The result has always been pcm16
+	return audio::coerce( audio::pcm16_id, audio::resample( input_audio, sampling_freq ) );
 }
 
 ML_DECLSPEC frame_type_ptr frame_rescale( rescale_object_ptr ro, frame_type_ptr frame, image::geometry &shape )
@@ -44,6 +44,7 @@ extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_hold( const std::wstring &
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_invert( const std::wstring & );
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_locked_audio( const std::wstring & );
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_loop( const std::wstring & );
+extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_memory_budget( const std::wstring & );
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_mix_matrix( const std::wstring & );
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_mono( const std::wstring & );
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_montage( const std::wstring & );
@@ -54,6 +55,7 @@ extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_offset( const std::wstring
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_pitch( const std::wstring & );
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_pulldown( const std::wstring & );
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_repeat( const std::wstring & );
+extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_resample( const std::wstring & );
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_sar( const std::wstring & );
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_sleep( const std::wstring & );
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_slots( const std::wstring & );
@@ -65,6 +67,7 @@ extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_transport( const std::wstri
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_volume( const std::wstring & );
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_pass( const std::wstring & );
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_remove( const std::wstring & );
+extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_renditions( const std::wstring & );
 extern ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_evaluate( const std::wstring & );
 
 //
@@ -131,6 +134,8 @@ public:
 			return create_locked_audio( resource );
 		if ( resource == L"loop" )
 			return create_loop( resource );
+		if ( resource == L"memory_budget" )
+			return create_memory_budget( resource );
 		if ( resource == L"mix_matrix" )
 			return create_mix_matrix( resource );
 		if ( resource == L"mono" )
@@ -151,6 +156,8 @@ public:
 			return create_pulldown( resource );
 		if ( resource == L"repeat" )
 			return create_repeat( resource );
+		if ( resource == L"resample" )
+			return create_resample( resource );
 		if ( resource == L"sar" )
 			return create_sar( resource );
 		if ( resource == L"sleep" )
@@ -173,6 +180,8 @@ public:
 			return create_pass( resource );
 		if ( resource == L"remove" )
 			return create_remove( resource );
+		if ( resource == L"renditions" )
+			return create_renditions( resource );
 		if ( resource == L"evaluate" )
 			return create_evaluate( resource );
 
@@ -13,12 +13,33 @@
 // filter:extract frames=3
 //
 // Will provide 3 frames from file.mpg (first, middle and last).
+//
+// Properties:
+//
+//	frames=n (default 180)
+//		Number of frames to extract.
+//	keyframes=0|1 (default 0)
+//		When 1, each frame is moved back to the nearest key frame so that only
+//		intra pictures need to be decoded - intended for storyboards and
+//		thumbnails where exact frame accuracy isn't required.
+//	index=url (default "")
+//		Awi index used to locate the key frames - without it, the key frame
+//		is taken from the packet at the position, which costs an extra seek
+//		and fetch per frame.
+//	threads=n (default 0)
+//		When greater than 1, the following frames are fetched in batches of 2n
+//		and their images decoded on n threads (this requires lazily decoded
+//		frames, as provided by filter:decode).
 
 #include "precompiled_headers.hpp"
 #include "amf_filter_plugin.hpp"
 #include "utility.hpp"
 
+#include <openmedialib/ml/indexer.hpp>
+
 #include <iostream>
+#include <map>
+#include <vector>
 
 namespace aml { namespace openmedialib {
 
@@ -28,8 +49,15 @@ class ML_PLUGIN_DECLSPEC filter_extract : public ml::filter_type
 		filter_extract( const std::wstring & )
 			: filter_type( )
 			, prop_frames_( pcos::key::from_string( "frames" ) )
+			, prop_keyframes_( pcos::key::from_string( "keyframes" ) )
+			, prop_index_( pcos::key::from_string( "index" ) )
+			, prop_threads_( pcos::key::from_string( "threads" ) )
+			, index_requested_( false )
 		{
 			properties( ).append( prop_frames_ = 180 );
+			properties( ).append( prop_keyframes_ = 0 );
+			properties( ).append( prop_index_ = std::wstring( L"" ) );
+			properties( ).append( prop_threads_ = 0 );
 		}
 
 		// Indicates if the input will enforce a packet decode
@@ -51,18 +79,81 @@ class ML_PLUGIN_DECLSPEC filter_extract : public ml::filter_type
 
 			if ( input && input->get_frames( ) > 0 )
 			{
-				int length = input->get_frames( );
-				int position = 0;
-				if ( prop_frames_.value< int >( ) > 1 )
-					position = int( ( double( get_position( ) ) / ( prop_frames_.value< int >( ) - 1 ) ) * length );
-				input->seek( position );
-				result = input->fetch( );
+				const int threads = prop_threads_.value< int >( );
+
+				if ( threads > 1 && input->is_thread_safe( ) )
+					result = fetch_batched( input, threads );
+
+				if ( !result )
+				{
+					input->seek( source_position( input, get_position( ) ) );
+					result = input->fetch( );
+				}
+
 				result->set_position( get_position( ) );
 			}
 		}
 
+		// Position in the input of the frame at position
+		int source_position( const ml::input_type_ptr &input, int position )
+		{
+			int length = input->get_frames( );
+			int result = 0;
+			if ( prop_frames_.value< int >( ) > 1 )
+				result = int( ( double( position ) / ( prop_frames_.value< int >( ) - 1 ) ) * length );
+
+			if ( prop_keyframes_.value< int >( ) )
+			{
+				if ( !index_requested_ && prop_index_.value< std::wstring >( ) != L"" )
+				{
+					index_requested_ = true;
+					indexer_item_ = ml::indexer_request( prop_index_.value< std::wstring >( ), ml::index_type::awi );
+				}
+
+				result = key_frame_of( input, std::min< int >( result, length - 1 ), indexer_item_ ? indexer_item_->index( ) : ml::awi_index_ptr( ) );
+			}
+
+			return result;
+		}
+
+		// The frame at the current position from the batch (fetching the next batch if needed) - 
+		// null if the batch doesn't provide it
+		ml::frame_type_ptr fetch_batched( const ml::input_type_ptr &input, int threads )
+		{
+			std::map< int, ml::frame_type_ptr >::const_iterator iter = batch_.find( get_position( ) );
+			if ( iter == batch_.end( ) )
+			{
+				fetch_batch( input, threads );
+				iter = batch_.find( get_position( ) );
+			}
+			return iter != batch_.end( ) && iter->second ? iter->second->shallow( ) : ml::frame_type_ptr( );
+		}
+
+		// Fetch the frames of the next 2 * threads positions and decode their images in parallel
+		void fetch_batch( const ml::input_type_ptr &input, int threads )
+		{
+			std::vector< ml::frame_type_ptr > frames;
+			batch_.clear( );
+
+			for ( int position = get_position( ); position < get_frames( ) && int( frames.size( ) ) < 2 * threads; position ++ )
+			{
+				input->seek( source_position( input, position ) );
+				ml::frame_type_ptr frame = input->fetch( );
+				batch_[ position ] = frame;
+				frames.push_back( frame );
+			}
+
+			evaluate_images( frames, threads );
+		}
+
 	private:
 		pl::pcos::property prop_frames_;
+		pl::pcos::property prop_keyframes_;
+		pl::pcos::property prop_index_;
+		pl::pcos::property prop_threads_;
+		bool index_requested_;
+		ml::indexer_item_ptr indexer_item_;
+		std::map< int, ml::frame_type_ptr > batch_;
 };
 
 ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_extract( const std::wstring &resource )
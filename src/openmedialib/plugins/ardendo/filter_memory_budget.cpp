@@ -0,0 +1,97 @@
+// Memory budget filter
+//
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+//
+// #filter:memory_budget
+//
+// Keeps the memory held by the caches and queues of the connected graph
+// within a limit (see ml/memory_budget.hpp). After each fetch, the usage of
+// the graph is measured and, when it exceeds the limit, the caches are asked
+// to drop their least recently used content - frame caches first, then the
+// demuxers' packet caches. Read ahead queues which belong to worker threads
+// are counted but never shrunk, so the usage can remain above the limit, and
+// the graph upstream of a threader (or other node whose input is fetched by
+// worker threads) isn't measured at all.
+//
+// Properties:
+//
+//   limit [int64, default 0]
+//     The budget in bytes - 0 only measures the usage.
+//
+//   usage [int64, read only]
+//     Bytes held by the graph after the last fetch.
+//
+//   peak [int64, read only]
+//     The highest usage measured (before enforcement).
+//
+// Example:
+//
+// file.mxf
+// filter:frame_rate fps_num=30000 fps_den=1001
+// filter:memory_budget limit=536870912
+
+#include "precompiled_headers.hpp"
+#include "amf_filter_plugin.hpp"
+
+#include <openmedialib/ml/memory_budget.hpp>
+
+namespace aml { namespace openmedialib {
+
+class ML_PLUGIN_DECLSPEC filter_memory_budget : public ml::filter_simple
+{
+	public:
+		filter_memory_budget( )
+			: ml::filter_simple( )
+			, prop_limit_( pcos::key::from_string( "limit" ) )
+			, prop_usage_( pcos::key::from_string( "usage" ) )
+			, prop_peak_( pcos::key::from_string( "peak" ) )
+		{
+			properties( ).append( prop_limit_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_usage_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_peak_ = boost::int64_t( 0 ) );
+		}
+
+		// Indicates if the input will enforce a packet decode
+		virtual bool requires_image( ) const { return false; }
+
+		// This provides the name of the plugin (used in serialisation)
+		virtual const std::wstring get_uri( ) const { return L"memory_budget"; }
+
+	protected:
+		// The main access point to the filter
+		void do_fetch( ml::frame_type_ptr &result )
+		{
+			result = fetch_from_slot( );
+
+			const ml::input_type_ptr graph = fetch_slot( );
+			const boost::int64_t limit = prop_limit_.value< boost::int64_t >( );
+			const boost::int64_t usage = ml::graph_memory_usage( graph );
+
+			if ( usage > prop_peak_.value< boost::int64_t >( ) )
+				prop_peak_ = usage;
+
+			if ( limit > 0 && usage > limit )
+			{
+				prop_usage_ = ml::enforce_memory_budget( graph, limit );
+				if ( prop_usage_.value< boost::int64_t >( ) > limit )
+					ARLOG_DEBUG( "Graph holds %1% bytes after enforcing a budget of %2%" )( prop_usage_.value< boost::int64_t >( ) )( limit );
+			}
+			else
+			{
+				prop_usage_ = usage;
+			}
+		}
+
+	private:
+		pcos::property prop_limit_;
+		pcos::property prop_usage_;
+		pcos::property prop_peak_;
+};
+
+ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_memory_budget( const std::wstring & )
+{
+	return ml::filter_type_ptr( new filter_memory_budget( ) );
+}
+
+} }
@@ -16,12 +16,22 @@
 //
 // Provides a single frame containing 16 frames from file.mpg, with each image scaled to
 // a thumbnail and arranged in a 4x4 grid.
+//
+// For storyboards of long GOP sources, keyframes=1 moves each thumbnail back to
+// the nearest key frame according to the awi index given by index=url, or to the
+// packet at the position when there is no index (so only intra pictures are
+// decoded) and threads=n decodes the thumbnails on n threads
+// (when the input provides lazily decoded frames, as filter:decode does).
+// filter:extract accepts the same properties.
 
 #include "precompiled_headers.hpp"
 #include "amf_filter_plugin.hpp"
 #include "utility.hpp"
 
+#include <openmedialib/ml/indexer.hpp>
+
 #include <iostream>
+#include <vector>
 
 namespace aml { namespace openmedialib {
 
@@ -96,10 +106,14 @@ class ML_PLUGIN_DECLSPEC filter_montage : public ml::filter_type
 			, prop_deferred_( pcos::key::from_string( "deferred" ) )
 			, prop_frames_( pcos::key::from_string( "frames" ) )
 			, prop_step_( pcos::key::from_string( "step" ) )
+			, prop_keyframes_( pcos::key::from_string( "keyframes" ) )
+			, prop_index_( pcos::key::from_string( "index" ) )
+			, prop_threads_( pcos::key::from_string( "threads" ) )
 			, prop_r_( pcos::key::from_string( "r" ) )
 			, prop_g_( pcos::key::from_string( "g" ) )
 			, prop_b_( pcos::key::from_string( "b" ) )
 			, result_frame_( )
+			, index_requested_( false )
 		{
 			properties( ).append( prop_width_ = 180 );
 			properties( ).append( prop_height_ = 100 );
@@ -109,6 +123,9 @@ class ML_PLUGIN_DECLSPEC filter_montage : public ml::filter_type
 			properties( ).append( prop_deferred_ = 0 );
 			properties( ).append( prop_frames_ = 0 );
 			properties( ).append( prop_step_ = 1 );
+			properties( ).append( prop_keyframes_ = 0 );
+			properties( ).append( prop_index_ = std::wstring( L"" ) );
+			properties( ).append( prop_threads_ = 0 );
 			properties( ).append( prop_r_ = 248 );
 			properties( ).append( prop_g_ = 118 );
 			properties( ).append( prop_b_ = 19 );
@@ -215,6 +232,8 @@ class ML_PLUGIN_DECLSPEC filter_montage : public ml::filter_type
 
 				m = prop_mode_.value< std::wstring >( );
 
+				fetch_thumbnails( input, in, out );
+
 				for ( int index = in, offset = 0; index < out; index += prop_step_.value< int >( ), offset ++ )
 				{
 					ml::frame_type_ptr fg;
@@ -223,10 +242,7 @@ class ML_PLUGIN_DECLSPEC filter_montage : public ml::filter_type
 						continue;
 
 					if ( frames_.find( index ) == frames_.end( ) )
-					{
-						input->seek( index );
-						frames_[ index ] = input->fetch( );
-					}
+						frames_[ index ] = fetch_thumbnail( input, index );
 
 					fg = frames_[ index ]->shallow( );
 					fg->set_position( 0 );
@@ -311,6 +327,42 @@ class ML_PLUGIN_DECLSPEC filter_montage : public ml::filter_type
 			}
 		}
 
+		ml::frame_type_ptr fetch_thumbnail( const ml::input_type_ptr &input, int index )
+		{
+			if ( prop_keyframes_.value< int >( ) )
+			{
+				if ( !index_requested_ && prop_index_.value< std::wstring >( ) != L"" )
+				{
+					index_requested_ = true;
+					indexer_item_ = ml::indexer_request( prop_index_.value< std::wstring >( ), ml::index_type::awi );
+				}
+
+				index = key_frame_of( input, index, indexer_item_ ? indexer_item_->index( ) : ml::awi_index_ptr( ) );
+			}
+			input->seek( index );
+			return input->fetch( );
+		}
+
+		// Fetch the thumbnails which aren't cached yet and decode them in parallel
+		void fetch_thumbnails( const ml::input_type_ptr &input, int in, int out )
+		{
+			const int threads = prop_threads_.value< int >( );
+			if ( threads <= 1 || !input->is_thread_safe( ) )
+				return;
+
+			std::vector< ml::frame_type_ptr > frames;
+			for ( int index = in; index < out && index < input->get_frames( ); index += prop_step_.value< int >( ) )
+			{
+				if ( index >= 0 && frames_.find( index ) == frames_.end( ) )
+				{
+					frames_[ index ] = fetch_thumbnail( input, index );
+					frames.push_back( frames_[ index ] );
+				}
+			}
+
+			evaluate_images( frames, threads );
+		}
+
 		void assign( ml::frame_type_ptr frame, pl::pcos::key name, double value )
 		{
 			if ( frame->properties( ).get_property_with_key( name ).valid( ) )
@@ -346,11 +398,16 @@ class ML_PLUGIN_DECLSPEC filter_montage : public ml::filter_type
 		pl::pcos::property prop_deferred_;
 		pl::pcos::property prop_frames_;
 		pl::pcos::property prop_step_;
+		pl::pcos::property prop_keyframes_;
+		pl::pcos::property prop_index_;
+		pl::pcos::property prop_threads_;
 		pl::pcos::property prop_r_;
 		pl::pcos::property prop_g_;
 		pl::pcos::property prop_b_;
 		ml::frame_type_ptr result_frame_;
 		std::map< int, ml::frame_type_ptr > frames_;
+		bool index_requested_;
+		ml::indexer_item_ptr indexer_item_;
 };
 
 ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_montage( const std::wstring &resource )
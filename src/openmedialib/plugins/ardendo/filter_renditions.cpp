@@ -0,0 +1,451 @@
+// Renditions filter
+//
+// Copyright (C) 2013 Vizrt
+// Released under the terms of the LGPL.
+//
+// #filter:renditions
+//
+// Writes the frames which pass through to a number of stores, each at its own
+// resolution and pixel format. This allows a mezzanine and any number of
+// proxies to be generated from a single decode of the source.
+//
+// Each rendition is described by a group of properties with an @<n>. prefix:
+//
+//   @0.store=avformat:mezzanine.mov
+//   @1.store=avformat:hd.mp4 @1.width=1920 @1.height=1080 @1.pf=yuv420p
+//   @2.store=avformat:proxy.mp4 @2.width=960 @2.height=540 @2.pf=yuv420p
+//
+// A width or height of 0 (the default) keeps the source dimension and an
+// empty pf keeps the source pixel format. Properties of the form
+// @<n>.store.<name> are passed on to the store of rendition n (as with
+// filter:store).
+//
+// The downscales form a pyramid - the sizes are produced largest first and
+// each is scaled from the smallest image already produced which is at least as
+// large, so 1080 -> 540 -> 270 computes each resolution once per frame no matter
+// how many renditions use it. The pyramid is built on the calling thread,
+// while the pixel format conversion and store push of each rendition happen
+// on a thread of its own (unless threaded is 0). Frames handed to those
+// threads are shallow copies, and a source image which would be encoded as
+// is is copied first, since the frame passed downstream still holds it.
+//
+// Properties:
+//
+//   enable - when 0, frames are passed through untouched (default: 1)
+//   threaded - encode each rendition on its own thread (default: 1)
+//   queue - frames which may be pending for each rendition (default: 4)
+//   interp - rescale filter: point, bilinear or bicubic (default: bicubic)
+//   rescales - number of rescales carried out (read only)
+
+#include "precompiled_headers.hpp"
+#include "amf_filter_plugin.hpp"
+#include "utility.hpp"
+
+#include <opencorelib/cl/spsc_queue.hpp>
+#include <opencorelib/cl/thread_name.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace aml { namespace openmedialib {
+
+namespace {
+
+// A level of the pyramid built for the current frame
+struct level_type
+{
+	level_type( int w, int h, const ml::image_type_ptr &img )
+		: width( w )
+		, height( h )
+		, image( img )
+	{ }
+
+	int width;
+	int height;
+	ml::image_type_ptr image;
+};
+
+}
+
+class ML_PLUGIN_DECLSPEC filter_renditions : public ml::filter_simple
+{
+	public:
+		filter_renditions( )
+			: ml::filter_simple( )
+			, prop_enable_( pcos::key::from_string( "enable" ) )
+			, prop_threaded_( pcos::key::from_string( "threaded" ) )
+			, prop_queue_( pcos::key::from_string( "queue" ) )
+			, prop_interp_( pcos::key::from_string( "interp" ) )
+			, prop_rescales_( pcos::key::from_string( "rescales" ) )
+			, failed_( false )
+		{
+			properties( ).append( prop_enable_ = 1 );
+			properties( ).append( prop_threaded_ = 1 );
+			properties( ).append( prop_queue_ = 4 );
+			properties( ).append( prop_interp_ = std::wstring( L"bicubic" ) );
+			properties( ).append( prop_rescales_ = 0 );
+		}
+
+		virtual ~filter_renditions( )
+		{
+			// Let each rendition drain its queue and complete its store
+			for ( std::vector< rendition_ptr >::iterator it = renditions_.begin( ); it != renditions_.end( ); ++it )
+			{
+				rendition &r = **it;
+				if ( r.thread )
+				{
+					// The thread keeps draining its queue after a failure, and stops waiting for space once it has exited
+					while ( !r.queue->push( ml::frame_type_ptr( ), boost::posix_time::milliseconds( 100 ) ) && !has_exited( r ) ) ;
+					r.thread->join( );
+				}
+				else if ( r.store )
+				{
+					r.store->complete( );
+				}
+			}
+		}
+
+		// Indicates if the input will enforce a packet decode
+		virtual bool requires_image( ) const { return true; }
+
+		virtual const std::wstring get_uri( ) const { return L"renditions"; }
+
+	protected:
+		// Each rendition has its own store and (optionally) its own thread
+		struct rendition
+		{
+			rendition( int n )
+				: index( n )
+				, width( 0 )
+				, height( 0 )
+				, exited( false )
+			{ }
+
+			int index;
+			std::wstring resource;
+			int width;
+			int height;
+			std::wstring pf;
+			ml::store_type_ptr store;
+			boost::shared_ptr< cl::spsc_queue< ml::frame_type_ptr > > queue;
+			boost::shared_ptr< boost::thread > thread;
+
+			// Set (under the filter's mutex) when the thread returns
+			bool exited;
+		};
+
+		typedef boost::shared_ptr< rendition > rendition_ptr;
+
+		void do_fetch( ml::frame_type_ptr &result )
+		{
+			if ( !last_frame_ || last_frame_->get_position( ) != get_position( ) )
+			{
+				result = fetch_from_slot( );
+				ARENFORCE_MSG( result, "Unable to obtain frame from input" );
+
+				if ( prop_enable_.value< int >( ) && result->get_image( ) )
+				{
+					if ( renditions_.empty( ) )
+						create_renditions( );
+
+					ARENFORCE_MSG( !has_failed( ), "Pushing to a rendition store failed" );
+
+					std::vector< level_type > levels;
+					levels.push_back( level_type( result->get_image( )->width( ), result->get_image( )->height( ), result->get_image( ) ) );
+
+					for ( std::vector< rendition_ptr >::iterator it = renditions_.begin( ); it != renditions_.end( ); ++it )
+					{
+						rendition &r = **it;
+						ml::frame_type_ptr frame = result->shallow( );
+						ml::image_type_ptr image = level( levels, r );
+
+						// The rendition thread mustn't encode an image which is still in use downstream
+						if ( prop_threaded_.value< int >( ) && image == result->get_image( ) && !converts( r, image ) )
+							image = ml::image_type_ptr( image->clone( ) );
+
+						frame->set_image( image );
+						deliver( r, frame );
+					}
+				}
+
+				last_frame_ = result->shallow( );
+			}
+			else
+			{
+				result = last_frame_->shallow( );
+			}
+		}
+
+		// Find the renditions described by the @<n>.store properties and sort them by size
+		void create_renditions( )
+		{
+			pcos::key_vector keys = properties( ).get_keys( );
+			for( pcos::key_vector::iterator it = keys.begin( ); it != keys.end( ); ++it )
+			{
+				std::string name( ( *it ).as_string( ) );
+				size_t dot = name.find( '.' );
+				if ( name.size( ) < 2 || name[ 0 ] != '@' || dot == std::string::npos || name.substr( dot ) != ".store" )
+					continue;
+
+				std::string number = name.substr( 1, dot - 1 );
+				if ( number.empty( ) || number.find_first_not_of( "0123456789" ) != std::string::npos )
+					continue;
+
+				rendition_ptr r( new rendition( atoi( number.c_str( ) ) ) );
+				r->resource = string_property( name, L"" );
+				r->width = int_property( "@" + number + ".width", 0 );
+				r->height = int_property( "@" + number + ".height", 0 );
+				r->pf = string_property( "@" + number + ".pf", L"" );
+				ARENFORCE_MSG( r->resource != L"", "No store specified for rendition %1%" )( r->index );
+				ARENFORCE_MSG( r->width >= 0 && r->height >= 0, "Invalid size requested for rendition %1%" )( r->index );
+				renditions_.push_back( r );
+			}
+
+			ARENFORCE_MSG( !renditions_.empty( ), "No renditions specified - set @0.store and friends" );
+
+			std::sort( renditions_.begin( ), renditions_.end( ), &filter_renditions::larger );
+		}
+
+		// Largest first, so that each level of the pyramid is available before the smaller ones
+		static bool larger( const rendition_ptr &a, const rendition_ptr &b )
+		{
+			const boost::int64_t area_a = boost::int64_t( a->width ? a->width : 1 << 16 ) * ( a->height ? a->height : 1 << 16 );
+			const boost::int64_t area_b = boost::int64_t( b->width ? b->width : 1 << 16 ) * ( b->height ? b->height : 1 << 16 );
+			return area_a > area_b || ( area_a == area_b && a->index < b->index );
+		}
+
+		// Obtain the image at the size required by the rendition, reusing or extending the pyramid
+		ml::image_type_ptr level( std::vector< level_type > &levels, const rendition &r )
+		{
+			const int width = r.width ? r.width : levels[ 0 ].width;
+			const int height = r.height ? r.height : levels[ 0 ].height;
+
+			// Use the smallest level which is at least as large as the target
+			size_t best = 0;
+			for ( size_t i = 0; i < levels.size( ); i ++ )
+			{
+				if ( levels[ i ].width == width && levels[ i ].height == height )
+					return levels[ i ].image;
+				if ( levels[ i ].width >= width && levels[ i ].height >= height &&
+					 levels[ i ].width * levels[ i ].height < levels[ best ].width * levels[ best ].height )
+					best = i;
+			}
+
+			ml::image_type_ptr image = ml::image::rescale( levels[ best ].image, width, height, interp( ) );
+			ARENFORCE_MSG( image, "Unable to rescale to %1%x%2% for rendition %3%" )( width )( height )( r.index );
+			levels.push_back( level_type( width, height, image ) );
+			prop_rescales_ = prop_rescales_.value< int >( ) + 1;
+
+			return image;
+		}
+
+		// Hand the frame to the rendition, creating its store and thread on the first frame
+		void deliver( rendition &r, ml::frame_type_ptr &frame )
+		{
+			if ( r.store == 0 )
+			{
+				convert( r, frame );
+
+				r.store = ml::create_store( r.resource, frame );
+				ARENFORCE_MSG( r.store, "Failed to create a store from %s" )( r.resource );
+				pass_properties( r );
+				ARENFORCE_MSG( r.store->init( ), "Failed to initalise a store from %s" )( r.resource );
+
+				if ( prop_threaded_.value< int >( ) )
+				{
+					r.queue.reset( new cl::spsc_queue< ml::frame_type_ptr >( size_t( std::max< int >( 1, prop_queue_.value< int >( ) ) ) ) );
+					r.thread.reset( new boost::thread( boost::bind( &filter_renditions::run, this, &r ) ) );
+				}
+			}
+
+			if ( r.thread )
+			{
+				// Blocks while the rendition is behind
+				while ( !r.queue->push( frame, boost::posix_time::milliseconds( 100 ) ) )
+					ARENFORCE_MSG( !has_failed( ), "Pushing to a rendition store failed" );
+			}
+			else
+			{
+				convert( r, frame );
+				ARENFORCE_MSG( r.store->push( frame ), "Pushing to store %1% failed." )( r.resource );
+			}
+		}
+
+		// Indicates if the image will be replaced by one in the pixel format of the rendition
+		bool converts( const rendition &r, const ml::image_type_ptr &image ) const
+		{
+			return r.pf != L"" && image && cl::str_util::to_wstring( image->pf( ) ) != r.pf;
+		}
+
+		// Converts the image to the pixel format of the rendition
+		void convert( const rendition &r, ml::frame_type_ptr &frame )
+		{
+			ml::image_type_ptr image = frame->get_image( );
+			if ( converts( r, image ) )
+			{
+				image = ml::image::convert( image, cl::str_util::to_t_string( r.pf ) );
+				ARENFORCE_MSG( image, "Unable to convert to %1% for rendition %2%" )( cl::str_util::to_string( r.pf ) )( r.index );
+				frame->set_image( image );
+			}
+		}
+
+		// Rendition thread - nothing may escape it, and the destructor relies on it being marked as exited
+		void run( rendition *r )
+		{
+			try
+			{
+				encode( r );
+			}
+			catch( const std::exception &e )
+			{
+				ARLOG_ERR( "Rendition %1% stopped: %2%" )( r->index )( e.what( ) );
+				fail( );
+			}
+			catch( ... )
+			{
+				ARLOG_ERR( "Rendition %1% stopped with an unknown exception" )( r->index );
+				fail( );
+			}
+
+			boost::mutex::scoped_lock lock( mutex_ );
+			r->exited = true;
+		}
+
+		// Converts and pushes each frame until the end of the queue is reached
+		void encode( rendition *r )
+		{
+			cl::set_thread_name( cl::str_util::to_t_string( "renditions " + boost::lexical_cast< std::string >( r->index ) ) );
+
+			ml::frame_type_ptr frame;
+			bool ok = true;
+
+			while ( true )
+			{
+				if ( !r->queue->pop( frame, boost::posix_time::milliseconds( 100 ) ) )
+					continue;
+				if ( !frame )
+					break;
+
+				if ( ok )
+				{
+					try
+					{
+						convert( *r, frame );
+						ok = r->store->push( frame );
+					}
+					catch( const std::exception &e )
+					{
+						ARLOG_ERR( "Rendition %1% failed: %2%" )( r->index )( e.what( ) );
+						ok = false;
+					}
+					catch( ... )
+					{
+						ARLOG_ERR( "Rendition %1% failed with an unknown exception" )( r->index );
+						ok = false;
+					}
+
+					if ( !ok )
+					{
+						ARLOG_ERR( "Pushing to store %1% failed." )( r->resource );
+						fail( );
+					}
+				}
+			}
+
+			if ( ok )
+				r->store->complete( );
+		}
+
+		void pass_properties( rendition &r )
+		{
+			std::string prefix = "@" + boost::lexical_cast< std::string >( r.index ) + ".store.";
+			int ps = static_cast< int >( prefix.size( ) );
+			pcos::key_vector keys = properties( ).get_keys( );
+			for( pcos::key_vector::iterator it = keys.begin( ); it != keys.end( ); ++it )
+			{
+				std::string name( ( *it ).as_string( ) );
+				if ( name.find( prefix ) == 0 )
+				{
+					std::string prop = name.substr( ps );
+					pcos::property p = r.store->properties( ).get_property_with_string( prop.c_str( ) );
+					if ( p.valid( ) )
+						p.set_from_string( string_property( name, L"" ) );
+					else
+						std::cerr << "Unknown property " << name << std::endl;
+				}
+			}
+		}
+
+		// The @ properties are strings when set from a script, but may be ints when set by an application
+		std::wstring string_property( const std::string &name, const std::wstring &def )
+		{
+			pcos::property p = properties( ).get_property_with_string( name.c_str( ) );
+			if ( p.valid( ) && p.is_a< std::wstring >( ) )
+				return p.value< std::wstring >( );
+			if ( p.valid( ) && p.is_a< int >( ) )
+				return cl::str_util::to_wstring( boost::lexical_cast< std::string >( p.value< int >( ) ) );
+			return def;
+		}
+
+		int int_property( const std::string &name, int def )
+		{
+			pcos::property p = properties( ).get_property_with_string( name.c_str( ) );
+			if ( p.valid( ) && p.is_a< int >( ) )
+				return p.value< int >( );
+			if ( p.valid( ) && p.is_a< std::wstring >( ) )
+				return atoi( cl::str_util::to_string( p.value< std::wstring >( ) ).c_str( ) );
+			return def;
+		}
+
+		ml::image::rescale_filter interp( )
+		{
+			if ( prop_interp_.value< std::wstring >( ) == L"point" )
+				return ml::image::POINT_SAMPLING;
+			else if ( prop_interp_.value< std::wstring >( ) == L"bilinear" )
+				return ml::image::BILINEAR_SAMPLING;
+			return ml::image::BICUBIC_SAMPLING;
+		}
+
+		bool has_failed( )
+		{
+			boost::mutex::scoped_lock lock( mutex_ );
+			return failed_;
+		}
+
+		void fail( )
+		{
+			boost::mutex::scoped_lock lock( mutex_ );
+			failed_ = true;
+		}
+
+		bool has_exited( const rendition &r )
+		{
+			boost::mutex::scoped_lock lock( mutex_ );
+			return r.exited;
+		}
+
+	private:
+		pcos::property prop_enable_;
+		pcos::property prop_threaded_;
+		pcos::property prop_queue_;
+		pcos::property prop_interp_;
+		pcos::property prop_rescales_;
+		ml::frame_type_ptr last_frame_;
+		std::vector< rendition_ptr > renditions_;
+		boost::mutex mutex_;
+		bool failed_;
+};
+
+ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_renditions( const std::wstring &resource )
+{
+	return ml::filter_type_ptr( new filter_renditions( ) );
+}
+
+} }
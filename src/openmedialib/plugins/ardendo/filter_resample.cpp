@@ -0,0 +1,188 @@
+// Audio resampling filter
+//
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+//
+// #filter:resample
+//
+// Converts the audio of the connected input to another sample rate with the
+// polyphase windowed sinc resampler in ml::audio.
+//
+// The input is treated as a continuous stream - the resampler state is carried
+// from one frame to the next during sequential playback, so there are no
+// discontinuities at frame boundaries. On a seek, the stream is restarted at
+// the output sample which corresponds to the requested frame and the input
+// frames preceding it are fed in again, so random access produces the same
+// samples as playback.
+//
+// Properties:
+//
+//   frequency [int, default 48000]
+//     The output sample rate.
+//
+//   af [string, default ""]
+//     The output sample type (see ml::audio::af_to_id) - the input type is
+//     retained when empty.
+//
+//   taps [int, default 32]
+//     Length of the filter - higher values give a sharper cut off at a higher
+//     cost.
+//
+// Example:
+//
+// file.wav
+// filter:resample frequency=48000
+
+#include "precompiled_headers.hpp"
+#include "amf_filter_plugin.hpp"
+
+#include <openmedialib/ml/audio_resampler.hpp>
+#include <opencorelib/cl/str_util.hpp>
+
+namespace aml { namespace openmedialib {
+
+class ML_PLUGIN_DECLSPEC filter_resample : public ml::filter_simple
+{
+	public:
+		filter_resample( )
+			: ml::filter_simple( )
+			, prop_frequency_( pcos::key::from_string( "frequency" ) )
+			, prop_af_( pcos::key::from_string( "af" ) )
+			, prop_taps_( pcos::key::from_string( "taps" ) )
+			, taps_( 0 )
+			, next_frame_( 0 )
+			, next_sample_( 0 )
+		{
+			properties( ).append( prop_frequency_ = 48000 );
+			properties( ).append( prop_af_ = std::wstring( L"" ) );
+			properties( ).append( prop_taps_ = 32 );
+		}
+
+		// Indicates if the input will enforce a packet decode
+		virtual bool requires_image( ) const { return false; }
+
+		// This provides the name of the plugin (used in serialisation)
+		virtual const std::wstring get_uri( ) const { return L"resample"; }
+
+	protected:
+		// The main access point to the filter
+		void do_fetch( ml::frame_type_ptr &result )
+		{
+			result = fetch_from_slot( );
+
+			if ( !result || !result->get_audio( ) )
+				return;
+
+			const ml::audio_type_ptr audio = result->get_audio( );
+			const int frequency = prop_frequency_.value< int >( );
+			const std::wstring af = prop_af_.value< std::wstring >( );
+			const ml::audio::identity id = af == L"" ? audio->id( ) : ml::audio::af_to_id( olib::opencorelib::str_util::to_t_string( af ) );
+
+			if ( frequency <= 0 || frequency == audio->frequency( ) )
+			{
+				if ( id != audio->id( ) )
+				{
+					result = result->shallow( );
+					result->set_audio( ml::audio::coerce( id, audio ) );
+				}
+				return;
+			}
+
+			int fps_num, fps_den;
+			result->get_fps( fps_num, fps_den );
+			ARENFORCE_MSG( fps_num > 0 && fps_den > 0, "Invalid frame rate %1%:%2% for resampling" )( fps_num )( fps_den );
+
+			// A change of rate, layout or filter restarts the stream
+			if ( !resampler_ || resampler_->in_frequency( ) != audio->frequency( ) || resampler_->out_frequency( ) != frequency ||
+				 resampler_->channels( ) != audio->channels( ) || taps_ != prop_taps_.value< int >( ) )
+			{
+				taps_ = prop_taps_.value< int >( );
+				resampler_ = ml::audio::create_resampler( audio->frequency( ), frequency, audio->channels( ), taps_ );
+			}
+
+			const int position = get_position( );
+			const boost::int64_t start = ml::audio::samples_to_frame( position, frequency, fps_num, fps_den );
+			const int samples = ml::audio::samples_for_frame( position, frequency, fps_num, fps_den );
+
+			// Anything other than the next frame of sequential playback requires a restart
+			if ( resampler_->position( ) != start )
+				seek( resampler_->reset( start ), fps_num, fps_den );
+
+			feed( samples, fps_num, fps_den );
+
+			ml::audio_type_ptr output = resampler_->pull( id, samples );
+			output->set_position( audio->position( ) );
+
+			result = result->shallow( );
+			result->set_audio( output );
+		}
+
+	private:
+		// Locate the input frame which holds input sample - the stream is assumed to have a constant rate
+		void seek( boost::int64_t sample, int fps_num, int fps_den )
+		{
+			const int frequency = resampler_->in_frequency( );
+			int frame = int( ( sample * fps_num ) / ( boost::int64_t( frequency ) * fps_den ) );
+
+			while ( frame > 0 && ml::audio::samples_to_frame( frame, frequency, fps_num, fps_den ) > sample )
+				frame --;
+			while ( ml::audio::samples_to_frame( frame + 1, frequency, fps_num, fps_den ) <= sample )
+				frame ++;
+
+			next_frame_ = frame;
+			next_sample_ = sample;
+		}
+
+		// Push input frames until the requested output samples are available
+		void feed( int samples, int fps_num, int fps_den )
+		{
+			ml::input_type_ptr input = fetch_slot( 0 );
+			const int frequency = resampler_->in_frequency( );
+			const int frames = get_frames( );
+
+			while ( resampler_->available( ) < samples )
+			{
+				const boost::int64_t first = ml::audio::samples_to_frame( next_frame_, frequency, fps_num, fps_den );
+				const int expected = ml::audio::samples_for_frame( next_frame_, frequency, fps_num, fps_den );
+				const int skip = int( next_sample_ - first );
+
+				if ( next_frame_ >= frames )
+				{
+					// Flush the tail of the stream
+					resampler_->push_silence( resampler_->reach( ) + 1 );
+					next_sample_ += resampler_->reach( ) + 1;
+					continue;
+				}
+
+				ml::frame_type_ptr frame = input->fetch( next_frame_ ++ );
+				ml::audio_type_ptr audio = frame ? frame->get_audio( ) : ml::audio_type_ptr( );
+
+				if ( audio && audio->frequency( ) == frequency && audio->channels( ) == resampler_->channels( ) )
+				{
+					resampler_->push( audio, skip );
+					next_sample_ += std::max< int >( audio->samples( ) - skip, 0 );
+				}
+				else
+				{
+					// Gaps and incompatible frames are treated as silence
+					resampler_->push_silence( expected - skip );
+					next_sample_ += std::max< int >( expected - skip, 0 );
+				}
+			}
+		}
+
+		pcos::property prop_frequency_;
+		pcos::property prop_af_;
+		pcos::property prop_taps_;
+		ml::audio::resampler_ptr resampler_;
+		int taps_;
+		int next_frame_;
+		boost::int64_t next_sample_;
+};
+
+ml::filter_type_ptr ML_PLUGIN_DECLSPEC create_resample( const std::wstring & )
+{
+	return ml::filter_type_ptr( new filter_resample( ) );
+}
+
+} }
@@ -12,6 +12,11 @@
 //
 // The graph can then be continued, adding additional effects, or providing
 // addition tee graphs which are encoding to another form of output.
+//
+// The preroll frames are pushed before the first of them is fetched back on 
+// the same thread, so a nudger: with blocking=1 (whose push waits for space) 
+// must queue more than preroll frames - this is enforced when the pushers are
+// collected. The default nudger: drops its oldest frames instead of waiting.
 
 #include "precompiled_headers.hpp"
 #include "amf_filter_plugin.hpp"
@@ -20,6 +25,8 @@
 namespace aml { namespace openmedialib {
 
 static pcos::key key_length_( pcos::key::from_string( "length" ) );
+static pcos::key key_queue_( pcos::key::from_string( "queue" ) );
+static pcos::key key_blocking_( pcos::key::from_string( "blocking" ) );
 
 class ML_PLUGIN_DECLSPEC filter_tee : public ml::filter_simple
 {
@@ -148,6 +155,13 @@ class ML_PLUGIN_DECLSPEC filter_tee : public ml::filter_simple
 				if ( graph->get_uri( ) == L"pusher:" || graph->get_uri( ) == L"nudger:" )
 				{
 					graph->properties( ).get_property_with_key( key_length_ ) = get_frames( );
+					pcos::property blocking = graph->properties( ).get_property_with_key( key_blocking_ );
+					if ( blocking.valid( ) && blocking.value< int >( ) )
+					{
+						pcos::property queue = graph->properties( ).get_property_with_key( key_queue_ );
+						ARENFORCE_MSG( prop_preroll_.value< int >( ) < queue.value< int >( ), "Tee preroll of %1% requires a blocking nudger: queue of more than %1% frames (found %2%)" )
+							( prop_preroll_.value< int >( ) )( queue.value< int >( ) );
+					}
 					pushers.push_back( graph );
 				}
 
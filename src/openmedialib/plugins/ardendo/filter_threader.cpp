@@ -43,6 +43,7 @@
 #include "utility.hpp"
 
 #include <opencorelib/cl/thread_name.hpp>
+#include <openmedialib/ml/memory_budget.hpp>
 
 #include <map>
 
@@ -98,7 +99,7 @@ std::string cache_to_string( const std::map< int, ml::frame_type_ptr >& cache )
 	return out;
 }
 
-class ML_PLUGIN_DECLSPEC filter_threader : public ml::filter_type
+class ML_PLUGIN_DECLSPEC filter_threader : public ml::filter_type, public ml::memory_consumer
 {
 	typedef boost::recursive_mutex::scoped_lock scoped_lock;
 
@@ -147,6 +148,20 @@ class ML_PLUGIN_DECLSPEC filter_threader : public ml::filter_type
 		virtual const std::wstring get_uri( ) const 
 		{ return L"threader"; }
 
+		// Frames read ahead by the worker thread - only the worker may modify the cache, so
+		// these are reported but never released
+		virtual boost::int64_t memory_usage( ) const
+		{
+			scoped_lock lock( mutex_ );
+			boost::int64_t result = 0;
+			for( std::map< int, ml::frame_type_ptr >::const_iterator it = cache_.begin( ); it != cache_.end( ); ++it )
+				result += ml::memory_bytes( it->second );
+			return result;
+		}
+
+		// The input is fetched by the worker thread
+		virtual bool memory_threaded( ) const { return true; }
+
 		int get_frames() const
 		{  
 			scoped_lock lock( mutex_ );
@@ -6,6 +6,40 @@
 // #store:preview:
 // 
 // Provides a simple/configurable audio/video playout store.
+//
+// By default, playout is paced by sleeping for the computed delay before each
+// frame (or by the audio device when audio is available). Setting scheduler=1
+// hands frames to a presentation thread instead - each frame is shown at an
+// absolute deadline on a monotonic clock (origin + n frame periods), so sleep
+// overshoot and slow frames don't accumulate as drift, and the caller fetches
+// the next frame while the current one waits for its deadline.
+//
+// Scheduler properties:
+//
+//	scheduler=0|1 (default 0)
+//		Present frames against the monotonic clock on a separate thread.
+//	schedule_queue=n (default 2)
+//		Number of frames which can wait for presentation.
+//	late_policy=drop|repeat (default drop)
+//		What happens to a frame which is at least a frame period late. drop
+//		skips the image when a newer frame is already waiting (audio is still
+//		played), repeat shows the previous image again for each frame period
+//		which was missed and then shows the frame.
+//	late_tolerance=ms (default 2)
+//		Frames presented later than this are counted as late.
+//
+// With the scheduler, push returns false once presenting any earlier frame has
+// failed - a frame is presented after push returns, so its own failure is
+// reported by the next push. Failures are sticky.
+//
+// Playout health (read only, updated on each push):
+//
+//	late, dropped, repeated, resyncs
+//		Frame counts - a resync occurs when playout falls more than a second
+//		behind and the schedule is restarted from the current time.
+//	slack, min_slack
+//		Time in microseconds between presentation and the deadline for the
+//		last frame and the smallest seen (negative when late).
 
 #include "precompiled_headers.hpp"
 
@@ -20,7 +54,13 @@
 
 #include <openpluginlib/pl/timer.hpp>
 #include <opencorelib/cl/media_definitions.hpp>
+#include <opencorelib/cl/spsc_queue.hpp>
+#include <opencorelib/cl/thread_name.hpp>
+#include <openmedialib/ml/statistics.hpp>
 #include <boost/operators.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 #include <boost/weak_ptr.hpp>
 
@@ -195,6 +235,43 @@ static boost::int64_t audio_owner = 0;
 
 #define const_preview const_cast< store_preview * >
 
+// A frame waiting for its presentation time on the scheduler thread
+struct scheduled_frame
+{
+	scheduled_frame( )
+		: reanchor( false )
+		, audio( false )
+	{ }
+
+	ml::frame_type_ptr frame;
+	bool reanchor;
+	bool audio;
+};
+
+// Playout health as measured by the scheduler thread
+struct schedule_stats
+{
+	schedule_stats( )
+		: frames( 0 )
+		, late( 0 )
+		, dropped( 0 )
+		, repeated( 0 )
+		, resyncs( 0 )
+		, slack( 0 )
+		, min_slack( 0 )
+		, failed( false )
+	{ }
+
+	boost::int64_t frames;
+	boost::int64_t late;
+	boost::int64_t dropped;
+	boost::int64_t repeated;
+	boost::int64_t resyncs;
+	boost::int64_t slack;
+	boost::int64_t min_slack;
+	bool failed;
+};
+
 class ML_PLUGIN_DECLSPEC store_preview : public ml::store_type
 {
 	typedef boost::mutex::scoped_lock scoped_lock;
@@ -222,6 +299,16 @@ class ML_PLUGIN_DECLSPEC store_preview : public ml::store_type
 			, prop_keys_wanted_( pcos::key::from_string( "keys_wanted" ) )
 			, prop_deinterlace_( pcos::key::from_string( "deinterlace" ) )
 			, prop_native_( pcos::key::from_string( "native" ) )
+			, prop_scheduler_( pcos::key::from_string( "scheduler" ) )
+			, prop_schedule_queue_( pcos::key::from_string( "schedule_queue" ) )
+			, prop_late_policy_( pcos::key::from_string( "late_policy" ) )
+			, prop_late_tolerance_( pcos::key::from_string( "late_tolerance" ) )
+			, prop_late_( pcos::key::from_string( "late" ) )
+			, prop_dropped_( pcos::key::from_string( "dropped" ) )
+			, prop_repeated_( pcos::key::from_string( "repeated" ) )
+			, prop_resyncs_( pcos::key::from_string( "resyncs" ) )
+			, prop_slack_( pcos::key::from_string( "slack" ) )
+			, prop_min_slack_( pcos::key::from_string( "min_slack" ) )
 			, key_box_( pcos::key::from_string( "box" ) )
 			, key_deferrable_( pcos::key::from_string( "deferrable" ) )
 			, key_preroll_( pcos::key::from_string( "preroll" ) )
@@ -243,6 +330,13 @@ class ML_PLUGIN_DECLSPEC store_preview : public ml::store_type
 			, first_( true )
 			, last_audio_push_result_( false )
 			, first_frame_( frame )
+			, discard_( 0 )
+			, drop_late_( true )
+			, tolerance_( 2000 )
+			, origin_( -1 )
+			, ticks_( 0 )
+			, fps_num_( 0 )
+			, fps_den_( 0 )
 		{
 			timer_ = aml::openmedialib::create_timer( );
 
@@ -269,6 +363,16 @@ class ML_PLUGIN_DECLSPEC store_preview : public ml::store_type
 			properties( ).append( prop_keys_wanted_ = 1 );
 			properties( ).append( prop_deinterlace_ = 1 );
 			properties( ).append( prop_native_ = 0.0 );
+			properties( ).append( prop_scheduler_ = 0 );
+			properties( ).append( prop_schedule_queue_ = 2 );
+			properties( ).append( prop_late_policy_ = std::wstring( L"drop" ) );
+			properties( ).append( prop_late_tolerance_ = 2 );
+			properties( ).append( prop_late_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_dropped_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_repeated_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_resyncs_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_slack_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_min_slack_ = boost::int64_t( 0 ) );
 			prop_box_.attach( obs_box_ );
 			prop_grab_audio_.attach( obs_grab_audio_ );
 			prop_sync_.attach( obs_sync_ );
@@ -277,6 +381,7 @@ class ML_PLUGIN_DECLSPEC store_preview : public ml::store_type
 
 		virtual ~store_preview( )
 		{
+			stop_scheduler( true );
 			scoped_lock lock( audio_lock_ );
             if ( audio_owner == boost::int64_t( this ) && audio_ )
 				audio_owner = 0;
@@ -476,6 +581,14 @@ class ML_PLUGIN_DECLSPEC store_preview : public ml::store_type
 					return true;
 				}
 
+				if ( prop_scheduler_.value< int >( ) )
+				{
+					result = schedule( frame );
+					poll_keydown( );
+					notify_callback( );
+					return result;
+				}
+
 				// Deal with the gap between this frame and the last
 				int position = frame->get_position( );
 				if ( position - last_position_ != last_speed_ )
@@ -602,31 +715,18 @@ class ML_PLUGIN_DECLSPEC store_preview : public ml::store_type
 						prop_ttn_ = 0;
 				}
 
-				if ( video_ && prop_keys_wanted_.value< int >( ) )
-				{
-					pl::pcos::property keydown = video_->properties( ).get_property_with_key( key_keydown_ );
-					if ( keydown.valid( ) )
-					{
-						int key = keydown.value< int >( );
-						if ( key != 0 )
-						{
-							prop_keydown_ = key;
-							keydown.set( 0 );
-						}
-					}
-				}
+				poll_keydown( );
 			}
 
-			typedef void ( *callback )( boost::uint64_t , ml::frame_type_ptr );
-			callback cb = callback( prop_callback_.value< boost::uint64_t >( ) );
-			if ( last_frame_shown_ && cb )
-				cb( prop_callback_arg_.value< boost::uint64_t >( ), last_frame_shown_ );
+			notify_callback( );
 
 			return result;
 		}
 
 		virtual ml::frame_type_ptr flush( )
 		{
+			stop_scheduler( true );
+
 			ml::frame_type_ptr frame;
 			if ( video_ ) 
 				video_->flush( );
@@ -641,6 +741,8 @@ class ML_PLUGIN_DECLSPEC store_preview : public ml::store_type
 
 		virtual void complete( )
 		{
+			stop_scheduler( false );
+
 			if ( active( ) && start_ == 0.0 )
 				start_ = time_now( );
 			bool result = true;
@@ -661,6 +763,238 @@ class ML_PLUGIN_DECLSPEC store_preview : public ml::store_type
 
 	private:
 
+		void poll_keydown( )
+		{
+			if ( video_ && prop_keys_wanted_.value< int >( ) )
+			{
+				// The video store updates keydown while it's being pushed to
+				scoped_lock lock( video_mutex_ );
+				pl::pcos::property keydown = video_->properties( ).get_property_with_key( key_keydown_ );
+				if ( keydown.valid( ) )
+				{
+					int key = keydown.value< int >( );
+					if ( key != 0 )
+					{
+						prop_keydown_ = key;
+						keydown.set( 0 );
+					}
+				}
+			}
+		}
+
+		void notify_callback( )
+		{
+			typedef void ( *callback )( boost::uint64_t , ml::frame_type_ptr );
+			callback cb = callback( prop_callback_.value< boost::uint64_t >( ) );
+			if ( !cb )
+				return;
+
+			ml::frame_type_ptr shown;
+			{
+				scoped_lock lock( video_mutex_ );
+				shown = last_frame_shown_;
+			}
+
+			if ( shown )
+				cb( prop_callback_arg_.value< boost::uint64_t >( ), shown );
+		}
+
+		// Queue the frame for the scheduler thread - blocks while the queue is full
+		bool schedule( ml::frame_type_ptr frame )
+		{
+			int position = frame->get_position( );
+			int speed = position - last_position_;
+
+			if ( audio_owner == 0 )
+				grab_audio( );
+
+			scheduled_frame item;
+			item.frame = frame;
+			item.reanchor = speed != last_speed_;
+			item.audio = audio_ && audio_owner == boost::int64_t( this ) && std::abs( speed ) == 1 && frame->get_audio( );
+
+			last_speed_ = speed;
+			last_position_ = position;
+
+			frame->set_pts( pts_ );
+			pts_ += duration( frame );
+
+			if ( !scheduler_ )
+				start_scheduler( );
+
+			while ( !schedule_->push( item, boost::posix_time::milliseconds( 100 ) ) )
+				;
+
+			return publish_schedule( );
+		}
+
+		void start_scheduler( )
+		{
+			drop_late_ = prop_late_policy_.value< std::wstring >( ) != L"repeat";
+			tolerance_ = boost::int64_t( prop_late_tolerance_.value< int >( ) ) * 1000;
+			origin_ = -1;
+			cl::detail::store_release( discard_, 0 );
+			schedule_.reset( new cl::spsc_queue< scheduled_frame >( size_t( std::max< int >( 1, prop_schedule_queue_.value< int >( ) ) ) ) );
+			scheduler_.reset( new boost::thread( boost::bind( &store_preview::run_scheduler, this ) ) );
+		}
+
+		// Waits for the scheduler thread to finish - queued frames are presented unless discarded
+		void stop_scheduler( bool discard )
+		{
+			if ( !scheduler_ )
+				return;
+
+			cl::detail::store_release( discard_, discard ? 1 : 0 );
+			while ( !schedule_->push( scheduled_frame( ), boost::posix_time::milliseconds( 100 ) ) )
+				;
+
+			scheduler_->join( );
+			scheduler_.reset( );
+			schedule_.reset( );
+			publish_schedule( );
+		}
+
+		void run_scheduler( )
+		{
+			cl::set_thread_name( _CT( "preview scheduler" ) );
+
+			scheduled_frame item;
+			while ( true )
+			{
+				if ( !schedule_->pop( item, boost::posix_time::milliseconds( 100 ) ) )
+					continue;
+				if ( !item.frame )
+					break;
+				if ( !cl::detail::load_acquire( discard_ ) )
+				{
+					try
+					{
+						present( item );
+					}
+					catch( const std::exception &e )
+					{
+						ARLOG_ERR( "Preview scheduler failed to present frame %1%: %2%" )( item.frame->get_position( ) )( e.what( ) );
+						scoped_lock lock( stats_mutex_ );
+						stats_.failed = true;
+					}
+				}
+				item = scheduled_frame( );
+			}
+		}
+
+		// Wait for the deadline of the frame (or apply the late policy) and show it
+		void present( const scheduled_frame &item )
+		{
+			ml::frame_type_ptr frame = item.frame;
+			boost::int64_t now = ml::fetch_stats_clock( );
+
+			int num = frame->get_fps_num( );
+			int den = frame->get_fps_den( );
+			if ( num <= 0 || den <= 0 )
+			{
+				num = 25;
+				den = 1;
+			}
+
+			// Deadlines are derived from the frame count so rounding and sleep overshoot never accumulate
+			bool resync = origin_ >= 0 && now - ( origin_ + ticks_ * den * 1000000 / num ) > 1000000;
+			if ( item.reanchor || resync || origin_ < 0 || num != fps_num_ || den != fps_den_ )
+			{
+				origin_ = now;
+				ticks_ = 0;
+				fps_num_ = num;
+				fps_den_ = den;
+			}
+
+			const boost::int64_t period = boost::int64_t( den ) * 1000000 / num;
+			const boost::int64_t deadline = origin_ + ticks_ * den * 1000000 / num;
+			const boost::int64_t slack = deadline - now;
+			ticks_ ++;
+
+			bool late = false;
+			bool show = true;
+			boost::int64_t repeats = 0;
+
+			if ( slack > 0 )
+			{
+				wait_until( deadline );
+			}
+			else if ( -slack > tolerance_ )
+			{
+				late = true;
+				if ( -slack >= period )
+				{
+					if ( drop_late_ && !schedule_->empty( ) )
+					{
+						show = false;
+					}
+					else if ( !drop_late_ )
+					{
+						// Fill the slots which were missed so the schedule stays on its grid
+						repeats = -slack / period;
+						ticks_ += repeats;
+					}
+				}
+			}
+
+			bool result = true;
+			if ( repeats > 0 )
+			{
+				ml::frame_type_ptr previous;
+				{
+					scoped_lock lock( video_mutex_ );
+					previous = last_frame_shown_;
+				}
+				for ( boost::int64_t i = 0; result && previous && i < repeats; i ++ )
+					result = video_push( previous );
+			}
+			if ( show && result )
+				result = video_push( frame );
+			if ( item.audio )
+				last_audio_push_result_ = audio_->push( frame );
+
+			scoped_lock lock( stats_mutex_ );
+			if ( stats_.frames ++ == 0 || slack < stats_.min_slack )
+				stats_.min_slack = slack;
+			stats_.slack = slack;
+			stats_.late += late ? 1 : 0;
+			stats_.dropped += show ? 0 : 1;
+			stats_.repeated += repeats;
+			stats_.resyncs += resync ? 1 : 0;
+			if ( !result )
+				stats_.failed = true;
+		}
+
+		// Sleep through most of the interval and yield through the remainder to absorb OS sleep overshoot
+		void wait_until( boost::int64_t deadline )
+		{
+			boost::int64_t remaining = deadline - ml::fetch_stats_clock( );
+			if ( remaining > 2000 )
+				boost::this_thread::sleep( boost::posix_time::microseconds( remaining - 2000 ) );
+			while ( ml::fetch_stats_clock( ) < deadline )
+				boost::this_thread::yield( );
+		}
+
+		// Copy the scheduler's measurements to the properties (on the pushing thread)
+		bool publish_schedule( )
+		{
+			schedule_stats stats;
+			{
+				scoped_lock lock( stats_mutex_ );
+				stats = stats_;
+			}
+
+			prop_late_ = stats.late;
+			prop_dropped_ = stats.dropped;
+			prop_repeated_ = stats.repeated;
+			prop_resyncs_ = stats.resyncs;
+			prop_slack_ = stats.slack;
+			prop_min_slack_ = stats.min_slack;
+			prop_ttn_ = int( std::max< boost::int64_t >( 0, stats.slack / 1000 ) );
+
+			return !stats.failed;
+		}
+
 		bool video_push( ml::frame_type_ptr frame )
 		{
 			scoped_lock lock( video_mutex_ );
@@ -726,6 +1060,16 @@ class ML_PLUGIN_DECLSPEC store_preview : public ml::store_type
 		pl::pcos::property prop_keys_wanted_;
 		pl::pcos::property prop_deinterlace_;
 		pl::pcos::property prop_native_;
+		pl::pcos::property prop_scheduler_;
+		pl::pcos::property prop_schedule_queue_;
+		pl::pcos::property prop_late_policy_;
+		pl::pcos::property prop_late_tolerance_;
+		pl::pcos::property prop_late_;
+		pl::pcos::property prop_dropped_;
+		pl::pcos::property prop_repeated_;
+		pl::pcos::property prop_resyncs_;
+		pl::pcos::property prop_slack_;
+		pl::pcos::property prop_min_slack_;
 		pl::pcos::key key_box_;
 		pl::pcos::key key_deferrable_;
 		pl::pcos::key key_preroll_;
@@ -749,6 +1093,17 @@ class ML_PLUGIN_DECLSPEC store_preview : public ml::store_type
 		bool first_;
 		bool last_audio_push_result_;
 		ml::frame_type_ptr first_frame_;
+		boost::scoped_ptr< cl::spsc_queue< scheduled_frame > > schedule_;
+		boost::scoped_ptr< boost::thread > scheduler_;
+		volatile int discard_;
+		bool drop_late_;
+		boost::int64_t tolerance_;
+		boost::int64_t origin_;
+		boost::int64_t ticks_;
+		int fps_num_;
+		int fps_den_;
+		boost::mutex stats_mutex_;
+		schedule_stats stats_;
 };
 
 ml::store_type_ptr ML_PLUGIN_DECLSPEC create_store_preview( const std::wstring &resource, const ml::frame_type_ptr &frame )
@@ -8,6 +8,8 @@
 #include "utility.hpp"
 #include <openmedialib/ml/stream.hpp>
 #include <openmedialib/ml/audio_block.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <cmath>
 
 #include <iostream>
@@ -392,6 +394,83 @@ void frame_report_props( const ml::frame_type_ptr &frame )
 	}
 }
 
+int key_frame_of( const ml::input_type_ptr &input, int position, const ml::awi_index_ptr &index )
+{
+	int result = position;
+
+	if ( index && index->usable( ) )
+	{
+		result = index->key_frame_of( position );
+	}
+	else if ( input )
+	{
+		// Without an index, ask the packet at position for the key frame of its gop
+		input->seek( position );
+		ml::frame_type_ptr frame = input->fetch( );
+		if ( frame && frame->get_stream( ) )
+			result = int( frame->get_stream( )->key( ) );
+	}
+
+	return result >= 0 && result <= position ? result : position;
+}
+
+namespace {
+
+struct evaluate_job
+{
+	evaluate_job( const std::vector< ml::frame_type_ptr > &frames )
+		: frames_( frames )
+		, next_( 0 )
+	{ }
+
+	void run( )
+	{
+		while( true )
+		{
+			size_t index;
+			{
+				boost::mutex::scoped_lock lock( mutex_ );
+				if ( next_ >= frames_.size( ) )
+					break;
+				index = next_ ++;
+			}
+
+			try
+			{
+				if ( frames_[ index ] )
+					frames_[ index ]->get_image( );
+			}
+			catch( const std::exception &e )
+			{
+				ARLOG_ERR( "Failed to evaluate the image at %1%: %2%" )( frames_[ index ]->get_position( ) )( e.what( ) );
+			}
+			catch( ... )
+			{
+				ARLOG_ERR( "Failed to evaluate the image at %1%" )( frames_[ index ]->get_position( ) );
+			}
+		}
+	}
+
+	const std::vector< ml::frame_type_ptr > &frames_;
+	boost::mutex mutex_;
+	size_t next_;
+};
+
+}
+
+void evaluate_images( const std::vector< ml::frame_type_ptr > &frames, int threads )
+{
+	evaluate_job job( frames );
+	const int workers = std::min< int >( threads, int( frames.size( ) ) ) - 1;
+
+	// The calling thread takes a share of the work too
+	boost::thread_group group;
+	for ( int i = 0; i < workers; i ++ )
+		group.create_thread( boost::bind( &evaluate_job::run, &job ) );
+	job.run( );
+	group.join_all( );
+}
+
 std::string to_multibyte_string( const olib::t_string& str )
 {
 #ifdef OLIB_ON_WINDOWS
@@ -3,7 +3,9 @@
 #define AMF_FILTER_UTILITY_H
 
 #include <ostream>
+#include <vector>
 #include <boost/cstdint.hpp>
+#include <openmedialib/ml/awi.hpp>
 
 namespace aml { namespace openmedialib {
 
@@ -52,6 +54,13 @@ extern void join_peaks( ml::frame_type_ptr &result, ml::frame_type_ptr &input );
 extern void copy_plane( ml::image_type_ptr output, ml::image_type_ptr input, size_t plane );
 extern void fill_plane( ml::image_type_ptr img, size_t plane, boost::uint8_t sample );
 
+// Thumbnail utilities - key_frame_of returns the key frame at or before position according to 
+// the awi index (or, when there is no usable index, to the key of the packet fetched from input 
+// at position - position itself if neither is known) and evaluate_images decodes the images of 
+// the frames on up to threads threads
+extern int key_frame_of( const ml::input_type_ptr &input, int position, const ml::awi_index_ptr &index );
+extern void evaluate_images( const std::vector< ml::frame_type_ptr > &frames, int threads );
+
 // Report to stream
 extern void report_frame( std::ostream &stream, const ml::frame_type_ptr &frame, bool evaluate = true );
 extern void report_image( std::ostream &stream, const ml::image_type_ptr &img, int num = 1, int den = 1 );
@@ -7,6 +7,11 @@
 //
 // Provides stream/packet based decoding. This is typically used for non-avformat:
 // input implementations to provide a means to decode the packets retrieved.
+//
+// When decode_video is 0, the audio block is decoded instead. Tracks are decoded
+// concurrently when there is more than one - audio_threads limits the threads
+// used (0 is automatic, 1 decodes on the calling thread) and audio_tracks is a
+// comma separated list of the tracks to decode (empty for all).
 // 
 // #filter:avencode
 // 
@@ -18,6 +23,7 @@
 #include <openmedialib/ml/openmedialib_plugin.hpp>
 #include <openmedialib/ml/filter_simple.hpp>
 #include <openmedialib/ml/stream.hpp>
+#include <openmedialib/ml/analyse.hpp>
 #include <openmedialib/ml/audio_block.hpp>
 #include <opencorelib/cl/profile.hpp>
 #include <openpluginlib/pl/pcos/isubject.hpp>
@@ -27,6 +33,12 @@
 #include <opencorelib/cl/core.hpp>
 #include <opencorelib/cl/enforce_defines.hpp>
 #include <opencorelib/cl/log_defines.hpp>
+#include <opencorelib/cl/thread_pool.hpp>
+#include <opencorelib/cl/function_job.hpp>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <vector>
 
@@ -54,6 +66,16 @@ extern const int AML_AES3_CODEC_ID;
 static const pl::pcos::key key_gop_closed_ = pl::pcos::key::from_string( "gop_closed" );
 static const pl::pcos::key key_fixed_sar_ = pl::pcos::key::from_string( "fixed_sar" );
 
+// Closed gop flag from a previous analysis of the stream, -1 if it hasn't been analysed
+static int analysed_closed( const ml::stream_type_ptr &stream )
+{
+	pl::pcos::property analysed = stream->properties( ).get_property_with_key( ml::analyse_type::key_analysed_ );
+	pl::pcos::property closed = stream->properties( ).get_property_with_key( ml::analyse_type::key_closed_gop_ );
+	if ( !analysed.valid( ) || !analysed.value< int >( ) || !closed.valid( ) || !closed.is_a< int >( ) )
+		return -1;
+	return closed.value< int >( ) ? 1 : 0;
+}
+
 static bool is_dv( const std::string &codec )
 {
 	return boost::algorithm::ends_with( codec,  "dv" ) || codec == "dv25" || codec == "dv50" || codec == "dvcprohd_1080i";
@@ -361,10 +383,16 @@ class stream_queue
 		void look_for_closed( const ml::frame_type_ptr &frame )
 		{
 			pl::pcos::property gop_closed( key_gop_closed_ );
+			const int analysed = analysed_closed( frame->get_stream( ) );
 			if ( is_dv( frame->get_stream( )->codec( ) ) || is_imx( frame->get_stream( )->codec( ) ) )
 			{
 				frame->get_stream( )->properties( ).append( gop_closed = 1 );
 			}
+			else if ( is_mpeg2( frame->get_stream( )->codec( ) ) && analysed >= 0 )
+			{
+				// Provided by the analyse filter (possibly from its sidecar), so the packet needn't be scanned
+				frame->get_stream( )->properties( ).append( gop_closed = analysed );
+			}
 			else if ( is_mpeg2( frame->get_stream( )->codec( ) ) )
 			{
 				boost::uint8_t *ptr = find_mpeg2_gop( frame->get_stream( ) );
@@ -471,6 +499,12 @@ class stream_queue
 			return !found;
 		}
 	
+	// The scope cache which decoded images are held in (shared with other decoders of the scope)
+	const lru_cache_type_ptr &lru_cache( ) const
+	{
+		return lru_cache_;
+	}
+
 	lru_cache_type::key_type lru_key_for_position( boost::int32_t pos )
 	{
 		lru_cache_type::key_type my_key( pos, input_->get_uri() );
@@ -573,21 +607,45 @@ class ML_PLUGIN_DECLSPEC frame_avformat : public ml::frame_type
 };
 	
 	
+// Decodes the audio tracks of the audio block attached to a frame.
+//
+// Each track has its own codec context, converter and reseat, so when more than
+// one track is decoded, the tracks are handed to a thread pool and decoded
+// concurrently (the calling thread decodes the first track itself). The results
+// are always combined in the order given by tracks_to_decode.
+//
+// A threads value of 0 selects one thread per track (limited by the number of
+// cores available) and 1 decodes all tracks on the calling thread.
+
 class avformat_audio_decoder
 {
 public:
-	avformat_audio_decoder( const std::vector< size_t >& tracks_to_decode )
+	avformat_audio_decoder( const std::vector< size_t >& tracks_to_decode, int threads = 0 )
 		: tracks_to_decode_( tracks_to_decode )
-		, decoded_frame_( 0 )
 		, next_packets_to_decoders_( )
 		, reseats_( )
 		, expected_( -1 )
+		, pool_( 0 )
 	{
 		ARENFORCE_MSG( tracks_to_decode_.size( ), "List of channels to decode can not be empty" );
+
+		if ( threads <= 0 )
+			threads = std::max< int >( 1, int( boost::thread::hardware_concurrency( ) ) );
+		threads = std::min< int >( threads, int( tracks_to_decode_.size( ) ) );
+
+		// The calling thread decodes one of the tracks, so the pool only needs the rest
+		if ( threads > 1 )
+			pool_ = new cl::thread_pool( threads - 1, boost::posix_time::seconds( 5 ) );
 	}
 	
 	virtual ~avformat_audio_decoder()
 	{
+		if ( pool_ )
+		{
+			pool_->terminate_all_threads( boost::posix_time::seconds( 5 ) );
+			delete pool_;
+		}
+
 		tear_down_codecs( );
 	}
 	
@@ -602,22 +660,71 @@ public:
 		audio::block_type_ptr audio_block = result->audio_block( );
 		
 		std::vector< audio_type_ptr > result_audios( tracks_to_decode_.size( ) );
+		std::vector< int > discards( tracks_to_decode_.size( ), 0 );
 		
-		// Iterate through the tracks that we have been told to decode and get the audio out
-		for( std::vector< size_t >::const_iterator tr_it = tracks_to_decode_.begin(); tr_it != tracks_to_decode_.end(); ++tr_it )
+		// Reset the next expected packet pos to the first packet in each track after a seek
+		if ( result->get_position( ) != expected_ )
 		{
-			int discard = 0;
-			if ( result->get_position( ) != expected_ )
+			for( size_t i = 0; i < tracks_to_decode_.size( ); ++i )
+			{
+				const size_t track = tracks_to_decode_[ i ];
+				ARENFORCE_MSG( audio_block->tracks.find( track ) != audio_block->tracks.end( ), "Audio track %1% not available in audio block" )( track );
+				next_packets_to_decoders_[ track ] = audio_block->tracks[ track ].packets.begin()->first;
+				reseats_[ track ]->clear();
+				discards[ i ] = audio_block->tracks[ track ].discard;
+			}
+		}
+
+		if ( pool_ )
+		{
+			// Hand all but the first track to the pool and decode the first one here
+			std::vector< cl::function_job_ptr > jobs;
+			for( size_t i = 1; i < tracks_to_decode_.size( ); ++i )
 			{
-				// Reset the next expected packet pos to the first packet in the first track
-				next_packets_to_decoders_[ *tr_it ] = audio_block->tracks[ *tr_it ].packets.begin()->first;
-				reseats_[ *tr_it ]->clear();
-				discard = audio_block->tracks[ *tr_it ].discard;
+				cl::function_job_ptr job( new cl::function_job( boost::bind( &avformat_audio_decoder::decode_job, this, boost::ref( audio_block ), i, 
+																			 result->get_position( ), discards[ i ], boost::ref( result_audios[ i ] ) ) ) );
+				pool_->add_job( job );
+				jobs.push_back( job );
 			}
 
-			result_audios[ tr_it - tracks_to_decode_.begin() ] = decode_track( audio_block->tracks[ *tr_it ].packets, *tr_it,
-																			   audio_block->samples, result->get_position( ),
-																			   discard );
+			bool failed = false;
+			std::string reason;
+
+			try
+			{
+				decode_job( audio_block, 0, result->get_position( ), discards[ 0 ], result_audios[ 0 ] );
+			}
+			catch( const std::exception &e )
+			{
+				failed = true;
+				reason = e.what( );
+			}
+
+			// All jobs must be finished before returning since they refer to result_audios
+			for( size_t i = 0; i < jobs.size( ); ++i )
+			{
+				while( !jobs[ i ]->wait_for_job_done( boost::posix_time::seconds( 5 ) ) )
+					ARLOG_DEBUG3( "Still waiting for audio track %1% to be decoded" )( tracks_to_decode_[ i + 1 ] );
+
+				if ( !failed && jobs[ i ]->get_exception_thrown( ) )
+				{
+					failed = true;
+					if ( jobs[ i ]->get_base_exception( ) )
+						reason = jobs[ i ]->get_base_exception( )->what( );
+					else if ( jobs[ i ]->get_std_exception( ) )
+						reason = jobs[ i ]->get_std_exception( )->what( );
+					else
+						reason = "unknown error";
+				}
+			}
+
+			ARENFORCE_MSG( !failed, "Failed to decode audio at position %1%: %2%" )( result->get_position( ) )( reason );
+		}
+		else
+		{
+			// Iterate through the tracks that we have been told to decode and get the audio out
+			for( size_t i = 0; i < tracks_to_decode_.size( ); ++i )
+				decode_job( audio_block, i, result->get_position( ), discards[ i ], result_audios[ i ] );
 		}
 		
 		audio_type_ptr combined = audio::combine( result_audios );
@@ -628,6 +735,15 @@ public:
 	}
 	
 private:
+
+	// Decodes the track at index in tracks_to_decode_ - may be called concurrently for different indexes
+	void decode_job( const audio::block_type_ptr &audio_block, size_t index, int position, int discard, audio_type_ptr &result )
+	{
+		const size_t track = tracks_to_decode_[ index ];
+		audio::block_type::const_iterator it = audio_block->tracks.find( track );
+		ARENFORCE_MSG( it != audio_block->tracks.end( ), "Audio track %1% not available in audio block" )( track );
+		result = decode_track( it->second.packets, track, audio_block->samples, position, discard );
+	}
 	
 	void tear_down_codecs( )
 	{
@@ -646,8 +762,11 @@ private:
 			delete ctx;
 		}
 
-		if( decoded_frame_ != 0 )
-			av_free( decoded_frame_ );
+		std::map< size_t, AVFrame * >::const_iterator itf;
+		for( itf = decoded_frames_.begin(); itf != decoded_frames_.end(); ++itf )
+			av_free( itf->second );
+
+		decoded_frames_.clear();
 
 		audio_contexts_.clear();
 		audio_codecs_.clear();
@@ -690,16 +809,21 @@ private:
 			}
 
 			audio_filters_[ tracks_to_decode_[ i ] ] = new avaudio_convert_to_aml( freq_in_out, chan_in_out, chan_in_out, AV_fmt_in, aml_format_out );
+
+			// Each track needs its own frame since tracks may be decoded concurrently
+			next_packets_to_decoders_[ tracks_to_decode_[ i ] ] = 0;
+			ARENFORCE_MSG( decoded_frames_[ tracks_to_decode_[ i ] ] = avcodec_alloc_frame( ) , "Failed to allocate AVFrame for decoding. Out of memory?" ); 
 		}
-		
-		ARENFORCE_MSG( decoded_frame_ = avcodec_alloc_frame( ) , "Failed to allocate AVFrame for decoding. Out of memory?" ); 
-		
 	}
 
 	audio_type_ptr decode_track( const audio::track_type::map& track_packets, const int track,
 								 const int wanted_samples, const int position, const int discard )
 	{
-		AVCodecContext *track_context = audio_contexts_[ track ];
+		// Only lookups here - the maps are shared by the tracks which are decoded concurrently
+		AVCodecContext *track_context = audio_contexts_.find( track )->second;
+		AVFrame *decoded_frame = decoded_frames_.find( track )->second;
+		avaudio_convert_to_aml *&track_filter = audio_filters_.find( track )->second;
+		int &next_packet = next_packets_to_decoders_.find( track )->second;
 		
 		AVPacket avpkt;
 		av_init_packet( &avpkt );
@@ -707,8 +831,8 @@ private:
 		// Discard will be set to 0 after a seek
 		int left_to_discard = discard;
 
-		audio::reseat_ptr track_reseater = reseats_[ track ];
-		const boost::int64_t packet_position = next_packets_to_decoders_[ track ];
+		audio::reseat_ptr track_reseater = reseats_.find( track )->second;
+		const boost::int64_t packet_position = next_packet;
 		audio::track_type::const_iterator packets_it =
 			track_packets.find( packet_position );
 
@@ -729,39 +853,39 @@ private:
 			stream_type_ptr strm = packets_it->second;
 			ARENFORCE_MSG( strm && strm->bytes( ), "No stream available on packet %1%" )( packets_it->first );
 	
-			avcodec_get_frame_defaults( decoded_frame_ );
+			avcodec_get_frame_defaults( decoded_frame );
 			
 			avpkt.data = strm->bytes( );
 			avpkt.size = strm->length( );
 			
 			int got_frame = 0;
-			avcodec_decode_audio4( track_context, decoded_frame_, &got_frame, &avpkt );
+			avcodec_decode_audio4( track_context, decoded_frame, &got_frame, &avpkt );
 
 			//ARENFORCE_MSG( error >= 0, "Error while decoding audio for track %1%. Error = %2%" )( track )( error );
 			
-			next_packets_to_decoders_[ track ] += packets_it->second->samples();
+			next_packet += packets_it->second->samples();
 
 			if( got_frame )
 			{
-				int channels = decoded_frame_->channels;
-				int frequency = decoded_frame_->sample_rate;
-				AVSampleFormat fmt = AVSampleFormat( decoded_frame_->format );
+				int channels = decoded_frame->channels;
+				int frequency = decoded_frame->sample_rate;
+				AVSampleFormat fmt = AVSampleFormat( decoded_frame->format );
 				ml::audio::identity id = AVSampleFormat_to_aml_id( fmt );
-				int samples = decoded_frame_->nb_samples;
-				bool changed = audio_filters_[ track ]->has_input_changed( frequency, channels, fmt );
+				int samples = decoded_frame->nb_samples;
+				bool changed = track_filter->has_input_changed( frequency, channels, fmt );
 
 				if ( changed && track_reseater->size( ) )
 				{
 					ml::audio_type_ptr buffered = track_reseater->retrieve( track_reseater->size( ) );
 					const boost::uint8_t *ptr = static_cast< const boost::uint8_t * >( buffered->pointer( ) );
-					ml::audio_type_ptr converted = audio_filters_[ track ]->resample( &ptr, buffered->samples( ), frequency, channels, fmt );
+					ml::audio_type_ptr converted = track_filter->resample( &ptr, buffered->samples( ), frequency, channels, fmt );
 					track_reseater->append( converted );
 				}
 
 				if ( changed )
 				{
-					delete audio_filters_[ track ];
-					audio_filters_[ track ] = new avaudio_convert_to_aml( frequency, channels, channels, fmt, id );
+					delete track_filter;
+					track_filter = new avaudio_convert_to_aml( frequency, channels, channels, fmt, id );
 				}
 
 				ARLOG_DEBUG7( "Managed to decode packet %1% on track %2%. Channels = %3%, frequency = %4%, samples = %5%, discard = %6%" )
@@ -776,7 +900,7 @@ private:
 					}
 				}
 
-				ml::audio_type_ptr decoded_audio = audio_filters_[ track ]->convert_with_offset( ( const boost::uint8_t ** ) decoded_frame_->data, decoded_frame_->nb_samples - left_to_discard, left_to_discard );
+				ml::audio_type_ptr decoded_audio = track_filter->convert_with_offset( ( const boost::uint8_t ** ) decoded_frame->data, decoded_frame->nb_samples - left_to_discard, left_to_discard );
 
 				left_to_discard = 0;
 
@@ -798,7 +922,7 @@ private:
 		// cache the information
 		if( track_reseater->size( ) == 0 )
 		{
-			ret = ml::audio::allocate( audio_filters_[ track ]->get_out_format( ), track_context->sample_rate, track_context->channels, wanted_samples, true );
+			ret = ml::audio::allocate( track_filter->get_out_format( ), track_context->sample_rate, track_context->channels, wanted_samples, true );
 		}
 		else
 		{
@@ -816,18 +940,21 @@ private:
 	std::map< size_t, AVCodecContext * > audio_contexts_;
 	std::map< size_t, avaudio_convert_to_aml* > audio_filters_;
 	std::map< size_t, AVCodec * > audio_codecs_;
-	AVFrame *decoded_frame_;
+	std::map< size_t, AVFrame * > decoded_frames_;
 	
 	// Kep track of what packet to feed the decoder next. We need one for eack track
 	std::map< size_t, int > next_packets_to_decoders_;
 	std::map< size_t, audio::reseat_ptr > reseats_;
 	
 	int expected_;
+
+	// Decodes the additional tracks concurrently (null when single threaded)
+	cl::thread_pool *pool_;
 };
 	
 typedef boost::shared_ptr< avformat_audio_decoder > avformat_audio_decoder_ptr;
 
-class avformat_decode_filter : public filter_simple
+class avformat_decode_filter : public filter_simple, public memory_consumer
 {
 	public:
 		// Filter_type overloads
@@ -839,6 +966,8 @@ class avformat_decode_filter : public filter_simple
 			, prop_threads_( pl::pcos::key::from_string( "threads" ) )
 			, prop_decode_video_( pl::pcos::key::from_string( "decode_video" ) )
 			, prop_strict_( pl::pcos::key::from_string( "strict" ) )
+			, prop_audio_threads_( pl::pcos::key::from_string( "audio_threads" ) )
+			, prop_audio_tracks_( pl::pcos::key::from_string( "audio_tracks" ) )
 			, initialised_( false )
 			, queue_( )
 			, audio_queue_( )
@@ -849,6 +978,8 @@ class avformat_decode_filter : public filter_simple
 			properties( ).append( prop_threads_ = 1 );
 			properties( ).append( prop_decode_video_ = 1 );
 			properties( ).append( prop_strict_ = FF_COMPLIANCE_NORMAL );
+			properties( ).append( prop_audio_threads_ = 0 );
+			properties( ).append( prop_audio_tracks_ = std::wstring( L"" ) );
 		}
 
 		virtual ~avformat_decode_filter( )
@@ -861,6 +992,15 @@ class avformat_decode_filter : public filter_simple
 		// This provides the name of the plugin (used in serialisation)
 		virtual const std::wstring get_uri( ) const { return L"avdecode"; }
 
+		// Decoded images are held in the scope cache rather than here
+		virtual boost::int64_t memory_usage( ) const { return 0; }
+
+		virtual void memory_shared( std::vector< memory_consumer * > &result ) const
+		{
+			if ( queue_ && queue_->lru_cache( ) )
+				result.push_back( queue_->lru_cache( ).get( ) );
+		}
+
 	protected:
 		
 		// The main access point to the filter
@@ -891,9 +1031,10 @@ class avformat_decode_filter : public filter_simple
 					audio::block_type::const_iterator it;
 					std::vector< size_t > tracks;
 					for( it = block->tracks.begin(); it != block->tracks.end(); ++it )
-						tracks.push_back( it->first );
+						if ( wants_track( it->first ) )
+							tracks.push_back( it->first );
 					
-					audio_queue_ = avformat_audio_decoder_ptr( new avformat_audio_decoder( tracks ) );
+					audio_queue_ = avformat_audio_decoder_ptr( new avformat_audio_decoder( tracks, prop_audio_threads_.value< int >( ) ) );
 				}
 
 				initialised_ = true;
@@ -923,12 +1064,33 @@ class avformat_decode_filter : public filter_simple
 		}
 
 	private:
+		// Determines if the track is listed in the comma separated audio_tracks property (an empty list selects all)
+		bool wants_track( size_t track ) const
+		{
+			const std::wstring list = prop_audio_tracks_.value< std::wstring >( );
+			if ( list == L"" )
+				return true;
+
+			std::vector< std::wstring > tokens;
+			boost::algorithm::split( tokens, list, boost::algorithm::is_any_of( L"," ) );
+			for( std::vector< std::wstring >::const_iterator it = tokens.begin( ); it != tokens.end( ); ++it )
+			{
+				const std::wstring token = boost::algorithm::trim_copy( *it );
+				if ( token != L"" && token == boost::lexical_cast< std::wstring >( track ) )
+					return true;
+			}
+
+			return false;
+		}
+
 		pl::pcos::property prop_gop_open_;
 		pl::pcos::property prop_scope_;
 		pl::pcos::property prop_source_uri_;
 		pl::pcos::property prop_threads_;
 		pl::pcos::property prop_decode_video_;
 		pl::pcos::property prop_strict_;
+		pl::pcos::property prop_audio_threads_;
+		pl::pcos::property prop_audio_tracks_;
 		bool initialised_;
 		stream_queue_ptr queue_;
 		avformat_audio_decoder_ptr audio_queue_;
@@ -1186,6 +1348,12 @@ class avformat_encode_filter : public filter_simple
 						if ( source->get_stream( )->properties( ).get_property_with_key( key_gop_closed_ ).value< int >( ) == 1 )
 							gop_closed = 1;
 					}
+					else if ( source->get_stream( ) )
+					{
+						// Packets which haven't passed through a decoder may carry the analysis (possibly 
+						// from the analyse filter's sidecar), which saves scanning them for the gop header
+						gop_closed = analysed_closed( source->get_stream( ) ) == 1 ? 1 : 0;
+					}
 					
 					if( source->get_stream( ) && ( source->get_stream( )->codec( ) != video_wrapper_->stream_codec_id( ) ) )
 					   stream_types_match = false;
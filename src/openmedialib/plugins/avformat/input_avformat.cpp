@@ -16,6 +16,7 @@
 #include <openmedialib/ml/audio_block.hpp>
 #include <openmedialib/ml/keys.hpp>
 #include <openmedialib/ml/io.hpp>
+#include <openmedialib/ml/memory_budget.hpp>
 
 #include <openpluginlib/pl/pcos/isubject.hpp>
 #include <openpluginlib/pl/pcos/observer.hpp>
@@ -195,7 +196,8 @@ class avformat_source : public input_type
 class stream_cache
 {
 	private:
-		cl::lru_key key_;
+		// Fetching the lru only refreshes its place in the lru_stream_cache
+		mutable cl::lru_key key_;
 		enum AVMediaType type_;
 		size_t index_;
 		boost::int64_t expected_;
@@ -287,6 +289,18 @@ class stream_cache
 			return result;
 		}
 
+		// Bytes held by the packets in the cache
+		boost::int64_t memory_usage( ) const
+		{
+			return ml::lru_memory_usage( *lru_stream_cache::fetch( key_ ) );
+		}
+
+		// Drop the least recently used packets - they're read again if they're needed
+		boost::int64_t memory_release( boost::int64_t bytes )
+		{
+			return ml::lru_memory_release( *lru_stream_cache::fetch( key_ ), bytes );
+		}
+
 	private:
 		ml::stream_type_ptr find_audio( boost::int64_t position )
 		{
@@ -956,9 +970,25 @@ class avformat_demux
 		{
 			return caches.find( id ) != caches.end( );
 		}
+
+		boost::int64_t memory_usage( ) const
+		{
+			boost::int64_t result = 0;
+			for ( std::map< size_t, stream_cache >::const_iterator iter = caches.begin( ); iter != caches.end( ); iter ++ )
+				result += iter->second.memory_usage( );
+			return result;
+		}
+
+		boost::int64_t memory_release( boost::int64_t bytes )
+		{
+			boost::int64_t result = 0;
+			for ( std::map< size_t, stream_cache >::iterator iter = caches.begin( ); result < bytes && iter != caches.end( ); iter ++ )
+				result += iter->second.memory_release( bytes - result );
+			return result;
+		}
 };
 
-class ML_PLUGIN_DECLSPEC avformat_input : public avformat_source
+class ML_PLUGIN_DECLSPEC avformat_input : public avformat_source, public memory_consumer
 {
 	public:
 		// Constructor and destructor
@@ -1105,6 +1135,11 @@ class ML_PLUGIN_DECLSPEC avformat_input : public avformat_source
 		virtual bool has_video( ) const { return prop_video_index_.value< int >( ) >= 0 && prop_video_index_.value< int >( ) < int( video_indexes_.size( ) ); }
 		virtual bool has_audio( ) const { return prop_audio_index_.value< int >( ) >= 0 && prop_audio_index_.value< int >( ) < int( audio_indexes_.size( ) ); }
 
+		// Packets cached by the demuxer
+		virtual boost::int64_t memory_usage( ) const { return demuxer_.memory_usage( ); }
+		virtual boost::int64_t memory_release( boost::int64_t bytes ) { return demuxer_.memory_release( bytes ); }
+		virtual int memory_priority( ) const { return memory::packets; }
+
 		// Audio/Visual
 		virtual int get_frames( ) const 
 		{
@@ -10,18 +10,26 @@
 
 #include <opencorelib/cl/core.hpp>
 #include <opencorelib/cl/enforce_defines.hpp>
+#include <opencorelib/cl/spsc_queue.hpp>
 
 #include <openmedialib/ml/openmedialib_plugin.hpp>
 #include <openmedialib/ml/stream.hpp>
 #include <openmedialib/ml/awi.hpp>
 #include <openmedialib/ml/io.hpp>
 #include <openmedialib/ml/keys.hpp>
+#include <openmedialib/ml/statistics.hpp>
 #include <openpluginlib/pl/pcos/isubject.hpp>
 #include <openpluginlib/pl/pcos/observer.hpp>
 
 #include <vector>
+#include <deque>
+#include <limits>
 #include <algorithm>
 
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
 #ifdef WIN32
 #	include <windows.h>
 #	undef INT64_C
@@ -175,6 +183,13 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 			, prop_audio_split_( pcos::key::from_string( "audio_split" ) )
 			, prop_frag_key_frame_( pcos::key::from_string( "frag_key_frame" ) )
 			, prop_flush_( pcos::key::from_string( "flush" ) )
+			, prop_pipeline_( pcos::key::from_string( "pipeline" ) )
+			, prop_pipeline_queue_( pcos::key::from_string( "pipeline_queue" ) )
+			, prop_pipeline_video_us_( pcos::key::from_string( "pipeline_video_us" ) )
+			, prop_pipeline_audio_us_( pcos::key::from_string( "pipeline_audio_us" ) )
+			, prop_pipeline_mux_us_( pcos::key::from_string( "pipeline_mux_us" ) )
+			, prop_pipeline_mux_wait_us_( pcos::key::from_string( "pipeline_mux_wait_us" ) )
+			, prop_pipeline_stall_us_( pcos::key::from_string( "pipeline_stall_us" ) )
 			, ts_generator_video_( AWI_V4_TYPE_VIDEO )
 			, ts_generator_audio_( AWI_V4_TYPE_AUDIO_FIRST, false ) //Will not write index header/footer
 			, ts_context_( 0 )
@@ -195,6 +210,13 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 			, first_had_audio_( false )
 			, audio_frames_( 0 )
 			, audio_packets_( 0 )
+			, pipelined_( false )
+			, pipeline_abort_( false )
+			, pipeline_failed_( false )
+			, mux_waiting_( false )
+			, video_lane_( 0 )
+			, mux_us_( 0 )
+			, mux_wait_us_( 0 )
 		{
 			ARENFORCE_MSG( frame, "No frame passed in construction of %s" )( resource );
 
@@ -329,13 +351,29 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 			properties( ).append( prop_audio_split_ = 0 );
 			properties( ).append( prop_frag_key_frame_ = 0 );
 			properties( ).append( prop_flush_ = 1 );
+
+			// Pipelined encoding - when enabled, video and each audio stream are encoded on their own 
+			// threads and a further thread muxes the packets. The queue size bounds the number of frames
+			// which can be pending in each encode stage before push blocks.
+			properties( ).append( prop_pipeline_ = 0 );
+			properties( ).append( prop_pipeline_queue_ = 8 );
+
+			// Time spent in each stage of the pipeline (microseconds)
+			properties( ).append( prop_pipeline_video_us_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_pipeline_audio_us_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_pipeline_mux_us_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_pipeline_mux_wait_us_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_pipeline_stall_us_ = boost::int64_t( 0 ) );
 		}
 
 		virtual ~avformat_store( )
 		{
+			// Finish (or abandon) the encode stages before the container is closed
+			stop_pipeline( oc_ && prop_flush_.value< int >( ) );
+
 			if ( oc_ && prop_flush_.value< int >( ) )
 			{
-				if ( video_stream_ && !video_copy_ )
+				if ( video_stream_ && !video_copy_ && !pipelined_ )
 				{
 					int out_size = 0;
 					do 
@@ -496,6 +534,10 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 				}
 			}
 
+			// Start the encode and mux threads if requested
+			if ( ret && prop_pipeline_.value< int >( ) )
+				start_pipeline( );
+
 			first_frame_ = frame_type_ptr( );
 
 			return ret;
@@ -537,8 +579,8 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 
 		void close_container( )
 		{
-			// Finalize encode for video
-			if ( audio_stream_.size( ) )
+			// Finalize encode for audio (the pipeline stages have already done so)
+			if ( audio_stream_.size( ) && !pipelined_ )
 			{
 				// Submit any partial audio block to the queue now
 				if( audio_block_used_ != 0 )
@@ -629,6 +671,9 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 				return false;
 			}
 
+			if ( pipelined_ )
+				return feed_pipeline( frame );
+
 			queue( frame );
 
 			while ( 1 )
@@ -675,6 +720,8 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 		// the store doesn't queue frames.
 		virtual frame_type_ptr flush( )
 		{ 
+			update_pipeline_stats( );
+
 			if ( prop_show_stats_.value< int >( ) )
 			{
 				double audio_pts = audio_stream_.size( ) != 0 ? double( audio_stream_[ 0 ]->pts.val ) * audio_stream_[ 0 ]->time_base.num / audio_stream_[ 0 ]->time_base.den : 0.0;
@@ -688,6 +735,12 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 		// implementation applies when the store doesn't queue frames.
 		virtual void complete( )
 		{ 
+			// Wait for the encode stages to consume everything pushed so far
+			wait_pipeline( );
+			update_pipeline_stats( );
+			if ( pipelined_ )
+				check_pipeline( );
+
 			if ( prop_show_stats_.value< int >( ) )
 			{
 				double audio_pts = audio_stream_.size( ) != 0 ? double( audio_stream_[ 0 ]->pts.val ) * audio_stream_[ 0 ]->time_base.num / audio_stream_[ 0 ]->time_base.den : 0.0;
@@ -1252,13 +1305,14 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 			{
 				AVCodecContext *c = video_stream_->codec;
 				ml::image::MLPixelFormat pf = ml::image::AV_to_ML( c->pix_fmt );
-				if ( pf != ml::image::ML_PIX_FMT_NONE && !video_copy_ )
+				if ( pf != ml::image::ML_PIX_FMT_NONE && !video_copy_ && !pipelined_ )
 				{
 					frame = ml::frame_convert( frame, ml::image::MLPF_to_string( pf ) );
 					video_queue_.push_back( frame );
 				}
 				else
 				{
+					// When pipelined, the conversion is left to the video encode stage
 					video_queue_.push_back( frame );
 				}
 			}
@@ -1350,26 +1404,24 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 					pkt.dts = av_rescale_q( encoded_images_, c->time_base, video_stream_->time_base );
 				}
 
-				if( oc_->pb && c->coded_frame && ( c->coded_frame->key_frame || c->coded_frame->pict_type == AV_PICTURE_TYPE_I ) && ( oc_->pb->pos != ts_last_offset_ || ts_last_offset_ == 0 ) )
-				{
-					if ( ts_context_ )
-					{
-						ts_generator_video_.enroll( encoded_images_, oc_->pb->pos );
-						write_ts_index( );
-					}
-					pkt.flags |= AV_PKT_FLAG_KEY;
-					ts_last_position_ = encoded_images_;
-					ts_last_offset_ = oc_->pb->pos;
-				}
+				const bool key = c->coded_frame && ( c->coded_frame->key_frame || c->coded_frame->pict_type == AV_PICTURE_TYPE_I );
 
 				pkt.stream_index = video_stream_->index;
 
 				if ( log_file_ && prop_pass_.value< int >( ) == 1 && c->stats_out )
 					fprintf( log_file_, "%s", c->stats_out );
 
-				// Write the compressed frame in the media file
-				int err = write_packet( oc_, &pkt, c, bitstream_filters_[ pkt.stream_index ] );
-				ret = err >= 0;
+				// Write the compressed frame in the media file (or pass it to the mux stage)
+				if ( pipelined_ )
+				{
+					ret = deliver( video_lane_, pkt, c, key, encoded_images_ );
+				}
+				else
+				{
+					index_video_packet( pkt, key, encoded_images_ );
+					int err = write_packet( oc_, &pkt, c, bitstream_filters_[ pkt.stream_index ] );
+					ret = err >= 0;
+				}
 
 				if ( log_file_ && prop_pass_.value< int >( ) == 1  && c->stats_out )
 					fprintf( log_file_, "%s", c->stats_out );
@@ -1446,7 +1498,53 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 			return ret;
 		}
 
+		// Flags encoded key frames and enrolls them in the ts index - this depends on the position in 
+		// the output, so it must happen on the thread which writes the packet, just before it's written
+		void index_video_packet( AVPacket &pkt, bool key, int position )
+		{
+			if( oc_->pb && key && ( oc_->pb->pos != ts_last_offset_ || ts_last_offset_ == 0 ) )
+			{
+				if ( ts_context_ )
+				{
+					ts_generator_video_.enroll( position, oc_->pb->pos );
+					write_ts_index( );
+				}
+				pkt.flags |= AV_PKT_FLAG_KEY;
+				ts_last_position_ = position;
+				ts_last_offset_ = oc_->pb->pos;
+			}
+		}
+
+		// Enrolls every 8th packet of the first audio stream in the ts index (as above)
+		void index_audio_packet( )
+		{
+			if( audio_packet_num_ % 8 == 0 )
+			{
+				if( ts_context_ )
+				{
+					ts_generator_audio_.enroll( audio_packet_num_, oc_->pb->pos );
+					write_ts_index( );
+				}
+			}
+			audio_packet_num_++;
+		}
+
 		int write_packet( AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx, AVBitStreamFilterContext *bsfc )
+		{
+			if ( filter_packet( pkt, avctx, bsfc ) < 0 )
+				return -1;
+
+			// Write the frame
+			int result = av_interleaved_write_frame(s, pkt);
+
+			// Free memory associated to the packet
+			//av_free_packet( pkt );
+
+			// Return result of the write
+			return result;
+		}
+
+		int filter_packet( AVPacket *pkt, AVCodecContext *avctx, AVBitStreamFilterContext *bsfc )
 		{
 			// Apply any bitstream filters which are required
 			// TODO: Provide external control over video and audio bitstream filters
@@ -1467,22 +1565,13 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 				bsfc = bsfc->next;
 			}
 
-			// Write the frame
-			int result = av_interleaved_write_frame(s, pkt);
-
-			// Free memory associated to the packet
-			//av_free_packet( pkt );
-
-			// Return result of the write
-			return result;
+			return 0;
 		}
 
 		// Process and output an image
 		// Precondition: the video queue is not empty
 		bool process_video( )
 		{
-			bool ret = true;
-
 			// Obtain the next image
 			frame_type_ptr frame = *( video_queue_.begin( ) );
 			video_queue_.pop_front( );
@@ -1492,6 +1581,14 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 			if ( video_copy_ )
 				return do_stream_write( frame );
 
+			return encode_video( frame );
+		}
+
+		// Convert and encode the image of the frame
+		bool encode_video( const frame_type_ptr &frame )
+		{
+			bool ret = true;
+
 			ml::image_type_ptr image = frame->get_image( );
 			AVCodecContext *c = video_stream_->codec;
 
@@ -1592,134 +1689,726 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 			bool ret = true;
 
 			audio_type_ptr audio;
-			boost::uint8_t *data = 0;
 
 			if ( audio_queue_.size( ) )
 			{
 				audio = *( audio_queue_.begin( ) );
 				audio_queue_.pop_front( );
-				data = static_cast< boost::uint8_t * >( audio->pointer( ) );
 			}
 			else
 			{
 				ret = false;
 			}
 
-			int stream = 0;
+			// Here we keep track of the number of audio packets which are delivered to the 
+			// codec contexts - note that in the split case, we only count this once.
+			if ( audio )
+				audio_frames_ ++;
+
+			for ( size_t stream = 0; ( do_flush || ( ret && audio ) ) && stream < audio_stream_.size( ); stream ++ )
+				ret = encode_audio( stream, audio, do_flush, audio_tmpbuf_, audio_packets_ );
+
+			first_audio_ = false;
+
+			return ret;
+		}
+
+		// Encode a block of audio samples to the given stream - tmpbuf is used to extract the
+		// channels when splitting and packets counts the packets returned by the codec
+		bool encode_audio( size_t stream, const audio_type_ptr &audio, bool do_flush, boost::uint8_t *tmpbuf, int &packets )
+		{
+			bool ret = true;
+
+			AVStream *av_stream = audio_stream_[ stream ];
+			const boost::uint8_t *data = audio ? static_cast< const boost::uint8_t * >( audio->pointer( ) ) : 0;
 
 			int encode_tries = 1;
 
-			for ( std::vector< AVStream * >::iterator iter = audio_stream_.begin( ); ( do_flush || ( ret && data ) ) && iter != audio_stream_.end( ); ++iter, ++stream )
+			for( int ec=0; ec<encode_tries; ec++ )
 			{
-				for( int ec=0; ec<encode_tries; ec++ )
+				int got_packet = 0;
+				AVCodecContext *c = av_stream->codec;
+
+				// make sure the context has had a codec associated with it.
+				if ( 0 == c->codec )
+				{
+					continue;
+				}
+
+				AVPacket pkt;
+				pkt.size = 0;
+				pkt.data = 0;
+				av_init_packet( &pkt );
+
+				boost::shared_ptr< AVFrame > temp;
+
+				if ( prop_audio_split_.value< int >( ) && audio )
 				{
-					int got_packet = 0;
-					AVCodecContext *c = ( *iter )->codec;
+					int samples = audio->samples( );
+					int channels = audio->channels( );
+					int channels_to_write = c->channels;
+					int start_channel = int( stream ) * prop_audio_split_.value< int >( );
+					int size = audio->sample_storage_size( );
+
+					boost::uint8_t *dst = tmpbuf;
+					const boost::uint8_t *src = data + start_channel * size;
+					while( samples -- )
+					{
+						memcpy( dst, src, size * channels_to_write );
+						dst += channels_to_write * size;
+						src += channels * size;
+					}
 
-					// make sure the context has had a codec associated with it.
-					if ( 0 == c->codec )
+					if ( audio_filters_[ stream ] == 0 )
 					{
-						continue;
+						audio_filters_[ stream ].reset( new avaudio_convert_to_AVFrame( audio->frequency( ), c->sample_rate, channels_to_write, c->channels, aml_id_to_AVSampleFormat( audio->id( ) ), c->sample_fmt ) );
+					}
+
+					temp = audio_filters_[ stream ]->convert( ( const boost::uint8_t ** )&tmpbuf, audio->samples( ) );
+					avcodec_encode_audio2( c, &pkt, temp.get(), &got_packet );
+				}
+				else if ( audio )
+				{
+					if ( audio_filters_[ stream ] == 0 )
+					{
+						audio_filters_[ stream ].reset( new avaudio_convert_to_AVFrame( audio->frequency( ), c->sample_rate, audio->channels( ), c->channels, aml_id_to_AVSampleFormat( audio->id( ) ), c->sample_fmt ) );
 					}
+					temp = audio_filters_[ stream ]->convert( audio );
+					avcodec_encode_audio2( c, &pkt, temp.get(), &got_packet );
+				}
+
+				if ( !audio && do_flush )
+				{
+					// flush the codec by sending in a 0-pointer
+					avcodec_encode_audio2( c, &pkt, temp.get(), &got_packet );
+				}
+
+				// Write the compressed frame in the media file
+				if ( c->coded_frame && uint64_t( c->coded_frame->pts ) != AV_NOPTS_VALUE )
+					pkt.pts = av_rescale_q( c->coded_frame->pts, c->time_base, av_stream->time_base );
+
+				pkt.flags |= AV_PKT_FLAG_KEY;
+				pkt.stream_index = av_stream->index;
 
-					AVPacket pkt;
-					pkt.size = 0;
-					pkt.data = 0;
-					av_init_packet( &pkt );
+				if ( pkt.size > 0 )
+				{
+					// Here we keep track of the number of audio packets which have been received
+					packets ++;
 
-					boost::shared_ptr< AVFrame > temp;
+					// Only the first stream is enrolled in the ts index
+					const bool index = stream == 0 && ( !first_audio_ || ec == encode_tries -1 );
 
-					// Here we keep track of the number of audio packets which are delivered to the 
-					// codec contexts - note that in the split case, we only count this once.
-					if ( audio && iter == audio_stream_.begin( ) )
-						audio_frames_ ++;
+					if ( pipelined_ )
+					{
+						ret = deliver( audio_stages_[ stream ]->lane, pkt, c, index, 0 );
+					}
+					else
+					{
+						if ( index )
+							index_audio_packet( );
+						ret = write_packet( oc_, &pkt, c, bitstream_filters_[ pkt.stream_index ] ) == 0;
+					}
 
-					if ( prop_audio_split_.value< int >( ) && audio )
+					if( !first_audio_ )
 					{
-						int samples = audio->samples( );
-						int channels = audio->channels( );
-						int channels_to_write = c->channels;
-						int start_channel = stream * prop_audio_split_.value< int >( );
-						int size = audio->sample_storage_size( );
-
-						boost::uint8_t *dst = audio_tmpbuf_;
-						const boost::uint8_t *src = data + start_channel * size;
-						while( samples -- )
-						{
-							memcpy( dst, src, size * channels_to_write );
-							dst += channels_to_write * size;
-							src += channels * size;
-						}
+						break;
+					}
+				}
+				else if ( data == 0 )
+				{
+					ret = false;
+				}
 
-						if ( audio_filters_[ stream ] == 0 )
-						{
-							audio_filters_[ stream ].reset( new avaudio_convert_to_AVFrame( audio->frequency( ), c->sample_rate, channels_to_write, c->channels, aml_id_to_AVSampleFormat( audio->id( ) ), c->sample_fmt ) );
-						}
+				av_free_packet( &pkt );
+			}
+
+			return ret;
+		}
+
+		// Pipelined encoding
+		//
+		// The calling thread carves up the pushed frames into the video and audio queues as usual (see 
+		// queue above) and hands their contents to a video encode stage and an encode stage for each 
+		// audio stream through bounded queues, so push blocks when a stage falls behind. The stages 
+		// pass their packets to a mux stage which writes them in timestamp order - when a stage has 
+		// nothing queued but may still deliver an earlier packet, the mux stage waits for it. The ts
+		// index depends on the position in the output, so it's only updated by the mux stage.
+		//
+		// Each lane holds at most as many packets as its stage's queue while the mux stage is writing, 
+		// so a slow mux blocks the stages and, in turn, push. Exceptions thrown by a stage stop the 
+		// pipeline and are raised again by the next push or complete.
+
+		// A packet travelling from an encode stage to the mux stage
+		struct pipeline_packet
+		{
+			AVPacket pkt;
+			std::vector< boost::uint8_t > data;
+
+			// Key frame (video) or enrolled in the ts index (audio)
+			bool flag;
+
+			// Encoded image number (video only)
+			int position;
+
+			// Time stamp used for interleaving (AV_TIME_BASE units)
+			boost::int64_t time;
+		};
+
+		typedef boost::shared_ptr< pipeline_packet > pipeline_packet_ptr;
+
+		// The packets delivered by a stage and not yet written - guarded by pipeline_mutex_
+		struct pipeline_lane
+		{
+			pipeline_lane( bool video_, size_t depth_ )
+				: video( video_ )
+				, depth( depth_ )
+				, finished( false )
+				, last( -std::numeric_limits< boost::int64_t >::max( ) )
+			{ }
+
+			bool video;
+			size_t depth;
+			std::deque< pipeline_packet_ptr > packets;
+			bool finished;
+
+			// Time of the last packet delivered - nothing earlier can follow
+			boost::int64_t last;
+		};
+
+		// An encode stage - the counters are guarded by pipeline_mutex_ except pushed, which 
+		// belongs to the calling thread, and frames and packets, which belong to the stage
+		template< typename input_type >
+		struct pipeline_stage
+		{
+			pipeline_stage( size_t capacity, size_t lane_ )
+				: input( capacity )
+				, lane( lane_ )
+				, pushed( 0 )
+				, processed( 0 )
+				, frames( 0 )
+				, packets( 0 )
+				, encode_us( 0 )
+			{ }
+
+			cl::spsc_queue< input_type > input;
+			size_t lane;
+			int pushed;
+			int processed;
+			int frames;
+			int packets;
+			boost::int64_t encode_us;
+			std::vector< boost::uint8_t > scratch;
+		};
+
+		typedef pipeline_stage< frame_type_ptr > video_stage_type;
+		typedef pipeline_stage< audio_type_ptr > audio_stage_type;
+		typedef boost::shared_ptr< audio_stage_type > audio_stage_ptr;
+
+		void start_pipeline( )
+		{
+			if ( video_copy_ || ( fmt_->flags & AVFMT_RAWPICTURE ) )
+			{
+				ARLOG_NOTICE( "Pipelined encoding isn't available for stream copies or raw pictures - encoding on the calling thread" );
+				return;
+			}
+
+			const size_t capacity = size_t( std::max< int >( 1, prop_pipeline_queue_.value< int >( ) ) );
+
+			if ( video_stream_ )
+			{
+				video_lane_ = pipeline_lanes_.size( );
+				pipeline_lanes_.push_back( pipeline_lane( true, capacity ) );
+				video_stage_.reset( new video_stage_type( capacity, video_lane_ ) );
+			}
+
+			// Audio is queued in blocks of the codec's frame size, so the audio queues are scaled to
+			// hold roughly the same duration as the video one
+			size_t blocks = capacity;
+			if ( audio_input_frame_size_ > 0 && prop_fps_num_.value< int >( ) > 0 )
+			{
+				const boost::int64_t samples = boost::int64_t( prop_frequency_.value< int >( ) ) * prop_fps_den_.value< int >( ) / prop_fps_num_.value< int >( );
+				blocks = capacity * size_t( samples / audio_input_frame_size_ + 1 );
+			}
+
+			for ( size_t stream = 0; stream < audio_stream_.size( ); stream ++ )
+			{
+				// Each stage creates its own converter - the map entries must exist before they start
+				audio_filters_[ stream ];
+
+				audio_stage_ptr stage( new audio_stage_type( blocks, pipeline_lanes_.size( ) ) );
+				stage->scratch.resize( audio_outbuf_size_ + 64 );
+				pipeline_lanes_.push_back( pipeline_lane( false, blocks ) );
+				audio_stages_.push_back( stage );
+			}
+
+			if ( pipeline_lanes_.empty( ) )
+				return;
+
+			pipelined_ = true;
+
+			pipeline_threads_.create_thread( boost::bind( &avformat_store::mux_stage, this ) );
+			if ( video_stage_ )
+				pipeline_threads_.create_thread( boost::bind( &avformat_store::video_stage, this ) );
+			for ( size_t stream = 0; stream < audio_stages_.size( ); stream ++ )
+				pipeline_threads_.create_thread( boost::bind( &avformat_store::audio_stage, this, stream ) );
+		}
+
+		// Finish the stages (flushing the codecs and writing everything they return) or abandon them
+		void stop_pipeline( bool finish )
+		{
+			if ( !pipelined_ )
+				return;
+
+			if ( finish )
+			{
+				// Submit any partial audio block and then mark the end of input for every stage
+				if ( audio_block_ && audio_block_used_ != 0 )
+				{
+					feed_audio( audio_block_ );
+					audio_block_used_ = 0;
+				}
+
+				bool ok = feed_audio( audio_type_ptr( ) );
+				if ( video_stage_ )
+					ok = feed( *video_stage_, frame_type_ptr( ) ) && ok;
+				if ( !ok )
+					abort_pipeline( );
+			}
+			else
+			{
+				abort_pipeline( );
+			}
 
-						temp = audio_filters_[ stream ]->convert( ( const boost::uint8_t ** )&audio_tmpbuf_, audio->samples( ) );
-						avcodec_encode_audio2( c, &pkt, temp.get(), &got_packet );
+			pipeline_threads_.join_all( );
+			update_pipeline_stats( );
+		}
+
+		// Wait for the stages to consume everything pushed so far and for the mux stage to write 
+		// everything it can (packets which are held for interleaving are written later)
+		void wait_pipeline( )
+		{
+			if ( !pipelined_ )
+				return;
+
+			boost::mutex::scoped_lock lock( pipeline_mutex_ );
+			while ( !pipeline_abort_ && !pipeline_failed_ && !pipeline_idle( ) )
+				pipeline_cond_.wait( lock );
+		}
+
+		// Precondition: pipeline_mutex_ is held
+		bool pipeline_idle( ) const
+		{
+			if ( !mux_waiting_ )
+				return false;
+			if ( video_stage_ && video_stage_->processed < video_stage_->pushed )
+				return false;
+			for ( size_t stream = 0; stream < audio_stages_.size( ); stream ++ )
+				if ( audio_stages_[ stream ]->processed < audio_stages_[ stream ]->pushed )
+					return false;
+			return true;
+		}
+
+		// Raise the exception which stopped a stage on the calling thread (once)
+		void check_pipeline( )
+		{
+			std::string error;
+			{
+				boost::mutex::scoped_lock lock( pipeline_mutex_ );
+				error.swap( pipeline_error_ );
+			}
+			ARENFORCE_MSG( error.empty( ), "Pipelined encoding of %1% failed: %2%" )( resource( ) )( error );
+		}
+
+		// Record the exception thrown by a stage and stop the pipeline
+		void pipeline_exception( const char *stage, const std::string &what )
+		{
+			ARLOG_ERR( "Exception in the %1% stage of %2%: %3%" )( stage )( resource( ) )( what );
+			boost::mutex::scoped_lock lock( pipeline_mutex_ );
+			if ( pipeline_error_.empty( ) )
+				pipeline_error_ = what.empty( ) ? std::string( "unknown exception" ) : what;
+			pipeline_failed_ = true;
+			pipeline_cond_.notify_all( );
+		}
+
+		bool pipeline_stopped( )
+		{
+			boost::mutex::scoped_lock lock( pipeline_mutex_ );
+			return pipeline_abort_ || pipeline_failed_;
+		}
+
+		void abort_pipeline( )
+		{
+			boost::mutex::scoped_lock lock( pipeline_mutex_ );
+			pipeline_abort_ = true;
+			pipeline_cond_.notify_all( );
+		}
+
+		// Queue the pushed frame and hand the results to the stages
+		bool feed_pipeline( const frame_type_ptr &frame )
+		{
+			check_pipeline( );
+
+			// The image may be produced on demand by upstream nodes which aren't thread safe, so it's
+			// resolved here rather than by the video encode stage
+			if ( video_stream_ && frame->has_image( ) )
+				frame->get_image( );
+
+			queue( frame );
+
+			bool ok = true;
+
+			while ( ok && video_queue_.size( ) )
+			{
+				ok = feed( *video_stage_, video_queue_.front( ) );
+				video_queue_.pop_front( );
+			}
+
+			while ( ok && audio_queue_.size( ) )
+			{
+				ok = feed_audio( audio_queue_.front( ) );
+				audio_queue_.pop_front( );
+			}
+
+			update_pipeline_stats( );
+
+			if ( prop_show_stats_.value< int >( ) && frame_pos_ ++ % prop_show_stats_.value< int >( ) == 0 )
+				fprintf( stderr, "%06d: video %8.2fs audio %8.2fs mux %8.2fs\r", frame_pos_ - 1,
+						 prop_pipeline_video_us_.value< boost::int64_t >( ) / 1000000.0,
+						 prop_pipeline_audio_us_.value< boost::int64_t >( ) / 1000000.0,
+						 prop_pipeline_mux_us_.value< boost::int64_t >( ) / 1000000.0 );
+
+			check_pipeline( );
+
+			return ok && !pipeline_stopped( );
+		}
+
+		// Push to a stage, blocking while its queue is full
+		template< typename stage_type, typename input_type >
+		bool feed( stage_type &stage, const input_type &item )
+		{
+			while ( !stage.input.push( item, boost::posix_time::milliseconds( 100 ) ) )
+			{
+				if ( pipeline_stopped( ) )
+					return false;
+			}
+			stage.pushed ++;
+			return true;
+		}
+
+		// Every audio stage encodes the same blocks
+		bool feed_audio( const audio_type_ptr &audio )
+		{
+			bool ok = true;
+			for ( size_t stream = 0; stream < audio_stages_.size( ); stream ++ )
+				ok = feed( *audio_stages_[ stream ], audio ) && ok;
+			return ok;
+		}
+
+		void video_stage( )
+		{
+			video_stage_type &stage = *video_stage_;
+			frame_type_ptr frame;
+			bool ok = true;
+			bool end = false;
+
+			try
+			{
+				while ( ok && !end && !pipeline_stopped( ) )
+				{
+					if ( !stage.input.pop( frame, boost::posix_time::milliseconds( 100 ) ) )
+						continue;
+
+					if ( frame )
+					{
+						const boost::int64_t start = ml::fetch_stats_clock( );
+						ok = encode_video( frame );
+						frame = frame_type_ptr( );
+						stage_done( stage, start, 1 );
 					}
-					else if ( audio )
+					else
 					{
-						if ( audio_filters_[ stream ] == 0 )
-						{
-							audio_filters_[ stream ].reset( new avaudio_convert_to_AVFrame( audio->frequency( ), c->sample_rate, audio->channels( ), c->channels, aml_id_to_AVSampleFormat( audio->id( ) ), c->sample_fmt ) );
-						}
-						temp = audio_filters_[ stream ]->convert( audio );
-						avcodec_encode_audio2( c, &pkt, temp.get(), &got_packet );
+						end = true;
 					}
+				}
 
-					if ( !audio && do_flush )
+				// Collect the images buffered in the codec
+				if ( ok && end )
+				{
+					const boost::int64_t start = ml::fetch_stats_clock( );
+					int out_size = 0;
+					do
 					{
-						// flush the codec by sending in a 0-pointer
-						avcodec_encode_audio2( c, &pkt, temp.get(), &got_packet );
+						ok = do_video_encode( true, &out_size );
 					}
+					while( ok && out_size > 0 );
+					stage_done( stage, start, 0 );
+				}
+			}
+			catch ( std::exception &exc )
+			{
+				pipeline_exception( "video encode", exc.what( ) );
+				ok = false;
+			}
+			catch ( ... )
+			{
+				pipeline_exception( "video encode", "" );
+				ok = false;
+			}
 
-					// Write the compressed frame in the media file
-					if ( c->coded_frame && uint64_t( c->coded_frame->pts ) != AV_NOPTS_VALUE )
-						pkt.pts = av_rescale_q( c->coded_frame->pts, c->time_base, ( *iter )->time_base );
+			finish_lane( stage.lane, ok );
+		}
 
-					pkt.flags |= AV_PKT_FLAG_KEY;
-					pkt.stream_index = ( *iter )->index;
+		void audio_stage( size_t stream )
+		{
+			audio_stage_type &stage = *audio_stages_[ stream ];
+			audio_type_ptr audio;
+			bool ok = true;
+			bool end = false;
 
-					if ( pkt.size > 0 )
+			try
+			{
+				while ( ok && !end && !pipeline_stopped( ) )
+				{
+					if ( !stage.input.pop( audio, boost::posix_time::milliseconds( 100 ) ) )
+						continue;
+
+					if ( audio )
+					{
+						const boost::int64_t start = ml::fetch_stats_clock( );
+						stage.frames ++;
+						ok = encode_audio( stream, audio, false, &stage.scratch[ 0 ], stage.packets );
+						audio = audio_type_ptr( );
+						stage_done( stage, start, 1 );
+					}
+					else
 					{
-						// Here we keep track of the number of audio packets which have been received
-						audio_packets_ ++;
+						end = true;
+					}
+				}
 
-						if( stream == 0)
-						{
-							if( !first_audio_ || ec == encode_tries -1 )
-							{
-								if( audio_packet_num_ % 8 == 0 )
-								{
-									if( ts_context_ )
-									{
-										ts_generator_audio_.enroll( audio_packet_num_, oc_->pb->pos );
-										write_ts_index( );
-									}
-								}
-								audio_packet_num_++;
-							}
-						}
+				// Keep flushing the codec until no more is returned
+				if ( ok && end )
+				{
+					const boost::int64_t start = ml::fetch_stats_clock( );
+					int flush_count = stage.frames - stage.packets;
+					while( flush_count -- && encode_audio( stream, audio_type_ptr( ), true, &stage.scratch[ 0 ], stage.packets ) ) ;
+					if ( flush_count >= 0 )
+					{
+						ARLOG_NOTICE( "Wasn't able to extract all the audio from the codec of stream %d %d %d/%d" )( stream )( flush_count )( stage.frames )( stage.packets );
+					}
+					stage_done( stage, start, 0 );
+				}
+			}
+			catch ( std::exception &exc )
+			{
+				pipeline_exception( "audio encode", exc.what( ) );
+				ok = false;
+			}
+			catch ( ... )
+			{
+				pipeline_exception( "audio encode", "" );
+				ok = false;
+			}
 
-						ret = write_packet( oc_, &pkt, c, bitstream_filters_[ pkt.stream_index ] ) == 0;
-						if( !first_audio_ )
-						{
-							break;
-						}
+			finish_lane( stage.lane, ok );
+		}
+
+		template< typename stage_type >
+		void stage_done( stage_type &stage, boost::int64_t start, int items )
+		{
+			const boost::int64_t elapsed = ml::fetch_stats_clock( ) - start;
+			boost::mutex::scoped_lock lock( pipeline_mutex_ );
+			stage.encode_us += elapsed;
+			stage.processed += items;
+			pipeline_cond_.notify_all( );
+		}
+
+		void finish_lane( size_t lane, bool ok )
+		{
+			boost::mutex::scoped_lock lock( pipeline_mutex_ );
+			pipeline_lanes_[ lane ].finished = true;
+			if ( !ok )
+				pipeline_failed_ = true;
+			mux_waiting_ = false;
+			pipeline_cond_.notify_all( );
+		}
+
+		// Called by an encode stage in place of writing the packet - the bitstream filters are applied
+		// here so that the codec context is only used by the stage which owns it. The data is copied 
+		// as the codec may reuse its buffer.
+		bool deliver( size_t lane, AVPacket &pkt, AVCodecContext *c, bool flag, int position )
+		{
+			if ( filter_packet( &pkt, c, bitstream_filters_[ pkt.stream_index ] ) < 0 )
+				return false;
+
+			pipeline_packet_ptr packet( new pipeline_packet );
+			av_init_packet( &packet->pkt );
+			packet->pkt.data = 0;
+			packet->pkt.size = 0;
+			packet->pkt.pts = pkt.pts;
+			packet->pkt.dts = pkt.dts;
+			packet->pkt.duration = pkt.duration;
+			packet->pkt.flags = pkt.flags;
+			packet->pkt.stream_index = pkt.stream_index;
+			packet->data.assign( pkt.data, pkt.data + pkt.size );
+			packet->flag = flag;
+			packet->position = position;
+
+			// Video is interleaved by decode order and audio by presentation
+			boost::int64_t ts = pipeline_lanes_[ lane ].video ? pkt.dts : pkt.pts;
+			if ( ts == boost::int64_t( AV_NOPTS_VALUE ) )
+				ts = pkt.pts;
+
+			boost::mutex::scoped_lock lock( pipeline_mutex_ );
+			pipeline_lane &target = pipeline_lanes_[ lane ];
+
+			// Wait while the lane is full and the mux stage is writing - when the mux stage is waiting 
+			// for another lane, this one must be allowed to grow or the stages would wait on each other
+			while ( target.packets.size( ) >= target.depth && !mux_waiting_ && !pipeline_abort_ && !pipeline_failed_ )
+				pipeline_cond_.wait( lock );
+
+			if ( ts != boost::int64_t( AV_NOPTS_VALUE ) )
+				packet->time = std::max( target.last, boost::int64_t( av_rescale_q( ts, oc_->streams[ pkt.stream_index ]->time_base, ml_av_time_base_q ) ) );
+			else
+				packet->time = target.last;
+			target.last = packet->time;
+			target.packets.push_back( packet );
+			mux_waiting_ = false;
+			pipeline_cond_.notify_all( );
+
+			return !pipeline_abort_ && !pipeline_failed_;
+		}
+
+		// Write the delivered packets in time stamp order until all the stages have finished
+		void mux_stage( )
+		{
+			boost::mutex::scoped_lock lock( pipeline_mutex_ );
+
+			while ( !pipeline_abort_ )
+			{
+				// Find the earliest packet queued
+				int next = -1;
+				bool pending = false;
+				for ( size_t i = 0; i < pipeline_lanes_.size( ); i ++ )
+				{
+					const pipeline_lane &lane = pipeline_lanes_[ i ];
+					if ( lane.packets.size( ) )
+					{
+						if ( next < 0 || lane.packets.front( )->time < pipeline_lanes_[ next ].packets.front( )->time )
+							next = int( i );
 					}
-					else if ( data == 0 )
+					else if ( !lane.finished )
 					{
-						ret = false;
+						pending = true;
 					}
+				}
+
+				if ( next < 0 && !pending )
+					break;
+
+				// Any stage with nothing queued may still deliver something earlier
+				bool blocked = next < 0;
+				for ( size_t i = 0; !blocked && i < pipeline_lanes_.size( ); i ++ )
+				{
+					const pipeline_lane &lane = pipeline_lanes_[ i ];
+					if ( lane.packets.empty( ) && !lane.finished && lane.last < pipeline_lanes_[ next ].packets.front( )->time )
+						blocked = true;
+				}
+
+				if ( blocked )
+				{
+					mux_waiting_ = true;
+					pipeline_cond_.notify_all( );
+					const boost::int64_t start = ml::fetch_stats_clock( );
+					pipeline_cond_.wait( lock );
+					mux_wait_us_ += ml::fetch_stats_clock( ) - start;
+					continue;
+				}
+
+				pipeline_packet_ptr packet = pipeline_lanes_[ next ].packets.front( );
+				pipeline_lanes_[ next ].packets.pop_front( );
+				const bool video = pipeline_lanes_[ next ].video;
 
-					av_free_packet( &pkt );
-				}	
+				// Wake any stage waiting for room in the lane
+				pipeline_cond_.notify_all( );
+
+				lock.unlock( );
+				const boost::int64_t start = ml::fetch_stats_clock( );
+				bool ok = false;
+				try
+				{
+					ok = write_pipeline_packet( *packet, video );
+				}
+				catch ( std::exception &exc )
+				{
+					pipeline_exception( "mux", exc.what( ) );
+				}
+				catch ( ... )
+				{
+					pipeline_exception( "mux", "" );
+				}
+				const boost::int64_t elapsed = ml::fetch_stats_clock( ) - start;
+				lock.lock( );
+
+				mux_us_ += elapsed;
+				if ( !ok )
+				{
+					ARLOG_ERR( "Failed to write packet to %1%" )( resource( ) );
+					pipeline_failed_ = true;
+					break;
+				}
 			}
-			first_audio_ = false;
 
-			return ret;
+			mux_waiting_ = true;
+			pipeline_cond_.notify_all( );
+		}
+
+		bool write_pipeline_packet( pipeline_packet &packet, bool video )
+		{
+			AVPacket pkt = packet.pkt;
+			pkt.data = packet.data.size( ) ? &packet.data[ 0 ] : 0;
+			pkt.size = int( packet.data.size( ) );
+
+			if ( video )
+				index_video_packet( pkt, packet.flag, packet.position );
+			else if ( packet.flag )
+				index_audio_packet( );
+
+			return av_interleaved_write_frame( oc_, &pkt ) >= 0;
+		}
+
+		void update_pipeline_stats( )
+		{
+			if ( !pipelined_ )
+				return;
+
+			boost::int64_t video_us = 0;
+			boost::int64_t audio_us = 0;
+			boost::int64_t stall_us = 0;
+			boost::int64_t mux_us = 0;
+			boost::int64_t mux_wait_us = 0;
+
+			{
+				boost::mutex::scoped_lock lock( pipeline_mutex_ );
+				if ( video_stage_ )
+					video_us = video_stage_->encode_us;
+				for ( size_t stream = 0; stream < audio_stages_.size( ); stream ++ )
+					audio_us += audio_stages_[ stream ]->encode_us;
+				mux_us = mux_us_;
+				mux_wait_us = mux_wait_us_;
+			}
+
+			// Time push spent blocked on full queues
+			if ( video_stage_ )
+				stall_us += video_stage_->input.statistics( ).producer_stall_time;
+			for ( size_t stream = 0; stream < audio_stages_.size( ); stream ++ )
+				stall_us += audio_stages_[ stream ]->input.statistics( ).producer_stall_time;
+
+			prop_pipeline_video_us_ = video_us;
+			prop_pipeline_audio_us_ = audio_us;
+			prop_pipeline_mux_us_ = mux_us;
+			prop_pipeline_mux_wait_us_ = mux_wait_us;
+			prop_pipeline_stall_us_ = stall_us;
 		}
 
 		// The output file or device
@@ -1841,6 +2530,13 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 
 		pcos::property prop_frag_key_frame_;
 		pcos::property prop_flush_;
+		pcos::property /* int */ prop_pipeline_;
+		pcos::property /* int */ prop_pipeline_queue_;
+		pcos::property /* int64 */ prop_pipeline_video_us_;
+		pcos::property /* int64 */ prop_pipeline_audio_us_;
+		pcos::property /* int64 */ prop_pipeline_mux_us_;
+		pcos::property /* int64 */ prop_pipeline_mux_wait_us_;
+		pcos::property /* int64 */ prop_pipeline_stall_us_;
 
 		awi_generator_v4 ts_generator_video_;
 		awi_generator_v4 ts_generator_audio_;
@@ -1868,6 +2564,22 @@ class ML_PLUGIN_DECLSPEC avformat_store : public store_type
 
 		int audio_frames_;
 		int audio_packets_;
+
+		// Pipelined encoding state (see start_pipeline)
+		bool pipelined_;
+		bool pipeline_abort_;
+		bool pipeline_failed_;
+		bool mux_waiting_;
+		std::string pipeline_error_;
+		size_t video_lane_;
+		boost::int64_t mux_us_;
+		boost::int64_t mux_wait_us_;
+		std::vector< pipeline_lane > pipeline_lanes_;
+		boost::scoped_ptr< video_stage_type > video_stage_;
+		std::vector< audio_stage_ptr > audio_stages_;
+		boost::mutex pipeline_mutex_;
+		boost::condition_variable pipeline_cond_;
+		boost::thread_group pipeline_threads_;
 };
 
 store_type_ptr ML_PLUGIN_DECLSPEC create_store_avformat( const std::wstring &resource, const frame_type_ptr &frame )
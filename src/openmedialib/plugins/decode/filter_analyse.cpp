@@ -1,8 +1,42 @@
 // Copyright (C) 2010 Vizrt
 // Released under the LGPL.
+//
+// #filter:analyse
+//
+// Parses the packets of the gop which contains the requested frame and
+// attaches the analysis (picture type, temporal offset etc) to the streams.
+//
+// Properties:
+//
+//	prefetch=n (default 0)
+//		Read and analyse the following n gops on a background thread while
+//		the current one is being consumed.
+//	cache=n (default 1)
+//		Number of analysed gops held for reuse (in addition to those which are
+//		prefetched) - revisiting a cached gop after a seek costs nothing.
+//	scan=file (default "")
+//		Before the first fetch, analyse the whole input and write a tab
+//		separated table with a line per frame to file.
+//	sidecar=file|auto (default "")
+//		Per frame analysis file (see ml/analyse_sidecar.hpp). When it exists
+//		and the media hasn't changed since it was written, the stored analysis
+//		is attached to the packets instead of parsing them - otherwise it is
+//		written once every frame has been analysed.
+//		auto places it next to the media as <file>.awa.
+//	hits, misses (read only)
+//		Requests served from the cache (including prefetched gops) and
+//		requests which had to wait for the gop to be read.
 
 #include "filter_analyse.hpp"
 
+#include <opencorelib/cl/enforce_defines.hpp>
+#include <opencorelib/cl/log_defines.hpp>
+#include <opencorelib/cl/str_util.hpp>
+#include <opencorelib/cl/thread_name.hpp>
+
+#include <boost/bind.hpp>
+#include <fstream>
+
 namespace pl = olib::openpluginlib;
 namespace ml = olib::openmedialib::ml;
 namespace il = olib::openmedialib::ml;
@@ -11,13 +45,53 @@ namespace cl = olib::opencorelib;
 
 namespace olib { namespace openmedialib { namespace ml { namespace decode {
 
+namespace
+{
+	// Obtain an integer from the analysed stream properties, -1 if the codec doesn't provide it
+	boost::int64_t stream_value( const ml::stream_type_ptr &stream, const pcos::key &key )
+	{
+		pcos::property prop = stream->properties( ).get_property_with_key( key );
+		if ( !prop.valid( ) )
+			return -1;
+		if ( prop.is_a< boost::int64_t >( ) )
+			return prop.value< boost::int64_t >( );
+		return prop.is_a< int >( ) ? prop.value< int >( ) : -1;
+	}
+}
+
 filter_analyse::filter_analyse( )
 	: ml::filter_simple( )
+	, prop_prefetch_( pcos::key::from_string( "prefetch" ) )
+	, prop_cache_( pcos::key::from_string( "cache" ) )
+	, prop_scan_( pcos::key::from_string( "scan" ) )
+	, prop_sidecar_( pcos::key::from_string( "sidecar" ) )
+	, prop_hits_( pcos::key::from_string( "hits" ) )
+	, prop_misses_( pcos::key::from_string( "misses" ) )
+	, hits_( 0 )
+	, misses_( 0 )
+	, requests_( 0 )
+	, consumer_( -1 )
+	, scanned_( false )
+	, sidecar_checked_( false )
+	, stop_( false )
+	, request_( -1 )
+	, next_( -1 )
+	, prefetch_( 0 )
+	, cache_( 1 )
+	, frames_( 0 )
 {
+	properties( ).append( prop_prefetch_ = 0 );
+	properties( ).append( prop_cache_ = 1 );
+	properties( ).append( prop_scan_ = std::wstring( L"" ) );
+	properties( ).append( prop_sidecar_ = std::wstring( L"" ) );
+	properties( ).append( prop_hits_ = boost::int64_t( 0 ) );
+	properties( ).append( prop_misses_ = boost::int64_t( 0 ) );
 }
     
 filter_analyse::~filter_analyse( )
-{ }
+{
+	stop_prefetch( );
+}
     
 bool filter_analyse::requires_image( ) const 
 { 
@@ -28,54 +102,320 @@ const std::wstring filter_analyse::get_uri( ) const
 { 
 	return L"analyse";
 }
+
+void filter_analyse::sync( )
+{
+	// The prefetch thread must not read the input while it's being synced
+	stop_prefetch( );
+	ml::filter_simple::sync( );
+}
     
 void filter_analyse::do_fetch( ml::frame_type_ptr &result )
 {
-	if ( gop_.find( get_position( ) ) == gop_.end( ) )
+	if ( !sidecar_checked_ )
+		open_sidecar( );
+
+	if ( !scanned_ && prop_scan_.value< std::wstring >( ) != L"" )
+		scan( );
+
+	analysed_gop_ptr gop = fetch_gop( get_position( ) );
+	std::map< int, ml::frame_type_ptr >::iterator iter = gop->frames.find( get_position( ) );
+	result = iter != gop->frames.end( ) ? iter->second : gop->fallback;
+
+	prop_hits_ = boost::int64_t( hits_ );
+	prop_misses_ = boost::int64_t( misses_ );
+}
+
+analysed_gop_ptr filter_analyse::read_gop( int position )
+{
+	analysed_gop_ptr gop( new analysed_gop( ) );
+	gop->start = gop->end = position;
+
+	// Fetch the current frame
+	ml::frame_type_ptr temp;
+
+	if ( inner_fetch( temp, position, false ) && temp->get_stream( ) )
+	{
+		std::map< int, ml::stream_type_ptr > streams;
+		int start = temp->get_stream( )->key( );
+		int index = start;
+
+		gop->fallback = temp;
+
+		// Read the current gop
+		while( index < get_frames( ) )
+		{
+			inner_fetch( temp, index ++ );
+			if ( !temp || !temp->get_stream( ) || start != temp->get_stream( )->key( ) ) break;
+			int sorted = start + temp->get_stream( )->properties( ).get_property_with_key( ml::analyse_type::key_temporal_reference_ ).value< int >( );
+			pl::pcos::property temporal_offset( ml::analyse_type::key_temporal_offset_ );
+			temp->get_stream( )->properties( ).append( temporal_offset = boost::int64_t( sorted ) );
+			gop->frames[ temp->get_position( ) ] = temp;
+			streams[ sorted ] = temp->get_stream( );
+		}
+
+		// Ensure that the recipient has access to the temporally sorted frames too
+		for ( std::map< int, ml::frame_type_ptr >::iterator iter = gop->frames.begin( ); iter != gop->frames.end( ); ++iter )
+		{
+			pl::pcos::property temporal_stream( ml::analyse_type::key_temporal_stream_ );
+			if ( streams.find( ( *iter ).first ) != streams.end( ) )
+				( *iter ).second->properties( ).append( temporal_stream = streams[ ( *iter ).first ] );
+		}
+
+		if ( !gop->frames.empty( ) )
+		{
+			gop->start = gop->frames.begin( )->first;
+			gop->end = gop->frames.rbegin( )->first + 1;
+		}
+	}
+	else
 	{
-		// Remove previously cached gop
-		gop_.erase( gop_.begin( ), gop_.end( ) );
+		gop->fallback = temp;
+	}
+
+	return gop;
+}
+
+analysed_gop_ptr filter_analyse::fetch_gop( int position )
+{
+	if ( prop_prefetch_.value< int >( ) > 0 && !thread_ )
+		start_prefetch( );
 
-		// Fetch the current frame
-		ml::frame_type_ptr temp;
+	boost::mutex::scoped_lock lock( mutex_ );
+	frames_ = get_frames( );
+	cache_ = std::max< int >( 1, prop_cache_.value< int >( ) );
 
-		if ( inner_fetch( temp, get_position( ), false ) && temp->get_stream( ) )
+	analysed_gop_ptr gop = find_gop( position );
+	const bool hit = gop.get( ) != 0;
+
+	if ( !gop && thread_ )
+	{
+		// Hand the request to the prefetch thread, which then carries on from this gop
+		request_ = position;
+		wake_.notify_all( );
+		while ( request_ >= 0 )
+			done_.wait( lock );
+
+		gop = find_gop( position );
+		if ( !gop && fallback_ )
 		{
-			std::map< int, ml::stream_type_ptr > streams;
-			int start = temp->get_stream( )->key( );
-			int index = start;
+			gop.reset( new analysed_gop( ) );
+			gop->start = gop->end = position;
+			gop->fallback = fallback_;
+		}
+		fallback_ = ml::frame_type_ptr( );
+	}
+
+	// Without a prefetcher, or when its read failed, the gop is read here so that any
+	// error reaches the caller - the prefetcher is stopped first (the next fetch starts
+	// it again) as the input and the analyser can't be used by both threads
+	if ( !gop )
+	{
+		lock.unlock( );
+		stop_prefetch( );
+		gop = read_gop( position );
+		lock.lock( );
+		if ( !gop->frames.empty( ) )
+			store_gop( gop );
+	}
+
+	gop->used = ++ requests_;
+	consumer_ = gop->start;
+	evict( );
+
+	// The consumer has moved on, so the prefetcher may have more to do
+	wake_.notify_all( );
+
+	if ( hit )
+		++ hits_;
+	else
+		++ misses_;
+
+	return gop;
+}
+
+analysed_gop_ptr filter_analyse::find_gop( int position )
+{
+	std::map< int, analysed_gop_ptr >::iterator iter = gops_.upper_bound( position );
+	if ( iter == gops_.begin( ) )
+		return analysed_gop_ptr( );
+	-- iter;
+	return position < iter->second->end ? iter->second : analysed_gop_ptr( );
+}
+
+void filter_analyse::store_gop( const analysed_gop_ptr &gop )
+{
+	gop->used = ++ requests_;
+	gops_[ gop->start ] = gop;
+	evict( );
+}
+
+void filter_analyse::evict( )
+{
+	const size_t limit = size_t( cache_ + prefetch_ );
 
-			// Read the current gop
-			while( index < get_frames( ) )
+	// Gops which have been prefetched but not yet consumed are kept
+	while ( gops_.size( ) > limit )
+	{
+		std::map< int, analysed_gop_ptr >::iterator oldest = gops_.end( );
+		for ( std::map< int, analysed_gop_ptr >::iterator iter = gops_.begin( ); iter != gops_.end( ) && iter->first <= consumer_; ++iter )
+			if ( oldest == gops_.end( ) || iter->second->used < oldest->second->used )
+				oldest = iter;
+
+		if ( oldest == gops_.end( ) )
+			break;
+
+		gops_.erase( oldest );
+	}
+}
+
+void filter_analyse::start_prefetch( )
+{
+	boost::mutex::scoped_lock lock( mutex_ );
+	prefetch_ = prop_prefetch_.value< int >( );
+	stop_ = false;
+	request_ = -1;
+	next_ = -1;
+	thread_.reset( new boost::thread( boost::bind( &filter_analyse::run_prefetch, this ) ) );
+}
+
+void filter_analyse::stop_prefetch( )
+{
+	if ( !thread_ )
+		return;
+
+	{
+		boost::mutex::scoped_lock lock( mutex_ );
+		stop_ = true;
+		wake_.notify_all( );
+	}
+
+	thread_->join( );
+	thread_.reset( );
+}
+
+bool filter_analyse::wants_prefetch( )
+{
+	if ( next_ < 0 || next_ >= frames_ )
+		return false;
+
+	int ahead = 0;
+	for ( std::map< int, analysed_gop_ptr >::iterator iter = gops_.upper_bound( consumer_ ); iter != gops_.end( ); ++iter )
+		ahead ++;
+
+	return ahead < prefetch_;
+}
+
+void filter_analyse::run_prefetch( )
+{
+	cl::set_thread_name( _CT( "analyse prefetch" ) );
+
+	boost::mutex::scoped_lock lock( mutex_ );
+
+	while ( true )
+	{
+		while ( !stop_ && request_ < 0 && !wants_prefetch( ) )
+			wake_.wait( lock );
+
+		if ( stop_ )
+			break;
+
+		const bool requested = request_ >= 0;
+		const int target = requested ? request_ : next_;
+
+		analysed_gop_ptr gop = find_gop( target );
+		if ( !gop )
+		{
+			// The input and the analyser are only used by this thread while it exists
+			lock.unlock( );
+			try
 			{
-				inner_fetch( temp, index ++ );
-				if ( !temp || !temp->get_stream( ) || start != temp->get_stream( )->key( ) ) break;
-				int sorted = start + temp->get_stream( )->properties( ).get_property_with_key( ml::analyse_type::key_temporal_reference_ ).value< int >( );
-				pl::pcos::property temporal_offset( ml::analyse_type::key_temporal_offset_ );
-				temp->get_stream( )->properties( ).append( temporal_offset = boost::int64_t( sorted ) );
-				gop_[ temp->get_position( ) ] = temp;
-				streams[ sorted ] = temp->get_stream( );
+				gop = read_gop( target );
 			}
-
-			// Ensure that the recipient has access to the temporally sorted frames too
-			for ( std::map< int, ml::frame_type_ptr >::iterator iter = gop_.begin( ); iter != gop_.end( ); ++iter )
+			catch( const std::exception &e )
 			{
-				pl::pcos::property temporal_stream( ml::analyse_type::key_temporal_stream_ );
-				if ( streams.find( ( *iter ).first ) != streams.end( ) )
-					( *iter ).second->properties( ).append( temporal_stream = streams[ ( *iter ).first ] );
+				ARLOG_ERR( "Analysis of the gop at %1% failed: %2%" )( target )( e.what( ) );
+				gop.reset( new analysed_gop( ) );
+				gop->start = gop->end = target;
 			}
+			lock.lock( );
 
-			result = gop_[ get_position( ) ];
+			if ( !gop->frames.empty( ) )
+				store_gop( gop );
 		}
-		else
+
+		next_ = gop->frames.empty( ) ? -1 : gop->end;
+
+		if ( requested )
 		{
-			result = temp;
+			fallback_ = gop->fallback;
+			request_ = -1;
+			done_.notify_all( );
 		}
 	}
-	else
+}
+
+void filter_analyse::scan( )
+{
+	scanned_ = true;
+
+	const std::string path = cl::str_util::to_string( prop_scan_.value< std::wstring >( ) );
+	std::ofstream table( path.c_str( ) );
+	ARENFORCE_MSG( table.good( ), "Unable to create the analysis table %1%" )( path );
+
+	table << "position\ttemporal\ttype\tkey\tsize\tclosed_gop\ttop_field_first\tprogressive" << std::endl;
+
+	int position = 0;
+	const int frames = get_frames( );
+	while ( position < frames )
 	{
-		result = gop_[ get_position( ) ];
+		analysed_gop_ptr gop = fetch_gop( position );
+
+		for ( std::map< int, ml::frame_type_ptr >::iterator iter = gop->frames.begin( ); iter != gop->frames.end( ); ++iter )
+		{
+			ml::stream_type_ptr stream = iter->second->get_stream( );
+			table << iter->first << '\t'
+				  << stream_value( stream, ml::analyse_type::key_temporal_offset_ ) << '\t'
+				  << stream_value( stream, ml::analyse_type::key_picture_coding_type_ ) << '\t'
+				  << stream->key( ) << '\t'
+				  << stream->length( ) << '\t'
+				  << stream_value( stream, ml::analyse_type::key_closed_gop_ ) << '\t'
+				  << stream_value( stream, ml::analyse_type::key_top_field_first_ ) << '\t'
+				  << stream_value( stream, ml::analyse_type::key_progressive_frame_ ) << '\n';
+		}
+
+		position = std::max< int >( position + 1, gop->end );
 	}
+
+	ARENFORCE_MSG( table.good( ), "Failed to write the analysis table %1%" )( path );
+}
+
+void filter_analyse::open_sidecar( )
+{
+	sidecar_checked_ = true;
+
+	const std::wstring sidecar = prop_sidecar_.value< std::wstring >( );
+	if ( sidecar == L"" )
+		return;
+
+	// The sidecar belongs to the media, so find the input at the bottom of the graph
+	ml::input_type_ptr input = fetch_slot( 0 );
+	while ( input && input->slot_count( ) > 0 && input->fetch_slot( 0 ) )
+		input = input->fetch_slot( 0 );
+	const std::wstring resource = input ? input->get_uri( ) : std::wstring( L"" );
+
+	if ( sidecar == L"auto" )
+		sidecar_path_ = ml::analyse_sidecar::path_for( resource );
+	else
+		sidecar_path_ = cl::str_util::to_string( sidecar );
+
+	if ( sidecar_path_ == "" )
+		return;
+
+	const std::string media = ml::analyse_sidecar::media_for( resource );
+	sidecar_ = ml::analyse_sidecar::open( sidecar_path_, get_frames( ), media );
+	if ( !sidecar_ )
+		sidecar_writer_.reset( new ml::analyse_sidecar_writer( get_frames( ), media ) );
 }
     
 bool filter_analyse::inner_fetch( ml::frame_type_ptr &result, int position, bool parse )
@@ -91,10 +431,26 @@ bool filter_analyse::inner_fetch( ml::frame_type_ptr &result, int position, bool
 	// If the frame has no stream then there is nothing to analyse.
 	if( !stream ) return false;
 
+	if ( sidecar_ && sidecar_->apply( result->get_position( ), stream ) )
+		return true;
+
 	if ( !analyse_ )
 		analyse_ = ml::analyse_factory( stream );
 	
-	return analyse_ ? analyse_->analyse( stream ) : false;
+	const bool analysed = analyse_ ? analyse_->analyse( stream ) : false;
+
+	if ( analysed && sidecar_writer_ )
+	{
+		sidecar_writer_->record( result->get_position( ), stream );
+		if ( sidecar_writer_->complete( ) )
+		{
+			if ( sidecar_writer_->write( sidecar_path_ ) )
+				ARLOG_DEBUG( "Wrote the analysis sidecar %1%" )( sidecar_path_ );
+			sidecar_writer_.reset( );
+		}
+	}
+
+	return analysed;
 }
 
 
@@ -3,11 +3,40 @@
 
 #include <openmedialib/ml/filter_simple.hpp>
 #include <openmedialib/ml/analyse.hpp>
+#include <openmedialib/ml/analyse_sidecar.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include <map>
 
 namespace ml = olib::openmedialib::ml;
 
 namespace olib { namespace openmedialib { namespace ml { namespace decode {
 
+// Analysis of the packets in one gop
+struct analysed_gop
+{
+	analysed_gop( )
+		: start( 0 )
+		, end( 0 )
+		, used( 0 )
+	{ }
+
+	// Position of the first frame and the one following the last
+	int start;
+	int end;
+
+	// Last request which used the gop (for eviction)
+	boost::int64_t used;
+
+	std::map< int, ml::frame_type_ptr > frames;
+
+	// Frame returned when the position couldn't be analysed
+	ml::frame_type_ptr fallback;
+};
+
+typedef boost::shared_ptr< analysed_gop > analysed_gop_ptr;
+
 class filter_analyse : public ml::filter_simple
 {
 public:
@@ -21,6 +50,9 @@ public:
     
     // This provides the name of the plugin (used in serialisation)
     virtual const std::wstring get_uri( ) const;
+
+	// Stops the prefetch thread before the input is synced
+	virtual void sync( );
     
 protected:
 
@@ -28,8 +60,61 @@ protected:
 
     bool inner_fetch( ml::frame_type_ptr &result, int position, bool parse = true );
 
-	std::map< int, ml::frame_type_ptr > gop_;
+	// Read and analyse the gop which contains position
+	analysed_gop_ptr read_gop( int position );
+
+	// Obtain the gop which contains position from the cache or the input
+	analysed_gop_ptr fetch_gop( int position );
+
+	// Cache lookup and maintenance - mutex_ must be held
+	analysed_gop_ptr find_gop( int position );
+	void store_gop( const analysed_gop_ptr &gop );
+	void evict( );
+
+	// Background prefetching
+	void start_prefetch( );
+	void stop_prefetch( );
+	bool wants_prefetch( );
+	void run_prefetch( );
+
+	// Write the per frame table for the whole input to the scan file
+	void scan( );
+
+	// Map the sidecar (or prepare to write it when it doesn't exist yet)
+	void open_sidecar( );
+
+	olib::openpluginlib::pcos::property prop_prefetch_;
+	olib::openpluginlib::pcos::property prop_cache_;
+	olib::openpluginlib::pcos::property prop_scan_;
+	olib::openpluginlib::pcos::property prop_sidecar_;
+	olib::openpluginlib::pcos::property prop_hits_;
+	olib::openpluginlib::pcos::property prop_misses_;
+
+	// Requests served from the cache and those which waited for a read
+	boost::detail::atomic_count hits_;
+	boost::detail::atomic_count misses_;
+
+	std::map< int, analysed_gop_ptr > gops_;
 	ml::analyse_ptr analyse_;
+	boost::int64_t requests_;
+	int consumer_;
+	bool scanned_;
+	bool sidecar_checked_;
+	std::string sidecar_path_;
+	ml::analyse_sidecar_ptr sidecar_;
+	ml::analyse_sidecar_writer_ptr sidecar_writer_;
+
+	boost::mutex mutex_;
+	boost::condition_variable wake_;
+	boost::condition_variable done_;
+	boost::scoped_ptr< boost::thread > thread_;
+	bool stop_;
+	int request_;
+	int next_;
+	int prefetch_;
+	int cache_;
+	int frames_;
+	ml::frame_type_ptr fallback_;
 };
 
 } } } }
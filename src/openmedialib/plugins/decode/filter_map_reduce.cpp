@@ -39,6 +39,15 @@ const std::wstring filter_map_reduce::get_uri( ) const { return std::wstring( L"
 
 const size_t filter_map_reduce::slot_count( ) const { return 1; }
 
+boost::int64_t filter_map_reduce::memory_usage( ) const
+{
+	boost::recursive_mutex::scoped_lock lock( mutex_ );
+	boost::int64_t result = 0;
+	for ( std::map< int, frame_type_ptr >::const_iterator iter = frame_map.begin( ); iter != frame_map.end( ); ++ iter )
+		result += memory_bytes( iter->second );
+	return result;
+}
+
 void filter_map_reduce::decode_job ( ml::frame_type_ptr frame )
 {
 	frame->get_image( );
@@ -7,6 +7,7 @@
 #define plugin_decode_filter_map_reduce_h
 
 #include <openmedialib/ml/filter_simple.hpp>
+#include <openmedialib/ml/memory_budget.hpp>
 #include <opencorelib/cl/thread_pool.hpp>
 
 namespace pl = olib::openpluginlib;
@@ -18,7 +19,7 @@ namespace cl = olib::opencorelib;
 namespace olib { namespace openmedialib { namespace ml { namespace decode {
 
 
-class ML_PLUGIN_DECLSPEC filter_map_reduce : public filter_simple
+class ML_PLUGIN_DECLSPEC filter_map_reduce : public filter_simple, public memory_consumer
 {
 	private:
 		pl::pcos::property prop_threads_;
@@ -26,7 +27,7 @@ class ML_PLUGIN_DECLSPEC filter_map_reduce : public filter_simple
 		int threads_;
 		std::map< int, frame_type_ptr > frame_map;
 		cl::thread_pool *pool_;
-		boost::recursive_mutex mutex_;
+		mutable boost::recursive_mutex mutex_;
 		boost::condition_variable_any cond_;
 		ml::frame_type_ptr last_frame_;
 		int expected_;
@@ -45,6 +46,12 @@ class ML_PLUGIN_DECLSPEC filter_map_reduce : public filter_simple
 
 		virtual const size_t slot_count( ) const;
 
+		// Frames decoded ahead by the pool (these are only reported - the pending fetches wait for them)
+		virtual boost::int64_t memory_usage( ) const;
+
+		// The input is fetched by the pool
+		virtual bool memory_threaded( ) const { return true; }
+
 	protected:
 
 		void decode_job ( ml::frame_type_ptr frame );
@@ -8,6 +8,7 @@
 
 #include <openmedialib/ml/openmedialib_plugin.hpp>
 #include <openmedialib/ml/keys.hpp>
+#include <openmedialib/ml/memory_budget.hpp>
 #include <opencorelib/cl/enforce_defines.hpp>
 #include <opencorelib/cl/log_defines.hpp>
 
@@ -17,7 +18,7 @@ namespace cl = olib::opencorelib;
 
 namespace olib { namespace openmedialib { namespace ml { namespace distributor {
 
-class ML_PLUGIN_DECLSPEC filter_fork : public filter_type
+class ML_PLUGIN_DECLSPEC filter_fork : public filter_type, public memory_consumer
 {
 	public:
 		filter_fork( )
@@ -42,6 +43,18 @@ class ML_PLUGIN_DECLSPEC filter_fork : public filter_type
 
 		virtual const size_t slot_count( ) const { return prop_slots_.value< int >( ); }
 
+		// The queue is held by the lock, which isn't necessarily connected to a slot
+		virtual boost::int64_t memory_usage( ) const { return 0; }
+
+		virtual void memory_shared( std::vector< memory_consumer * > &result ) const
+		{
+			if ( memory_consumer *lock = dynamic_cast< memory_consumer * >( lock_.get( ) ) )
+				result.push_back( lock );
+		}
+
+		// Slot 0 is the input behind the lock, which other threads fetch from
+		virtual bool memory_threaded_slot( size_t slot ) const { return slot == 0; }
+
 		void on_slot_change( input_type_ptr input, int slot = 0 ) 
 		{
 			if ( slot == 0 && input )
@@ -10,6 +10,7 @@
 
 #include <openmedialib/ml/openmedialib_plugin.hpp>
 #include <openmedialib/ml/keys.hpp>
+#include <openmedialib/ml/memory_budget.hpp>
 #include <opencorelib/cl/enforce_defines.hpp>
 #include <opencorelib/cl/log_defines.hpp>
 
@@ -19,7 +20,7 @@ namespace cl = olib::opencorelib;
 
 namespace olib { namespace openmedialib { namespace ml { namespace distributor {
 
-class ML_PLUGIN_DECLSPEC filter_lock : public filter_simple
+class ML_PLUGIN_DECLSPEC filter_lock : public filter_simple, public memory_consumer
 {
 	public:
 		filter_lock( )
@@ -39,6 +40,14 @@ class ML_PLUGIN_DECLSPEC filter_lock : public filter_simple
 
 		virtual const size_t slot_count( ) const { return 1; }
 
+		// Frames queued for the other threads - any which are dropped are fetched again
+		virtual boost::int64_t memory_usage( ) const { return lru_memory_usage( lru_ ); }
+		virtual boost::int64_t memory_release( boost::int64_t bytes ) { return lru_memory_release( lru_, bytes ); }
+		virtual int memory_priority( ) const { return memory::cache; }
+
+		// Other threads fetch through the lock, so the memory walk stops here
+		virtual bool memory_threaded( ) const { return true; }
+
 		// Thread safe seek method - each thread holds its own state here
 		virtual void seek( const int position, const bool relative = false )
 		{
@@ -6,10 +6,36 @@
 // threadsafe implementation which allows pushes and fetches to be carried out
 // on two different threads.
 //
+// By default, pushes never block - the last 'queue' frames pushed are held in
+// an lru and the oldest are dropped as new ones arrive.
+//
+// When 'blocking' is 1, frames are instead handed from the pushing thread to 
+// the fetching thread via a lock free single producer/single consumer ring of 
+// 'queue' frames. When the ring is full, push waits for up to 'timeout' ms for
+// the consumer to catch up and returns false if it doesn't - so this is only 
+// suitable when pushes and fetches are carried out on different threads. 
+// Fetched frames are retained on the consumer side (up to 'queue' of them) so
+// that positions can be requested again.
+//
+// Pushing a null frame clears the queued frames.
+//
+// Read only statistics:
+//
+// depth - current number of frames in the lru or ring
+// max_depth - highest number of frames in the ring
+// push_stalls, push_stall_us - times (and total us) push had to wait for space
+// fetch_stalls, fetch_stall_us - times (and total us) fetch had to wait for a frame
+//
+// (only depth is maintained when blocking is 0)
+//
 #include <openmedialib/ml/openmedialib_plugin.hpp>
 #include <openmedialib/ml/keys.hpp>
 #include <opencorelib/cl/enforce_defines.hpp>
 #include <opencorelib/cl/log_defines.hpp>
+#include <opencorelib/cl/spsc_queue.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <algorithm>
+#include <map>
 
 namespace pl = olib::openpluginlib;
 namespace ml = olib::openmedialib::ml;
@@ -20,14 +46,32 @@ namespace olib { namespace openmedialib { namespace ml { namespace distributor {
 class ML_PLUGIN_DECLSPEC input_nudger : public input_type
 {
 	public:
+		typedef cl::spsc_queue< frame_type_ptr > queue_type;
+
 		input_nudger( ) 
 		: prop_length_( pl::pcos::key::from_string( "length" ) )
 		, prop_queue_( pl::pcos::key::from_string( "queue" ) )
 		, prop_timeout_( pl::pcos::key::from_string( "timeout" ) )
+		, prop_blocking_( pl::pcos::key::from_string( "blocking" ) )
+		, prop_depth_( pl::pcos::key::from_string( "depth" ) )
+		, prop_max_depth_( pl::pcos::key::from_string( "max_depth" ) )
+		, prop_push_stalls_( pl::pcos::key::from_string( "push_stalls" ) )
+		, prop_push_stall_us_( pl::pcos::key::from_string( "push_stall_us" ) )
+		, prop_fetch_stalls_( pl::pcos::key::from_string( "fetch_stalls" ) )
+		, prop_fetch_stall_us_( pl::pcos::key::from_string( "fetch_stall_us" ) )
+		, blocking_( false )
+		, queue_( new queue_type( 50 ) )
 		{ 
 			properties( ).append( prop_length_ = INT_MAX );
 			properties( ).append( prop_queue_ = 50 );
 			properties( ).append( prop_timeout_ = 5000 );
+			properties( ).append( prop_blocking_ = 0 );
+			properties( ).append( prop_depth_ = 0 );
+			properties( ).append( prop_max_depth_ = 0 );
+			properties( ).append( prop_push_stalls_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_push_stall_us_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_fetch_stalls_ = boost::int64_t( 0 ) );
+			properties( ).append( prop_fetch_stall_us_ = boost::int64_t( 0 ) );
 		}
 
 		// Indicates if the input will enforce a packet decode
@@ -41,9 +85,12 @@ class ML_PLUGIN_DECLSPEC input_nudger : public input_type
 		// Audio/Visual
 		virtual int get_frames( ) const { return prop_length_.value< int >( ); }
 
-		// Push method
+		// Push method - must only be called from one thread at a time
 		virtual bool push( frame_type_ptr frame )
 		{
+			if ( blocking_ )
+				return queue_->push( frame, boost::posix_time::milliseconds( prop_timeout_.value< int >( ) ) );
+
 			lru_.resize( prop_queue_.value< int >( ) );
 			if ( frame )
 				lru_.append( frame->get_position( ), frame );
@@ -53,19 +100,92 @@ class ML_PLUGIN_DECLSPEC input_nudger : public input_type
 		}
 
 	protected:
-		// Fetch method
+		// The mode and ring are chosen when the input is initialised - the 
+		// blocking and queue properties can't be changed after the first push
+		bool initialize( )
+		{
+			blocking_ = prop_blocking_.value< int >( ) != 0;
+			queue_.reset( new queue_type( size_t( std::max( 1, prop_queue_.value< int >( ) ) ) ) );
+			return true;
+		}
+
+		// Fetch method - must only be called from one thread at a time
 		void do_fetch( frame_type_ptr &result )
 		{
-			result = lru_.wait( get_position( ), boost::posix_time::milliseconds( prop_timeout_.value< int >( ) ));
-			if ( result )
-				result = result->shallow( );
+			if ( !blocking_ )
+			{
+				result = lru_.wait( get_position( ), boost::posix_time::milliseconds( prop_timeout_.value< int >( ) ) );
+				if ( result )
+					result = result->shallow( );
+				prop_depth_ = int( lru_.count( ) );
+				return;
+			}
+
+			const int position = get_position( );
+			boost::system_time timeout = boost::get_system_time( ) + boost::posix_time::milliseconds( prop_timeout_.value< int >( ) );
+
+			// Move everything which has arrived so far into the retained frames
+			frame_type_ptr frame;
+			while ( queue_->try_pop( frame ) )
+				retain( frame );
+
+			// Wait for the requested position to arrive
+			std::map< int, frame_type_ptr >::iterator iter;
+			while ( ( iter = retained_.find( position ) ) == retained_.end( ) )
+			{
+				boost::system_time now = boost::get_system_time( );
+				if ( now >= timeout || !queue_->pop( frame, timeout - now ) )
+					break;
+				retain( frame );
+			}
+
+			if ( iter != retained_.end( ) )
+				result = iter->second->shallow( );
+
+			update_statistics( );
 		}
 
 	private:
+		// Retain the frame, discarding the earliest positions beyond the queue size
+		void retain( const frame_type_ptr &frame )
+		{
+			if ( frame )
+			{
+				retained_[ frame->get_position( ) ] = frame;
+				while ( int( retained_.size( ) ) > prop_queue_.value< int >( ) )
+					retained_.erase( retained_.begin( ) );
+			}
+			else
+			{
+				retained_.clear( );
+			}
+		}
+
+		void update_statistics( )
+		{
+			cl::spsc_queue_statistics stats = queue_->statistics( );
+			prop_depth_ = int( queue_->size( ) );
+			prop_max_depth_ = int( stats.max_depth );
+			prop_push_stalls_ = stats.producer_stalls;
+			prop_push_stall_us_ = stats.producer_stall_time;
+			prop_fetch_stalls_ = stats.consumer_stalls;
+			prop_fetch_stall_us_ = stats.consumer_stall_time;
+		}
+
 		pl::pcos::property prop_length_;
 		pl::pcos::property prop_queue_;
 		pl::pcos::property prop_timeout_;
+		pl::pcos::property prop_blocking_;
+		pl::pcos::property prop_depth_;
+		pl::pcos::property prop_max_depth_;
+		pl::pcos::property prop_push_stalls_;
+		pl::pcos::property prop_push_stall_us_;
+		pl::pcos::property prop_fetch_stalls_;
+		pl::pcos::property prop_fetch_stall_us_;
+		bool blocking_;
 		ml::lru_frame_type lru_;
+		boost::scoped_ptr< queue_type > queue_;
+		std::map< int, frame_type_ptr > retained_;
 };
 
 input_type_ptr create_nudger()
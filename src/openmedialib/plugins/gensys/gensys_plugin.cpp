@@ -125,8 +125,11 @@
 #include <openmedialib/ml/openmedialib_plugin.hpp>
 #include <openmedialib/ml/filter_simple.hpp>
 #include <openmedialib/ml/audio.hpp>
+#include <openmedialib/ml/memory_budget.hpp>
 #include <opencorelib/cl/lru.hpp>
 #include <opencorelib/cl/utilities.hpp>
+#include <opencorelib/cl/thread_pool.hpp>
+#include <opencorelib/cl/function_job.hpp>
 
 #include <openmedialib/ml/image/image.hpp>
 #include <openmedialib/ml/image/rescale_object.hpp>
@@ -134,7 +137,9 @@
 #include <iostream>
 #include <cstdlib>
 #include <vector>
+#include <algorithm>
 #include <map>
+#include <set>
 #include <string>
 #include <cmath>
 #include <limits>
@@ -1620,11 +1625,16 @@ class ML_PLUGIN_DECLSPEC correction_filter : public filter_simple
 //
 // 	fps_num = numerator [default: 25]
 // 	fps_den = denominator [default: 1]
+// 	interpolation = none | blend [default: none]
+// 		none repeats or drops source frames, blend mixes the two source frames either
+// 		side of each output frame in proportion to their distance (per field when 
+// 		interlaced), which reduces the judder of 50 to 59.94 or 25 to 29.97 conversions
+// 	threads = number of threads used to blend [default: 0 - one per core]
 //
 
 static pl::pcos::key key_audio_reversed_( pcos::key::from_string( "audio_reversed" ) );
 
-class ML_PLUGIN_DECLSPEC frame_rate_filter : public filter_type
+class ML_PLUGIN_DECLSPEC frame_rate_filter : public filter_type, public memory_consumer
 {
 	typedef cl::lru< int, ml::frame_type_ptr > frame_cache;
 	typedef boost::rational< boost::int64_t > rational;
@@ -1644,18 +1654,56 @@ class ML_PLUGIN_DECLSPEC frame_rate_filter : public filter_type
 			, prop_fps_den_( pcos::key::from_string( "fps_den" ) )
 			, prop_audio_direction_( pcos::key::from_string( "audio_direction" ) )
 			, prop_check_on_connect_( pcos::key::from_string( "check_on_connect" ) )
+			, prop_interpolation_( pcos::key::from_string( "interpolation" ) )
+			, prop_threads_( pcos::key::from_string( "threads" ) )
 			, current_dir_( 1 )
 			, reseat_( )
 			, next_input_( 0 )
+			, target_( 0 )
 			, valid_on_connect_( false )
+			, pool_( 0 )
+			, pool_threads_( 0 )
 		{
 			properties( ).append( prop_fps_num_ = 25 );
 			properties( ).append( prop_fps_den_ = 1 );
 			properties( ).append( prop_audio_direction_ = 0 );
 			properties( ).append( prop_check_on_connect_ = 1 );
+			properties( ).append( prop_interpolation_ = std::wstring( L"none" ) );
+			properties( ).append( prop_threads_ = 0 );
 			reseat_ = audio::create_reseat( );
 		}
 
+		virtual ~frame_rate_filter( )
+		{
+			if ( pool_ )
+			{
+				pool_->terminate_all_threads( boost::posix_time::seconds( 5 ) );
+				delete pool_;
+			}
+		}
+
+		// Cached source frames
+		virtual boost::int64_t memory_usage( ) const { return lru_memory_usage( cache_ ); }
+
+		// Only the frames behind the current target can be dropped - the audio of the frames from
+		// the target onwards is still being consumed by the following fetches
+		virtual boost::int64_t memory_release( boost::int64_t bytes )
+		{
+			stale_frames stale( target_, current_dir_ );
+			cache_.each( stale );
+
+			boost::int64_t released = 0;
+			for ( std::vector< frame_type_ptr >::const_iterator iter = stale.frames.begin( ); released < bytes && iter != stale.frames.end( ); ++ iter )
+			{
+				cache_.remove( ( *iter )->get_position( ) );
+				released += memory_bytes( *iter );
+			}
+
+			return released;
+		}
+
+		virtual int memory_priority( ) const { return memory::cache; }
+
 		// Indicates if the input will enforce a packet decode
 		virtual bool requires_image( ) const 
 		{ return src_has_image_ && !( prop_fps_num_.value< int >( ) == src_fps_num_ && prop_fps_den_.value< int >( ) == src_fps_den_ ); }
@@ -1708,6 +1756,8 @@ class ML_PLUGIN_DECLSPEC frame_rate_filter : public filter_type
 
 		virtual void on_slot_change( input_type_ptr input, int )
 		{
+			cache_.clear( );
+			last_frame_ = frame_type_ptr( );
 			valid_on_connect_ = !incomplete_input( input );
 			if ( valid_on_connect_ )
 				check_input( input );
@@ -1778,6 +1828,9 @@ class ML_PLUGIN_DECLSPEC frame_rate_filter : public filter_type
 				{
 					result = time_shift( input, fps_num, fps_den );
 				}
+
+				if ( result && src_has_image_ && prop_interpolation_.value< std::wstring >( ) == L"blend" && !( fps_num == src_fps_num_ && fps_den == src_fps_den_ ) )
+					interpolate( input, result );
 			}
 			else if ( input )
 			{
@@ -1854,6 +1907,7 @@ class ML_PLUGIN_DECLSPEC frame_rate_filter : public filter_type
 				? round_down( map_dest_to_source( position_ ) )
 				: round_up( map_dest_to_source( position_ + 1 ) ) - 1;
 			const int samples = audio::samples_for_frame( position_, src_frequency_, fps_num, fps_den );
+			target_ = target;
 
 			// After a seek, we need to know how many samples to discard from the first audio packet we extract
 			int discard = 0;
@@ -1912,16 +1966,9 @@ class ML_PLUGIN_DECLSPEC frame_rate_filter : public filter_type
 								   "Moving away from target %1% at %2% + %3%" )( target )( next_input_ )( current_dir_ );
 				}
 
-				// Seek and fetch the next input frame
-				input->seek( next_input_ );
-				frame_type_ptr frame = input->fetch( );
-				ARENFORCE( frame && frame->get_audio() );
-
-				// Make a shallow copy to allow modification (like audio direction)
-				frame = frame->shallow( );
-
-				// Reverse the audio as required
-				handle_reverse_input_audio( frame );
+				// Obtain the next input frame (which may have been cached by the interpolation)
+				frame_type_ptr frame = source_frame( input, next_input_ );
+				ARENFORCE( frame->get_audio() );
 
 				// Append audio to the reseat and discard what we need to on the first frame
 				if ( discard < frame->get_audio( )->samples( ) )
@@ -1963,6 +2010,164 @@ class ML_PLUGIN_DECLSPEC frame_rate_filter : public filter_type
 			return result;
 		}
 
+		// Fetch a source frame via the cache - a shallow copy with the audio in the current direction
+		ml::frame_type_ptr source_frame( ml::input_type_ptr &input, int position )
+		{
+			ml::frame_type_ptr frame = cache_.fetch( position );
+
+			if ( !frame )
+			{
+				input->seek( position );
+				frame = input->fetch( );
+				ARENFORCE( frame );
+
+				// Make a shallow copy to allow modification (like audio direction)
+				frame = frame->shallow( );
+
+				// Reverse the audio as required
+				handle_reverse_input_audio( frame );
+
+				cache_.append( position, frame );
+			}
+
+			return frame;
+		}
+
+		// Replace the image of the result with a blend of the source frames either side of the output position
+		void interpolate( ml::input_type_ptr &input, ml::frame_type_ptr &result )
+		{
+			const rational time = map_dest_to_source( position_ );
+			const int base = int( round_down( time ) );
+
+			if ( base + 1 >= src_frames_ )
+				return;
+
+			// The second field of the output is half an output frame later and is taken from the second
+			// fields of the sources, which are half a source frame later
+			const rational first = time - base;
+			const rational second = first + map_dest_to_source( 1 ) / 2 - rational( 1, 2 );
+			const int first_weight = weight( first );
+
+			ml::frame_type_ptr frame_a = source_frame( input, base );
+			ml::frame_type_ptr frame_b = source_frame( input, base + 1 );
+
+			ml::image_type_ptr a = frame_a->get_image( );
+			ml::image_type_ptr b = frame_b->get_image( );
+			if ( !a || !b || a->ml_pixel_format( ) != b->ml_pixel_format( ) || a->width( ) != b->width( ) || a->height( ) != b->height( ) )
+				return;
+
+			const int second_weight = a->field_order( ) == ml::image::progressive ? first_weight : weight( second );
+
+			if ( first_weight == 0 && second_weight == 0 )
+			{
+				result->set_image( a );
+				result->set_alpha( frame_a->get_alpha( ) );
+			}
+			else if ( first_weight == 256 && second_weight == 256 )
+			{
+				result->set_image( b );
+				result->set_alpha( frame_b->get_alpha( ) );
+			}
+			else
+			{
+				result->set_image( blend( a, b, first_weight, second_weight ) );
+
+				ml::image_type_ptr alpha_a = frame_a->get_alpha( );
+				ml::image_type_ptr alpha_b = frame_b->get_alpha( );
+				if ( alpha_a && alpha_b && alpha_a->ml_pixel_format( ) == alpha_b->ml_pixel_format( ) && alpha_a->width( ) == alpha_b->width( ) && alpha_a->height( ) == alpha_b->height( ) )
+					result->set_alpha( blend( alpha_a, alpha_b, first_weight, second_weight ) );
+				else
+					result->set_alpha( alpha_a );
+			}
+
+			if ( result->get_image( ) )
+				result->get_image( )->set_writable( false );
+			if ( result->get_alpha( ) )
+				result->get_alpha( )->set_writable( false );
+		}
+
+		// Contribution of the later source frame in 256ths
+		static int weight( const rational &fraction )
+		{
+			// The second field can fall outside the source pair, so clamp before scaling
+			if ( fraction <= 0 )
+				return 0;
+			if ( fraction >= 1 )
+				return 256;
+			return int( boost::rational_cast< boost::int64_t >( fraction * 256 + rational( 1, 2 ) ) );
+		}
+
+		// Blend the images in horizontal slices - the calling thread blends the first slice and the pool the rest
+		ml::image_type_ptr blend( const ml::image_type_ptr &a, const ml::image_type_ptr &b, int first, int second )
+		{
+			ml::image_type_ptr result = ml::image::allocate( a );
+			result->set_field_order( a->field_order( ) );
+			result->set_sar_num( a->get_sar_num( ) );
+			result->set_sar_den( a->get_sar_den( ) );
+			result->set_position( a->position( ) );
+
+			int threads = prop_threads_.value< int >( );
+			if ( threads <= 0 )
+				threads = std::max< int >( 1, int( boost::thread::hardware_concurrency( ) ) );
+
+			// Slices of fewer than 32 scan lines aren't worth a thread
+			const int slices = std::max< int >( 1, std::min< int >( threads, result->height( ) / 32 ) );
+
+			if ( slices > 1 && ( !pool_ || pool_threads_ < slices - 1 ) )
+			{
+				if ( pool_ )
+				{
+					pool_->terminate_all_threads( boost::posix_time::seconds( 5 ) );
+					delete pool_;
+				}
+				pool_ = new cl::thread_pool( slices - 1, boost::posix_time::seconds( 5 ) );
+				pool_threads_ = slices - 1;
+			}
+
+			std::vector< cl::function_job_ptr > jobs;
+			for ( int i = 1; i < slices; i ++ )
+			{
+				cl::function_job_ptr job( new cl::function_job( boost::bind( &ml::image::blend, result, a, b, first, second, i, slices ) ) );
+				pool_->add_job( job );
+				jobs.push_back( job );
+			}
+
+			bool failed = false;
+			std::string reason;
+
+			try
+			{
+				ml::image::blend( result, a, b, first, second, 0, slices );
+			}
+			catch( const std::exception &e )
+			{
+				failed = true;
+				reason = e.what( );
+			}
+
+			// All jobs must be finished before returning since they write to the result
+			for ( size_t i = 0; i < jobs.size( ); i ++ )
+			{
+				while( !jobs[ i ]->wait_for_job_done( boost::posix_time::seconds( 5 ) ) )
+					ARLOG_DEBUG3( "Still waiting for slice %1% of frame %2% to be blended" )( i + 1 )( position_ );
+
+				if ( !failed && jobs[ i ]->get_exception_thrown( ) )
+				{
+					failed = true;
+					if ( jobs[ i ]->get_base_exception( ) )
+						reason = jobs[ i ]->get_base_exception( )->what( );
+					else if ( jobs[ i ]->get_std_exception( ) )
+						reason = jobs[ i ]->get_std_exception( )->what( );
+					else
+						reason = "unknown error";
+				}
+			}
+
+			ARENFORCE_MSG( !failed, "Failed to blend frame %1%: %2%" )( position_ )( reason );
+
+			return result;
+		}
+
 		void handle_reverse_input_audio( ml::frame_type_ptr frame ) const
 		{
 			ml::audio_type_ptr audio = frame->get_audio( );
@@ -1990,6 +2195,22 @@ class ML_PLUGIN_DECLSPEC frame_rate_filter : public filter_type
 			}
 		}
 
+		// Collects the cached frames which are behind the target, least recently used first
+		struct stale_frames
+		{
+			stale_frames( int target, int direction ) : target( target ), direction( direction ) { }
+
+			void operator ( )( const frame_type_ptr &frame )
+			{
+				if ( frame && ( frame->get_position( ) - target ) * direction < 0 )
+					frames.push_back( frame );
+			}
+
+			int target;
+			int direction;
+			std::vector< frame_type_ptr > frames;
+		};
+
 		int position_;
 		int expected_;
 		int src_frames_;
@@ -2001,13 +2222,18 @@ class ML_PLUGIN_DECLSPEC frame_rate_filter : public filter_type
 		pcos::property prop_fps_den_;
 		pcos::property prop_audio_direction_;
 		pcos::property prop_check_on_connect_;
+		pcos::property prop_interpolation_;
+		pcos::property prop_threads_;
 		int current_dir_;
 		audio::reseat_ptr reseat_;
 		std::map < int, frame_type_ptr > map_;
 		frame_type_ptr last_frame_;
 		int next_input_;
+		int target_;
 		frame_cache cache_;
 		bool valid_on_connect_;
+		cl::thread_pool *pool_;
+		int pool_threads_;
 };
 
 //
@@ -2828,20 +3054,67 @@ class ML_PLUGIN_DECLSPEC visualise_filter : public filter_simple
 // have the same frame rate/sample information - that is left as an exercise
 // for the filter graph builder to deal with.
 //
+// The slot holding a position is found by a binary search of the running
+// totals collected by sync_frames.
+//
+// When preroll is set, the first frames of the upcoming clips are fetched by a
+// background thread while the current clip plays, so that the seek and decode
+// latency of the first frame of a clip is hidden. The upcoming clips must not
+// be used elsewhere in the graph while that happens - the playlist waits for
+// the background fetch before it touches a prerolled clip itself.
+//
 // Properties:
 //
 // 	slots = n (default: 2)
 // 		The maximum number of connected slots
+//
+// 	preroll = n (default: 0)
+// 		The number of frames fetched ahead from the start of the upcoming clips
+// 		(0 disables the preroll)
+//
+// 	preroll_clips = n (default: 1)
+// 		The number of upcoming clips which are prerolled
+//
+// 	transitions = n (read only)
+// 		The number of times the playhead has moved from one clip to another
+//
+// 	transition_latency, max_transition_latency = ms (read only)
+// 		The time taken to fetch the first frame after the last (and the slowest)
+// 		transition
 
-class ML_PLUGIN_DECLSPEC playlist_filter : public filter_type
+class ML_PLUGIN_DECLSPEC playlist_filter : public filter_type, public memory_consumer
 {
 	public:
 		playlist_filter( )
 			: filter_type( )
 			, prop_slots_( pcos::key::from_string( "slots" ) )
+			, prop_preroll_( pcos::key::from_string( "preroll" ) )
+			, prop_preroll_clips_( pcos::key::from_string( "preroll_clips" ) )
+			, prop_transitions_( pcos::key::from_string( "transitions" ) )
+			, prop_transition_latency_( pcos::key::from_string( "transition_latency" ) )
+			, prop_max_transition_latency_( pcos::key::from_string( "max_transition_latency" ) )
 			, total_frames_( 0 )
+			, last_connected_( 0 )
+			, last_slot_( -1 )
+			, pool_( 0 )
 		{
 			properties( ).append( prop_slots_ = 2 );
+			properties( ).append( prop_preroll_ = 0 );
+			properties( ).append( prop_preroll_clips_ = 1 );
+			properties( ).append( prop_transitions_ = 0 );
+			properties( ).append( prop_transition_latency_ = 0.0 );
+			properties( ).append( prop_max_transition_latency_ = 0.0 );
+		}
+
+		virtual ~playlist_filter( )
+		{
+			cancel_preroll( );
+
+			if ( pool_ )
+			{
+				pool_->terminate_all_threads( boost::posix_time::seconds( 5 ) );
+				delete pool_;
+			}
 		}
 
 		// Indicates if the input will enforce a packet decode
@@ -2856,55 +3129,201 @@ class ML_PLUGIN_DECLSPEC playlist_filter : public filter_type
 			return total_frames_;
 		}
 
+		// Upcoming slots are prerolled by the pool, so the memory walk stops here
+		virtual boost::int64_t memory_usage( ) const { return 0; }
+		virtual bool memory_threaded( ) const { return true; }
+
 	protected:
 		void do_fetch( frame_type_ptr &result )
 		{
+			const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time( );
+
 			size_t slot = slot_for_position( get_position( ) );
 			input_type_ptr input = fetch_slot( slot );
 
 			if ( input )
 			{
-				input->seek( get_position( ) - slot_offset( slot ) );
-				result = input->fetch( );
+				result = prerolled( slot, get_position( ) - slot_offset( slot ) );
+				if ( !result )
+				{
+					input->seek( get_position( ) - slot_offset( slot ) );
+					result = input->fetch( );
+				}
 				if ( result )
 					result->set_position( get_position( ) );
 			}
+
+			if ( int( slot ) != last_slot_ )
+			{
+				if ( last_slot_ >= 0 )
+				{
+					const double latency = double( ( boost::posix_time::microsec_clock::universal_time( ) - start ).total_microseconds( ) ) / 1000.0;
+					prop_transitions_ = prop_transitions_.value< int >( ) + 1;
+					prop_transition_latency_ = latency;
+					if ( latency > prop_max_transition_latency_.value< double >( ) )
+						prop_max_transition_latency_ = latency;
+				}
+
+				last_slot_ = int( slot );
+				schedule_preroll( slot );
+			}
 		}
 
 		virtual void sync_frames( )
 		{
+			// The slots may have changed, so anything prerolled is suspect
+			cancel_preroll( );
+			last_slot_ = -1;
+
 			slots_.erase( slots_.begin( ), slots_.end( ) );
 			total_frames_ = 0;
+			last_connected_ = 0;
 			for ( size_t i = 0; i < slot_count( ); i ++ )
 			{
 				total_frames_ += fetch_slot( i ) ? fetch_slot( i )->get_frames( ) : 0;
 				slots_.push_back( total_frames_ );
+				if ( fetch_slot( i ) )
+					last_connected_ = i;
 			}
 		}
 
 	private:
+		// Frames fetched ahead from the start of a clip - only the job touches
+		// the frames until it's done
+		struct preroll_type
+		{
+			cl::function_job_ptr job;
+			std::map< int, frame_type_ptr > frames;
+		};
+
+		typedef boost::shared_ptr< preroll_type > preroll_type_ptr;
+		typedef std::map< size_t, preroll_type_ptr > preroll_map;
+
+		// The first slot whose running total exceeds the position holds it - slots
+		// which contribute no frames are never selected. Positions beyond the end
+		// belong to the last connected slot.
 		size_t slot_for_position( int position )
 		{
-			size_t result = 0;
-			for ( size_t i = 0; i < slots_.size( ); i ++ )
+			std::vector< int >::const_iterator iter = std::upper_bound( slots_.begin( ), slots_.end( ), std::max< int >( position, 0 ) );
+			return iter != slots_.end( ) ? size_t( iter - slots_.begin( ) ) : last_connected_;
+		}
+
+		int slot_offset( size_t slot )
+		{
+			return slot == 0 ? 0 : slots_[ slot - 1 ];
+		}
+
+		bool has_frames( size_t slot )
+		{
+			return fetch_slot( slot ) && slots_[ slot ] > slot_offset( slot );
+		}
+
+		static void preroll_job( input_type_ptr input, int frames, preroll_type_ptr preroll )
+		{
+			frames = std::min< int >( frames, input->get_frames( ) );
+			for ( int i = 0; i < frames; i ++ )
 			{
-				if ( fetch_slot( i ) )
+				input->seek( i );
+				frame_type_ptr frame = input->fetch( );
+				if ( frame )
+					preroll->frames[ i ] = frame;
+			}
+		}
+
+		// Wait for the job to release the clip - failures are logged and the clip is fetched normally
+		void wait_for( const preroll_type_ptr &preroll, size_t slot )
+		{
+			while( !preroll->job->wait_for_job_done( boost::posix_time::seconds( 5 ) ) )
+				ARLOG_DEBUG3( "Still waiting for the preroll of playlist slot %1%" )( slot );
+
+			if ( preroll->job->get_exception_thrown( ) )
+			{
+				ARLOG_WARN( "Preroll of playlist slot %1% failed" )( slot );
+				preroll->frames.clear( );
+			}
+		}
+
+		// Take the prerolled frame for the position in the slot (if any)
+		frame_type_ptr prerolled( size_t slot, int position )
+		{
+			frame_type_ptr result;
+			preroll_map::iterator iter = prerolls_.find( slot );
+
+			if ( iter != prerolls_.end( ) )
+			{
+				preroll_type_ptr preroll = iter->second;
+				wait_for( preroll, slot );
+
+				std::map< int, frame_type_ptr >::iterator frame = preroll->frames.find( position );
+				if ( frame != preroll->frames.end( ) )
+					result = frame->second;
+
+				// Playback moves forward, so earlier frames are no longer needed
+				preroll->frames.erase( preroll->frames.begin( ), preroll->frames.upper_bound( position ) );
+				if ( preroll->frames.empty( ) )
+					prerolls_.erase( iter );
+			}
+
+			return result;
+		}
+
+		// Preroll the clips following the slot and drop prerolls of any others
+		void schedule_preroll( size_t slot )
+		{
+			const int frames = prop_preroll_.value< int >( );
+			std::set< size_t > upcoming;
+
+			for ( size_t i = slot + 1; frames > 0 && i < slots_.size( ) && int( upcoming.size( ) ) < prop_preroll_clips_.value< int >( ); i ++ )
+				if ( has_frames( i ) )
+					upcoming.insert( i );
+
+			for ( preroll_map::iterator iter = prerolls_.begin( ); iter != prerolls_.end( ); )
+			{
+				if ( iter->first != slot && upcoming.find( iter->first ) == upcoming.end( ) )
 				{
-					result = i;
-					if ( position < slots_[ i ] ) break;
+					wait_for( iter->second, iter->first );
+					prerolls_.erase( iter ++ );
+				}
+				else
+				{
+					++ iter;
 				}
 			}
-			return result;
+
+			for ( std::set< size_t >::const_iterator i = upcoming.begin( ); i != upcoming.end( ); ++ i )
+			{
+				if ( prerolls_.find( *i ) != prerolls_.end( ) )
+					continue;
+
+				if ( !pool_ )
+					pool_ = new cl::thread_pool( 1, boost::posix_time::seconds( 5 ) );
+
+				preroll_type_ptr preroll( new preroll_type( ) );
+				preroll->job = cl::function_job_ptr( new cl::function_job( boost::bind( &playlist_filter::preroll_job, fetch_slot( *i ), frames, preroll ) ) );
+				prerolls_[ *i ] = preroll;
+				pool_->add_job( preroll->job );
+			}
 		}
 
-		int slot_offset( size_t slot )
+		void cancel_preroll( )
 		{
-			return slot == 0 ? 0 : slots_[ slot - 1 ];
+			for ( preroll_map::iterator iter = prerolls_.begin( ); iter != prerolls_.end( ); ++ iter )
+				wait_for( iter->second, iter->first );
+			prerolls_.clear( );
 		}
 
 		pcos::property prop_slots_;
+		pcos::property prop_preroll_;
+		pcos::property prop_preroll_clips_;
+		pcos::property prop_transitions_;
+		pcos::property prop_transition_latency_;
+		pcos::property prop_max_transition_latency_;
 		std::vector< int > slots_;
 		int total_frames_;
+		size_t last_connected_;
+		int last_slot_;
+		preroll_map prerolls_;
+		cl::thread_pool *pool_;
 };
 
 //
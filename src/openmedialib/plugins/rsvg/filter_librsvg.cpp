@@ -6,13 +6,22 @@
 // #input:svg:
 //
 // An SVG input based on librsvg.
+//
+// The rendered document is kept in the overlay cache (see ml/overlay_cache.hpp)
+// after conversion to the pixel format of the background, so it is only
+// rendered once for each size and format.
 
 #include <opencorelib/cl/enforce_defines.hpp>
 #include <openmedialib/ml/openmedialib_plugin.hpp>
+#include <openmedialib/ml/overlay_cache.hpp>
+#include <openmedialib/ml/utilities.hpp>
+#include <opencorelib/cl/str_util.hpp>
 #include <openpluginlib/pl/pcos/isubject.hpp>
 #include <openpluginlib/pl/pcos/observer.hpp>
 
 #include <iostream>
+#include <sstream>
+#include <boost/filesystem/operations.hpp>
 #include <boost/thread.hpp>
 
 #include <librsvg/rsvg.h>
@@ -59,6 +68,9 @@ class ML_PLUGIN_DECLSPEC filter_librsvg : public ml::filter_type
 
 			svg_ = ml::create_input( L"svg:" );
 			ARENFORCE_MSG( svg_ != 0, "Failed to create backing input for SVG filter" );
+
+			// The converted render is cached here, so the raw render needn't be
+			svg_->properties( ).get_property_with_string( "cache" ) = 0;
 		}
 
 		// Indicates if the input will enforce a packet decode
@@ -104,8 +116,21 @@ class ML_PLUGIN_DECLSPEC filter_librsvg : public ml::filter_type
 				svg_->properties( ).get_property_with_string( "resource" ) = prop_file_.value< std::wstring >();
 
 
-				// Fetch image
-				ml::frame_type_ptr fg = svg_->fetch( );
+				// Fetch image (reusing a previous render for the same document, size and format)
+				const olib::t_string pf = prop_deferred_.value< int >( ) ? olib::t_string( _CT( "" ) ) : result->get_image( )->pf( );
+				const std::string key = cache_key( result, pf );
+				ml::frame_type_ptr fg = ml::overlay_cache_fetch( key );
+
+				if ( !fg )
+				{
+					fg = svg_->fetch( );
+
+					// Convert now so that the compositor needn't do it for each frame
+					if ( pf != _CT( "" ) && fg->get_image( ) )
+						fg = ml::frame_convert( fg, pf );
+
+					ml::overlay_cache_insert( key, fg );
+				}
 
 				if( !result->properties( ).get_property_with_string( "background" ).valid( ) )
 				{
@@ -128,6 +153,34 @@ class ML_PLUGIN_DECLSPEC filter_librsvg : public ml::filter_type
 
 	protected:
 
+		// Describes everything the composited overlay depends on
+		std::string cache_key( const ml::frame_type_ptr &frame, const olib::t_string &pf ) const
+		{
+			std::wstringstream description;
+			int sar_num = 0, sar_den = 0;
+			frame->get_sar( sar_num, sar_den );
+
+			// Include the modification time of the file, so that a changed file is rendered again
+			std::time_t modified = 0;
+			if ( prop_file_.value< std::wstring >( ) != L"" )
+			{
+				std::string filename = cl::str_util::to_string( prop_file_.value< std::wstring >( ) );
+				if( filename.find( "svg:" ) == 0 )
+					filename = filename.substr( 4 );
+				boost::system::error_code error;
+				modified = boost::filesystem::last_write_time( filename, error );
+				if ( error )
+					modified = 0;
+			}
+
+			description << L"file=" << prop_file_.value< std::wstring >( ) << L"@" << modified << L"|xml=" << prop_xml_.value< std::wstring >( )
+						<< L"|" << frame->get_image( )->width( ) << L"x" << frame->get_image( )->height( )
+						<< L"|" << sar_num << L":" << sar_den << L"|" << prop_stretch_.value< int >( )
+						<< L"|" << cl::str_util::to_wstring( pf );
+
+			return ml::overlay_cache_key( "svg_filter", description.str( ) );
+		}
+
 		pcos::property prop_file_;
 		pcos::property prop_xml_;
 		pcos::property prop_duration_;
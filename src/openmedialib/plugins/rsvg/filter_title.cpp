@@ -9,8 +9,15 @@
 // title, font, font size and geometry. Internally, it generates an SVG doc
 // which is passed to the SVG input for conversion to a image and is then
 // compositord on to the image from the connected input.
+//
+// Rendered titles are kept in the overlay cache (see ml/overlay_cache.hpp)
+// after conversion to the pixel format of the background, so a title which
+// has been shown before costs a lookup rather than a render and conversion.
 
 #include <openmedialib/ml/openmedialib_plugin.hpp>
+#include <openmedialib/ml/overlay_cache.hpp>
+#include <openmedialib/ml/utilities.hpp>
+#include <opencorelib/cl/str_util.hpp>
 #include <openpluginlib/pl/pcos/isubject.hpp>
 #include <openpluginlib/pl/pcos/observer.hpp>
 
@@ -27,6 +34,7 @@ namespace aml { namespace openmedialib {
 
 static pl::pcos::key key_deferred_( pcos::key::from_string( "deferred" ) );
 static pl::pcos::key key_doc_( pcos::key::from_string( "xml" ) );
+static pl::pcos::key key_cache_( pcos::key::from_string( "cache" ) );
 static pl::pcos::key key_x_( pcos::key::from_string( "x" ) );
 static pl::pcos::key key_y_( pcos::key::from_string( "y" ) );
 static pl::pcos::key key_w_( pcos::key::from_string( "w" ) );
@@ -101,6 +109,9 @@ class filter_title : public ml::filter_simple
 			svg_ = ml::create_input( L"svg:" );
 			assert( svg_ != 0 );
 			svg_->init( );
+
+			// The converted title is cached here, so the raw render needn't be
+			svg_->properties( ).get_property_with_key( key_cache_ ) = 0;
 		}
 
 		virtual ~filter_title( )
@@ -135,11 +146,26 @@ class filter_title : public ml::filter_simple
 				w += w % 2;
 				h += h % 2;
 
-				// Pass the doc to the svg input
-				svg_->properties( ).get_property_with_key( key_doc_ ) = create_doc( result, w, h );
+				// Reuse the title if it has been rendered for this pixel format before
+				const std::wstring doc = create_doc( result, w, h );
+				const olib::t_string pf = prop_deferred_.value< int >( ) ? olib::t_string( _CT( "" ) ) : result->get_image( )->pf( );
+				const std::string key = ml::overlay_cache_key( "title", doc + L"|" + cl::str_util::to_wstring( pf ) );
+				ml::frame_type_ptr fg = ml::overlay_cache_fetch( key );
+
+				if ( !fg )
+				{
+					// Pass the doc to the svg input
+					svg_->properties( ).get_property_with_key( key_doc_ ) = doc;
+					fg = svg_->fetch( );
+
+					// Convert now so that the compositor needn't do it for each frame
+					if ( pf != _CT( "" ) && fg->get_image( ) )
+						fg = ml::frame_convert( fg, pf );
+
+					ml::overlay_cache_insert( key, fg );
+				}
 
-				// Fetch image and assign geometry
-				ml::frame_type_ptr fg = svg_->fetch( );
+				// Assign geometry
 				assign( fg, key_x_, prop_x_.value< double >( ) );
 				assign( fg, key_y_, prop_y_.value< double >( ) );
 				assign( fg, key_w_, prop_w_.value< double >( ) );
@@ -35,18 +35,26 @@
 //		is set to 0, this value is taken into account so that the image
 //		produced has the correct aspect ratio when viewed with the
 //		given sar.
+//
+// cache : int
+//		If 1 (default), rendered images are shared through the overlay cache
+//		(see ml/overlay_cache.hpp), so a document which has been rendered
+//		before at the same size isn't rendered again.
 
 #include <opencorelib/cl/core.hpp>
 #include <opencorelib/cl/enforce_defines.hpp>
 #include <opencorelib/cl/guard_define.hpp>
 
 #include <openmedialib/ml/openmedialib_plugin.hpp>
+#include <openmedialib/ml/overlay_cache.hpp>
 #include <openpluginlib/pl/pcos/isubject.hpp>
 #include <openpluginlib/pl/pcos/observer.hpp>
 #include <opencorelib/cl/log_defines.hpp>
 #include <opencorelib/cl/enforce_defines.hpp>
 
 #include <iostream>
+#include <sstream>
+#include <boost/filesystem/operations.hpp>
 #include <boost/thread.hpp>
 
 #include <librsvg/rsvg.h>
@@ -110,6 +118,7 @@ class ML_PLUGIN_DECLSPEC input_librsvg : public ml::input_type
 			, prop_render_sar_num_( pcos::key::from_string( "render_sar_num" ) )
 			, prop_render_sar_den_( pcos::key::from_string( "render_sar_den" ) )
 			, prop_stretch_( pcos::key::from_string( "stretch" ) )
+			, prop_cache_( pcos::key::from_string( "cache" ) )
 			, obs_dirty_state_( new rsvg_observer( &dirty_ ) )
 			, frame_( )
 		{
@@ -127,6 +136,7 @@ class ML_PLUGIN_DECLSPEC input_librsvg : public ml::input_type
 			properties( ).append( prop_render_sar_den_ = 1 );
 
 			properties( ).append( prop_stretch_ = 0 );
+			properties( ).append( prop_cache_ = 1 );
 
 			//Attach an observer which will set the dirty flag for
 			//all properties that should cause us to re-render the SVG.
@@ -230,8 +240,48 @@ class ML_PLUGIN_DECLSPEC input_librsvg : public ml::input_type
 			}
 		}
 
+		// Describes everything the render depends on
+		std::string cache_key( ) const
+		{
+			std::wstringstream description;
+			const std::wstring resource = prop_resource_.value< std::wstring >( );
+
+			if ( resource.empty( ) || resource == L"svg:" )
+			{
+				description << L"xml=" << prop_xml_.value< std::wstring >( );
+			}
+			else
+			{
+				// Include the modification time, so that a changed file is rendered again
+				std::string filename = olib::opencorelib::str_util::to_string( resource );
+				if( filename.find( "svg:" ) == 0 )
+					filename = filename.substr( 4 );
+				boost::system::error_code error;
+				std::time_t modified = boost::filesystem::last_write_time( filename, error );
+				description << L"file=" << resource << L"@" << ( error ? std::time_t( 0 ) : modified );
+			}
+
+			description << L"|" << prop_render_width_.value< int >( ) << L"x" << prop_render_height_.value< int >( )
+						<< L"|" << prop_render_sar_num_.value< int >( ) << L":" << prop_render_sar_den_.value< int >( )
+						<< L"|" << prop_stretch_.value< int >( );
+
+			return ml::overlay_cache_key( "svg", description.str( ) );
+		}
+
 		void do_fetch( ml::frame_type_ptr &result )
 		{
+			const std::string key = dirty_ && prop_cache_.value< int >( ) ? cache_key( ) : std::string( "" );
+
+			if ( key != "" )
+			{
+				ml::frame_type_ptr cached = ml::overlay_cache_fetch( key );
+				if ( cached )
+				{
+					frame_ = cached;
+					dirty_ = false;
+				}
+			}
+
 			if( dirty_ )
 			{
 				RsvgHandle *handle = NULL;
@@ -324,6 +374,9 @@ class ML_PLUGIN_DECLSPEC input_librsvg : public ml::input_type
 				}
 				frame_->set_image( image );
 
+				if ( key != "" )
+					ml::overlay_cache_insert( key, frame_ );
+
 				//Our image is now rendered and in sync with the current state
 				dirty_ = false;
 			}
@@ -348,6 +401,7 @@ class ML_PLUGIN_DECLSPEC input_librsvg : public ml::input_type
 		pcos::property prop_render_sar_num_;
 		pcos::property prop_render_sar_den_;
 		pcos::property prop_stretch_;
+		pcos::property prop_cache_;
 		boost::shared_ptr< rsvg_observer > obs_dirty_state_;
 		ml::frame_type_ptr frame_;
 };
@@ -15,7 +15,11 @@
 // size, etc. It doesn't yet support deferred frames, but when printing the
 // same text with the same options (technically as long as the "dirty"
 // property is still false) the overlayed image will be cached and not redrawn
-// which although being fast, takes its time.
+// which although being fast, takes its time. Renders of static text are also
+// shared through the overlay cache (see ml/overlay_cache.hpp), so text which
+// has been drawn before with the same options and frame geometry is not drawn
+// again. Timecodes change on every frame, so they're drawn directly rather
+// than evicting reusable renders from the cache.
 //
 // It has the following properties:
 // type:
@@ -67,6 +71,7 @@
 //
 
 #include <openmedialib/ml/openmedialib_plugin.hpp>
+#include <openmedialib/ml/overlay_cache.hpp>
 #include <openpluginlib/pl/pcos/isubject.hpp>
 #include <openpluginlib/pl/pcos/observer.hpp>
 #include <opencorelib/cl/enforce_defines.hpp>
@@ -144,6 +149,9 @@ protected:
 
 	ml::image_type_ptr redraw( ml::frame_type_ptr& bg_frame );
 
+	// Describes everything the overlay for the frame depends on
+	std::string cache_key( ml::frame_type_ptr& bg_frame );
+
 	// The main access point to the filter
 	void do_fetch( ml::frame_type_ptr& frame );
 
@@ -415,6 +423,21 @@ ml::image_type_ptr filter_textoverlay::redraw( ml::frame_type_ptr& bg_frame )
 	return cairo_surface_->to_image( );
 }
 
+std::string filter_textoverlay::cache_key( ml::frame_type_ptr& bg_frame )
+{
+	std::ostringstream description;
+
+	description << get_type( ) << '|' << text_to_draw( bg_frame ) << '|'
+	            << get_color( ) << '|' << get_stroke_width( ) << '|' << get_stroke_color( ) << '|'
+	            << get_font_face( ) << '|' << get_font_size( ) << '|' << get_font_slant( ) << '|' << get_font_weight( ) << '|'
+	            << get_textpos( ) << '|' << get_origin( ) << '|' << get_alignment( ) << '|'
+	            << get_box_color( ) << '|' << get_box_padding( ) << '|'
+	            << bg_frame->width( ) << 'x' << bg_frame->height( ) << '|' << bg_frame->sar( ) << '|'
+	            << ( get_deferred( ) ? "rgba" : "yuv420p" );
+
+	return ml::overlay_cache_key( "textoverlay", description.str( ) );
+}
+
 void filter_textoverlay::do_fetch( ml::frame_type_ptr& frame )
 {
 	frame = fetch_from_slot( );
@@ -435,14 +458,23 @@ void filter_textoverlay::do_fetch( ml::frame_type_ptr& frame )
 	// caching the first bounding box of the text, and force it
 	// for all time codes.
 
-	if ( get_dirty( ) || !cairo_context_ || get_type( ) == "tc" ) {
-		ml::image_type_ptr image = redraw( frame );
+	if ( get_dirty( ) || !overlay_ || get_type( ) == "tc" ) {
+		const bool cacheable = get_type( ) != "tc";
+		const std::string key = cacheable ? cache_key( frame ) : std::string( );
+		overlay_ = cacheable ? ml::overlay_cache_fetch( key ) : ml::frame_type_ptr( );
+
+		if ( !overlay_ ) {
+			ml::image_type_ptr image = redraw( frame );
 
-		overlay_ = ml::frame_type_ptr( new ml::frame_type( ) );
-		overlay_->set_image( image );
+			overlay_ = ml::frame_type_ptr( new ml::frame_type( ) );
+			overlay_->set_image( image );
 
-		if ( !get_deferred( ) )
-			overlay_ = ml::frame_convert( overlay_, _CT("yuv420p") );
+			if ( !get_deferred( ) )
+				overlay_ = ml::frame_convert( overlay_, _CT("yuv420p") );
+
+			if ( cacheable )
+				ml::overlay_cache_insert( key, overlay_ );
+		}
 
 		overlay_->set_sar( 1, 1 );
 		overlay_->set_fps( frame->get_fps_num( ), frame->get_fps_den( ) );
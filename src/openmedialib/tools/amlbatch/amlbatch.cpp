@@ -7,6 +7,9 @@
 #include <fstream>
 #include <sstream>
 #include <deque>
+#include <vector>
+#include <algorithm>
+#include <cmath>
 
 #include <signal.h>
 
@@ -14,10 +17,14 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <termios.h>
 #else
 #include <conio.h>
 #include <io.h>
+#include <windows.h>
+#include <psapi.h>
+#pragma comment( lib, "psapi.lib" )
 #endif
 
 #include <opencorelib/cl/core.hpp>
@@ -28,9 +35,14 @@
 #include <openmedialib/ml/openmedialib_plugin.hpp>
 #include <openmedialib/ml/indexer.hpp>
 #include <openmedialib/ml/audio_channel_extract.hpp>
+#include <openmedialib/ml/statistics.hpp>
+#include <openmedialib/ml/audio_pool.hpp>
+#include <openmedialib/ml/memory_budget.hpp>
+#include <opencorelib/cl/lru.hpp>
 
 #include <openpluginlib/pl/timer.hpp>
 #include <boost/thread.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <opencorelib/cl/special_folders.hpp>
 
@@ -342,7 +354,292 @@ void prepare_graph( ml::filter_type_ptr input, std::vector< ml::store_type_ptr >
 		walk_and_assign( input, "active", 1 );
 }
 
-void run( ml::input_type_ptr input, bool interactive, bool stats )
+// Performance report generated by the --perf-report=<file> option. The report
+// holds per frame fetch latency percentiles, a per node breakdown of the time
+// spent in the graph (see ml/statistics.hpp), peak memory usage, the memory
+// held by the caches of the graph and of each node at the end of the run (see
+// ml/memory_budget.hpp), buffer allocation counts and lru cache hit rates. It
+// is written as JSON unless the file name ends with .csv.
+
+class perf_report
+{
+	public:
+		perf_report( const std::string &file, double interval )
+			: file_( file )
+			, interval_( boost::int64_t( interval * MICRO_SECS ) )
+			, start_( 0 )
+			, interval_start_( 0 )
+			, cache_hits_( 0 )
+			, cache_misses_( 0 )
+		{ }
+
+		// Resets all counters and starts the clock
+		void start( ml::input_type_ptr input )
+		{
+			ml::enable_fetch_stats( true );
+			ml::reset_fetch_stats( input );
+			latencies_.clear( );
+			interval_latencies_.clear( );
+			intervals_.clear( );
+			allocations_ = ml::allocation_stats( );
+			audio_pool_ = ml::audio::pool_stats( );
+			cache_hits_ = cl::lru_statistics::hits( );
+			cache_misses_ = cl::lru_statistics::misses( );
+			start_ = interval_start_ = ml::fetch_stats_clock( );
+		}
+
+		// Records the time taken to fetch a frame from the graph
+		void frame( boost::int64_t elapsed )
+		{
+			latencies_.push_back( elapsed );
+
+			if ( interval_ > 0 )
+			{
+				interval_latencies_.push_back( elapsed );
+				boost::int64_t now = ml::fetch_stats_clock( );
+				if ( now - interval_start_ >= interval_ )
+				{
+					interval_type item;
+					item.start = double( interval_start_ - start_ ) / MICRO_SECS;
+					item.frames = interval_latencies_.size( );
+					item.fps = item.frames / ( double( now - interval_start_ ) / MICRO_SECS );
+					item.latency = summarise( interval_latencies_ );
+					intervals_.push_back( item );
+					interval_latencies_.clear( );
+					interval_start_ = now;
+				}
+			}
+		}
+
+		// Collects the node statistics from the graph and writes the report
+		bool write( ml::input_type_ptr input )
+		{
+			boost::int64_t elapsed = ml::fetch_stats_clock( ) - start_;
+
+			nodes_ = ml::collect_fetch_stats( input );
+
+			if ( !ml::fetch_trace_enabled( ) )
+				ml::enable_fetch_stats( false );
+
+			summary_.clear( );
+			latency_type latency = summarise( latencies_ );
+			ml::allocation_stats_type allocations = ml::allocation_stats( );
+			ml::audio::pool_stats_type audio_pool = ml::audio::pool_stats( );
+			boost::int64_t hits = cl::lru_statistics::hits( ) - cache_hits_;
+			boost::int64_t misses = cl::lru_statistics::misses( ) - cache_misses_;
+
+			metric( "frames", boost::int64_t( latencies_.size( ) ) );
+			metric( "elapsed_s", double( elapsed ) / MICRO_SECS );
+			metric( "fps", elapsed > 0 ? latencies_.size( ) / ( double( elapsed ) / MICRO_SECS ) : 0.0 );
+			metric( "latency_mean_us", latency.mean );
+			metric( "latency_p50_us", latency.p50 );
+			metric( "latency_p95_us", latency.p95 );
+			metric( "latency_p99_us", latency.p99 );
+			metric( "latency_max_us", latency.max );
+			metric( "peak_rss_kb", boost::int64_t( peak_rss( ) ) );
+			metric( "graph_memory_bytes", boost::int64_t( ml::graph_memory_usage( input ) ) );
+			metric( "image_allocations", boost::int64_t( allocations.images - allocations_.images ) );
+			metric( "image_allocated_bytes", boost::int64_t( allocations.image_bytes - allocations_.image_bytes ) );
+			metric( "audio_allocations", boost::int64_t( allocations.audios - allocations_.audios ) );
+			metric( "audio_allocated_bytes", boost::int64_t( allocations.audio_bytes - allocations_.audio_bytes ) );
+			metric( "audio_pool_requests", boost::int64_t( audio_pool.requests - audio_pool_.requests ) );
+			metric( "audio_pool_system_allocations", boost::int64_t( audio_pool.system_allocations - audio_pool_.system_allocations ) );
+			metric( "audio_pool_retained_bytes", boost::int64_t( audio_pool.retained_bytes ) );
+			metric( "cache_hits", hits );
+			metric( "cache_misses", misses );
+			metric( "cache_hit_rate", hits + misses > 0 ? double( hits ) / double( hits + misses ) : 0.0 );
+
+			std::ofstream stream( file_.c_str( ) );
+			if ( !stream.good( ) )
+			{
+				std::cerr << "Unable to write performance report to " << file_ << std::endl;
+				return false;
+			}
+
+			if ( file_.size( ) >= 4 && file_.substr( file_.size( ) - 4 ) == ".csv" )
+				write_csv( stream );
+			else
+				write_json( stream );
+
+			return stream.good( );
+		}
+
+	private:
+		struct latency_type
+		{
+			latency_type( ) : mean( 0 ), p50( 0 ), p95( 0 ), p99( 0 ), max( 0 ) { }
+			double mean, p50, p95, p99, max;
+		};
+
+		struct interval_type
+		{
+			double start;
+			size_t frames;
+			double fps;
+			latency_type latency;
+		};
+
+		static latency_type summarise( std::vector< boost::int64_t > values )
+		{
+			latency_type result;
+			if ( !values.empty( ) )
+			{
+				std::sort( values.begin( ), values.end( ) );
+				double total = 0.0;
+				for ( std::vector< boost::int64_t >::const_iterator i = values.begin( ); i != values.end( ); ++i )
+					total += double( *i );
+				result.mean = total / values.size( );
+				result.p50 = percentile( values, 50.0 );
+				result.p95 = percentile( values, 95.0 );
+				result.p99 = percentile( values, 99.0 );
+				result.max = double( values.back( ) );
+			}
+			return result;
+		}
+
+		// Nearest rank percentile of a sorted collection
+		static double percentile( const std::vector< boost::int64_t > &sorted, double percent )
+		{
+			size_t rank = size_t( std::ceil( percent / 100.0 * sorted.size( ) ) );
+			return double( sorted[ rank > 0 ? rank - 1 : 0 ] );
+		}
+
+		static long peak_rss( )
+		{
+#ifndef WIN32
+			struct rusage usage;
+			if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+				return 0;
+#	ifdef __APPLE__
+			return long( usage.ru_maxrss / 1024 );
+#	else
+			return long( usage.ru_maxrss );
+#	endif
+#else
+			PROCESS_MEMORY_COUNTERS counters;
+			if ( !GetProcessMemoryInfo( GetCurrentProcess( ), &counters, sizeof( counters ) ) )
+				return 0;
+			return long( counters.PeakWorkingSetSize / 1024 );
+#endif
+		}
+
+		void metric( const std::string &name, double value )
+		{
+			std::ostringstream text;
+			text << value;
+			summary_.push_back( std::make_pair( name, text.str( ) ) );
+		}
+
+		// Counters and byte totals are written in full rather than in exponent form
+		void metric( const std::string &name, boost::int64_t value )
+		{
+			std::ostringstream text;
+			text << value;
+			summary_.push_back( std::make_pair( name, text.str( ) ) );
+		}
+
+		// Escapes a string for JSON (quote = '\\') or CSV (quote = '"') output
+		static std::string escape( const std::string &value, char quote = '\\' )
+		{
+			std::string result;
+			for ( std::string::const_iterator i = value.begin( ); i != value.end( ); ++i )
+			{
+				if ( *i == '"' || ( *i == '\\' && quote == '\\' ) )
+					result += quote;
+				if ( ( unsigned char )*i < 0x20 )
+					result += ' ';
+				else
+					result += *i;
+			}
+			return result;
+		}
+
+		void write_json( std::ostream &stream )
+		{
+			stream << "{" << std::endl;
+			stream << "\t\"summary\": {" << std::endl;
+			for ( size_t i = 0; i < summary_.size( ); i ++ )
+				stream << "\t\t\"" << summary_[ i ].first << "\": " << summary_[ i ].second << ( i + 1 < summary_.size( ) ? "," : "" ) << std::endl;
+			stream << "\t}," << std::endl;
+
+			stream << "\t\"intervals\": [" << std::endl;
+			for ( size_t i = 0; i < intervals_.size( ); i ++ )
+			{
+				const interval_type &item = intervals_[ i ];
+				stream << "\t\t{ \"start_s\": " << item.start << ", \"frames\": " << item.frames << ", \"fps\": " << item.fps
+					   << ", \"latency_p50_us\": " << item.latency.p50 << ", \"latency_p95_us\": " << item.latency.p95
+					   << ", \"latency_p99_us\": " << item.latency.p99 << ", \"latency_max_us\": " << item.latency.max << " }"
+					   << ( i + 1 < intervals_.size( ) ? "," : "" ) << std::endl;
+			}
+			stream << "\t]," << std::endl;
+
+			stream << "\t\"nodes\": [" << std::endl;
+			for ( size_t i = 0; i < nodes_.size( ); i ++ )
+			{
+				const ml::fetch_stats_node &node = nodes_[ i ];
+				stream << "\t\t{ \"path\": \"" << node.path << "\", \"uri\": \"" << escape( uri( node ) ) << "\""
+					   << ", \"calls\": " << node.stats.calls << ", \"total_us\": " << node.stats.elapsed
+					   << ", \"self_us\": " << node.stats.self << ", \"mean_us\": " << mean( node ) 
+					   << ", \"max_us\": " << node.stats.maximum << ", \"image_bytes\": " << node.stats.image_bytes
+					   << ", \"audio_bytes\": " << node.stats.audio_bytes << ", \"memory_bytes\": " << ml::node_memory_usage( node.input )
+					   << " }" << ( i + 1 < nodes_.size( ) ? "," : "" ) << std::endl;
+			}
+			stream << "\t]" << std::endl;
+			stream << "}" << std::endl;
+		}
+
+		void write_csv( std::ostream &stream )
+		{
+			stream << "metric,value" << std::endl;
+			for ( size_t i = 0; i < summary_.size( ); i ++ )
+				stream << summary_[ i ].first << "," << summary_[ i ].second << std::endl;
+			stream << std::endl;
+
+			stream << "start_s,frames,fps,latency_p50_us,latency_p95_us,latency_p99_us,latency_max_us" << std::endl;
+			for ( size_t i = 0; i < intervals_.size( ); i ++ )
+			{
+				const interval_type &item = intervals_[ i ];
+				stream << item.start << "," << item.frames << "," << item.fps << "," << item.latency.p50 << "," 
+					   << item.latency.p95 << "," << item.latency.p99 << "," << item.latency.max << std::endl;
+			}
+			stream << std::endl;
+
+			stream << "path,uri,calls,total_us,self_us,mean_us,max_us,image_bytes,audio_bytes,memory_bytes" << std::endl;
+			for ( size_t i = 0; i < nodes_.size( ); i ++ )
+			{
+				const ml::fetch_stats_node &node = nodes_[ i ];
+				stream << node.path << ",\"" << escape( uri( node ), '"' ) << "\"," << node.stats.calls << "," << node.stats.elapsed << "," 
+					   << node.stats.self << "," << mean( node ) << "," << node.stats.maximum << "," 
+					   << node.stats.image_bytes << "," << node.stats.audio_bytes << "," << ml::node_memory_usage( node.input ) << std::endl;
+			}
+		}
+
+		static double mean( const ml::fetch_stats_node &node )
+		{
+			return node.stats.calls ? double( node.stats.elapsed ) / node.stats.calls : 0.0;
+		}
+
+		static std::string uri( const ml::fetch_stats_node &node )
+		{
+			return cl::str_util::to_string( node.input->get_uri( ) );
+		}
+
+		std::string file_;
+		boost::int64_t interval_;
+		boost::int64_t start_;
+		boost::int64_t interval_start_;
+		std::vector< boost::int64_t > latencies_;
+		std::vector< boost::int64_t > interval_latencies_;
+		std::vector< interval_type > intervals_;
+		ml::fetch_stats_list nodes_;
+		std::vector< std::pair< std::string, std::string > > summary_;
+		ml::allocation_stats_type allocations_;
+		ml::audio::pool_stats_type audio_pool_;
+		boost::int64_t cache_hits_;
+		boost::int64_t cache_misses_;
+};
+
+void run( ml::input_type_ptr input, bool interactive, bool stats, perf_report *report )
 {
 	boost::system_time last_time = boost::get_system_time( );
 	int frame_count = 0;
@@ -360,6 +657,9 @@ void run( ml::input_type_ptr input, bool interactive, bool stats )
 
 	term_init( );
 
+	if ( report )
+		report->start( input );
+
 	for ( int i = 0; running && sigterm_count == 0 && i < total_frames; )
 	{
 		boost::system_time curr_time = boost::get_system_time( );
@@ -383,7 +683,10 @@ void run( ml::input_type_ptr input, bool interactive, bool stats )
 			std::cerr << i << "/" << total_frames << " fps: " << last_fps << clear_to_eol;
 
 		input->seek( i );
+		boost::int64_t fetch_start = report ? ml::fetch_stats_clock( ) : 0;
 		ml::frame_type_ptr frame = input->fetch( );
+		if ( report )
+			report->frame( ml::fetch_stats_clock( ) - fetch_start );
 
 		if ( !( frame && !frame->in_error( ) && ( frame->has_image( ) || frame->has_audio( ) || frame->get_stream( ) || frame->audio_block( ) ) ) )
 			break;
@@ -450,7 +753,7 @@ void run( ml::input_type_ptr input, bool interactive, bool stats )
 	term_exit( );
 }
 
-void play( ml::filter_type_ptr input, std::vector< ml::store_type_ptr > &store, bool interactive, int speed, bool stats, bool show_source_tc )
+void play( ml::filter_type_ptr input, std::vector< ml::store_type_ptr > &store, bool interactive, int speed, bool stats, bool show_source_tc, perf_report *report )
 {
 	bool error = false;
 	std::vector< ml::store_type_ptr >::iterator iter;
@@ -482,6 +785,9 @@ void play( ml::filter_type_ptr input, std::vector< ml::store_type_ptr > &store,
 
 	term_init( );
 
+	if ( report )
+		report->start( input );
+
 	while( !error && sigterm_count == 0 )
 	{
 
@@ -537,7 +843,12 @@ void play( ml::filter_type_ptr input, std::vector< ml::store_type_ptr > &store,
 		frame_count += 1;
 
 		if ( !frame || frame->get_position( ) != input->get_position( ) )
+		{
+			boost::int64_t fetch_start = report ? ml::fetch_stats_clock( ) : 0;
 			frame = input->fetch( );
+			if ( report )
+				report->frame( ml::fetch_stats_clock( ) - fetch_start );
+		}
 
 		if( !frame ) break;
 
@@ -706,6 +1017,9 @@ int real_main( int argc, const char *argv[ ] )
 	int seek_to = 0;
 	bool stats = true;
 	bool show_source_tc = false;
+	std::string report_file;
+	double report_interval = 0.0;
+	std::string trace_file;
 
 	int index = 1;
 
@@ -724,6 +1038,18 @@ int real_main( int argc, const char *argv[ ] )
 		{
 			show_source_tc = true;
 		}
+		else if ( arg.find( L"--perf-report=" ) == 0 )
+		{
+			report_file = cl::str_util::to_string( arg.substr( 14 ) );
+		}
+		else if ( arg.find( L"--perf-interval=" ) == 0 )
+		{
+			report_interval = atof( cl::str_util::to_string( arg.substr( 16 ) ).c_str( ) );
+		}
+		else if ( arg.find( L"--perf-trace=" ) == 0 )
+		{
+			trace_file = cl::str_util::to_string( arg.substr( 13 ) );
+		}
 		else if ( arg == L"--no-stats" )
 			stats = false;
 		else if ( arg == L"--interactive" )
@@ -741,6 +1067,11 @@ int real_main( int argc, const char *argv[ ] )
 	// Execute the tokens
 	execute = tokens;
 
+	boost::scoped_ptr< perf_report > report( report_file != "" ? new perf_report( report_file, report_interval ) : 0 );
+
+	if ( trace_file != "" )
+		ml::enable_fetch_trace( true );
+
 	if ( result.value< std::wstring >( ) != L"OK" )
 	{
 		std::cerr << cl::str_util::to_string( result.value< std::wstring >( ) ) << std::endl;
@@ -767,7 +1098,12 @@ int real_main( int argc, const char *argv[ ] )
 	// Allow us to just iterate through the graph if the last filter says so
 	if ( input->fetch_slot( ) && input->fetch_slot( )->property( "@loop" ).valid( ) )
 	{
-		run( input, interactive, stats );
+		run( input, interactive, stats, report.get( ) );
+
+		if ( report && !report->write( input ) )
+			return 5;
+		if ( trace_file != "" && !ml::write_fetch_trace( trace_file ) )
+			return 5;
 	}
 	else
 	{
@@ -828,7 +1164,12 @@ int real_main( int argc, const char *argv[ ] )
 				std::cerr << "One or more stores must be specified after the \"--\" token" << std::endl;
 				return 3;
 			}
-			play( pitch, stores, interactive, should_seek ? 0 : 1, stats, show_source_tc );
+			play( pitch, stores, interactive, should_seek ? 0 : 1, stats, show_source_tc, report.get( ) );
+
+			if ( report && !report->write( pitch ) )
+				return 5;
+			if ( trace_file != "" && !ml::write_fetch_trace( trace_file ) )
+				return 5;
 		}
 	}
 	return 0;
@@ -838,7 +1179,7 @@ int AMLBATCH_MAIN( int argc, const char *argv[ ] )
 {
 	if ( argc <= 1 )
 	{
-		std::cerr << "Usage: amlbatch <graph> [ -- ( <store> )* ]" << std::endl;
+		std::cerr << "Usage: amlbatch [ --perf-report=<file> [ --perf-interval=<seconds> ] ] [ --perf-trace=<file> ] <graph> [ -- ( <store> )* ]" << std::endl;
 		return 0;
 	}
 
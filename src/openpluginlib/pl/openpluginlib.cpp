@@ -86,7 +86,7 @@ namespace
 			{
 				olib::t_stringstream ss;
 				log_msg.pretty_print_one_line( ss, cl::print::output_default );
-				std::cerr << cl::str_util::to_string( cl::log_utilities::get_log_prefix_string( log_msg.level( ), formatted_stream_, cl::logoutput::output_default ) ) << " " << cl::str_util::to_string( ss.str( ) ) << std::endl;
+				std::cerr << cl::str_util::to_string( cl::log_utilities::get_log_prefix_string( log_msg.level( ), formatted_stream_, cl::logoutput::output_default, log_msg.time( ), log_msg.thread_id( ) ) ) << " " << cl::str_util::to_string( ss.str( ) ) << std::endl;
 			}
 		private:
 			t_stringstream formatted_stream_;
@@ -203,6 +203,9 @@ namespace
 			if( !lookup_path.empty( ) )
 				el_reg.insert_custom( lookup_path );
 
+			// The registry may have changed, so the plugin indexes must be rebuilt
+			detail::clear_resolved_plugins( );
+
 			// Ugh - must find a better way to handle path info (do we really need platform specific here at all?)
 #ifdef WIN32
 			profile_base += "/../profiles/";
@@ -222,6 +225,7 @@ namespace
 			else
 				el_reg.clear( );
 
+			detail::release_resolved_plugins( );
 			detail::unload_shared_library( );
 		}
 	}
@@ -233,37 +237,6 @@ namespace detail
 {
 	namespace
 	{
-		class is_match : public std::unary_function<boost::wregex, bool>
-		{
-		public:
-			explicit is_match( const std::wstring& to_match )
-				: to_match_( to_match )
-			{ }
-
-			bool operator( )( const boost::wregex& expr )
-			{
-				if( boost::regex_match( to_match_.c_str( ), expr ) )
-					return true;
-
-				return false;
-			}
-
-		private:
-			is_match& operator=( const is_match& );
-
-		private:
-			const std::wstring& to_match_;
-		};
-
-		bool if_matches_expression( const std::wstring& to_match, const std::vector<boost::wregex>& expression )
-		{
-			typedef std::vector<boost::wregex>::const_iterator const_iterator;
-
-			const_iterator I = std::find_if( expression.begin( ), expression.end( ), is_match( to_match ) );
-
-			return I != expression.end( );
-		}
-
 		void null_delete( void* )
 		{ }
 	}
@@ -287,53 +260,11 @@ namespace detail
 		return opl_ptr( static_cast<openplugin*>( 0 ), null_delete );
 	}
 
-	discover_query_impl::container find_plugins( const std::wstring& libname, 
-												 const std::wstring& type, 
-												 const std::wstring& to_match, 
-												 const detail::registry::container& el_reg_db )
-	{
-		typedef detail::registry::container						db_container;
-		typedef db_container::const_iterator					db_const_iterator;
-		typedef db_container::iterator							db_iterator;
-		typedef std::pair<db_const_iterator, db_const_iterator>	query_iterator_pair;
-
-		discover_query_impl::container plugins;
-
-		query_iterator_pair pair;
-		if( libname.empty( ) )
-		{
-			pair.first  = el_reg_db.begin( );
-			pair.second = el_reg_db.end( );
-		}
-		else
-		{
-			pair = el_reg_db.equal_range( libname );
-		}
-
-		while( pair.first != pair.second )
-		{
-			const std::wstring& item_type							= ( *pair.first ).second.type;
-			const std::vector<boost::wregex>& item_extension	= ( *pair.first ).second.extension;
-
-			if( ( type.empty( ) || type == item_type ) && ( to_match.empty( ) || if_matches_expression( to_match, item_extension ) ) ) 
-				plugins.push_back( ( *pair.first ).second );
-
-			++pair.first;
-		}
-
-		return plugins;
-	}
-	
 	bool discover_query_impl::operator( )( const std::wstring& libname, const std::wstring& type, const std::wstring& to_match )
 	{
-		// Custom db first
-		container plugins = find_plugins( libname, type, to_match, detail::registry::instance( ).get_custom_db( ) );
-
-		if ( plugins.empty() ) 
-		{
-			// try the std db
-			plugins = find_plugins( libname, type, to_match, detail::registry::instance( ).get_std_db( ) );
-		}
+		// Custom db first, then the std db
+		container plugins;
+		find_indexed_plugins( libname, type, to_match, plugins );
 
 		if ( !plugins.empty() )
 			std::copy( plugins.begin(), plugins.end(), std::inserter( plugins_, plugins_.end() ) );
@@ -115,8 +115,21 @@ namespace detail
 	private:
 		container plugins_;
 	};
+
+	// Collect the plugins matching the query from the indexed registry (custom plugins first, registry order)
+	void find_indexed_plugins( const std::wstring& libname, const std::wstring& type, const std::wstring& to_match, discover_query_impl::container &plugins );
 }
 
+// Obtain the highest merit plugin matching the query (as the first plugin of a merit sorted discovery
+// would be) - the plugin is created once and shared by all callers, so it must be stateless. Repeated 
+// lookups of resources which resolve in the same way don't take any locks.
+OPENPLUGINLIB_DECLSPEC opl_ptr resolve_plugin( const std::wstring& libname, const std::wstring& type, const std::wstring& to_match );
+
+// Find the plugins under lookup_path without registering them and return the number found - the
+// registry snapshot is used (and refreshed if stale) unless use_snapshot is false. Of most use for
+// measuring start up.
+OPENPLUGINLIB_DECLSPEC int scan_plugins( const std::string& lookup_path, bool use_snapshot = true );
+
 template<class query = default_query_traits>
 class discovery
 {
@@ -5,75 +5,169 @@
 // Released under the LGPL.
 // For more information, see http://www.openlibraries.org.
 
+#include <algorithm>
 #include <iostream>
-#include <string>
-#include <map>
+#include <stdexcept>
+#include <string.h>
 
 #include <boost/functional/hash.hpp>
-#include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <opencorelib/cl/spsc_queue.hpp>
 
 #include <openpluginlib/pl/pcos/key.hpp>
 
 namespace olib { namespace openpluginlib { namespace pcos {
 
-typedef std::map< std::string, std::size_t > string_key_map;
-typedef std::map< std::size_t, std::string > key_string_map;
+// Keys are interned - each distinct string is copied once into a global table
+// and given the next id, so comparisons are integer compares and as_string is
+// an array look up.
+//
+// Both tables are only ever appended to while holding the mutex, and entries
+// are published with release stores, so readers never lock. from_string of a
+// known key hashes the string and probes the table without allocating. When
+// the hash table grows, the old one is left in place for any readers which are
+// still probing it (the key tables live for the whole process anyway).
+//
+// All the state is zero initialised, since keys are created during the static
+// initialisation of other modules.
+
+namespace {
+
+namespace detail = olib::opencorelib::detail;
+
+struct entry
+{
+	std::size_t hash;
+	std::size_t id;
+	const char *name;
+};
+
+struct table
+{
+	std::size_t mask;
+	entry **slots;
+};
 
-static boost::recursive_mutex mutex_;
+// The names are held in chunks of 1 << chunk_bits, found via a fixed directory
+const std::size_t chunk_bits = 12;
+const std::size_t chunk_size = std::size_t( 1 ) << chunk_bits;
+const std::size_t max_chunks = 4096;
 
-typedef boost::recursive_mutex::scoped_lock scoped_lock;
+table *table_ = 0;
+const char **chunks_[ max_chunks ] = { 0 };
+std::size_t count_ = 0;
 
-static key_string_map& keyStringMap()
+boost::mutex &table_mutex( )
 {
-    static key_string_map static_keyStringMap;
-    return static_keyStringMap;
+	static boost::mutex mutex;
+	return mutex;
 }
 
-static string_key_map& stringKeyMap()
+inline std::size_t hash_of( const char *name, std::size_t length )
 {
-    static string_key_map static_stringKeyMap;
-    return static_stringKeyMap;
+	return boost::hash_range( name, name + length );
 }
 
-key key::from_string( const char* keyAsString )
+bool find( const table *current, const char *name, std::size_t hash, std::size_t &id )
 {
-	scoped_lock lock( mutex_ );
+	if ( current == 0 )
+		return false;
+
+	for ( std::size_t i = hash & current->mask; ; i = ( i + 1 ) & current->mask )
+	{
+		const entry *item = detail::load_acquire( current->slots[ i ] );
+		if ( item == 0 )
+			return false;
+		if ( item->hash == hash && strcmp( item->name, name ) == 0 )
+		{
+			id = item->id;
+			return true;
+		}
+	}
+}
 
-    if ( stringKeyMap().find( keyAsString ) == stringKeyMap().end( ) )
-    {
-        boost::hash< std::string > hashFn;
-        std::size_t h = hashFn( keyAsString );
+// Add the item to a table which has room for it
+void place( table *current, entry *item )
+{
+	std::size_t i = item->hash & current->mask;
+	while ( current->slots[ i ] != 0 )
+		i = ( i + 1 ) & current->mask;
+	detail::store_release( current->slots[ i ], item );
+}
+
+// Replace the table with one of twice the size (the load is kept under a half)
+table *grow( table *current )
+{
+	const std::size_t size = current == 0 ? 1024 : ( current->mask + 1 ) * 2;
 
-        stringKeyMap()[ keyAsString ] = h;
-        keyStringMap()[ h ] = keyAsString;
-    }
+	table *result = new table;
+	result->mask = size - 1;
+	result->slots = new entry *[ size ];
+	std::fill( result->slots, result->slots + size, static_cast< entry * >( 0 ) );
 
-    return key( stringKeyMap()[ keyAsString ] );
+	if ( current != 0 )
+		for ( std::size_t i = 0; i <= current->mask; i ++ )
+			if ( current->slots[ i ] != 0 )
+				place( result, current->slots[ i ] );
+
+	detail::store_release( table_, result );
+	return result;
 }
 
-const char* key::as_string() const
+// Must be called with the mutex held and only when the name isn't in the table
+std::size_t insert( const char *name, std::size_t length, std::size_t hash )
 {
-	scoped_lock lock( mutex_ );
-    return keyStringMap()[ id_ ].c_str();
+	if ( count_ >= chunk_size * max_chunks )
+		throw std::length_error( "pcos::key table is full" );
+
+	table *current = table_;
+	if ( current == 0 || ( count_ + 1 ) * 2 > current->mask + 1 )
+		current = grow( current );
+
+	char *copy = new char[ length + 1 ];
+	memcpy( copy, name, length + 1 );
+
+	const char **chunk = chunks_[ count_ >> chunk_bits ];
+	if ( chunk == 0 )
+	{
+		chunk = new const char *[ chunk_size ];
+		std::fill( chunk, chunk + chunk_size, static_cast< const char * >( 0 ) );
+		detail::store_release( chunks_[ count_ >> chunk_bits ], chunk );
+	}
+	detail::store_release( chunk[ count_ & ( chunk_size - 1 ) ], static_cast< const char * >( copy ) );
+
+	entry *item = new entry;
+	item->hash = hash;
+	item->id = count_;
+	item->name = copy;
+	place( current, item );
+
+	return count_ ++;
 }
 
-key::key( std::size_t id )
-    : id_( id )
-{}
-    
-bool key::operator<( const key& k ) const
-{
-    return id_ < k.id_;
 }
 
-bool key::operator==( const key& k ) const
+key key::from_string( const char* keyAsString )
 {
-    return id_ == k.id_;
+	const std::size_t length = strlen( keyAsString );
+	const std::size_t hash = hash_of( keyAsString, length );
+	std::size_t id;
+
+	if ( !find( detail::load_acquire( table_ ), keyAsString, hash, id ) )
+	{
+		boost::mutex::scoped_lock lock( table_mutex( ) );
+		if ( !find( table_, keyAsString, hash, id ) )
+			id = insert( keyAsString, length, hash );
+	}
+
+	return key( id );
 }
 
-bool key::operator!=( const key& k ) const
+const char* key::as_string() const
 {
-    return id_ != k.id_;
+	const char **chunk = detail::load_acquire( chunks_[ id_ >> chunk_bits ] );
+	return detail::load_acquire( chunk[ id_ & ( chunk_size - 1 ) ] );
 }
 
 std::ostream& operator<<( std::ostream& os, const key& k )
@@ -83,4 +177,3 @@ std::ostream& operator<<( std::ostream& os, const key& k )
 }
 
 } } }
-
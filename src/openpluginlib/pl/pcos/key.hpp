@@ -17,7 +17,10 @@
 namespace olib { namespace openpluginlib { namespace pcos {
 
 /// A lightweight, comparable key to be used for 
-/// properties
+/// properties - the strings are interned, so each distinct
+/// string has a single id (allocated in order of first use
+/// and stable for the life of the process) and keys compare
+/// as integers
 class OPENPLUGINLIB_DECLSPEC key
 {
 public:
@@ -25,14 +28,14 @@ public:
     const char* as_string() const;
 	const std::size_t id( ) const { return id_; }
     
-    bool operator<( const key& ) const;
-    bool operator==( const key& ) const;
-    bool operator!=( const key& ) const;
+    bool operator<( const key& k ) const { return id_ < k.id_; }
+    bool operator==( const key& k ) const { return id_ == k.id_; }
+    bool operator!=( const key& k ) const { return id_ != k.id_; }
 
     OPENPLUGINLIB_DECLSPEC friend std::ostream& operator<<( std::ostream&, const key& );
 
 private:
-    key( std::size_t );
+    explicit key( std::size_t id ) : id_( id ) { }
     
     std::size_t id_;
 };
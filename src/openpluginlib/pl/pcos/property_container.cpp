@@ -12,7 +12,7 @@
 #include <openpluginlib/pl/pcos/subject.hpp>
 
 // std
-#include <map>
+#include <vector>
 #include <algorithm>
 #include <iterator>
 #include <memory>
@@ -41,6 +41,19 @@ private:
 class property_container::property_container_impl
 {
 public:
+    // The properties are held in a vector sorted by key id, so a look up is a
+    // binary search of integers over contiguous memory (they're held by pointer
+    // since assigning a property notifies its observers)
+    typedef std::vector< std::pair< key, boost::shared_ptr< property > > > property_map;
+
+    struct key_order
+    {
+	bool operator()( const property_map::value_type& entry, const key& k ) const
+	{
+	    return entry.first < k;
+	}
+    };
+
     property_container_impl( property_container* )
         : propertyObserver( new forwarding_observer( &subject_ ) )
     {}
@@ -51,13 +64,19 @@ public:
 		//callback will be invalid after this container has been destroyed
 		for( property_map::iterator I = propertyMap.begin(); I != propertyMap.end(); ++I )
 		{
-			I->second.detach( propertyObserver );
+			I->second->detach( propertyObserver );
 		}
 	}
 
+	property_map::iterator find( const key& k )
+	{
+		property_map::iterator I = std::lower_bound( propertyMap.begin(), propertyMap.end(), k, key_order() );
+		return I != propertyMap.end() && I->first == k ? I : propertyMap.end();
+	}
+
     void append( property p )
     {
-		property_map::iterator iter = propertyMap.find( p.get_key() );
+		property_map::iterator iter = find( p.get_key() );
 		if( iter != propertyMap.end() )
 		{
 			//If there was a previous property with the same key, we must
@@ -65,20 +84,21 @@ public:
 			//because the property might live longer than this container, and
 			//could attempt to update or propertyObserver after we've been
 			//destroyed, which will cause a crash.
-			remove( iter->second );
+			remove( *iter->second );
 		}
 
-		propertyMap.insert( std::make_pair( p.get_key(), p ) );
+		const key k = p.get_key();
+		propertyMap.insert( std::lower_bound( propertyMap.begin(), propertyMap.end(), k, key_order() ), std::make_pair( k, boost::shared_ptr< property >( new property( p ) ) ) );
         p.attach( propertyObserver );
     }
 
     void remove( property p )
     {
-	property_map::iterator I = propertyMap.find( p.get_key() );
+	property_map::iterator I = find( p.get_key() );
 
         if ( I != propertyMap.end() )
         {
-            propertyMap.erase( p.get_key() );
+            propertyMap.erase( I );
             p.detach( propertyObserver );
         }
     }
@@ -93,7 +113,7 @@ public:
 	
 	void operator()( const typename T::value_type& mi )
 	{
-	    std::auto_ptr< property > clone( mi.second.clone() );
+	    std::auto_ptr< property > clone( mi.second->clone() );
 	    impl_->append( *clone.get() );
 	}
     };
@@ -102,12 +122,12 @@ public:
     property_container_impl* clone( property_container* pc ) const
     {
 	property_container_impl* result = new property_container_impl( pc );
+	result->propertyMap.reserve( propertyMap.size() );
 	std::for_each( propertyMap.begin(), propertyMap.end(), CloneProperty< property_map >( result ) );
 
 	return result;
     }
 
-    typedef std::map< key, property > property_map;
     property_map propertyMap;
     subject subject_;
 
@@ -166,12 +186,13 @@ property property_container::get_property_with_string( const char* k ) const
     
 property property_container::get_property_with_key( const key& k ) const
 {
-    if ( !impl_->propertyMap.count( k ) )
+    property_container_impl::property_map::iterator I = impl_->find( k );
+    if ( I == impl_->propertyMap.end() )
     {
         return property::NULL_PROPERTY;
     }
 
-    return impl_->propertyMap.find( k )->second;
+    return *I->second;
 }
 
 template < typename T, typename U > T returnFirst( const std::pair< T, U >& p )
@@ -182,8 +203,9 @@ template < typename T, typename U > T returnFirst( const std::pair< T, U >& p )
 key_vector property_container::get_keys() const
 {
     key_vector result;
+    result.reserve( impl_->propertyMap.size() );
     std::back_insert_iterator< key_vector > bii( result );
-    std::transform( impl_->propertyMap.begin(), impl_->propertyMap.end(), bii, returnFirst< key, property > );
+    std::transform( impl_->propertyMap.begin(), impl_->propertyMap.end(), bii, returnFirst< key, boost::shared_ptr< property > > );
 
     return result;
 }
@@ -0,0 +1,350 @@
+// openpluginlib - A plugin interface to openlibraries.
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+// Indexed plugin lookup and resolution cache.
+//
+// The extension expressions of a plugin are almost always one of three forms -
+// a literal name ("chroma", "colour:"), a scheme ("avformat:.*") or a file
+// extension (".*\.mxf"). These are compiled into maps when the index for a
+// libname and type is first requested, and only the remaining expressions are
+// matched with boost::regex.
+//
+// Since the maps determine the plugins which can match a resource, the map
+// entries hit (together with the results of the remaining expressions) form a
+// key which identifies the resolution - resources with the same key always
+// resolve to the same plugin. resolve_plugin caches the created plugin by that
+// key in an immutable snapshot which is published with release semantics, so
+// a lookup which has been seen before takes no locks. A miss copies the
+// snapshot, adds the entry and publishes the new one. Replaced snapshots are
+// retained until the plugins are cleared, since readers may still use them.
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/recursive_mutex.hpp>
+
+#include <opencorelib/cl/spsc_queue.hpp>
+
+#include <openpluginlib/pl/openpluginlib.hpp>
+#include <openpluginlib/pl/registry.hpp>
+
+namespace cl = olib::opencorelib;
+
+namespace olib { namespace openpluginlib {
+
+namespace
+{
+	// Characters which make an extension expression more than a literal string
+	const wchar_t *meta_characters = L".[]{}()\\*+?|^$";
+
+	bool is_literal( const std::wstring &value )
+	{
+		if ( value.empty( ) || value.find_first_of( meta_characters ) != std::wstring::npos )
+			return false;
+		for ( std::wstring::const_iterator i = value.begin( ); i != value.end( ); ++i )
+			if ( *i > 127 )
+				return false;
+		return true;
+	}
+
+	// The expressions are compiled case insensitively - only ascii is mapped here,
+	// since only ascii expressions are placed in the maps
+	std::wstring lower( const std::wstring &value )
+	{
+		std::wstring result( value );
+		for ( std::wstring::iterator i = result.begin( ); i != result.end( ); ++i )
+			if ( *i >= L'A' && *i <= L'Z' )
+				*i = *i - L'A' + L'a';
+		return result;
+	}
+
+	bool ends_with( const std::wstring &value, const std::wstring &tail )
+	{
+		return value.size( ) > tail.size( ) && value.compare( value.size( ) - tail.size( ), tail.size( ), tail ) == 0;
+	}
+
+	bool starts_with( const std::wstring &value, const std::wstring &head )
+	{
+		return value.size( ) > head.size( ) && value.compare( 0, head.size( ), head ) == 0;
+	}
+
+	typedef std::vector< size_t > positions;
+	typedef std::map< std::wstring, positions > position_map;
+
+	void add( position_map &map, const std::wstring &value, size_t position )
+	{
+		positions &list = map[ lower( value ) ];
+		if ( list.empty( ) || list.back( ) != position )
+			list.push_back( position );
+	}
+
+	const positions *lookup( const position_map &map, const std::wstring &value )
+	{
+		position_map::const_iterator i = map.find( value );
+		return i == map.end( ) ? 0 : &i->second;
+	}
+
+	// The plugins of one db which match a libname and type
+	class db_index
+	{
+		public:
+			db_index( const std::wstring &libname, const std::wstring &type, const detail::registry::container &db )
+			{
+				typedef detail::registry::container::const_iterator const_iterator;
+				std::pair< const_iterator, const_iterator > range( db.begin( ), db.end( ) );
+				if ( !libname.empty( ) )
+					range = db.equal_range( libname );
+
+				for ( ; range.first != range.second; ++range.first )
+				{
+					const detail::plugin_item &item = range.first->second;
+					if ( !type.empty( ) && type != item.type )
+						continue;
+
+					const size_t position = items_.size( );
+					items_.push_back( item );
+
+					for ( std::vector< boost::wregex >::const_iterator i = item.extension.begin( ); i != item.extension.end( ); ++i )
+					{
+						const std::wstring expr = i->str( );
+						const std::wstring any_extension = L".*\\.";
+						const std::wstring any_tail = L":.*";
+
+						if ( is_literal( expr ) )
+							add( literals_, expr, position );
+						else if ( starts_with( expr, any_extension ) && is_literal( expr.substr( any_extension.size( ) ) ) )
+							add( extensions_, expr.substr( any_extension.size( ) ), position );
+						else if ( ends_with( expr, any_tail ) && is_literal( expr.substr( 0, expr.size( ) - any_tail.size( ) ) ) && expr.find( L':' ) == expr.size( ) - any_tail.size( ) )
+							add( schemes_, expr.substr( 0, expr.size( ) - any_tail.size( ) ), position );
+						else
+							generics_.push_back( std::make_pair( *i, position ) );
+					}
+				}
+			}
+
+			// Append the resolution key of the resource and collect the positions of the matching plugins
+			void match( const std::wstring &resource, const std::wstring &lowered, std::wstring &key, positions &result ) const
+			{
+				if ( resource.empty( ) )
+				{
+					for ( size_t i = 0; i < items_.size( ); i ++ )
+						result.push_back( i );
+					key += L"*|";
+					return;
+				}
+
+				const positions *found = lookup( literals_, lowered );
+				if ( found )
+				{
+					result.insert( result.end( ), found->begin( ), found->end( ) );
+					key += lowered;
+				}
+				key += L'|';
+
+				const std::wstring::size_type colon = lowered.find( L':' );
+				found = colon != std::wstring::npos ? lookup( schemes_, lowered.substr( 0, colon ) ) : 0;
+				if ( found )
+				{
+					result.insert( result.end( ), found->begin( ), found->end( ) );
+					key += lowered.substr( 0, colon );
+				}
+				key += L'|';
+
+				const std::wstring::size_type dot = lowered.rfind( L'.' );
+				found = dot != std::wstring::npos ? lookup( extensions_, lowered.substr( dot + 1 ) ) : 0;
+				if ( found )
+				{
+					result.insert( result.end( ), found->begin( ), found->end( ) );
+					key += lowered.substr( dot + 1 );
+				}
+				key += L'|';
+
+				for ( std::vector< std::pair< boost::wregex, size_t > >::const_iterator i = generics_.begin( ); i != generics_.end( ); ++i )
+				{
+					const bool matched = boost::regex_match( resource.c_str( ), i->first );
+					if ( matched )
+						result.push_back( i->second );
+					key += matched ? L'1' : L'0';
+				}
+				key += L'|';
+
+				// Registry order, each plugin once
+				std::sort( result.begin( ), result.end( ) );
+				result.erase( std::unique( result.begin( ), result.end( ) ), result.end( ) );
+			}
+
+			const detail::plugin_item &item( size_t position ) const
+			{ return items_[ position ]; }
+
+		private:
+			std::vector< detail::plugin_item > items_;
+			position_map literals_;
+			position_map schemes_;
+			position_map extensions_;
+			std::vector< std::pair< boost::wregex, size_t > > generics_;
+	};
+
+	// Custom plugins are searched before the standard ones
+	struct lookup_index
+	{
+		lookup_index( const std::wstring &libname, const std::wstring &type )
+			: custom( libname, type, detail::registry::instance( ).get_custom_db( ) )
+			, standard( libname, type, detail::registry::instance( ).get_std_db( ) )
+		{ }
+
+		// Collects the matching plugins in the order discovery reports them (prior to the merit sort)
+		std::wstring match( const std::wstring &resource, std::vector< const detail::plugin_item * > &result ) const
+		{
+			const std::wstring lowered = lower( resource );
+			std::wstring key;
+			positions found;
+
+			custom.match( resource, lowered, key, found );
+			for ( positions::const_iterator i = found.begin( ); i != found.end( ); ++i )
+				result.push_back( &custom.item( *i ) );
+
+			// The key must include the standard part even when the custom db matches
+			found.clear( );
+			standard.match( resource, lowered, key, found );
+			if ( result.empty( ) )
+				for ( positions::const_iterator i = found.begin( ); i != found.end( ); ++i )
+					result.push_back( &standard.item( *i ) );
+
+			return key;
+		}
+
+		db_index custom;
+		db_index standard;
+	};
+
+	typedef boost::shared_ptr< const lookup_index > lookup_index_ptr;
+
+	struct snapshot
+	{
+		std::map< std::wstring, lookup_index_ptr > indexes;
+		std::map< std::wstring, opl_ptr > resolved;
+	};
+
+	boost::recursive_mutex mutex_;
+	snapshot *volatile current_ = 0;
+	std::vector< snapshot * > retired_;
+
+	std::wstring index_name( const std::wstring &libname, const std::wstring &type )
+	{
+		return libname + L'\n' + type;
+	}
+
+	// Obtain the index for libname and type, publishing a new snapshot if it doesn't exist yet - mutex must be held
+	lookup_index_ptr index_for( const std::wstring &libname, const std::wstring &type, snapshot *&snap )
+	{
+		const std::wstring name = index_name( libname, type );
+
+		if ( snap )
+		{
+			std::map< std::wstring, lookup_index_ptr >::const_iterator i = snap->indexes.find( name );
+			if ( i != snap->indexes.end( ) )
+				return i->second;
+		}
+
+		lookup_index_ptr index( new lookup_index( libname, type ) );
+		snapshot *next = snap ? new snapshot( *snap ) : new snapshot( );
+		next->indexes[ name ] = index;
+
+		if ( snap )
+			retired_.push_back( snap );
+		cl::detail::store_release( current_, next );
+		snap = next;
+
+		return index;
+	}
+
+	const detail::plugin_item *highest_merit( const std::vector< const detail::plugin_item * > &plugins )
+	{
+		const detail::plugin_item *result = 0;
+		for ( std::vector< const detail::plugin_item * >::const_iterator i = plugins.begin( ); i != plugins.end( ); ++i )
+			if ( !result || ( *i )->merit > result->merit )
+				result = *i;
+		return result;
+	}
+}
+
+namespace detail
+{
+	void find_indexed_plugins( const std::wstring& libname, const std::wstring& type, const std::wstring& to_match, discover_query_impl::container &plugins )
+	{
+		boost::recursive_mutex::scoped_lock lock( mutex_ );
+		snapshot *snap = cl::detail::load_acquire( current_ );
+		lookup_index_ptr index = index_for( libname, type, snap );
+
+		std::vector< const plugin_item * > found;
+		index->match( to_match, found );
+		for ( std::vector< const plugin_item * >::const_iterator i = found.begin( ); i != found.end( ); ++i )
+			plugins.push_back( discover_query_impl::plugin_proxy( **i ) );
+	}
+
+	void clear_resolved_plugins( )
+	{
+		boost::recursive_mutex::scoped_lock lock( mutex_ );
+		snapshot *snap = cl::detail::load_acquire( current_ );
+		if ( snap )
+			retired_.push_back( snap );
+		cl::detail::store_release( current_, static_cast< snapshot * >( 0 ) );
+	}
+
+	void release_resolved_plugins( )
+	{
+		boost::recursive_mutex::scoped_lock lock( mutex_ );
+		clear_resolved_plugins( );
+		for ( std::vector< snapshot * >::iterator i = retired_.begin( ); i != retired_.end( ); ++i )
+			delete *i;
+		retired_.clear( );
+	}
+}
+
+opl_ptr resolve_plugin( const std::wstring &libname, const std::wstring &type, const std::wstring &to_match )
+{
+	// Lock free path - the index exists and the resolution has been seen before
+	snapshot *snap = cl::detail::load_acquire( current_ );
+	if ( snap )
+	{
+		std::map< std::wstring, lookup_index_ptr >::const_iterator index = snap->indexes.find( index_name( libname, type ) );
+		if ( index != snap->indexes.end( ) )
+		{
+			std::vector< const detail::plugin_item * > found;
+			const std::wstring key = index_name( libname, type ) + L'\n' + index->second->match( to_match, found );
+			std::map< std::wstring, opl_ptr >::const_iterator i = snap->resolved.find( key );
+			if ( i != snap->resolved.end( ) )
+				return i->second;
+		}
+	}
+
+	boost::recursive_mutex::scoped_lock lock( mutex_ );
+	snap = cl::detail::load_acquire( current_ );
+	lookup_index_ptr index = index_for( libname, type, snap );
+
+	std::vector< const detail::plugin_item * > found;
+	const std::wstring key = index_name( libname, type ) + L'\n' + index->match( to_match, found );
+
+	std::map< std::wstring, opl_ptr >::const_iterator i = snap->resolved.find( key );
+	if ( i != snap->resolved.end( ) )
+		return i->second;
+
+	opl_ptr result;
+	const detail::plugin_item *item = highest_merit( found );
+	if ( item )
+		result = detail::discover_query_impl::plugin_proxy( *item ).create_plugin( "" );
+
+	// Publish a snapshot which includes the new resolution
+	snapshot *next = new snapshot( *snap );
+	next->resolved[ key ] = result;
+	retired_.push_back( snap );
+	cl::detail::store_release( current_, next );
+
+	return result;
+}
+
+} }
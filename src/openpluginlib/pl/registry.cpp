@@ -23,11 +23,15 @@
 #include <boost/regex.hpp>
 #include <boost/tokenizer.hpp>
 
+#include <cstdlib>
+
 #ifdef HAVE_OFX
 #include <OfxCore.h>
 #endif
 
 #include <openpluginlib/pl/registry.hpp>
+#include <openpluginlib/pl/registry_snapshot.hpp>
+#include <openpluginlib/pl/openpluginlib.hpp>
 #include <openpluginlib/pl/opl_importer.hpp>
 #include <opencorelib/cl/core.hpp>
 #include <opencorelib/cl/str_util.hpp>
@@ -39,15 +43,16 @@ namespace olib { namespace openpluginlib { namespace detail {
 
 namespace
 {
-	// Insert all the opl plugins found in lookup_path into the specified db
-	bool insert( const std::string& lookup_path, detail::registry::container& db, detail::registry::list &auto_load )
+	bool snapshot_enabled( )
 	{
-		namespace fs = boost::filesystem;
-
-		typedef detail::registry::container db_container;
+		static const bool enabled = getenv( "AML_PLUGIN_SNAPSHOT" ) == 0 || std::string( getenv( "AML_PLUGIN_SNAPSHOT" ) ) != "0";
+		return enabled;
+	}
 
-		if( lookup_path.empty( ) )
-			return false;
+	// Collect the .opl files found in lookup_path in directory order
+	opl_stamps find_opl_files( const std::string& lookup_path )
+	{
+		opl_stamps stamps;
 
 		boost::regex opl_ex( ".*\\.opl", boost::regex::extended | boost::regex::icase );
 
@@ -73,17 +78,67 @@ namespace
 				// OLIBs native plugins.
 				if( boost::regex_match( dir_iter->path( ).string( ), opl_ex ) )
 				{
-					opl_importer importer;
-					importer( dir_iter->path( ) );
-				
-					std::copy( importer.plugins.begin( ), importer.plugins.end( ), std::inserter( db, db.begin( ) ) );
-
-					if ( importer.auto_load )
-						auto_load.push_back( importer.plugins.begin( )->second );
+					boost::system::error_code error;
+					opl_stamp stamp;
+					stamp.path = cl::str_util::to_wstring( dir_iter->path( ).native( ) );
+					stamp.modified = boost::int64_t( fs::last_write_time( dir_iter->path( ), error ) );
+					stamp.size = boost::int64_t( fs::file_size( dir_iter->path( ), error ) );
+					stamps.push_back( stamp );
 				}
 			}
 		}
 
+		return stamps;
+	}
+
+	// Obtain the plugins of all the .opl files in lookup_path - from the snapshot
+	// when it matches the files, otherwise by parsing them and writing a new one
+	void load( const std::string& lookup_path, bool use_snapshot, opl_entries& entries )
+	{
+		const opl_stamps stamps = find_opl_files( lookup_path );
+		const std::string snapshot = use_snapshot ? registry_snapshot_path( lookup_path ) : std::string( );
+
+		if( registry_snapshot_read( snapshot, stamps, entries ) )
+			return;
+
+		entries.clear( );
+		entries.reserve( stamps.size( ) );
+
+		for( opl_stamps::const_iterator I = stamps.begin( ); I != stamps.end( ); ++I )
+		{
+			opl_importer importer;
+			importer( fs::path( cl::str_util::to_t_string( I->path ) ) );
+
+			opl_entry entry;
+			entry.stamp = *I;
+			entry.auto_load = importer.auto_load;
+			for( opl_importer::container::const_iterator J = importer.plugins.begin( ); J != importer.plugins.end( ); ++J )
+				entry.plugins.push_back( J->second );
+			entries.push_back( entry );
+		}
+
+		registry_snapshot_write( snapshot, entries );
+	}
+
+	// Insert all the opl plugins found in lookup_path into the specified db
+	bool insert( const std::string& lookup_path, detail::registry::container& db, detail::registry::list &auto_load )
+	{
+		if( lookup_path.empty( ) )
+			return false;
+
+		opl_entries entries;
+		load( lookup_path, snapshot_enabled( ), entries );
+
+		for( opl_entries::const_iterator I = entries.begin( ); I != entries.end( ); ++I )
+		{
+			std::insert_iterator<detail::registry::container> out( db, db.begin( ) );
+			for( std::vector<plugin_item>::const_iterator J = I->plugins.begin( ); J != I->plugins.end( ); ++J )
+				*out++ = detail::registry::container::value_type( J->libname, *J );
+
+			if ( I->auto_load && !I->plugins.empty( ) )
+				auto_load.push_back( I->plugins.front( ) );
+		}
+
 		return true;
 	}
 
@@ -122,4 +177,18 @@ void registry::clear( )
 	custom_db_.clear( );
 }
 
-} } }
+}
+
+int scan_plugins( const std::string& lookup_path, bool use_snapshot )
+{
+	detail::opl_entries entries;
+	if( !lookup_path.empty( ) )
+		detail::load( lookup_path, use_snapshot, entries );
+
+	int result = 0;
+	for( detail::opl_entries::const_iterator I = entries.begin( ); I != entries.end( ); ++I )
+		result += int( I->plugins.size( ) );
+	return result;
+}
+
+} }
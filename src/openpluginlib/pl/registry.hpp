@@ -129,6 +129,12 @@ private:
 	static bool destroyed_, was_destroyed_;
 };
 
+// Drop the plugin indexes and resolutions after the registry changes (plugins remain alive until released)
+void clear_resolved_plugins( );
+
+// Destroy all plugins created by resolve_plugin
+void release_resolved_plugins( );
+
 } } }
 
 #endif
@@ -0,0 +1,439 @@
+// openpluginlib - A plugin interface to openlibraries.
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+// Snapshot layout - all values are big endian:
+//
+//     "OPLS" version:u32 size:u32 entries:u32 entry*
+//
+// entry:  path:str modified:i64 size:i64 auto_load:u8 plugins:u32 plugin*
+// plugin: name:str type:str mime:str category:str libname:str in_filter:str
+//         out_filter:str opl_path:str merit:i32 extensions:u32 str* filenames:u32 str*
+// str:    length:u32 followed by length u32 characters
+//
+// Characters are stored as 32 bits so that the snapshot doesn't depend on the
+// size of wchar_t. The size in the header must match the file.
+//
+// The snapshot names the libraries which are loaded, so it's only trusted when
+// nobody else could have written it - by default it's kept in a directory of
+// the temp directory which is private to the user (mode 0700), and a snapshot
+// which isn't owned by the user or is writable by others is ignored. Every
+// library must also be in the directory of the .opl it's listed under.
+
+#ifndef BOOST_FILESYSTEM_DYN_LINK
+    #define BOOST_FILESYSTEM_DYN_LINK
+#endif
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <opencorelib/cl/core.hpp>
+#include <opencorelib/cl/str_util.hpp>
+
+#include <openpluginlib/pl/registry_snapshot.hpp>
+#include <openpluginlib/pl/openpluginlib.hpp>
+#include <openpluginlib/pl/log.hpp>
+
+namespace fs = boost::filesystem;
+namespace ipc = boost::interprocess;
+
+namespace olib { namespace openpluginlib { namespace detail {
+
+namespace
+{
+	const char magic[ ] = "OPLS";
+	const boost::uint32_t version = 1;
+	const size_t header_size = 16;
+
+	// Serialises the snapshot into memory
+	class writer
+	{
+		public:
+			void u8( boost::uint8_t value )
+			{ data_.push_back( value ); }
+
+			void u32( boost::uint32_t value )
+			{
+				data_.push_back( boost::uint8_t( value >> 24 ) );
+				data_.push_back( boost::uint8_t( value >> 16 ) );
+				data_.push_back( boost::uint8_t( value >> 8 ) );
+				data_.push_back( boost::uint8_t( value ) );
+			}
+
+			void i64( boost::int64_t value )
+			{
+				u32( boost::uint32_t( boost::uint64_t( value ) >> 32 ) );
+				u32( boost::uint32_t( boost::uint64_t( value ) ) );
+			}
+
+			void str( const std::wstring& value )
+			{
+				u32( boost::uint32_t( value.size( ) ) );
+				for ( std::wstring::const_iterator i = value.begin( ); i != value.end( ); ++i )
+					u32( boost::uint32_t( *i ) );
+			}
+
+			void strings( const std::vector< std::wstring >& values )
+			{
+				u32( boost::uint32_t( values.size( ) ) );
+				for ( std::vector< std::wstring >::const_iterator i = values.begin( ); i != values.end( ); ++i )
+					str( *i );
+			}
+
+			void patch( size_t offset, boost::uint32_t value )
+			{
+				for ( int i = 0; i < 4; i ++ )
+					data_[ offset + i ] = boost::uint8_t( value >> ( 24 - 8 * i ) );
+			}
+
+			std::vector< boost::uint8_t >& data( )
+			{ return data_; }
+
+		private:
+			std::vector< boost::uint8_t > data_;
+	};
+
+	// Bounds checked cursor over the mapped snapshot - once a read fails, all reads fail
+	class reader
+	{
+		public:
+			reader( const boost::uint8_t *data, size_t size )
+				: data_( data )
+				, end_( data + size )
+				, ok_( true )
+			{ }
+
+			bool ok( ) const
+			{ return ok_; }
+
+			bool available( size_t bytes )
+			{
+				ok_ = ok_ && size_t( end_ - data_ ) >= bytes;
+				return ok_;
+			}
+
+			boost::uint8_t u8( )
+			{
+				if ( !available( 1 ) ) return 0;
+				return *data_ ++;
+			}
+
+			boost::uint32_t u32( )
+			{
+				if ( !available( 4 ) ) return 0;
+				const boost::uint32_t result = ( boost::uint32_t( data_[ 0 ] ) << 24 ) | ( boost::uint32_t( data_[ 1 ] ) << 16 ) | ( boost::uint32_t( data_[ 2 ] ) << 8 ) | data_[ 3 ];
+				data_ += 4;
+				return result;
+			}
+
+			boost::int64_t i64( )
+			{
+				const boost::uint64_t high = u32( );
+				return boost::int64_t( ( high << 32 ) | u32( ) );
+			}
+
+			std::wstring str( )
+			{
+				std::wstring result;
+				const boost::uint32_t length = u32( );
+				if ( !available( size_t( length ) * 4 ) ) return result;
+				result.reserve( length );
+				for ( boost::uint32_t i = 0; i < length; i ++ )
+					result.push_back( wchar_t( u32( ) ) );
+				return result;
+			}
+
+			void strings( std::vector< std::wstring >& values )
+			{
+				const boost::uint32_t count = u32( );
+				for ( boost::uint32_t i = 0; ok_ && i < count; i ++ )
+					values.push_back( str( ) );
+			}
+
+		private:
+			const boost::uint8_t *data_;
+			const boost::uint8_t *end_;
+			bool ok_;
+	};
+
+	// Stable across runs and platforms, unlike boost::hash
+	std::string fnv1a( const std::string& value )
+	{
+		boost::uint64_t hash = 14695981039346656037ULL;
+		for ( std::string::const_iterator i = value.begin( ); i != value.end( ); ++i )
+		{
+			hash ^= boost::uint8_t( *i );
+			hash *= 1099511628211ULL;
+		}
+
+		std::ostringstream result;
+		result << std::hex << hash;
+		return result.str( );
+	}
+
+	bool same_stamp( const opl_stamp& a, const opl_stamp& b )
+	{
+		return a.path == b.path && a.modified == b.modified && a.size == b.size;
+	}
+
+	// Checks that path is owned by the user and that nobody else can write to it - 
+	// directories must also be private to the user
+	bool is_private( const std::string& path, bool directory )
+	{
+#ifndef WIN32
+		struct stat info;
+		if ( lstat( path.c_str( ), &info ) != 0 || info.st_uid != geteuid( ) )
+			return false;
+		if ( directory )
+			return S_ISDIR( info.st_mode ) && ( info.st_mode & ( S_IRWXG | S_IRWXO ) ) == 0;
+		return S_ISREG( info.st_mode ) && ( info.st_mode & ( S_IWGRP | S_IWOTH ) ) == 0;
+#else
+		return true;
+#endif
+	}
+
+	// The directory for the user's snapshots in the temp directory, created when necessary
+	// (empty if it can't be created or isn't private)
+	std::string private_directory( )
+	{
+		boost::system::error_code error;
+		const fs::path temp = fs::temp_directory_path( error );
+		if ( error )
+			return "";
+
+#ifndef WIN32
+		std::ostringstream name;
+		name << "aml-plugins-" << geteuid( );
+		const std::string result = ( temp / name.str( ) ).string( );
+		if ( mkdir( result.c_str( ), S_IRWXU ) != 0 && errno != EEXIST )
+			return "";
+#else
+		const std::string result = temp.string( );
+#endif
+
+		if ( !is_private( result, true ) )
+		{
+			PL_LOG( level::warning, boost::format( "Not using plugin snapshots - %1% isn't private to this user" ) % result );
+			return "";
+		}
+
+		return result;
+	}
+
+	// Each library must be a file name to be resolved by the loader or be in the 
+	// directory of the .opl it's listed under (as the opl parser generates)
+	bool valid_filenames( const opl_entry& entry, const plugin_item& item )
+	{
+		if ( item.opl_path != entry.stamp.path )
+			return false;
+
+		const fs::path opl_dir = fs::path( olib::opencorelib::str_util::to_t_string( entry.stamp.path ) ).parent_path( );
+
+		for ( std::vector< std::wstring >::const_iterator i = item.filenames.begin( ); i != item.filenames.end( ); ++i )
+		{
+			const fs::path file( olib::opencorelib::str_util::to_t_string( *i ) );
+			if ( !file.has_parent_path( ) || file.parent_path( ) == opl_dir )
+				continue;
+#ifdef WIN32
+			if ( file.parent_path( ) == fs::path( plugins_path( ) ) )
+				continue;
+#endif
+			return false;
+		}
+
+		return true;
+	}
+}
+
+std::string registry_snapshot_path( const std::string& lookup_path )
+{
+	const char *dir = getenv( "AML_PLUGIN_SNAPSHOT" );
+	if ( dir && std::string( dir ) == "0" )
+		return "";
+
+	const std::string base = dir && *dir ? std::string( dir ) : private_directory( );
+	if ( base.empty( ) )
+		return "";
+
+	return ( fs::path( base ) / ( "aml-plugins-" + fnv1a( lookup_path ) + ".snapshot" ) ).string( );
+}
+
+bool registry_snapshot_read( const std::string& path, const opl_stamps& stamps, opl_entries& entries )
+{
+	boost::system::error_code error;
+	if ( path.empty( ) || !fs::exists( path, error ) )
+		return false;
+
+	if ( !is_private( path, false ) )
+	{
+		PL_LOG( level::warning, boost::format( "Ignoring the plugin snapshot %1% - it's not owned by this user or is writable by others" ) % path );
+		return false;
+	}
+
+	try
+	{
+		ipc::file_mapping file( path.c_str( ), ipc::read_only );
+		ipc::mapped_region region( file, ipc::read_only );
+		reader in( static_cast< const boost::uint8_t * >( region.get_address( ) ), region.get_size( ) );
+
+		if ( !in.available( header_size ) || memcmp( region.get_address( ), magic, 4 ) != 0 )
+			return false;
+
+		in.u32( );
+		if ( in.u32( ) != version || in.u32( ) != region.get_size( ) || in.u32( ) != stamps.size( ) )
+			return false;
+
+		opl_entries result;
+		result.reserve( stamps.size( ) );
+
+		for ( opl_stamps::const_iterator stamp = stamps.begin( ); stamp != stamps.end( ); ++stamp )
+		{
+			opl_entry entry;
+			entry.stamp.path = in.str( );
+			entry.stamp.modified = in.i64( );
+			entry.stamp.size = in.i64( );
+
+			// An .opl file which has been added, removed or changed invalidates the snapshot
+			if ( !in.ok( ) || !same_stamp( entry.stamp, *stamp ) )
+				return false;
+
+			entry.auto_load = in.u8( ) != 0;
+
+			const boost::uint32_t plugins = in.u32( );
+			for ( boost::uint32_t i = 0; in.ok( ) && i < plugins; i ++ )
+			{
+				plugin_item item;
+				item.name = in.str( );
+				item.type = in.str( );
+				item.mime = in.str( );
+				item.category = in.str( );
+				item.libname = in.str( );
+				item.in_filter = in.str( );
+				item.out_filter = in.str( );
+				item.opl_path = in.str( );
+				item.merit = int( boost::int32_t( in.u32( ) ) );
+
+				// Compiled as the opl parser does
+				std::vector< std::wstring > extensions;
+				in.strings( extensions );
+				item.extension.reserve( extensions.size( ) );
+				for ( std::vector< std::wstring >::const_iterator e = extensions.begin( ); e != extensions.end( ); ++e )
+					item.extension.push_back( boost::wregex( *e, boost::wregex::extended | boost::wregex::icase ) );
+
+				in.strings( item.filenames );
+				if ( in.ok( ) && !valid_filenames( entry, item ) )
+				{
+					PL_LOG( level::warning, boost::format( "Ignoring the plugin snapshot %1% - it lists libraries outside the plugin directories" ) % path );
+					return false;
+				}
+
+				entry.plugins.push_back( item );
+			}
+
+			if ( !in.ok( ) )
+				return false;
+
+			result.push_back( entry );
+		}
+
+		entries.swap( result );
+		return true;
+	}
+	catch( const std::exception& e )
+	{
+		PL_LOG( level::warning, boost::format( "Ignoring the plugin snapshot %1%: %2%" ) % path % e.what( ) );
+	}
+
+	return false;
+}
+
+bool registry_snapshot_write( const std::string& path, const opl_entries& entries )
+{
+	if ( path.empty( ) )
+		return false;
+
+	writer out;
+	for ( int i = 0; i < 4; i ++ )
+		out.u8( boost::uint8_t( magic[ i ] ) );
+	out.u32( version );
+	out.u32( 0 );
+	out.u32( boost::uint32_t( entries.size( ) ) );
+
+	for ( opl_entries::const_iterator entry = entries.begin( ); entry != entries.end( ); ++entry )
+	{
+		out.str( entry->stamp.path );
+		out.i64( entry->stamp.modified );
+		out.i64( entry->stamp.size );
+		out.u8( entry->auto_load ? 1 : 0 );
+		out.u32( boost::uint32_t( entry->plugins.size( ) ) );
+
+		for ( std::vector< plugin_item >::const_iterator item = entry->plugins.begin( ); item != entry->plugins.end( ); ++item )
+		{
+			out.str( item->name );
+			out.str( item->type );
+			out.str( item->mime );
+			out.str( item->category );
+			out.str( item->libname );
+			out.str( item->in_filter );
+			out.str( item->out_filter );
+			out.str( item->opl_path );
+			out.u32( boost::uint32_t( boost::int32_t( item->merit ) ) );
+
+			std::vector< std::wstring > extensions;
+			for ( std::vector< boost::wregex >::const_iterator e = item->extension.begin( ); e != item->extension.end( ); ++e )
+				extensions.push_back( e->str( ) );
+			out.strings( extensions );
+			out.strings( item->filenames );
+		}
+	}
+
+	out.patch( 8, boost::uint32_t( out.data( ).size( ) ) );
+
+	// Concurrent processes may write the same snapshot, so each writes its own
+	// temporary file and readers only ever see a complete one
+	boost::system::error_code error;
+	const std::string temp = path + "." + fs::unique_path( "%%%%%%%%", error ).string( );
+	if ( error )
+		return false;
+
+	{
+		std::ofstream file( temp.c_str( ), std::ios::binary | std::ios::trunc );
+		file.write( reinterpret_cast< const char * >( &out.data( )[ 0 ] ), std::streamsize( out.data( ).size( ) ) );
+#ifndef WIN32
+		// Readers reject snapshots which others can write, whatever the umask
+		chmod( temp.c_str( ), S_IRUSR | S_IWUSR );
+#endif
+		if ( !file.good( ) )
+		{
+			file.close( );
+			fs::remove( temp, error );
+			return false;
+		}
+	}
+
+	fs::rename( temp, path, error );
+	if ( error )
+	{
+		PL_LOG( level::warning, boost::format( "Unable to write the plugin snapshot %1%: %2%" ) % path % error.message( ) );
+		fs::remove( temp, error );
+		return false;
+	}
+
+	return true;
+}
+
+} } }
@@ -0,0 +1,71 @@
+// openpluginlib - A plugin interface to openlibraries.
+
+// Copyright (C) 2013 Vizrt
+// Released under the LGPL.
+
+#ifndef REGISTRY_SNAPSHOT_INC_
+#define REGISTRY_SNAPSHOT_INC_
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include <openpluginlib/pl/openplugin.hpp>
+
+namespace olib { namespace openpluginlib { namespace detail {
+
+// Parsing every .opl file with xerces dominates the start up of short lived
+// processes, so the plugins found under a lookup path are serialised to a
+// binary snapshot after a full scan. Subsequent scans only list the .opl
+// files and compare their paths, modification times and sizes against the
+// snapshot - if they all match, the plugins are read from the memory mapped
+// snapshot instead.
+//
+// Snapshots are written to the directory named by the AML_PLUGIN_SNAPSHOT
+// environment variable or, when unset, a directory of the temp directory which
+// is private to the user - setting it to 0 disables them. Snapshots which
+// aren't owned by the user, are writable by others or name libraries outside
+// the directories of their .opl files are ignored.
+
+// Identifies the state of an .opl file
+struct opl_stamp
+{
+	opl_stamp( )
+		: modified( 0 )
+		, size( 0 )
+	{ }
+
+	std::wstring path;
+	boost::int64_t modified;
+	boost::int64_t size;
+};
+
+typedef std::vector< opl_stamp > opl_stamps;
+
+// The plugins described by one .opl file
+struct opl_entry
+{
+	opl_entry( )
+		: auto_load( false )
+	{ }
+
+	opl_stamp stamp;
+	bool auto_load;
+	std::vector< plugin_item > plugins;
+};
+
+typedef std::vector< opl_entry > opl_entries;
+
+// Location of the snapshot for the lookup path (empty when snapshots are disabled)
+std::string registry_snapshot_path( const std::string& lookup_path );
+
+// Read the snapshot - returns false if it's missing, damaged or doesn't match the stamps
+bool registry_snapshot_read( const std::string& path, const opl_stamps& stamps, opl_entries& entries );
+
+// Replace the snapshot with the entries - returns false if it can't be written
+bool registry_snapshot_write( const std::string& path, const opl_entries& entries );
+
+} } }
+
+#endif
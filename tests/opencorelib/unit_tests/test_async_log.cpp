@@ -0,0 +1,126 @@
+#include "precompiled_headers.hpp"
+#include <boost/test/auto_unit_test.hpp>
+
+#include <opencorelib/cl/logtarget.hpp>
+#include <opencorelib/cl/loghandler.hpp>
+#include <opencorelib/cl/exception_context.hpp>
+
+#include <boost/thread.hpp>
+#include <vector>
+
+using namespace olib;
+using namespace olib::opencorelib;
+
+namespace
+{
+	class recording_logtarget : public logtarget
+	{
+	public:
+		recording_logtarget()
+			: timed_( 0 )
+		{}
+
+		virtual void log( invoke_assert &, const TCHAR * )
+		{
+		}
+
+		virtual void log( base_exception &, const TCHAR * )
+		{
+		}
+
+		virtual void log( logger &log_obj, const TCHAR * )
+		{
+			boost::mutex::scoped_lock lock( mutex_ );
+			messages_.push_back( log_obj.get_context()->message() );
+			threads_.push_back( boost::this_thread::get_id() );
+			if( !log_obj.time().is_special() )
+				++timed_;
+		}
+
+		size_t count()
+		{
+			boost::mutex::scoped_lock lock( mutex_ );
+			return messages_.size();
+		}
+
+		std::vector< t_string > messages_;
+		std::vector< boost::thread::id > threads_;
+		int timed_;
+		boost::mutex mutex_;
+	};
+
+	// Installs the target and raises the log level for the duration of a test
+	struct async_fixture
+	{
+		async_fixture()
+			: level_( the_log_handler::instance().get_global_log_level() )
+			, target_( new recording_logtarget() )
+		{
+			the_log_handler::instance().set_global_log_level( log_level::debug1 );
+			the_log_handler::instance().add_target( target_ );
+			the_log_handler::instance().set_async( true );
+		}
+
+		~async_fixture()
+		{
+			the_log_handler::instance().set_async( false );
+			the_log_handler::instance().remove_target( target_ );
+			the_log_handler::instance().set_global_log_level( level_ );
+		}
+
+		log_level::severity level_;
+		boost::shared_ptr< recording_logtarget > target_;
+	};
+
+	void log_from_worker( int count )
+	{
+		for( int i = 0; i < count; ++i )
+			ARLOG_DEBUG( "worker %1%" )( i );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( async_log_delivers_on_writer_thread )
+{
+	async_fixture fixture;
+
+	ARLOG_DEBUG( "first" );
+	ARLOG_DEBUG( "second" );
+	the_log_handler::instance().flush();
+
+	BOOST_REQUIRE_EQUAL( fixture.target_->count(), size_t( 2 ) );
+	BOOST_CHECK( fixture.target_->messages_[ 0 ] == _CT("first") );
+	BOOST_CHECK( fixture.target_->messages_[ 1 ] == _CT("second") );
+	BOOST_CHECK( fixture.target_->threads_[ 0 ] != boost::this_thread::get_id() );
+	BOOST_CHECK_EQUAL( fixture.target_->timed_, 2 );
+	BOOST_CHECK_EQUAL( the_log_handler::instance().get_dropped(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( async_log_flushes_errors_immediately )
+{
+	async_fixture fixture;
+
+	ARLOG_DEBUG( "queued" );
+	ARLOG_ERR( "serious" );
+
+	// The error and everything before it are written before ARLOG_ERR returns
+	BOOST_REQUIRE_EQUAL( fixture.target_->count(), size_t( 2 ) );
+	BOOST_CHECK( fixture.target_->messages_[ 1 ] == _CT("serious") );
+}
+
+BOOST_AUTO_TEST_CASE( async_log_drains_exited_threads_on_shutdown )
+{
+	boost::shared_ptr< recording_logtarget > target;
+	{
+		async_fixture fixture;
+		target = fixture.target_;
+
+		boost::thread first( boost::bind( log_from_worker, 100 ) );
+		boost::thread second( boost::bind( log_from_worker, 100 ) );
+		first.join();
+		second.join();
+	}
+
+	// Disabling the writer delivers everything which was queued
+	BOOST_CHECK_EQUAL( target->count() + size_t( the_log_handler::instance().get_dropped() ), size_t( 200 ) );
+	BOOST_CHECK( !the_log_handler::instance().get_async() );
+}
@@ -0,0 +1,332 @@
+// Benchmarks for the audio kernels in ml::audio
+
+#include <openmedialib/ml/types.hpp>
+#include <openmedialib/ml/audio.hpp>
+#include <openmedialib/ml/audio_pool.hpp>
+#include <openmedialib/ml/audio_resampler.hpp>
+#include <openmedialib/ml/utilities.hpp>
+#include <opencorelib/cl/utilities.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "benchmark.hpp"
+
+namespace ml = olib::openmedialib::ml;
+
+namespace {
+
+// One frame of 48khz audio at 25fps
+const int frequency = 48000;
+const int samples = 1920;
+
+ml::audio_type_ptr source( ml::audio::identity id, int channels )
+{
+	ml::audio_type_ptr audio = ml::audio::allocate( id, frequency, channels, samples, true );
+	return audio;
+}
+
+// Runs one of the pcm24 packing functions over a frame of 8 channel audio with the SSSE3 versions on or off
+template< typename F >
+void pack( benchmark::state &state, bool simd, size_t in_bytes, size_t out_bytes, F function )
+{
+	const uint32_t count = samples * 8;
+	std::vector< boost::uint8_t > in( count * in_bytes, 0x5a );
+	std::vector< boost::uint8_t > out( count * out_bytes + 16 );
+
+	const bool original = ml::audio::simd_enabled( );
+	if ( ml::audio::set_simd_enabled( simd ) != simd )
+	{
+		ml::audio::set_simd_enabled( original );
+		state.skip( "SSSE3 is not available" );
+		return;
+	}
+
+	state.set_bytes( in.size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		function( &out[ 0 ], &in[ 0 ], count );
+		benchmark::keep( out[ 0 ] );
+	}
+
+	ml::audio::set_simd_enabled( original );
+}
+
+void pack_pcm24( boost::uint8_t *out, const boost::uint8_t *in, uint32_t count )
+{
+	ml::audio::pack_pcm24_from_pcm32( out, in, count, 1 );
+}
+
+void pack_aiff24( boost::uint8_t *out, const boost::uint8_t *in, uint32_t count )
+{
+	ml::audio::pack_aiff24_from_pcm32( out, in, count, 1 );
+}
+
+void unpack_pcm24( boost::uint8_t *out, const boost::uint8_t *in, uint32_t count )
+{
+	ml::audio::unpack_pcm24( reinterpret_cast< boost::uint32_t * >( out ), in, count, 1 );
+}
+
+void byteswap( benchmark::state &state, bool simd )
+{
+	const size_t size = samples * 2 * 2;
+	boost::shared_ptr< boost::uint8_t > buffer( static_cast< boost::uint8_t * >( olib::opencorelib::utilities::aligned_alloc( 16, size ) ), &olib::opencorelib::utilities::aligned_free );
+	memset( buffer.get( ), 0x5a, size );
+
+	const bool original = ml::audio::simd_enabled( );
+	if ( ml::audio::set_simd_enabled( simd ) != simd )
+	{
+		ml::audio::set_simd_enabled( original );
+		state.skip( "SSSE3 is not available" );
+		return;
+	}
+
+	state.set_bytes( size );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		ml::audio::byteswap16_inplace( buffer.get( ), int32_t( size ) );
+		benchmark::keep( buffer.get( )[ 0 ] );
+	}
+
+	ml::audio::set_simd_enabled( original );
+}
+
+void convert( benchmark::state &state, ml::audio::identity from, ml::audio::identity to, int channels )
+{
+	ml::audio_type_ptr audio = source( from, channels );
+	state.set_bytes( audio->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::audio::coerce( to, audio ) );
+}
+
+// The linear interpolation which ml::audio_resample used previously - kept for comparison
+ml::audio_type_ptr linear_resample( const ml::audio_type_ptr &input, int frequency )
+{
+	const int samples_in = input->samples( );
+	const int channels = input->channels( );
+	const double count = ( double( samples_in ) * frequency ) / input->frequency( );
+	const int samples_out = int( 0.5 + count );
+	const double ratio = double( samples_in ) / count;
+
+	ml::audio::pcm16_ptr output( new ml::audio::pcm16( frequency, channels, samples_out, false ) );
+	const short *in = static_cast< const short * >( input->pointer( ) );
+	short *out = static_cast< short * >( output->pointer( ) );
+
+	for ( int n = 0; n < samples_out; n ++ )
+	{
+		const double offset = ratio * n;
+		const int index = int( offset );
+		const double delta = fmod( offset, 1 );
+		for ( int c = 0; c < channels; c ++ )
+		{
+			if ( n == 0 )
+				out[ c ] = in[ c ];
+			else if ( offset + 1.0 > double( samples_in ) )
+				out[ n * channels + c ] = in[ ( samples_in - 1 ) * channels + c ];
+			else
+				out[ n * channels + c ] = short( in[ index * channels + c ] + delta * ( in[ ( index + 1 ) * channels + c ] - in[ index * channels + c ] ) + 0.5 );
+		}
+	}
+
+	return output;
+}
+
+// Streams frames of 44.1khz audio through a resampler to 48khz with the SSE dot product on or off
+void resample_stream( benchmark::state &state, ml::audio::identity id, int channels, bool simd )
+{
+	const bool original = ml::audio::simd_enabled( );
+	if ( ml::audio::set_simd_enabled( simd ) != simd )
+	{
+		ml::audio::set_simd_enabled( original );
+		state.skip( "SIMD is not available" );
+		return;
+	}
+
+	ml::audio_type_ptr audio = ml::audio::allocate( id, 44100, channels, 1764, true );
+	ml::audio::resampler_ptr resampler = ml::audio::create_resampler( 44100, frequency, channels );
+
+	state.set_bytes( audio->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		resampler->push( audio );
+		benchmark::keep( resampler->pull( id, samples ) );
+	}
+
+	ml::audio::set_simd_enabled( original );
+}
+
+}
+
+AML_BENCHMARK( audio, allocate_pcm32_8ch )
+{
+	state.set_bytes( source( ml::audio::pcm32_id, 8 )->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::audio::allocate( ml::audio::pcm32_id, frequency, 8, samples, true ) );
+}
+
+AML_BENCHMARK( audio, buffer_system_16ch )
+{
+	const size_t size = samples * 16 * 4;
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		void *buffer = olib::opencorelib::utilities::aligned_alloc( 16, size );
+		benchmark::keep( buffer );
+		olib::opencorelib::utilities::aligned_free( buffer );
+	}
+}
+
+AML_BENCHMARK( audio, buffer_pool_16ch )
+{
+	const size_t size = samples * 16 * 4;
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		void *buffer = ml::audio::pool_allocate( size );
+		benchmark::keep( buffer );
+		ml::audio::pool_release( buffer );
+	}
+}
+
+AML_BENCHMARK( audio, convert_pcm16_to_float_2ch )
+{
+	convert( state, ml::audio::pcm16_id, ml::audio::float_id, 2 );
+}
+
+AML_BENCHMARK( audio, convert_float_to_pcm16_2ch )
+{
+	convert( state, ml::audio::float_id, ml::audio::pcm16_id, 2 );
+}
+
+AML_BENCHMARK( audio, convert_pcm32_to_pcm24_8ch )
+{
+	convert( state, ml::audio::pcm32_id, ml::audio::pcm24_id, 8 );
+}
+
+AML_BENCHMARK( audio, convert_pcm24_to_pcm16_8ch )
+{
+	convert( state, ml::audio::pcm24_id, ml::audio::pcm16_id, 8 );
+}
+
+AML_BENCHMARK( audio, channel_convert_2_to_8 )
+{
+	ml::audio_type_ptr audio = source( ml::audio::pcm32_id, 2 );
+	state.set_bytes( audio->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::audio::channel_convert( audio, 8 ) );
+}
+
+AML_BENCHMARK( audio, mix_pcm32_2ch )
+{
+	ml::audio_type_ptr a = source( ml::audio::pcm32_id, 2 );
+	ml::audio_type_ptr b = source( ml::audio::pcm32_id, 2 );
+	state.set_bytes( a->size( ) + b->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::audio::mixer( a, b ) );
+}
+
+AML_BENCHMARK( audio, volume_pcm32_8ch )
+{
+	ml::audio_type_ptr audio = source( ml::audio::pcm32_id, 8 );
+	state.set_bytes( audio->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::audio::volume( audio, 0.5f, 1.0f ) );
+}
+
+AML_BENCHMARK( audio, resample_48000_to_44100_2ch )
+{
+	ml::audio_type_ptr audio = source( ml::audio::pcm16_id, 2 );
+	state.set_bytes( audio->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::audio_resample( audio, 44100 ) );
+}
+
+AML_BENCHMARK( audio, resample_linear_48000_to_44100_2ch )
+{
+	ml::audio_type_ptr audio = source( ml::audio::pcm16_id, 2 );
+	state.set_bytes( audio->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( linear_resample( audio, 44100 ) );
+}
+
+AML_BENCHMARK( audio, resample_stream_44100_to_48000_2ch )
+{
+	resample_stream( state, ml::audio::pcm16_id, 2, false );
+}
+
+AML_BENCHMARK( audio, resample_stream_44100_to_48000_2ch_sse )
+{
+	resample_stream( state, ml::audio::pcm16_id, 2, true );
+}
+
+AML_BENCHMARK( audio, resample_stream_44100_to_48000_8ch_sse )
+{
+	resample_stream( state, ml::audio::pcm32_id, 8, true );
+}
+
+// Decoded packets reseated into 29.97fps frames
+AML_BENCHMARK( audio, reseat_1152_to_ntsc_8ch )
+{
+	ml::audio_type_ptr packet = ml::audio::allocate( ml::audio::pcm32_id, frequency, 8, 1152, true );
+	ml::audio::reseat_ptr reseat = ml::audio::create_reseat( );
+	state.set_bytes( 1601 * 8 * 4 );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		const int wanted = ml::audio::samples_for_frame( int( i % 5 ), frequency, 30000, 1001 );
+		while ( !reseat->has( wanted ) )
+			reseat->append( packet );
+		benchmark::keep( reseat->retrieve( wanted ) );
+	}
+}
+
+AML_BENCHMARK( audio, pack_pcm24_8ch )
+{
+	pack( state, false, 4, 3, pack_pcm24 );
+}
+
+AML_BENCHMARK( audio, pack_pcm24_8ch_ssse3 )
+{
+	pack( state, true, 4, 3, pack_pcm24 );
+}
+
+AML_BENCHMARK( audio, pack_aiff24_8ch )
+{
+	pack( state, false, 4, 3, pack_aiff24 );
+}
+
+AML_BENCHMARK( audio, pack_aiff24_8ch_ssse3 )
+{
+	pack( state, true, 4, 3, pack_aiff24 );
+}
+
+AML_BENCHMARK( audio, unpack_pcm24_8ch )
+{
+	pack( state, false, 3, 4, unpack_pcm24 );
+}
+
+AML_BENCHMARK( audio, unpack_pcm24_8ch_ssse3 )
+{
+	pack( state, true, 3, 4, unpack_pcm24 );
+}
+
+AML_BENCHMARK( audio, byteswap16_2ch )
+{
+	byteswap( state, false );
+}
+
+AML_BENCHMARK( audio, byteswap16_2ch_ssse3 )
+{
+	byteswap( state, true );
+}
@@ -0,0 +1,300 @@
+// Benchmarks for the awi index parsers
+
+#include <openmedialib/ml/awi.hpp>
+#include <openmedialib/ml/awi_mapped.hpp>
+
+#include "benchmark.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+namespace ml = olib::openmedialib::ml;
+
+namespace {
+
+// A 10 hour 25fps index - a video entry per 12 frame gop and an audio entry per second
+const int index_frames = 10 * 60 * 60 * 25;
+
+// The indexer reads index files in blocks of this size
+const size_t chunk_size = 16384;
+
+// Serialises the index as a store would, flushing both generators every 10 seconds (the video
+// generator writes the header and footer, so it's flushed first and closed last)
+const std::vector< boost::uint8_t > &ten_hour_index( )
+{
+	static std::vector< boost::uint8_t > result;
+
+	if ( result.empty( ) )
+	{
+		ml::awi_generator_v4 video( ml::AWI_V4_TYPE_VIDEO );
+		ml::awi_generator_v4 audio( ml::AWI_V4_TYPE_AUDIO_FIRST, false );
+		std::vector< boost::uint8_t > buffer;
+		boost::int64_t offset = 0;
+
+		for ( int frame = 0; frame < index_frames; frame ++ )
+		{
+			if ( frame % 12 == 0 )
+				video.enroll( frame, offset );
+			if ( frame % 25 == 0 )
+				audio.enroll( frame, offset );
+
+			offset += 40000 + ( frame % 7 ) * 1000;
+
+			if ( frame % 250 == 249 )
+			{
+				video.flush( buffer );
+				result.insert( result.end( ), buffer.begin( ), buffer.end( ) );
+				audio.flush( buffer );
+				result.insert( result.end( ), buffer.begin( ), buffer.end( ) );
+			}
+		}
+
+		audio.close( index_frames, offset );
+		audio.flush( buffer );
+		result.insert( result.end( ), buffer.begin( ), buffer.end( ) );
+		video.close( index_frames, offset );
+		video.flush( buffer );
+		result.insert( result.end( ), buffer.begin( ), buffer.end( ) );
+	}
+
+	return result;
+}
+
+// The parsing strategy used before the awi_buffer - the data is appended to a vector and each field
+// is erased from its front as it's read
+class legacy_parser_v4 : public ml::awi_index_v4
+{
+	public:
+		legacy_parser_v4( boost::uint16_t type )
+			: ml::awi_index_v4( type )
+			, type_( type )
+			, header_read_( false )
+		{ }
+
+		void parse( const boost::uint8_t *data, size_t length )
+		{
+			buffer_.insert( buffer_.end( ), data, data + length );
+
+			while ( buffer_.size( ) >= 20 && !eof_ )
+			{
+				const boost::uint16_t type = boost::uint16_t( read( 2 ) );
+
+				if ( !header_read_ )
+				{
+					ml::awi_header_v4 header;
+					header.type = type;
+					read( 3 ); read( 1 ); read( 4 ); read( 10 );
+					set( header );
+					header_read_ = true;
+				}
+				else if ( type == ml::AWI_V4_TYPE_FOOTER )
+				{
+					ml::awi_footer_v4 footer;
+					footer.type = type;
+					read( 4 ); read( 3 ); read( 1 ); read( 10 );
+					set( footer );
+				}
+				else if ( type == type_ )
+				{
+					ml::awi_item_v4 item;
+					item.type = type;
+					item.frames = boost::int16_t( read( 2 ) );
+					item.frame = boost::int32_t( read( 4 ) );
+					item.offset = boost::int64_t( read( 8 ) );
+					item.length = boost::int32_t( read( 4 ) );
+					set( item );
+				}
+				else
+				{
+					read( 18 );
+				}
+			}
+		}
+
+	private:
+		boost::uint64_t read( size_t bytes )
+		{
+			boost::uint64_t value = 0;
+			for ( size_t i = 0; i < std::min< size_t >( bytes, 8 ); i ++ )
+				value = ( value << 8 ) | buffer_[ i ];
+			buffer_.erase( buffer_.begin( ), buffer_.begin( ) + bytes );
+			return value;
+		}
+
+		boost::uint16_t type_;
+		bool header_read_;
+		std::vector< boost::uint8_t > buffer_;
+};
+
+template < typename T >
+void parse_chunked( benchmark::state &state )
+{
+	const std::vector< boost::uint8_t > &data = ten_hour_index( );
+	state.set_bytes( boost::int64_t( data.size( ) ) );
+	state.reset( );
+
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		T parser( ml::AWI_V4_TYPE_VIDEO );
+		for ( size_t offset = 0; offset < data.size( ); offset += chunk_size )
+			parser.parse( &data[ offset ], std::min( chunk_size, data.size( ) - offset ) );
+		benchmark::keep( parser.total_frames( ) );
+	}
+}
+
+// The ten hour index written to a temporary file along with its mapped sidecar - the files are
+// removed when the benchmarks exit
+class mapped_fixture
+{
+	public:
+		mapped_fixture( )
+			: parser_( ml::AWI_V4_TYPE_VIDEO )
+		{
+			namespace fs = boost::filesystem;
+			const std::vector< boost::uint8_t > &data = ten_hour_index( );
+			parser_.parse( &data[ 0 ], data.size( ) );
+
+			boost::system::error_code error;
+			index_ = ( fs::temp_directory_path( error ) / fs::unique_path( "%%%%%%%%.awi", error ) ).string( );
+			std::ofstream file( index_.c_str( ), std::ios::binary );
+			file.write( reinterpret_cast< const char * >( &data[ 0 ] ), std::streamsize( data.size( ) ) );
+			file.close( );
+
+			if ( ml::awi_mapped_index::write( index_, parser_ ) )
+				mapped_ = ml::awi_mapped_index::open( index_, ml::AWI_V4_TYPE_VIDEO );
+		}
+
+		~mapped_fixture( )
+		{
+			mapped_.reset( );
+			boost::system::error_code error;
+			boost::filesystem::remove( ml::awi_mapped_index::path_for( index_, ml::AWI_V4_TYPE_VIDEO ), error );
+			boost::filesystem::remove( index_, error );
+		}
+
+		const std::string &index( ) const { return index_; }
+		ml::awi_index_v4 &parser( ) { return parser_; }
+		const ml::awi_mapped_index_ptr &mapped( ) const { return mapped_; }
+
+	private:
+		ml::awi_parser_v4 parser_;
+		std::string index_;
+		ml::awi_mapped_index_ptr mapped_;
+};
+
+mapped_fixture &fixture( )
+{
+	static mapped_fixture result;
+	return result;
+}
+
+// Number of look ups carried out by each thread per iteration
+const int lookups = 100000;
+
+// Seek style look ups spread over the whole index
+void seek( ml::awi_index *index )
+{
+	boost::int64_t sum = 0;
+	for ( int i = 0; i < lookups; i ++ )
+	{
+		const int position = int( ( boost::int64_t( i ) * 7919 * 25 ) % index_frames );
+		sum += index->find( position ) + index->key_frame_of( position );
+	}
+	benchmark::keep( sum );
+}
+
+void lookup( benchmark::state &state, ml::awi_index *index, int threads )
+{
+	if ( !index )
+	{
+		state.skip( "unable to write the mapped index" );
+		return;
+	}
+
+	state.set_frames( boost::int64_t( lookups ) * threads );
+	state.reset( );
+
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		boost::thread_group group;
+		for ( int t = 0; t < threads; t ++ )
+			group.create_thread( boost::bind( &seek, index ) );
+		group.join_all( );
+	}
+}
+
+int hardware_threads( )
+{
+	return std::max< int >( 2, int( boost::thread::hardware_concurrency( ) ) );
+}
+
+}
+
+// Parsing a complete index held in memory (as a mapped file would be)
+AML_BENCHMARK( awi, parse_v4_10h )
+{
+	const std::vector< boost::uint8_t > &data = ten_hour_index( );
+	state.set_bytes( boost::int64_t( data.size( ) ) );
+	state.reset( );
+
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		ml::awi_parser_v4 parser( ml::AWI_V4_TYPE_VIDEO );
+		parser.parse( &data[ 0 ], data.size( ) );
+		benchmark::keep( parser.total_frames( ) );
+	}
+}
+
+// Parsing in the blocks which the indexer reads
+AML_BENCHMARK( awi, parse_v4_10h_chunked )
+{
+	parse_chunked< ml::awi_parser_v4 >( state );
+}
+
+AML_BENCHMARK( awi, parse_v4_10h_chunked_legacy )
+{
+	parse_chunked< legacy_parser_v4 >( state );
+}
+
+// Opening a finished index from its mapped sidecar rather than parsing it
+AML_BENCHMARK( awi, open_mapped_10h )
+{
+	const std::string index = fixture( ).index( );
+	if ( !fixture( ).mapped( ) )
+	{
+		state.skip( "unable to write the mapped index" );
+		return;
+	}
+
+	state.reset( );
+
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::awi_mapped_index::open( index, ml::AWI_V4_TYPE_VIDEO ) );
+}
+
+// Look ups on the parsed index (which locks on each call) and on the mapped index, from one
+// thread and from as many threads as there are cores
+AML_BENCHMARK( awi, lookup_parsed_10h )
+{
+	lookup( state, &fixture( ).parser( ), 1 );
+}
+
+AML_BENCHMARK( awi, lookup_mapped_10h )
+{
+	lookup( state, fixture( ).mapped( ).get( ), 1 );
+}
+
+AML_BENCHMARK( awi, lookup_parsed_10h_threaded )
+{
+	lookup( state, &fixture( ).parser( ), hardware_threads( ) );
+}
+
+AML_BENCHMARK( awi, lookup_mapped_10h_threaded )
+{
+	lookup( state, fixture( ).mapped( ).get( ), hardware_threads( ) );
+}
@@ -0,0 +1,111 @@
+// Benchmarks for the frame caches (cl::lru and the scope handler)
+
+#include <opencorelib/cl/lru.hpp>
+#include <openmedialib/ml/frame.hpp>
+#include <openmedialib/ml/memory_budget.hpp>
+#include <openmedialib/ml/scope_handler.hpp>
+
+#include "benchmark.hpp"
+
+namespace cl = olib::opencorelib;
+namespace ml = olib::openmedialib::ml;
+
+namespace {
+
+typedef cl::lru< int, ml::frame_type_ptr > frame_lru;
+
+const int cache_size = 50;
+
+// Kept below the scope handler's own limit so that lookups hit
+const int scope_size = 16;
+
+}
+
+AML_BENCHMARK( cache, lru_append )
+{
+	frame_lru cache( cache_size );
+	ml::frame_type_ptr frame( new ml::frame_type( ) );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		cache.append( int( i ), frame );
+}
+
+AML_BENCHMARK( cache, lru_fetch_hit )
+{
+	frame_lru cache( cache_size );
+	ml::frame_type_ptr frame( new ml::frame_type( ) );
+	for ( int i = 0; i < cache_size; i ++ )
+		cache.append( i, frame );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( cache.fetch( int( i % cache_size ) ) );
+}
+
+AML_BENCHMARK( cache, lru_fetch_miss )
+{
+	frame_lru cache( cache_size );
+	ml::frame_type_ptr frame( new ml::frame_type( ) );
+	for ( int i = 0; i < cache_size; i ++ )
+		cache.append( i, frame );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( cache.fetch( cache_size + int( i % cache_size ) ) );
+}
+
+AML_BENCHMARK( cache, lru_highest_in_range )
+{
+	frame_lru cache( cache_size );
+	ml::frame_type_ptr frame( new ml::frame_type( ) );
+	for ( int i = 0; i < cache_size; i += 2 )
+		cache.append( i, frame );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		int upper = int( i % cache_size );
+		benchmark::keep( cache.highest_in_range( upper, upper - 4 ) );
+	}
+}
+
+AML_BENCHMARK( cache, scope_insert )
+{
+	ml::lru_cache_type_ptr cache = ml::the_scope_handler::Instance( ).lru_cache( L"benchmark" );
+	ml::frame_type_ptr frame( new ml::frame_type( ) );
+	const std::wstring uri( L"benchmark:insert" );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		cache->insert_frame_for_position( ml::lru_cache_type::key_type( int( i ), uri ), frame );
+	cache->clear( );
+}
+
+AML_BENCHMARK( cache, scope_lookup_hit )
+{
+	ml::lru_cache_type_ptr cache = ml::the_scope_handler::Instance( ).lru_cache( L"benchmark" );
+	ml::frame_type_ptr frame( new ml::frame_type( ) );
+	const std::wstring uri( L"benchmark:lookup" );
+	for ( int i = 0; i < scope_size; i ++ )
+		cache->insert_frame_for_position( ml::lru_cache_type::key_type( i, uri ), frame );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( cache->frame_for_position( ml::lru_cache_type::key_type( int( i % scope_size ), uri ) ) );
+	cache->clear( );
+}
+
+// Measuring a full cache, as the memory_budget filter does after each fetch
+AML_BENCHMARK( cache, lru_memory_usage )
+{
+	frame_lru cache( cache_size );
+	for ( int i = 0; i < cache_size; i ++ )
+	{
+		ml::frame_type_ptr frame( new ml::frame_type( ) );
+		frame->set_audio( ml::audio::allocate( ml::audio::pcm16_id, 48000, 2, 1920 ) );
+		cache.append( i, frame );
+	}
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::lru_memory_usage( cache ) );
+}
+
+AML_BENCHMARK( cache, scope_memory_usage )
+{
+	ml::lru_cache_type_ptr cache = ml::the_scope_handler::Instance( ).lru_cache( L"benchmark" );
+	ml::frame_type_ptr frame( new ml::frame_type( ) );
+	const std::wstring uri( L"benchmark:usage" );
+	for ( int i = 0; i < scope_size; i ++ )
+		cache->insert_frame_for_position( ml::lru_cache_type::key_type( i, uri ), frame );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( cache->memory_usage( ) );
+	cache->clear( );
+}
@@ -0,0 +1,280 @@
+// End to end fetch benchmarks for small graphs built from the generators and
+// the raw: plugin
+
+#include <opencorelib/cl/core.hpp>
+#include <opencorelib/cl/special_folders.hpp>
+#include <opencorelib/cl/str_util.hpp>
+#include <opencorelib/cl/uuid_16b.hpp>
+#include <openmedialib/ml/utilities.hpp>
+#include <openmedialib/ml/input.hpp>
+#include <openmedialib/ml/filter.hpp>
+#include <openmedialib/ml/frame.hpp>
+#include <openmedialib/ml/store.hpp>
+#include <openmedialib/ml/audio.hpp>
+#include <openmedialib/ml/image/image.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+
+#include "benchmark.hpp"
+
+namespace cl = olib::opencorelib;
+namespace ml = olib::openmedialib::ml;
+namespace fs = boost::filesystem;
+
+namespace {
+
+// Number of frames written to the raw: test file
+const int raw_frames = 25;
+
+ml::input_type_ptr colour( const std::wstring &pf, int width, int height, int interlace = 0, int alpha = 255 )
+{
+	ml::input_type_ptr input = ml::create_delayed_input( L"colour:" );
+	if ( input )
+	{
+		input->property( "colourspace" ) = pf;
+		input->property( "width" ) = width;
+		input->property( "height" ) = height;
+		input->property( "interlace" ) = interlace;
+		input->property( "a" ) = alpha;
+		if ( !input->init( ) )
+			input = ml::input_type_ptr( );
+	}
+	return input;
+}
+
+ml::input_type_ptr tone( int channels )
+{
+	ml::input_type_ptr input = ml::create_delayed_input( L"tone:" );
+	if ( input )
+	{
+		input->property( "channels" ) = channels;
+		input->property( "frequency" ) = 48000;
+		if ( !input->init( ) )
+			input = ml::input_type_ptr( );
+	}
+	return input;
+}
+
+ml::input_type_ptr attach( const std::wstring &name, ml::input_type_ptr input )
+{
+	ml::filter_type_ptr filter = input ? ml::create_filter( name ) : ml::filter_type_ptr( );
+	if ( filter && filter->connect( input ) )
+	{
+		filter->sync( );
+		return filter;
+	}
+	return ml::input_type_ptr( );
+}
+
+// Converts the tone to 44.1khz with the named filter
+ml::input_type_ptr resampled( const std::wstring &name, int channels )
+{
+	ml::input_type_ptr graph = attach( name, tone( channels ) );
+	if ( graph )
+		graph->property( "frequency" ) = 44100;
+	return graph;
+}
+
+// Converts a 1080 colour source at fps_in to fps_in * 1.2 / 1.001 with the requested interpolation
+ml::input_type_ptr converted( int fps_in, int interlace, const std::wstring &interpolation )
+{
+	ml::input_type_ptr input = ml::create_delayed_input( L"colour:" );
+	if ( !input )
+		return input;
+
+	input->property( "colourspace" ) = std::wstring( L"yuv422p" );
+	input->property( "width" ) = 1920;
+	input->property( "height" ) = 1080;
+	input->property( "interlace" ) = interlace;
+	input->property( "fps_num" ) = fps_in;
+	input->property( "fps_den" ) = 1;
+	if ( !input->init( ) )
+		return ml::input_type_ptr( );
+
+	ml::input_type_ptr graph = attach( L"frame_rate", input );
+	if ( graph )
+	{
+		graph->property( "fps_num" ) = fps_in * 1200;
+		graph->property( "fps_den" ) = 1001;
+		graph->property( "interpolation" ) = interpolation;
+	}
+	return graph;
+}
+
+// Fetches frames sequentially from the graph, wrapping at the end
+void fetch( benchmark::state &state, ml::input_type_ptr graph )
+{
+	if ( !graph )
+	{
+		state.skip( "unable to construct graph" );
+		return;
+	}
+
+	int frames = std::max( 1, graph->get_frames( ) );
+
+	// Graph construction and the first fetch are excluded from the measurement
+	graph->seek( 0 );
+	ml::frame_type_ptr frame = graph->fetch( );
+	if ( frame && frame->get_image( ) )
+		state.set_bytes( frame->get_image( )->size( ) );
+	else if ( frame && frame->get_audio( ) )
+		state.set_bytes( frame->get_audio( )->size( ) );
+	state.set_frames( 1 );
+	state.reset( );
+
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		graph->seek( int( i % frames ) );
+		frame = graph->fetch( );
+		benchmark::keep( frame->get_image( ) );
+		benchmark::keep( frame->get_audio( ) );
+	}
+}
+
+// Writes a short raw: file once and removes it when the process exits
+class raw_file
+{
+	public:
+		raw_file( )
+		{
+			cl::uuid_16b unique_id;
+			path_ = cl::special_folder::get( cl::special_folder::temp ) / ( unique_id.to_hex_string( ) + _CT( "_benchmark.raw" ) );
+
+			ml::input_type_ptr input = colour( L"yuv422p", 1920, 1080, 1 );
+			if ( !input )
+				return;
+
+			input->seek( 0 );
+			ml::frame_type_ptr frame = input->fetch( );
+			ml::store_type_ptr store = ml::create_store( L"raw:" + uri( ), frame );
+			if ( !store || !store->init( ) )
+				return;
+
+			for ( int i = 0; i < raw_frames; i ++ )
+			{
+				input->seek( i );
+				if ( !store->push( input->fetch( ) ) )
+					return;
+			}
+			store->complete( );
+		}
+
+		~raw_file( )
+		{
+			boost::system::error_code ec;
+			fs::remove( path_, ec );
+			fs::remove( fs::path( path_.native( ) + _CT( ".aml" ) ), ec );
+		}
+
+		std::wstring uri( ) const
+		{
+			return cl::str_util::to_wstring( path_.native( ) );
+		}
+
+		bool exists( ) const
+		{
+			return fs::exists( path_ );
+		}
+
+	private:
+		fs::path path_;
+};
+
+ml::input_type_ptr raw( )
+{
+	static raw_file file;
+	if ( !file.exists( ) )
+		return ml::input_type_ptr( );
+	return ml::create_input( L"raw:" + file.uri( ) );
+}
+
+}
+
+AML_BENCHMARK( graph, colour_yuv422p_1080 )
+{
+	fetch( state, colour( L"yuv422p", 1920, 1080 ) );
+}
+
+AML_BENCHMARK( graph, colour_deinterlace_1080 )
+{
+	ml::input_type_ptr input = colour( L"yuv422p", 1920, 1080, 1 );
+	fetch( state, attach( L"deinterlace", input ) );
+}
+
+AML_BENCHMARK( graph, colour_conform_deinterlace_1080 )
+{
+	ml::input_type_ptr input = colour( L"yuv420p", 1920, 1080, 1 );
+	fetch( state, attach( L"deinterlace", attach( L"conform", input ) ) );
+}
+
+AML_BENCHMARK( graph, colour_composite_1080 )
+{
+	ml::input_type_ptr background = colour( L"yuv422p", 1920, 1080 );
+	ml::input_type_ptr foreground = colour( L"yuv422p", 1920, 1080, 0, 128 );
+	ml::filter_type_ptr composite = ml::create_filter( L"composite" );
+	if ( background && foreground && composite )
+	{
+		composite->property( "rx" ) = 0.25;
+		composite->property( "ry" ) = 0.25;
+		composite->property( "rw" ) = 0.5;
+		composite->property( "rh" ) = 0.5;
+		composite->connect( background, 0 );
+		composite->connect( foreground, 1 );
+		composite->sync( );
+	}
+	fetch( state, composite );
+}
+
+AML_BENCHMARK( graph, tone_2ch )
+{
+	fetch( state, tone( 2 ) );
+}
+
+AML_BENCHMARK( graph, tone_volume_8ch )
+{
+	fetch( state, attach( L"volume", tone( 8 ) ) );
+}
+
+// The native polyphase resampler against swresample
+AML_BENCHMARK( graph, tone_resample_2ch )
+{
+	fetch( state, resampled( L"resample", 2 ) );
+}
+
+AML_BENCHMARK( graph, tone_resampler_2ch )
+{
+	fetch( state, resampled( L"resampler", 2 ) );
+}
+
+// Frame rate conversion by repeating frames against blending them
+AML_BENCHMARK( graph, frame_rate_25_to_2997_1080i )
+{
+	fetch( state, converted( 25, 1, L"none" ) );
+}
+
+AML_BENCHMARK( graph, frame_rate_25_to_2997_1080i_blend )
+{
+	fetch( state, converted( 25, 1, L"blend" ) );
+}
+
+AML_BENCHMARK( graph, frame_rate_50_to_5994_1080p )
+{
+	fetch( state, converted( 50, 0, L"none" ) );
+}
+
+AML_BENCHMARK( graph, frame_rate_50_to_5994_1080p_blend )
+{
+	fetch( state, converted( 50, 0, L"blend" ) );
+}
+
+AML_BENCHMARK( graph, raw_yuv422p_1080 )
+{
+	fetch( state, raw( ) );
+}
+
+AML_BENCHMARK( graph, raw_deinterlace_1080 )
+{
+	fetch( state, attach( L"deinterlace", raw( ) ) );
+}
@@ -0,0 +1,116 @@
+// Benchmarks for the image kernels in ml::image
+
+#include <openmedialib/ml/types.hpp>
+#include <openmedialib/ml/image/image.hpp>
+#include <openmedialib/ml/image/utility.hpp>
+#include <opencorelib/cl/minimal_string_defines.hpp>
+
+#include "benchmark.hpp"
+
+namespace ml = olib::openmedialib::ml;
+
+namespace {
+
+const int width = 1920;
+const int height = 1080;
+
+ml::image_type_ptr source( const olib::t_string &pf )
+{
+	ml::image_type_ptr image = ml::image::allocate( pf, width, height );
+	image->set_field_order( ml::image::top_field_first );
+	return image;
+}
+
+}
+
+AML_BENCHMARK( image, allocate_yuv422p_1080 )
+{
+	state.set_bytes( source( _CT( "yuv422p" ) )->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::image::allocate( _CT( "yuv422p" ), width, height ) );
+}
+
+AML_BENCHMARK( image, allocate_yuv422p10le_1080 )
+{
+	state.set_bytes( source( _CT( "yuv422p10le" ) )->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::image::allocate( _CT( "yuv422p10le" ), width, height ) );
+}
+
+AML_BENCHMARK( image, clone_yuv422p_1080 )
+{
+	ml::image_type_ptr image = source( _CT( "yuv422p" ) );
+	state.set_bytes( image->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::image_type_ptr( image->clone( ) ) );
+}
+
+AML_BENCHMARK( image, convert_yuv422p_to_r8g8b8_1080 )
+{
+	ml::image_type_ptr image = source( _CT( "yuv422p" ) );
+	state.set_bytes( image->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::image::convert( image, _CT( "r8g8b8" ) ) );
+}
+
+AML_BENCHMARK( image, convert_yuv420p_to_yuv422p_1080 )
+{
+	ml::image_type_ptr image = source( _CT( "yuv420p" ) );
+	state.set_bytes( image->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::image::convert( image, _CT( "yuv422p" ) ) );
+}
+
+AML_BENCHMARK( image, convert_yuv422p10le_to_yuv422p_1080 )
+{
+	ml::image_type_ptr image = source( _CT( "yuv422p10le" ) );
+	state.set_bytes( image->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::image::convert( image, _CT( "yuv422p" ) ) );
+}
+
+AML_BENCHMARK( image, rescale_yuv422p_1080_to_720_bicubic )
+{
+	ml::image_type_ptr image = source( _CT( "yuv422p" ) );
+	state.set_bytes( image->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::image::rescale( image, 1280, 720, ml::image::BICUBIC_SAMPLING ) );
+}
+
+AML_BENCHMARK( image, rescale_yuv422p_1080_to_sd_point )
+{
+	ml::image_type_ptr image = source( _CT( "yuv422p" ) );
+	state.set_bytes( image->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::image::rescale( image, 720, 576, ml::image::POINT_SAMPLING ) );
+}
+
+AML_BENCHMARK( image, deinterlace_yuv422p_1080 )
+{
+	ml::image_type_ptr image = source( _CT( "yuv422p" ) );
+	state.set_bytes( image->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		// Deinterlacing is carried out in place and marks the image as progressive
+		image->set_field_order( ml::image::top_field_first );
+		benchmark::keep( ml::image::deinterlace( image ) );
+	}
+}
+
+AML_BENCHMARK( image, field_yuv422p_1080 )
+{
+	ml::image_type_ptr image = source( _CT( "yuv422p" ) );
+	state.set_bytes( image->size( ) );
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::image::field( image, int( i & 1 ) ) );
+}
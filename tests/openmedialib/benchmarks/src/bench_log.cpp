@@ -0,0 +1,121 @@
+// Benchmarks for the cost of a log request on the calling thread - compares
+// the synchronous log_handler with the background writer (set_async)
+
+#include <opencorelib/cl/core.hpp>
+#include <opencorelib/cl/log_defines.hpp>
+#include <opencorelib/cl/logger.hpp>
+#include <opencorelib/cl/loghandler.hpp>
+#include <opencorelib/cl/logtarget.hpp>
+#include <opencorelib/cl/logprinter.hpp>
+
+#include <sstream>
+
+#include "benchmark.hpp"
+
+namespace cl = olib::opencorelib;
+
+namespace {
+
+// Requests queued between flushes in the async benchmarks (well below the ring capacity)
+const int batch = 1024;
+
+// Formats each request the way the openpluginlib stderr target does, but into memory
+class formatting_logtarget : public cl::logtarget
+{
+	public:
+		formatting_logtarget( )
+		{
+			cl::log_utilities::get_formatted_stream( prefix_, _CT(""), _CT("%H:%M:%S%F") );
+		}
+
+		virtual void log( cl::invoke_assert &, const TCHAR * ) { }
+		virtual void log( cl::base_exception &, const TCHAR * ) { }
+
+		virtual void log( cl::logger &log_msg, const TCHAR * )
+		{
+			olib::t_stringstream ss;
+			log_msg.pretty_print_one_line( ss, cl::print::output_default );
+			out_ << cl::log_utilities::get_log_prefix_string( log_msg.level( ), prefix_, cl::logoutput::output_default, log_msg.time( ), log_msg.thread_id( ) ) << _CT(" ") << ss.str( ) << std::endl;
+			out_.str( _CT("") );
+		}
+
+	private:
+		olib::t_stringstream prefix_;
+		olib::t_stringstream out_;
+};
+
+// Installs the target at the debug level for the duration of a benchmark
+class scoped_target
+{
+	public:
+		explicit scoped_target( bool async )
+			: level_( cl::the_log_handler::instance( ).get_global_log_level( ) )
+			, target_( new formatting_logtarget( ) )
+		{
+			cl::the_log_handler::instance( ).set_global_log_level( cl::log_level::debug1 );
+			cl::the_log_handler::instance( ).add_target( target_ );
+			cl::the_log_handler::instance( ).set_async( async );
+		}
+
+		~scoped_target( )
+		{
+			cl::the_log_handler::instance( ).set_async( false );
+			cl::the_log_handler::instance( ).remove_target( target_ );
+			cl::the_log_handler::instance( ).set_global_log_level( level_ );
+		}
+
+	private:
+		cl::log_level::severity level_;
+		cl::logtarget_ptr target_;
+};
+
+}
+
+AML_BENCHMARK( log, filtered_debug )
+{
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		ARLOG_DEBUG3( "frame %1% of %2%" )( i )( state.iterations( ) );
+}
+
+AML_BENCHMARK( log, sync_debug )
+{
+	scoped_target target( false );
+	state.reset( );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		ARLOG_DEBUG( "frame %1% of %2%" )( i )( state.iterations( ) );
+}
+
+AML_BENCHMARK( log, async_debug )
+{
+	scoped_target target( true );
+	state.reset( );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		ARLOG_DEBUG( "frame %1% of %2%" )( i )( state.iterations( ) );
+
+		// Only the calling thread's cost is measured - the writer catches up outside the timing
+		if ( i % batch == batch - 1 )
+		{
+			state.pause( );
+			cl::the_log_handler::instance( ).flush( );
+			state.resume( );
+		}
+	}
+	state.pause( );
+	cl::the_log_handler::instance( ).flush( );
+	state.resume( );
+}
+
+// Includes waiting for the writer, so this is the end to end throughput
+AML_BENCHMARK( log, async_debug_written )
+{
+	scoped_target target( true );
+	state.reset( );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		ARLOG_DEBUG( "frame %1% of %2%" )( i )( state.iterations( ) );
+		if ( i % batch == batch - 1 )
+			cl::the_log_handler::instance( ).flush( );
+	}
+	cl::the_log_handler::instance( ).flush( );
+}
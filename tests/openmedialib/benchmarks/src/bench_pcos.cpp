@@ -0,0 +1,153 @@
+// Benchmarks for pcos property access
+
+#include <openpluginlib/pl/pcos/property_container.hpp>
+#include <openpluginlib/pl/pcos/property.hpp>
+#include <openpluginlib/pl/pcos/key.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+
+namespace pcos = olib::openpluginlib::pcos;
+
+namespace {
+
+// Roughly the number of properties on a store or input with many options
+const int property_count = 32;
+
+std::string name( int index )
+{
+	std::ostringstream str;
+	str << "property_" << index;
+	return str.str( );
+}
+
+pcos::property_container container( )
+{
+	pcos::property_container result;
+	for ( int i = 0; i < property_count; i ++ )
+		result.append( pcos::property( pcos::key::from_string( name( i ).c_str( ) ) ) = i );
+	return result;
+}
+
+}
+
+AML_BENCHMARK( pcos, key_from_string )
+{
+	const std::string key = name( property_count / 2 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( pcos::key::from_string( key.c_str( ) ) );
+}
+
+AML_BENCHMARK( pcos, key_compare )
+{
+	pcos::key a = pcos::key::from_string( name( 1 ).c_str( ) );
+	pcos::key b = pcos::key::from_string( name( 2 ).c_str( ) );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( a < b );
+}
+
+AML_BENCHMARK( pcos, lookup_with_string )
+{
+	pcos::property_container props = container( );
+	std::vector< std::string > names;
+	for ( int i = 0; i < property_count; i ++ )
+		names.push_back( name( i ) );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( props.get_property_with_string( names[ i % property_count ].c_str( ) ) );
+}
+
+AML_BENCHMARK( pcos, lookup_with_key )
+{
+	pcos::property_container props = container( );
+	std::vector< pcos::key > keys;
+	for ( int i = 0; i < property_count; i ++ )
+		keys.push_back( pcos::key::from_string( name( i ).c_str( ) ) );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( props.get_property_with_key( keys[ i % property_count ] ) );
+}
+
+AML_BENCHMARK( pcos, lookup_missing )
+{
+	pcos::property_container props = container( );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( props.get_property_with_string( "not_a_property" ) );
+}
+
+AML_BENCHMARK( pcos, value_int )
+{
+	pcos::property_container props = container( );
+	pcos::property prop = props.get_property_with_string( name( 0 ).c_str( ) );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( prop.value< int >( ) );
+}
+
+AML_BENCHMARK( pcos, assign_int )
+{
+	pcos::property_container props = container( );
+	pcos::property prop = props.get_property_with_string( name( 0 ).c_str( ) );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		prop = int( i );
+}
+
+// The properties which a filter or store appends in its constructor - each key is looked up by
+// name and the properties are appended one by one
+AML_BENCHMARK( pcos, construct_properties )
+{
+	std::vector< std::string > names;
+	for ( int i = 0; i < property_count; i ++ )
+		names.push_back( name( i ) );
+
+	state.set_frames( property_count );
+	state.reset( );
+
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		pcos::property_container props;
+		for ( int p = 0; p < property_count; p ++ )
+			props.append( pcos::property( pcos::key::from_string( names[ p ].c_str( ) ) ) = p );
+		benchmark::keep( props );
+	}
+}
+
+// The property traffic of a typical fetch - a handful of properties are read and one is assigned,
+// either by name (as the helper functions do) or with keys held by the caller
+AML_BENCHMARK( pcos, per_frame_with_string )
+{
+	pcos::property_container props = container( );
+	std::vector< std::string > names;
+	for ( int i = 0; i < 8; i ++ )
+		names.push_back( name( i * 3 ) );
+
+	state.reset( );
+
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		int sum = 0;
+		for ( int p = 0; p < 8; p ++ )
+			sum += props.get_property_with_string( names[ p ].c_str( ) ).value< int >( );
+		props.get_property_with_string( names[ 0 ].c_str( ) ) = int( i );
+		benchmark::keep( sum );
+	}
+}
+
+AML_BENCHMARK( pcos, per_frame_with_key )
+{
+	pcos::property_container props = container( );
+	std::vector< pcos::key > keys;
+	for ( int i = 0; i < 8; i ++ )
+		keys.push_back( pcos::key::from_string( name( i * 3 ).c_str( ) ) );
+
+	state.reset( );
+
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		int sum = 0;
+		for ( int p = 0; p < 8; p ++ )
+			sum += props.get_property_with_key( keys[ p ] ).value< int >( );
+		props.get_property_with_key( keys[ 0 ] ) = int( i );
+		benchmark::keep( sum );
+	}
+}
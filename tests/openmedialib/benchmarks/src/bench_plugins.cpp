@@ -0,0 +1,130 @@
+// Plugin resolution benchmarks - the cost of the ml::create_* calls which build
+// a graph. Run with AML_PLUGIN_CACHE=0 to compare against a full discovery for
+// every call.
+
+#include <opencorelib/cl/core.hpp>
+#include <openpluginlib/pl/openpluginlib.hpp>
+#include <openmedialib/ml/utilities.hpp>
+#include <openmedialib/ml/input.hpp>
+#include <openmedialib/ml/filter.hpp>
+
+#include "benchmark.hpp"
+
+#include <cstdlib>
+
+namespace pl = olib::openpluginlib;
+namespace ml = olib::openmedialib::ml;
+
+namespace {
+
+// Filters used to build the graph - all are cheap to construct and connect
+const wchar_t *filters[ ] = { L"chroma", L"crop", L"correction", L"deinterlace", L"lerp" };
+
+// Nodes in the graph
+const int nodes = 200;
+
+}
+
+AML_BENCHMARK( plugins, resolve_filter )
+{
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( pl::resolve_plugin( L"openmedialib", L"filter", L"deinterlace" ) );
+}
+
+AML_BENCHMARK( plugins, resolve_input_extension )
+{
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( pl::resolve_plugin( L"openmedialib", L"input", i % 2 ? L"/media/clip_a.mov" : L"/media/clip_b.mxf" ) );
+}
+
+AML_BENCHMARK( plugins, create_filter )
+{
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::create_filter( filters[ i % 5 ] ) );
+}
+
+AML_BENCHMARK( plugins, create_delayed_input )
+{
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( ml::create_delayed_input( L"colour:" ) );
+}
+
+// Graph construction throughput - each iteration builds a 200 node chain, so
+// the fps figure is graphs per second
+AML_BENCHMARK( plugins, build_graph_200 )
+{
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		ml::input_type_ptr graph = ml::create_input( L"colour:" );
+		if ( !graph )
+		{
+			state.skip( "the colour: input is unavailable" );
+			return;
+		}
+
+		for ( int n = 1; n < nodes; n ++ )
+		{
+			ml::filter_type_ptr filter = ml::create_filter( filters[ n % 5 ] );
+			if ( !filter )
+			{
+				state.skip( "unable to create the filters" );
+				return;
+			}
+			filter->connect( graph );
+			graph = filter;
+		}
+
+		benchmark::keep( graph );
+	}
+}
+
+namespace {
+
+// The plugin directory used by pl::init
+std::string lookup_path( )
+{
+	const char *path = getenv( "AML_PATH" );
+	return path ? path : "";
+}
+
+}
+
+// Start up cost of the registry - parsing every .opl file against reading the
+// snapshot written by the first scan
+AML_BENCHMARK( plugins, startup_scan )
+{
+	const std::string path = lookup_path( );
+	if ( path == "" )
+	{
+		state.skip( "AML_PATH is not set" );
+		return;
+	}
+
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( pl::scan_plugins( path, false ) );
+}
+
+AML_BENCHMARK( plugins, startup_snapshot )
+{
+	const std::string path = lookup_path( );
+	if ( path == "" )
+	{
+		state.skip( "AML_PATH is not set" );
+		return;
+	}
+
+	// Ensure the snapshot is current before timing
+	state.pause( );
+	pl::scan_plugins( path, true );
+	state.resume( );
+
+	state.set_frames( 1 );
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+		benchmark::keep( pl::scan_plugins( path, true ) );
+}
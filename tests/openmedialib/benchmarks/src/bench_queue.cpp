@@ -0,0 +1,137 @@
+// Benchmarks for passing frames between threads - compares the mutex/condition
+// lru handoff (as used by the original nudger: input) with cl::spsc_queue
+
+#include <opencorelib/cl/lru.hpp>
+#include <opencorelib/cl/spsc_queue.hpp>
+#include <openmedialib/ml/frame.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <stdexcept>
+
+#include "benchmark.hpp"
+
+namespace cl = olib::opencorelib;
+namespace ml = olib::openmedialib::ml;
+
+namespace {
+
+const int queue_size = 50;
+
+// Number of threads the frames pass through between the producer and the consumer
+const int relays = 2;
+
+boost::posix_time::time_duration timeout( )
+{
+	return boost::posix_time::milliseconds( 5000 );
+}
+
+// Frames keyed by position in a bounded lru, consumed frames are removed
+class lru_transport
+{
+	public:
+		lru_transport( )
+			: lru_( queue_size )
+		{ }
+
+		bool push( int position, const ml::frame_type_ptr &frame )
+		{
+			return lru_.append_if_not_full( position, frame, timeout( ) );
+		}
+
+		ml::frame_type_ptr pop( int position )
+		{
+			ml::frame_type_ptr frame = lru_.wait( position, timeout( ) );
+			lru_.remove( position );
+			return frame;
+		}
+
+	private:
+		cl::lru< int, ml::frame_type_ptr > lru_;
+};
+
+// Frames passed in order through a lock free ring
+class ring_transport
+{
+	public:
+		ring_transport( )
+			: queue_( queue_size )
+		{ }
+
+		bool push( int, const ml::frame_type_ptr &frame )
+		{
+			return queue_.push( frame, timeout( ) );
+		}
+
+		ml::frame_type_ptr pop( int )
+		{
+			ml::frame_type_ptr frame;
+			queue_.pop( frame, timeout( ) );
+			return frame;
+		}
+
+	private:
+		cl::spsc_queue< ml::frame_type_ptr > queue_;
+};
+
+template< typename transport >
+void produce( transport *out, boost::int64_t count )
+{
+	for ( boost::int64_t i = 0; i < count; i ++ )
+	{
+		ml::frame_type_ptr frame( new ml::frame_type( ) );
+		frame->set_position( int( i ) );
+		if ( !out->push( int( i ), frame ) )
+			break;
+	}
+}
+
+template< typename transport >
+void relay( transport *in, transport *out, boost::int64_t count )
+{
+	for ( boost::int64_t i = 0; i < count; i ++ )
+	{
+		ml::frame_type_ptr frame = in->pop( int( i ) );
+		if ( !frame || !out->push( int( i ), frame ) )
+			break;
+	}
+}
+
+// Pushes frames from a producer thread through the relays to this thread
+template< typename transport >
+void handoff( benchmark::state &state )
+{
+	const boost::int64_t count = state.iterations( );
+	transport queues[ relays + 1 ];
+
+	boost::thread_group threads;
+	threads.create_thread( boost::bind( &produce< transport >, &queues[ 0 ], count ) );
+	for ( int i = 0; i < relays; i ++ )
+		threads.create_thread( boost::bind( &relay< transport >, &queues[ i ], &queues[ i + 1 ], count ) );
+
+	bool failed = false;
+	for ( boost::int64_t i = 0; !failed && i < count; i ++ )
+	{
+		ml::frame_type_ptr frame = queues[ relays ].pop( int( i ) );
+		failed = !frame || frame->get_position( ) != int( i );
+	}
+
+	threads.join_all( );
+
+	if ( failed )
+		throw std::runtime_error( "frame lost in handoff" );
+
+	state.set_frames( 1 );
+}
+
+}
+
+AML_BENCHMARK( queue, handoff_lru )
+{
+	handoff< lru_transport >( state );
+}
+
+AML_BENCHMARK( queue, handoff_spsc )
+{
+	handoff< ring_transport >( state );
+}
@@ -0,0 +1,126 @@
+// Storyboard benchmarks - a 100 thumbnail montage of a long GOP file, comparing
+// exact frame extraction with the key frame only mode of filter:extract (with
+// and without parallel decoding).
+//
+// The media is taken from the AML_BENCHMARK_STORYBOARD environment variable and
+// should be a long GOP file of around an hour (ie: XDCAM HD or h264) - the
+// benchmarks are skipped when it isn't set. The key frame modes locate the key
+// frames with the awi index named by AML_BENCHMARK_STORYBOARD_INDEX (without
+// it, they extract the exact frames).
+
+#include <opencorelib/cl/core.hpp>
+#include <opencorelib/cl/str_util.hpp>
+#include <openmedialib/ml/utilities.hpp>
+#include <openmedialib/ml/input.hpp>
+#include <openmedialib/ml/filter.hpp>
+#include <openmedialib/ml/frame.hpp>
+#include <openmedialib/ml/image/image.hpp>
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "benchmark.hpp"
+
+namespace cl = olib::opencorelib;
+namespace ml = olib::openmedialib::ml;
+
+namespace {
+
+// Thumbnails in the storyboard
+const int thumbnails = 100;
+
+// The packet input and decoder are shared by all iterations, so only the extraction is measured
+ml::input_type_ptr source( )
+{
+	static ml::input_type_ptr decode;
+	static bool attempted = false;
+
+	if ( !attempted )
+	{
+		attempted = true;
+
+		const char *media = getenv( "AML_BENCHMARK_STORYBOARD" );
+		ml::input_type_ptr input = media ? ml::create_delayed_input( L"avformat:" + cl::str_util::to_wstring( media ) ) : ml::input_type_ptr( );
+		if ( input )
+		{
+			input->property( "packet_stream" ) = 1;
+			if ( !input->init( ) )
+				return ml::input_type_ptr( );
+		}
+
+		ml::filter_type_ptr filter = input ? ml::create_filter( L"decode" ) : ml::filter_type_ptr( );
+		if ( filter && filter->connect( input ) )
+		{
+			filter->sync( );
+			decode = filter;
+		}
+	}
+
+	return decode;
+}
+
+void storyboard( benchmark::state &state, int keyframes, int threads )
+{
+	ml::input_type_ptr input = source( );
+	if ( !input )
+	{
+		state.skip( "AML_BENCHMARK_STORYBOARD is not set to a usable long GOP file" );
+		return;
+	}
+
+	state.set_frames( thumbnails );
+
+	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+	{
+		// A new graph each time, since the montage is cached
+		ml::filter_type_ptr extract = ml::create_filter( L"extract" );
+		ml::filter_type_ptr montage = ml::create_filter( L"montage" );
+		if ( !extract || !montage )
+		{
+			state.skip( "the extract and montage filters are unavailable" );
+			return;
+		}
+
+		extract->property( "frames" ) = thumbnails;
+		extract->property( "keyframes" ) = keyframes;
+		if ( getenv( "AML_BENCHMARK_STORYBOARD_INDEX" ) )
+			extract->property( "index" ) = cl::str_util::to_wstring( getenv( "AML_BENCHMARK_STORYBOARD_INDEX" ) );
+		extract->property( "threads" ) = threads;
+		extract->connect( input );
+		extract->sync( );
+
+		montage->property( "orient" ) = 2;
+		montage->property( "width" ) = 160;
+		montage->property( "height" ) = 90;
+		montage->property( "lines" ) = 0;
+		montage->connect( extract );
+		montage->sync( );
+
+		ml::frame_type_ptr frame = montage->fetch( );
+		benchmark::keep( frame->get_image( ) );
+	}
+}
+
+int hardware_threads( )
+{
+	return std::max< int >( 2, int( boost::thread::hardware_concurrency( ) ) );
+}
+
+}
+
+AML_BENCHMARK( storyboard, exact_100 )
+{
+	storyboard( state, 0, 0 );
+}
+
+AML_BENCHMARK( storyboard, keyframes_100 )
+{
+	storyboard( state, 1, 0 );
+}
+
+AML_BENCHMARK( storyboard, keyframes_threaded_100 )
+{
+	storyboard( state, 1, hardware_threads( ) );
+}
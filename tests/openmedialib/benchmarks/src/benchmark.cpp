@@ -0,0 +1,285 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#elif defined( __APPLE__ )
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+namespace benchmark {
+
+namespace {
+
+struct entry
+{
+	std::string group;
+	std::string name;
+	function fn;
+
+	std::string full_name( ) const { return group + "/" + name; }
+};
+
+std::vector< entry > &registry( )
+{
+	static std::vector< entry > entries;
+	return entries;
+}
+
+struct options
+{
+	options( )
+		: min_time( 0.2 )
+		, repeat( 5 )
+		, csv( false )
+		, list( false )
+	{ }
+
+	std::vector< std::string > filters;
+	double min_time;
+	int repeat;
+	bool csv;
+	bool list;
+};
+
+struct result
+{
+	result( )
+		: iterations( 0 )
+		, ns_per_op( 0.0 )
+		, min_ns_per_op( 0.0 )
+		, mb_per_sec( 0.0 )
+		, fps( 0.0 )
+	{ }
+
+	boost::int64_t iterations;
+	double ns_per_op;
+	double min_ns_per_op;
+	double mb_per_sec;
+	double fps;
+	std::string error;
+};
+
+volatile const void *sink_ = 0;
+
+bool matches( const options &opts, const entry &e )
+{
+	if ( opts.filters.empty( ) )
+		return true;
+	const std::string name = e.full_name( );
+	for ( std::vector< std::string >::const_iterator i = opts.filters.begin( ); i != opts.filters.end( ); ++i )
+		if ( name.find( *i ) != std::string::npos )
+			return true;
+	return false;
+}
+
+// Runs the benchmark once with the given iteration count and returns the elapsed time
+boost::int64_t sample( const entry &e, boost::int64_t iterations, state &s )
+{
+	s = state( iterations );
+	s.start( );
+	e.fn( s );
+	s.stop( );
+	return std::max< boost::int64_t >( s.elapsed( ), 1 );
+}
+
+result measure( const entry &e, const options &opts )
+{
+	result r;
+	const boost::int64_t target = boost::int64_t( opts.min_time * 1e9 );
+
+	// Calibrate - grow the iteration count until a sample takes at least the minimum time
+	state s( 1 );
+	boost::int64_t iterations = 1;
+	boost::int64_t elapsed = sample( e, iterations, s );
+	while ( !s.skipped( ) && elapsed < target && iterations < 1000000000 )
+	{
+		double factor = double( target ) * 1.2 / double( elapsed );
+		factor = std::min( std::max( factor, 1.5 ), 10.0 );
+		iterations = boost::int64_t( double( iterations ) * factor ) + 1;
+		elapsed = sample( e, iterations, s );
+	}
+
+	if ( s.skipped( ) )
+	{
+		r.error = "skipped: " + s.reason( );
+		return r;
+	}
+
+	std::vector< double > samples;
+	samples.push_back( double( elapsed ) / double( iterations ) );
+	for ( int i = 1; i < opts.repeat; i ++ )
+		samples.push_back( double( sample( e, iterations, s ) ) / double( iterations ) );
+
+	std::sort( samples.begin( ), samples.end( ) );
+
+	r.iterations = iterations;
+	r.ns_per_op = samples[ samples.size( ) / 2 ];
+	r.min_ns_per_op = samples[ 0 ];
+	if ( s.bytes( ) > 0 )
+		r.mb_per_sec = double( s.bytes( ) ) * 1e3 / r.ns_per_op;
+	if ( s.frames( ) > 0 )
+		r.fps = double( s.frames( ) ) * 1e9 / r.ns_per_op;
+
+	return r;
+}
+
+void usage( const char *program )
+{
+	std::cerr << "Usage: " << program << " [--list] [--csv] [--filter=<substring>]* [--min-time=<seconds>] [--repeat=<count>]" << std::endl;
+}
+
+bool parse( int argc, char *argv[ ], options &opts )
+{
+	for ( int i = 1; i < argc; i ++ )
+	{
+		const std::string arg = argv[ i ];
+		if ( arg == "--csv" )
+			opts.csv = true;
+		else if ( arg == "--list" )
+			opts.list = true;
+		else if ( arg.find( "--filter=" ) == 0 )
+			opts.filters.push_back( arg.substr( 9 ) );
+		else if ( arg.find( "--min-time=" ) == 0 )
+			opts.min_time = std::atof( arg.substr( 11 ).c_str( ) );
+		else if ( arg.find( "--repeat=" ) == 0 )
+			opts.repeat = std::max( 1, std::atoi( arg.substr( 9 ).c_str( ) ) );
+		else
+			return false;
+	}
+	return opts.min_time > 0.0;
+}
+
+std::string format( double value, int precision )
+{
+	if ( value <= 0.0 )
+		return "-";
+	std::ostringstream str;
+	str << std::fixed << std::setprecision( precision ) << value;
+	return str.str( );
+}
+
+void report( const options &opts, const entry &e, const result &r )
+{
+	if ( opts.csv )
+	{
+		std::cout << e.group << "," << e.name << "," << r.iterations << ","
+				  << format( r.ns_per_op, 1 ) << "," << format( r.min_ns_per_op, 1 ) << ","
+				  << format( r.mb_per_sec, 2 ) << "," << format( r.fps, 2 ) << ","
+				  << r.error << std::endl;
+	}
+	else if ( r.error.empty( ) )
+	{
+		std::cout << std::left << std::setw( 48 ) << e.full_name( ) << std::right
+				  << std::setw( 12 ) << r.iterations
+				  << std::setw( 16 ) << format( r.ns_per_op, 1 )
+				  << std::setw( 12 ) << format( r.mb_per_sec, 2 )
+				  << std::setw( 14 ) << format( r.fps, 2 )
+				  << std::endl;
+	}
+	else
+	{
+		std::cout << std::left << std::setw( 48 ) << e.full_name( ) << " " << r.error << std::endl;
+	}
+}
+
+}
+
+boost::int64_t clock_ns( )
+{
+#ifdef WIN32
+	static LARGE_INTEGER frequency = { 0 };
+	if ( frequency.QuadPart == 0 )
+		QueryPerformanceFrequency( &frequency );
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter( &counter );
+	return boost::int64_t( double( counter.QuadPart ) * 1e9 / double( frequency.QuadPart ) );
+#elif defined( __APPLE__ )
+	static mach_timebase_info_data_t info = { 0, 0 };
+	if ( info.denom == 0 )
+		mach_timebase_info( &info );
+	return boost::int64_t( mach_absolute_time( ) * info.numer / info.denom );
+#else
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return boost::int64_t( ts.tv_sec ) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+registration::registration( const char *group, const char *name, function fn )
+{
+	entry e;
+	e.group = group;
+	e.name = name;
+	e.fn = fn;
+	registry( ).push_back( e );
+}
+
+void escape( const void *value )
+{
+	sink_ = value;
+}
+
+int run( int argc, char *argv[ ] )
+{
+	options opts;
+	if ( !parse( argc, argv, opts ) )
+	{
+		usage( argv[ 0 ] );
+		return 1;
+	}
+
+	const std::vector< entry > &entries = registry( );
+
+	if ( opts.list )
+	{
+		for ( std::vector< entry >::const_iterator i = entries.begin( ); i != entries.end( ); ++i )
+			if ( matches( opts, *i ) )
+				std::cout << i->full_name( ) << std::endl;
+		return 0;
+	}
+
+	if ( opts.csv )
+		std::cout << "group,name,iterations,ns_per_op,min_ns_per_op,mb_per_sec,fps,error" << std::endl;
+	else
+		std::cout << std::left << std::setw( 48 ) << "benchmark" << std::right
+				  << std::setw( 12 ) << "iterations"
+				  << std::setw( 16 ) << "ns/op"
+				  << std::setw( 12 ) << "MB/s"
+				  << std::setw( 14 ) << "fps"
+				  << std::endl;
+
+	int failures = 0;
+	for ( std::vector< entry >::const_iterator i = entries.begin( ); i != entries.end( ); ++i )
+	{
+		if ( !matches( opts, *i ) )
+			continue;
+
+		result r;
+		try
+		{
+			r = measure( *i, opts );
+		}
+		catch( const std::exception &e )
+		{
+			r.error = std::string( "failed: " ) + e.what( );
+			failures ++;
+		}
+
+		report( opts, *i, r );
+	}
+
+	return failures == 0 ? 0 : 2;
+}
+
+}
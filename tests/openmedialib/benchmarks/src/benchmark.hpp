@@ -0,0 +1,109 @@
+#ifndef AML_BENCHMARK_HPP_INCLUDED_
+#define AML_BENCHMARK_HPP_INCLUDED_
+
+// A minimal benchmark harness for the openmedialib kernels.
+//
+// Each benchmark is a function which receives a state object and carries out
+// the operation being measured state.iterations( ) times. The runner
+// calibrates the iteration count so that each sample takes roughly the
+// requested minimum time and reports the median of a number of samples.
+//
+// Benchmarks are registered at static initialisation time via the
+// AML_BENCHMARK macro:
+//
+// AML_BENCHMARK( image, allocate_yuv422p_1080 )
+// {
+// 	state.set_bytes( 1920 * 1080 * 2 );
+// 	for ( boost::int64_t i = 0; i < state.iterations( ); i ++ )
+// 		benchmark::keep( ml::image::allocate( _CT( "yuv422p" ), 1920, 1080 ) );
+// }
+//
+// The bytes and frames processed per iteration are optional and are used to
+// derive MB/s and fps figures respectively.
+
+#include <boost/cstdint.hpp>
+#include <string>
+
+namespace benchmark {
+
+// Returns a monotonic time in nanoseconds
+boost::int64_t clock_ns( );
+
+class state
+{
+	public:
+		explicit state( boost::int64_t iterations )
+			: iterations_( iterations )
+			, bytes_( 0 )
+			, frames_( 0 )
+			, elapsed_( 0 )
+			, started_( 0 )
+			, skipped_( false )
+		{ }
+
+		/// Number of times the measured operation should be carried out
+		boost::int64_t iterations( ) const { return iterations_; }
+
+		/// Bytes processed by one iteration (reported as MB/s)
+		void set_bytes( boost::int64_t bytes ) { bytes_ = bytes; }
+		boost::int64_t bytes( ) const { return bytes_; }
+
+		/// Frames processed by one iteration (reported as fps)
+		void set_frames( boost::int64_t frames ) { frames_ = frames; }
+		boost::int64_t frames( ) const { return frames_; }
+
+		/// Excludes the time between pause and resume from the measurement
+		void pause( ) { elapsed_ += clock_ns( ) - started_; }
+		void resume( ) { started_ = clock_ns( ); }
+
+		/// Discards the time measured so far (ie: after constructing a graph)
+		void reset( ) { elapsed_ = 0; started_ = clock_ns( ); }
+
+		/// Marks the benchmark as unavailable (ie: a plugin is missing)
+		void skip( const std::string &reason ) { skipped_ = true; reason_ = reason; }
+		bool skipped( ) const { return skipped_; }
+		const std::string &reason( ) const { return reason_; }
+
+		/// Used by the runner to collect the time spent
+		void start( ) { reset( ); }
+		void stop( ) { elapsed_ += clock_ns( ) - started_; }
+		boost::int64_t elapsed( ) const { return elapsed_; }
+
+	private:
+		boost::int64_t iterations_;
+		boost::int64_t bytes_;
+		boost::int64_t frames_;
+		boost::int64_t elapsed_;
+		boost::int64_t started_;
+		bool skipped_;
+		std::string reason_;
+};
+
+typedef void ( *function )( state & );
+
+// Adds the benchmark to the global list - use via AML_BENCHMARK
+class registration
+{
+	public:
+		registration( const char *group, const char *name, function fn );
+};
+
+// Prevents the compiler from discarding a computed value
+void escape( const void *value );
+
+template< typename T > inline void keep( const T &value )
+{
+	escape( &value );
+}
+
+// Runs all registered benchmarks which match the command line options
+int run( int argc, char *argv[ ] );
+
+}
+
+#define AML_BENCHMARK( group, name ) \
+	static void aml_benchmark_##group##_##name( benchmark::state & ); \
+	static benchmark::registration aml_registration_##group##_##name( #group, #name, aml_benchmark_##group##_##name ); \
+	static void aml_benchmark_##group##_##name( benchmark::state &state )
+
+#endif
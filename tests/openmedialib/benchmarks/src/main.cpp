@@ -0,0 +1,62 @@
+#include <opencorelib/cl/enforce_defines.hpp>
+#include <opencorelib/cl/utilities.hpp>
+#include <opencorelib/cl/special_folders.hpp>
+#include <openpluginlib/pl/openpluginlib.hpp>
+#include <openmedialib/ml/indexer.hpp>
+
+#include <iostream>
+#include <clocale>
+
+#include "benchmark.hpp"
+
+namespace pl = olib::openpluginlib;
+namespace cl = olib::opencorelib;
+
+void init_pl()
+{
+#ifdef WIN32
+	#define PATH_LEN 1024
+
+	char mod_name[ PATH_LEN ];
+	DWORD ret = ::GetModuleFileNameA( NULL, mod_name, PATH_LEN );
+
+	ARENFORCE_MSG( ret > 0 && ret < PATH_LEN, "Failed to get the path to the current executable. Error returned was:\n%1%" )
+		( cl::utilities::handle_system_error( false ) )( ret );
+
+	std::string a_path(mod_name);
+	std::string::size_type pos = a_path.rfind("\\");
+	ARENFORCE_MSG( pos != std::string::npos, "Unexpected format of path to current executable: %1%" )( a_path );
+
+	std::string a_path2 = a_path.substr(0, pos);
+	a_path2 += "\\aml-plugins";
+
+	pl::init( a_path2 );
+#elif defined( __APPLE__ )
+	olib::t_path plugins_path = cl::special_folder::get( cl::special_folder::plugins );
+	pl::init( plugins_path.string( ) );
+#else
+	setlocale(LC_CTYPE, "");
+	pl::init( );
+#endif
+}
+
+int main( int argc, char *argv[ ] )
+{
+	int result = 0;
+
+	try
+	{
+		init_pl( );
+		result = benchmark::run( argc, argv );
+	}
+	catch( const std::exception &e )
+	{
+		std::cerr << "Benchmark run failed: " << e.what( ) << std::endl;
+		result = 1;
+	}
+
+	olib::openmedialib::ml::indexer_shutdown( );
+	pl::uninit( );
+
+	return result;
+}
@@ -0,0 +1,227 @@
+#include <boost/test/unit_test.hpp>
+#include <openmedialib/ml/analyse.hpp>
+#include <openmedialib/ml/analyse_sidecar.hpp>
+#include <openmedialib/ml/stream.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <vector>
+
+namespace ml = olib::openmedialib::ml;
+namespace pcos = olib::openpluginlib::pcos;
+namespace fs = boost::filesystem;
+
+namespace {
+
+// A video packet with the given key, position and length
+class test_stream : public ml::stream_type
+{
+	public:
+		test_stream( int key, int position, size_t length )
+			: container_( "test" )
+			, codec_( "mpeg2video" )
+			, key_( key )
+			, position_( position )
+			, data_( length )
+		{ }
+
+		pcos::property_container &properties( ) { return properties_; }
+		const enum ml::stream_id id( ) const { return ml::stream_video; }
+		const std::string &container( ) const { return container_; }
+		const std::string &codec( ) const { return codec_; }
+		size_t length( ) { return data_.size( ); }
+		boost::uint8_t *bytes( ) { return data_.size( ) ? &data_[ 0 ] : 0; }
+		const boost::int64_t key( ) const { return key_; }
+		const boost::int64_t position( ) const { return position_; }
+		const int bitrate( ) const { return 50000000; }
+		const int estimated_gop_size( ) const { return 12; }
+		ml::image::field_order_flags field_order( ) const { return ml::image::top_field_first; }
+
+	private:
+		pcos::property_container properties_;
+		std::string container_;
+		std::string codec_;
+		int key_;
+		int position_;
+		std::vector< boost::uint8_t > data_;
+};
+
+const int frames = 12;
+
+size_t packet_length( int position )
+{
+	return size_t( 1000 + position * 10 );
+}
+
+// An analysed packet of a 12 frame closed gop
+ml::stream_type_ptr analysed( int position )
+{
+	ml::stream_type_ptr stream( new test_stream( 0, position, packet_length( position ) ) );
+	pcos::property_container properties = stream->properties( );
+	properties.append( pcos::property( ml::analyse_type::key_analysed_ ) = 1 );
+	properties.append( pcos::property( ml::analyse_type::key_temporal_reference_ ) = ( position + 2 ) % frames );
+	properties.append( pcos::property( ml::analyse_type::key_picture_coding_type_ ) = position == 0 ? 1 : 3 );
+	properties.append( pcos::property( ml::analyse_type::key_vbv_delay_ ) = 9000 + position );
+	properties.append( pcos::property( ml::analyse_type::key_closed_gop_ ) = position == 0 ? 1 : 0 );
+	properties.append( pcos::property( ml::analyse_type::key_broken_link_ ) = 0 );
+	properties.append( pcos::property( ml::analyse_type::key_top_field_first_ ) = 1 );
+	properties.append( pcos::property( ml::analyse_type::key_progressive_frame_ ) = 0 );
+	return stream;
+}
+
+int value( const ml::stream_type_ptr &stream, const pcos::key &key )
+{
+	pcos::property prop = stream->properties( ).get_property_with_key( key );
+	BOOST_REQUIRE( prop.valid( ) );
+	return prop.value< int >( );
+}
+
+// A temporary file standing in for the media
+std::string create_media( )
+{
+	const std::string path = ( fs::temp_directory_path( ) / fs::unique_path( "%%%%%%%%.mpg" ) ).string( );
+	std::ofstream file( path.c_str( ), std::ios::binary | std::ios::trunc );
+	file << std::string( 4096, 'm' );
+	return path;
+}
+
+// Write the sidecar of the analysed packets of media to a new temporary file
+std::string write_sidecar( const std::string &media )
+{
+	const std::string path = media + ".awa";
+
+	ml::analyse_sidecar_writer writer( frames, media );
+	for ( int i = 0; i < frames; i ++ )
+	{
+		// Nothing is written until every frame is recorded
+		BOOST_CHECK( !writer.complete( ) );
+		BOOST_CHECK( !writer.write( path ) );
+		writer.record( i, analysed( i ) );
+	}
+
+	BOOST_REQUIRE( writer.complete( ) );
+	BOOST_REQUIRE( writer.write( path ) );
+
+	// Only the sidecar is left behind
+	int files = 0;
+	for ( fs::directory_iterator iter( fs::path( path ).parent_path( ) ); iter != fs::directory_iterator( ); ++iter )
+		if ( iter->path( ).string( ).find( path ) == 0 )
+			files ++;
+	BOOST_CHECK_EQUAL( files, 1 );
+
+	return path;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE( analyse_sidecar )
+
+BOOST_AUTO_TEST_CASE( write_and_map )
+{
+	const std::string media = create_media( );
+	const std::string path = write_sidecar( media );
+
+	ml::analyse_sidecar_ptr sidecar = ml::analyse_sidecar::open( path, frames, media );
+	BOOST_REQUIRE( sidecar );
+	BOOST_CHECK_EQUAL( sidecar->frames( ), frames );
+
+	for ( int i = 0; i < frames; i ++ )
+	{
+		ml::stream_type_ptr stream( new test_stream( 0, i, packet_length( i ) ) );
+		BOOST_REQUIRE( sidecar->apply( i, stream ) );
+
+		BOOST_CHECK_EQUAL( value( stream, ml::analyse_type::key_analysed_ ), 1 );
+		BOOST_CHECK_EQUAL( value( stream, ml::analyse_type::key_temporal_reference_ ), ( i + 2 ) % frames );
+		BOOST_CHECK_EQUAL( value( stream, ml::analyse_type::key_picture_coding_type_ ), i == 0 ? 1 : 3 );
+		BOOST_CHECK_EQUAL( value( stream, ml::analyse_type::key_vbv_delay_ ), 9000 + i );
+		BOOST_CHECK_EQUAL( value( stream, ml::analyse_type::key_closed_gop_ ), i == 0 ? 1 : 0 );
+		BOOST_CHECK_EQUAL( value( stream, ml::analyse_type::key_broken_link_ ), 0 );
+		BOOST_CHECK_EQUAL( value( stream, ml::analyse_type::key_top_field_first_ ), 1 );
+		BOOST_CHECK_EQUAL( value( stream, ml::analyse_type::key_progressive_frame_ ), 0 );
+	}
+
+	// Out of range positions have no record
+	ml::stream_type_ptr stream( new test_stream( 0, frames, packet_length( frames ) ) );
+	BOOST_CHECK( !sidecar->apply( frames, stream ) );
+	BOOST_CHECK( !sidecar->apply( -1, stream ) );
+
+	sidecar.reset( );
+	fs::remove( path );
+	fs::remove( media );
+}
+
+BOOST_AUTO_TEST_CASE( stale_sidecar_is_rejected )
+{
+	const std::string media = create_media( );
+	const std::string path = write_sidecar( media );
+
+	// A different number of frames means the media has changed
+	BOOST_CHECK( !ml::analyse_sidecar::open( path, frames + 1, media ) );
+	BOOST_CHECK( !ml::analyse_sidecar::open( path, frames - 1, media ) );
+
+	// Packets which don't match the key and length recorded aren't annotated
+	ml::analyse_sidecar_ptr sidecar = ml::analyse_sidecar::open( path, frames, media );
+	BOOST_REQUIRE( sidecar );
+
+	ml::stream_type_ptr resized( new test_stream( 0, 3, packet_length( 3 ) + 1 ) );
+	BOOST_CHECK( !sidecar->apply( 3, resized ) );
+	BOOST_CHECK( !resized->properties( ).get_property_with_key( ml::analyse_type::key_analysed_ ).valid( ) );
+
+	ml::stream_type_ptr moved( new test_stream( 2, 3, packet_length( 3 ) ) );
+	BOOST_CHECK( !sidecar->apply( 3, moved ) );
+	BOOST_CHECK( !moved->properties( ).get_property_with_key( ml::analyse_type::key_analysed_ ).valid( ) );
+
+	sidecar.reset( );
+	fs::remove( path );
+	fs::remove( media );
+}
+
+BOOST_AUTO_TEST_CASE( truncated_sidecar_is_rejected )
+{
+	const std::string media = create_media( );
+	const std::string path = write_sidecar( media );
+
+	// Drop the last record
+	fs::resize_file( path, analyse_sidecar_header_size + ( frames - 1 ) * analyse_sidecar_record_size );
+	BOOST_CHECK( !ml::analyse_sidecar::open( path, frames, media ) );
+
+	// Only part of the header
+	fs::resize_file( path, analyse_sidecar_header_size / 2 );
+	BOOST_CHECK( !ml::analyse_sidecar::open( path, frames, media ) );
+
+	// Not a sidecar at all
+	{
+		std::ofstream file( path.c_str( ), std::ios::binary | std::ios::trunc );
+		file << std::string( analyse_sidecar_header_size + frames * analyse_sidecar_record_size, 'x' );
+	}
+	BOOST_CHECK( !ml::analyse_sidecar::open( path, frames, media ) );
+
+	fs::remove( path );
+
+	// Missing files and sidecars without frames are ignored
+	BOOST_CHECK( !ml::analyse_sidecar::open( path, frames, media ) );
+	BOOST_CHECK( !ml::analyse_sidecar::open( "", frames, media ) );
+
+	fs::remove( media );
+}
+
+BOOST_AUTO_TEST_CASE( sidecar_of_changed_media_is_rejected )
+{
+	const std::string media = create_media( );
+	const std::string path = write_sidecar( media );
+	BOOST_CHECK( ml::analyse_sidecar::open( path, frames, media ) );
+
+	// Same number of frames, but the media has been rewritten
+	{
+		std::ofstream file( media.c_str( ), std::ios::binary | std::ios::app );
+		file << 'm';
+	}
+	BOOST_CHECK( !ml::analyse_sidecar::open( path, frames, media ) );
+
+	// Nor does it match media which isn't a local file
+	BOOST_CHECK( !ml::analyse_sidecar::open( path, frames, "" ) );
+
+	fs::remove( path );
+	fs::remove( media );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,58 @@
+#include <boost/test/unit_test.hpp>
+#include <openmedialib/ml/audio.hpp>
+#include <openmedialib/ml/audio_pool.hpp>
+
+namespace ml = olib::openmedialib::ml;
+
+BOOST_AUTO_TEST_SUITE( audio_pool )
+
+BOOST_AUTO_TEST_CASE( released_buffers_are_reused )
+{
+	void *first = ml::audio::pool_allocate( 1920 * 2 * 2 + 16 );
+	BOOST_REQUIRE( first );
+	BOOST_CHECK_EQUAL( reinterpret_cast< size_t >( first ) % 16, 0u );
+	ml::audio::pool_release( first );
+
+	ml::audio::pool_stats_type before = ml::audio::pool_stats( );
+
+	// Same size class, so the buffer comes back from this thread's free list
+	void *second = ml::audio::pool_allocate( 1920 * 2 * 2 + 20 );
+	BOOST_CHECK_EQUAL( first, second );
+	ml::audio::pool_release( second );
+
+	ml::audio::pool_stats_type after = ml::audio::pool_stats( );
+	BOOST_CHECK_EQUAL( after.requests - before.requests, 1 );
+	BOOST_CHECK_EQUAL( after.thread_hits - before.thread_hits, 1 );
+	BOOST_CHECK_EQUAL( after.system_allocations, before.system_allocations );
+	BOOST_CHECK_EQUAL( after.releases - before.releases, 1 );
+}
+
+BOOST_AUTO_TEST_CASE( audio_objects_do_not_allocate_in_steady_state )
+{
+	// Warm up the free lists for the sizes used below
+	{
+		ml::audio_type_ptr a = ml::audio::allocate( ml::audio::pcm16_id, 48000, 16, 1920 );
+		ml::audio_type_ptr b = ml::audio::coerce( ml::audio::float_id, a );
+	}
+
+	ml::audio::pool_stats_type before = ml::audio::pool_stats( );
+
+	for ( int i = 0; i < 100; i ++ )
+	{
+		ml::audio_type_ptr a = ml::audio::allocate( ml::audio::pcm16_id, 48000, 16, 1920 );
+		ml::audio_type_ptr b = ml::audio::coerce( ml::audio::float_id, a );
+		BOOST_REQUIRE( b );
+	}
+
+	ml::audio::pool_stats_type after = ml::audio::pool_stats( );
+	BOOST_CHECK_EQUAL( after.requests - before.requests, 200 );
+	BOOST_CHECK_EQUAL( after.system_allocations, before.system_allocations );
+}
+
+BOOST_AUTO_TEST_CASE( trim_releases_shared_buffers )
+{
+	ml::audio::pool_trim( );
+	BOOST_CHECK_EQUAL( ml::audio::pool_stats( ).retained_bytes, 0 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
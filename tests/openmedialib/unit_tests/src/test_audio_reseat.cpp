@@ -0,0 +1,130 @@
+#include <boost/test/unit_test.hpp>
+#include <openmedialib/ml/audio.hpp>
+#include <openmedialib/ml/audio_pool.hpp>
+#include <openmedialib/ml/audio_reseat.hpp>
+#include <openmedialib/ml/utilities.hpp>
+
+namespace ml = olib::openmedialib::ml;
+
+namespace
+{
+	// Stereo pcm16 where each sample holds its index in the stream (mod 2^15) and the channel is negated
+	ml::audio_type_ptr counter( int start, int samples )
+	{
+		ml::audio::pcm16_ptr audio( new ml::audio::pcm16( 48000, 2, samples, false ) );
+		for ( int i = 0; i < samples; i ++ )
+		{
+			audio->data( )[ i * 2 ] = boost::int16_t( ( start + i ) & 0x7fff );
+			audio->data( )[ i * 2 + 1 ] = boost::int16_t( -( ( start + i ) & 0x7fff ) );
+		}
+		return audio;
+	}
+
+	bool continues( const ml::audio_type_ptr &audio, int start )
+	{
+		const boost::int16_t *data = static_cast< const boost::int16_t * >( audio->pointer( ) );
+		for ( int i = 0; i < audio->samples( ); i ++ )
+			if ( data[ i * 2 ] != boost::int16_t( ( start + i ) & 0x7fff ) || data[ i * 2 + 1 ] != boost::int16_t( -( ( start + i ) & 0x7fff ) ) )
+				return false;
+		return true;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE( audio_reseat )
+
+BOOST_AUTO_TEST_CASE( retrieves_span_appends )
+{
+	ml::audio::reseat_ptr reseat = ml::audio::create_reseat( );
+
+	// 48khz at 25fps into 29.97fps - the retrieves wrap the ring and span several appends
+	int appended = 0, retrieved = 0;
+	for ( int frame = 0; frame < 500; frame ++ )
+	{
+		const int wanted = ml::audio::samples_for_frame( frame, 48000, 30000, 1001 );
+		while ( !reseat->has( wanted ) )
+		{
+			reseat->append( counter( appended, 1920 ) );
+			appended += 1920;
+		}
+
+		ml::audio_type_ptr audio = reseat->retrieve( wanted );
+		BOOST_REQUIRE( audio );
+		BOOST_REQUIRE_EQUAL( audio->samples( ), wanted );
+		BOOST_REQUIRE( continues( audio, retrieved ) );
+		retrieved += wanted;
+		BOOST_CHECK_EQUAL( reseat->size( ), appended - retrieved );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( offset_padding_and_conversion )
+{
+	ml::audio::reseat_ptr reseat = ml::audio::create_reseat( );
+
+	// The offset skips the start of the first packet
+	reseat->append( counter( 0, 1000 ), 400 );
+	BOOST_CHECK_EQUAL( reseat->size( ), 600 );
+
+	// Later packets are converted to the type of the first
+	reseat->append( ml::audio::coerce( ml::audio::float_id, counter( 1000, 1000 ) ) );
+	BOOST_CHECK_EQUAL( reseat->size( ), 1600 );
+
+	BOOST_CHECK( !reseat->retrieve( 2000, false ) );
+
+	ml::audio_type_ptr audio = reseat->retrieve( 2000, true );
+	BOOST_REQUIRE( audio );
+	BOOST_CHECK( audio->id( ) == ml::audio::pcm16_id );
+	BOOST_REQUIRE_EQUAL( audio->samples( ), 2000 );
+	BOOST_CHECK_EQUAL( reseat->size( ), 0 );
+
+	const boost::int16_t *data = static_cast< const boost::int16_t * >( audio->pointer( ) );
+	BOOST_CHECK_EQUAL( data[ 0 ], 400 );
+	BOOST_CHECK_EQUAL( data[ 1199 * 2 ], 1599 );
+	BOOST_CHECK_EQUAL( data[ 1199 * 2 + 1 ], -1599 );
+	BOOST_CHECK_EQUAL( data[ 1600 * 2 ], 0 );
+	BOOST_CHECK_EQUAL( data[ 1999 * 2 + 1 ], 0 );
+
+	// Once empty, the next append determines the type again
+	reseat->append( ml::audio::allocate( ml::audio::pcm32_id, 48000, 6, 100 ) );
+	audio = reseat->retrieve( 100 );
+	BOOST_REQUIRE( audio );
+	BOOST_CHECK( audio->id( ) == ml::audio::pcm32_id );
+	BOOST_CHECK_EQUAL( audio->channels( ), 6 );
+}
+
+BOOST_AUTO_TEST_CASE( no_allocations_in_steady_state )
+{
+	ml::audio::reseat_impl reseat;
+
+	// Decoded mp2 packets into 29.97fps frames
+	ml::audio_type_ptr packet = ml::audio::coerce( ml::audio::float_id, counter( 0, 1152 ) );
+
+	// Warm up the ring and the pool's free lists for the retrieved sizes
+	int frame = 0;
+	for ( ; frame < 50; frame ++ )
+	{
+		const int wanted = ml::audio::samples_for_frame( frame, 48000, 30000, 1001 );
+		while ( !reseat.has( wanted ) )
+			reseat.append( packet );
+		reseat.retrieve( wanted, false );
+	}
+
+	const int capacity = reseat.capacity( );
+	ml::audio::pool_stats_type before = ml::audio::pool_stats( );
+
+	for ( ; frame < 1050; frame ++ )
+	{
+		const int wanted = ml::audio::samples_for_frame( frame, 48000, 30000, 1001 );
+		while ( !reseat.has( wanted ) )
+			reseat.append( packet );
+		BOOST_REQUIRE( reseat.retrieve( wanted, false ) );
+	}
+
+	ml::audio::pool_stats_type after = ml::audio::pool_stats( );
+
+	// One buffer per retrieve, always recycled, and the ring never grows
+	BOOST_CHECK_EQUAL( after.requests - before.requests, 1000 );
+	BOOST_CHECK_EQUAL( after.system_allocations, before.system_allocations );
+	BOOST_CHECK_EQUAL( reseat.capacity( ), capacity );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
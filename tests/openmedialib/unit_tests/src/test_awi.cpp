@@ -1,5 +1,10 @@
 #include <boost/test/unit_test.hpp>
 #include <openmedialib/ml/awi.hpp>
+#include <openmedialib/ml/awi_mapped.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <fstream>
+#include <vector>
 
 using namespace olib::openmedialib::ml;
 
@@ -144,6 +149,79 @@ void test_calculate_method< awi_generator_v4 >( )
 	test_calculate_method_with_gaps( g3 );
 }
 
+// Generates an index of gops of 12 frames with variable sizes and returns its serialised form
+template< typename AWI_GEN_TYPE >
+std::vector< boost::uint8_t > generate( AWI_GEN_TYPE &generator, int gops )
+{
+	std::vector< boost::uint8_t > result, buffer;
+	boost::int64_t offset = 0;
+
+	for ( int i = 0; i < gops; i ++ )
+	{
+		BOOST_REQUIRE( generator.enroll( i * 12, offset ) );
+		offset += 100000 + ( i * 7919 ) % 50000;
+
+		// Flushing periodically as a growing file would
+		if ( i % 100 == 99 )
+		{
+			BOOST_REQUIRE( generator.flush( buffer ) );
+			result.insert( result.end( ), buffer.begin( ), buffer.end( ) );
+		}
+	}
+
+	BOOST_REQUIRE( generator.close( gops * 12, offset ) );
+	BOOST_REQUIRE( generator.flush( buffer ) );
+	result.insert( result.end( ), buffer.begin( ), buffer.end( ) );
+	return result;
+}
+
+// Parses the data in chunks of the given sizes (cycled) and checks the result against the generator
+template< typename AWI_GEN_TYPE, typename AWI_PARSER_TYPE >
+void test_parse_chunks( AWI_GEN_TYPE &generator, AWI_PARSER_TYPE &parser, const std::vector< boost::uint8_t > &data, const std::vector< size_t > &chunks )
+{
+	size_t position = 0;
+	for ( size_t i = 0; position < data.size( ); i ++ )
+	{
+		const size_t length = std::min( chunks[ i % chunks.size( ) ], data.size( ) - position );
+
+		// A private copy which is invalidated after the call ensures that nothing is read from it later
+		std::vector< boost::uint8_t > chunk( data.begin( ) + position, data.begin( ) + position + length );
+		parser.parse( chunk.empty( ) ? 0 : &chunk[ 0 ], length );
+		std::fill( chunk.begin( ), chunk.end( ), 0xff );
+
+		position += length;
+		BOOST_REQUIRE( parser.valid( ) );
+	}
+
+	BOOST_CHECK( parser.finished( ) );
+	BOOST_CHECK_EQUAL( parser.total_frames( ), generator.total_frames( ) );
+	BOOST_CHECK_EQUAL( parser.bytes( ), generator.bytes( ) );
+
+	for ( int position = 0; position < generator.total_frames( ); position += 5 )
+	{
+		BOOST_CHECK_EQUAL( parser.find( position ), generator.find( position ) );
+		BOOST_CHECK_EQUAL( parser.key_frame_of( position ), generator.key_frame_of( position ) );
+	}
+}
+
+template< typename AWI_GEN_TYPE, typename AWI_PARSER_TYPE >
+void test_parse( AWI_GEN_TYPE &generator, AWI_PARSER_TYPE &whole, AWI_PARSER_TYPE &split )
+{
+	const std::vector< boost::uint8_t > data = generate( generator, 1000 );
+
+	// All at once and in sizes which split records at every possible point
+	test_parse_chunks( generator, whole, data, std::vector< size_t >( 1, data.size( ) ) );
+
+	std::vector< size_t > chunks;
+	chunks.push_back( 1 );
+	chunks.push_back( 7 );
+	chunks.push_back( 19 );
+	chunks.push_back( 0 );
+	chunks.push_back( 333 );
+	chunks.push_back( 16384 );
+	test_parse_chunks( generator, split, data, chunks );
+}
+
 BOOST_AUTO_TEST_SUITE( awi )
 
 BOOST_AUTO_TEST_CASE( version2 )
@@ -161,4 +239,146 @@ BOOST_AUTO_TEST_CASE( version4 )
 	test_calculate_method< awi_generator_v4 >( );
 }
 
+BOOST_AUTO_TEST_CASE( parse_version2 )
+{
+	awi_generator_v2 generator;
+	awi_parser_v2 whole, split;
+	test_parse( generator, whole, split );
+}
+
+BOOST_AUTO_TEST_CASE( parse_version4 )
+{
+	awi_generator_v4 generator( AWI_V4_TYPE_VIDEO );
+	awi_parser_v4 whole( AWI_V4_TYPE_VIDEO ), split( AWI_V4_TYPE_VIDEO );
+	test_parse( generator, whole, split );
+
+	// Audio entries interleaved with the video are skipped
+	awi_generator_v4 video( AWI_V4_TYPE_VIDEO );
+	awi_generator_v4 audio( AWI_V4_TYPE_AUDIO_FIRST, false );
+	std::vector< boost::uint8_t > data, buffer;
+	BOOST_REQUIRE( video.flush( buffer ) );
+	data.insert( data.end( ), buffer.begin( ), buffer.end( ) );
+	for ( int i = 0; i < 100; i ++ )
+	{
+		BOOST_REQUIRE( video.enroll( i * 12, i * 100000 ) );
+		BOOST_REQUIRE( audio.enroll( i * 12, i * 10000 ) );
+		BOOST_REQUIRE( audio.flush( buffer ) );
+		data.insert( data.end( ), buffer.begin( ), buffer.end( ) );
+		BOOST_REQUIRE( video.flush( buffer ) );
+		data.insert( data.end( ), buffer.begin( ), buffer.end( ) );
+	}
+	BOOST_REQUIRE( video.close( 1200, 10000000 ) );
+	BOOST_REQUIRE( video.flush( buffer ) );
+	data.insert( data.end( ), buffer.begin( ), buffer.end( ) );
+
+	awi_parser_v4 parser( AWI_V4_TYPE_VIDEO );
+	test_parse_chunks( video, parser, data, std::vector< size_t >( 1, 25 ) );
+}
+
+BOOST_AUTO_TEST_CASE( mapped_version4 )
+{
+	namespace fs = boost::filesystem;
+
+	awi_generator_v4 generator( AWI_V4_TYPE_VIDEO );
+	const std::vector< boost::uint8_t > data = generate( generator, 1000 );
+
+	const std::string index = ( fs::temp_directory_path( ) / fs::unique_path( "%%%%%%%%.awi" ) ).string( );
+	{
+		std::ofstream file( index.c_str( ), std::ios::binary );
+		file.write( reinterpret_cast< const char * >( &data[ 0 ] ), std::streamsize( data.size( ) ) );
+	}
+
+	awi_parser_v4 parser( AWI_V4_TYPE_VIDEO );
+	parser.parse( &data[ 0 ], data.size( ) );
+	BOOST_REQUIRE( parser.finished( ) );
+
+	BOOST_CHECK( !awi_mapped_index::open( index, AWI_V4_TYPE_VIDEO ) );
+	BOOST_REQUIRE( awi_mapped_index::write( index, parser ) );
+	BOOST_CHECK( !awi_mapped_index::open( index, AWI_V4_TYPE_AUDIO_FIRST ) );
+
+	awi_mapped_index_ptr mapped = awi_mapped_index::open( index, AWI_V4_TYPE_VIDEO );
+	BOOST_REQUIRE( mapped );
+	BOOST_CHECK( mapped->valid( ) );
+	BOOST_CHECK( mapped->finished( ) );
+	BOOST_CHECK_EQUAL( mapped->type( ), AWI_V4_TYPE_VIDEO );
+	BOOST_CHECK_EQUAL( mapped->total_frames( ), parser.total_frames( ) );
+	BOOST_CHECK_EQUAL( mapped->frames( 0 ), parser.frames( 0 ) );
+	BOOST_CHECK_EQUAL( mapped->bytes( ), parser.bytes( ) );
+
+	for ( int position = -1; position <= parser.total_frames( ) + 12; position ++ )
+	{
+		BOOST_CHECK_EQUAL( mapped->find( position ), parser.find( position ) );
+		BOOST_CHECK_EQUAL( mapped->key_frame_of( position ), parser.key_frame_of( position ) );
+		BOOST_CHECK_EQUAL( mapped->offset( position ), parser.offset( position ) );
+		BOOST_CHECK_EQUAL( mapped->length( position ), parser.length( position ) );
+	}
+
+	for ( boost::int64_t size = 0; size < parser.bytes( ) + 100000; size += 997 )
+	{
+		BOOST_CHECK_EQUAL( mapped->calculate( size ), parser.calculate( size ) );
+		BOOST_CHECK_EQUAL( mapped->key_frame_from( size ), parser.key_frame_from( size ) );
+	}
+
+	// The sidecar is ignored once the index changes
+	{
+		std::ofstream file( index.c_str( ), std::ios::binary | std::ios::app );
+		file.write( reinterpret_cast< const char * >( &data[ 0 ] ), 20 );
+	}
+	BOOST_CHECK( !awi_mapped_index::open( index, AWI_V4_TYPE_VIDEO ) );
+
+	mapped.reset( );
+	fs::remove( awi_mapped_index::path_for( index, AWI_V4_TYPE_VIDEO ) );
+	fs::remove( index );
+}
+
+BOOST_AUTO_TEST_CASE( mapped_version4_details )
+{
+	namespace fs = boost::filesystem;
+
+	// Every frame of the 12 frame gops is detailed, not just the key frames
+	awi_generator_v4 generator( AWI_V4_TYPE_VIDEO );
+	std::vector< boost::uint8_t > data, buffer;
+	boost::int64_t offset = 0;
+	for ( int i = 0; i < 50; i ++ )
+	{
+		BOOST_REQUIRE( generator.enroll( i * 12, offset ) );
+		for ( int j = 0; j < 12; j ++ )
+		{
+			const boost::int32_t length = 1000 + ( i * 12 + j ) * 7;
+			BOOST_REQUIRE( generator.detail( i * 12 + j, offset, length ) );
+			offset += length;
+		}
+	}
+	BOOST_REQUIRE( generator.close( 600, offset ) );
+	BOOST_REQUIRE( generator.flush( buffer ) );
+	data.insert( data.end( ), buffer.begin( ), buffer.end( ) );
+	BOOST_REQUIRE( generator.finished( ) );
+
+	const std::string index = ( fs::temp_directory_path( ) / fs::unique_path( "%%%%%%%%.awi" ) ).string( );
+	{
+		std::ofstream file( index.c_str( ), std::ios::binary );
+		file.write( reinterpret_cast< const char * >( &data[ 0 ] ), std::streamsize( data.size( ) ) );
+	}
+
+	BOOST_REQUIRE( awi_mapped_index::write( index, generator ) );
+	awi_mapped_index_ptr mapped = awi_mapped_index::open( index, AWI_V4_TYPE_VIDEO );
+	BOOST_REQUIRE( mapped );
+
+	// Position 5 isn't a key frame, so it's only known from the details
+	BOOST_CHECK( generator.offset( 5 ) > 0 );
+	BOOST_CHECK_EQUAL( mapped->offset( 5 ), generator.offset( 5 ) );
+	BOOST_CHECK_EQUAL( mapped->length( 5 ), generator.length( 5 ) );
+
+	for ( int position = -1; position <= 612; position ++ )
+	{
+		BOOST_CHECK_EQUAL( mapped->offset( position ), generator.offset( position ) );
+		BOOST_CHECK_EQUAL( mapped->length( position ), generator.length( position ) );
+		BOOST_CHECK_EQUAL( mapped->key_frame_of( position ), generator.key_frame_of( position ) );
+	}
+
+	mapped.reset( );
+	fs::remove( awi_mapped_index::path_for( index, AWI_V4_TYPE_VIDEO ) );
+	fs::remove( index );
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #include <opencorelib/cl/str_util.hpp>
 #include <openmedialib/ml/filter.hpp>
 #include <openmedialib/ml/store.hpp>
+#include <openmedialib/ml/image/image.hpp>
 
 using namespace olib::openmedialib::ml;
 using namespace olib::opencorelib::str_util;
@@ -192,4 +193,84 @@ BOOST_AUTO_TEST_CASE( frame_rate_filter )
 	}
 }
 
+// Two 25fps clips of 2 frames each, the first black and the second with a red of 200
+filter_type_ptr create_cut( int interlace )
+{
+	filter_type_ptr playlist = create_filter( L"playlist" );
+	BOOST_REQUIRE( playlist );
+	playlist->property( "slots" ) = 2;
+
+	for ( int i = 0; i < 2; i ++ )
+	{
+		input_type_ptr colour = create_delayed_input( L"colour:" );
+		BOOST_REQUIRE( colour );
+		colour->property( "colourspace" ) = std::wstring( L"r8g8b8" );
+		colour->property( "width" ) = 64;
+		colour->property( "height" ) = 64;
+		colour->property( "interlace" ) = interlace;
+		colour->property( "out" ) = 2;
+		colour->property( "r" ) = i * 200;
+		BOOST_REQUIRE( colour->init( ) );
+		BOOST_REQUIRE( playlist->connect( colour, i ) );
+	}
+
+	playlist->sync( );
+	return playlist;
+}
+
+// Red of the first pixel of a scan line of the frame at position
+int red( input_type_ptr input, int position, int line )
+{
+	frame_type_ptr frame = input->fetch( position );
+	BOOST_REQUIRE( frame && frame->get_image( ) );
+	image::image_type_8_ptr image = image::coerce< image::image_type_8 >( frame->get_image( ) );
+	BOOST_REQUIRE( image );
+	return int( *( image->data( 0 ) + line * image->pitch( 0 ) ) );
+}
+
+BOOST_AUTO_TEST_CASE( frame_rate_filter_blend )
+{
+	const int threads[ ] = { 1, 4 };
+
+	for ( size_t i = 0; i < sizeof( threads ) / sizeof( threads[ 0 ] ); i ++ )
+	{
+		filter_type_ptr blend = create_filter( L"frame_rate" );
+		BOOST_REQUIRE( blend );
+		blend->property( "fps_num" ) = 50;
+		blend->property( "fps_den" ) = 1;
+		blend->property( "interpolation" ) = std::wstring( L"blend" );
+		blend->property( "threads" ) = threads[ i ];
+		BOOST_REQUIRE( blend->connect( create_cut( 0 ) ) );
+		blend->sync( );
+
+		// Frames which coincide with a source frame are untouched, the others are half way to the next
+		BOOST_CHECK_EQUAL( red( blend, 2, 0 ), 0 );
+		BOOST_CHECK_EQUAL( red( blend, 3, 0 ), 100 );
+		BOOST_CHECK_EQUAL( red( blend, 3, 63 ), 100 );
+		BOOST_CHECK_EQUAL( red( blend, 4, 0 ), 200 );
+		BOOST_CHECK_EQUAL( red( blend, 7, 0 ), 200 );
+	}
+
+	// Without interpolation, frames are repeated
+	filter_type_ptr repeat = create_filter( L"frame_rate" );
+	BOOST_REQUIRE( repeat );
+	repeat->property( "fps_num" ) = 50;
+	repeat->property( "fps_den" ) = 1;
+	BOOST_REQUIRE( repeat->connect( create_cut( 0 ) ) );
+	repeat->sync( );
+	BOOST_CHECK_EQUAL( red( repeat, 3, 0 ), 0 );
+
+	// The second field of interlaced output is a quarter of a source frame later than the first, but the second 
+	// field of the source is half a frame later, so it's weighted a quarter towards the next frame
+	filter_type_ptr fields = create_filter( L"frame_rate" );
+	BOOST_REQUIRE( fields );
+	fields->property( "fps_num" ) = 50;
+	fields->property( "fps_den" ) = 1;
+	fields->property( "interpolation" ) = std::wstring( L"blend" );
+	BOOST_REQUIRE( fields->connect( create_cut( 1 ) ) );
+	fields->sync( );
+	BOOST_CHECK_EQUAL( red( fields, 3, 0 ), 100 );
+	BOOST_CHECK_EQUAL( red( fields, 3, 1 ), 50 );
+}
+
 BOOST_AUTO_TEST_SUITE_END( )
@@ -0,0 +1,297 @@
+#include <boost/test/unit_test.hpp>
+#include <openmedialib/ml/audio.hpp>
+#include <openmedialib/ml/filter_simple.hpp>
+#include <openmedialib/ml/frame.hpp>
+#include <openmedialib/ml/memory_budget.hpp>
+#include <openmedialib/ml/utilities.hpp>
+#include <opencorelib/cl/lru.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace ml = olib::openmedialib::ml;
+namespace cl = olib::opencorelib;
+
+namespace
+{
+	// The consumers in the order in which they were asked to release
+	std::vector< ml::memory_consumer * > released;
+
+	// A consumer shared by several nodes (like a scope cache)
+	class shared_consumer : public ml::memory_consumer
+	{
+		public:
+			shared_consumer( boost::int64_t bytes )
+				: bytes_( bytes )
+			{ }
+
+			boost::int64_t memory_usage( ) const { return bytes_; }
+
+			boost::int64_t memory_release( boost::int64_t bytes )
+			{
+				released.push_back( this );
+				const boost::int64_t result = std::min( bytes, bytes_ );
+				bytes_ -= result;
+				return result;
+			}
+
+			int memory_priority( ) const { return ml::memory::cache; }
+
+		private:
+			boost::int64_t bytes_;
+	};
+
+	// A pass through node which holds the bytes given (and releases them when releasable)
+	class consumer_node : public ml::filter_simple, public ml::memory_consumer
+	{
+		public:
+			consumer_node( boost::int64_t bytes, int priority, bool releasable, ml::memory_consumer *shared = 0 )
+				: ml::filter_simple( )
+				, bytes_( bytes )
+				, priority_( priority )
+				, releasable_( releasable )
+				, shared_( shared )
+			{ }
+
+			virtual bool requires_image( ) const { return false; }
+
+			virtual const std::wstring get_uri( ) const { return L"consumer_node"; }
+
+			boost::int64_t memory_usage( ) const { return bytes_; }
+
+			boost::int64_t memory_release( boost::int64_t bytes )
+			{
+				if ( !releasable_ )
+					return 0;
+				released.push_back( this );
+				const boost::int64_t result = std::min( bytes, bytes_ );
+				bytes_ -= result;
+				return result;
+			}
+
+			int memory_priority( ) const { return priority_; }
+
+			void memory_shared( std::vector< ml::memory_consumer * > &result ) const
+			{
+				if ( shared_ )
+					result.push_back( shared_ );
+			}
+
+		protected:
+			void do_fetch( ml::frame_type_ptr &result ) { result = fetch_from_slot( ); }
+
+		private:
+			boost::int64_t bytes_;
+			int priority_;
+			bool releasable_;
+			ml::memory_consumer *shared_;
+	};
+
+	// A node whose input is fetched by worker threads (like a threader)
+	class threaded_node : public consumer_node
+	{
+		public:
+			threaded_node( boost::int64_t bytes )
+				: consumer_node( bytes, ml::memory::pipeline, false )
+			{ }
+
+			bool memory_threaded( ) const { return true; }
+	};
+
+	ml::frame_type_ptr audio_frame( int position, int samples )
+	{
+		ml::frame_type_ptr frame( new ml::frame_type( ) );
+		frame->set_position( position );
+		frame->set_audio( ml::audio::allocate( ml::audio::pcm16_id, 48000, 2, samples ) );
+		return frame;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE( memory_budget )
+
+BOOST_AUTO_TEST_CASE( frame_and_lru_usage )
+{
+	ml::frame_type_ptr frame = audio_frame( 0, 1920 );
+	const boost::int64_t audio = frame->get_audio( )->size( );
+	BOOST_REQUIRE( audio > 0 );
+	BOOST_CHECK_EQUAL( frame->memory_usage( ), audio );
+
+	// Attached frames are included
+	frame->push( audio_frame( 0, 1920 ) );
+	BOOST_CHECK_EQUAL( frame->memory_usage( ), audio * 2 );
+
+	cl::lru< int, ml::frame_type_ptr > lru( 10 );
+	for ( int i = 0; i < 5; i ++ )
+		lru.append( i, audio_frame( i, 1920 ) );
+	BOOST_CHECK_EQUAL( ml::lru_memory_usage( lru ), audio * 5 );
+
+	// Make 0 the most recently used - releasing a single byte drops 1 only
+	BOOST_REQUIRE( lru.fetch( 0 ) );
+	BOOST_CHECK_EQUAL( ml::lru_memory_release( lru, 1 ), audio );
+	BOOST_CHECK_EQUAL( lru.count( ), size_t( 4 ) );
+	BOOST_CHECK( !lru.find( 1 ) );
+	BOOST_CHECK( lru.find( 0 ) );
+
+	BOOST_CHECK_EQUAL( ml::lru_memory_release( lru, audio * 100 ), audio * 4 );
+	BOOST_CHECK_EQUAL( lru.count( ), size_t( 0 ) );
+	BOOST_CHECK_EQUAL( ml::lru_memory_usage( lru ), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( report_and_release_order )
+{
+	shared_consumer shared( 2000 );
+	boost::shared_ptr< consumer_node > a( new consumer_node( 1000, ml::memory::cache, true, &shared ) );
+	boost::shared_ptr< consumer_node > b( new consumer_node( 5000, ml::memory::pipeline, false ) );
+	boost::shared_ptr< consumer_node > c( new consumer_node( 3000, ml::memory::packets, true ) );
+	boost::shared_ptr< consumer_node > d( new consumer_node( 500, ml::memory::pipeline, false, &shared ) );
+
+	a->connect( b );
+	b->connect( c );
+	c->connect( d );
+
+	// The shared consumer is counted once per graph, but by each node using it
+	std::vector< ml::memory_usage_type > report;
+	ml::memory_report( a, report );
+	BOOST_CHECK_EQUAL( report.size( ), size_t( 5 ) );
+	BOOST_CHECK_EQUAL( ml::graph_memory_usage( a ), 11500 );
+	BOOST_CHECK_EQUAL( ml::node_memory_usage( a ), 3000 );
+	BOOST_CHECK_EQUAL( ml::node_memory_usage( d ), 2500 );
+	BOOST_CHECK_EQUAL( ml::graph_memory_usage( c ), 2500 + 3000 );
+
+	// Under budget - nothing is released
+	released.clear( );
+	BOOST_CHECK_EQUAL( ml::enforce_memory_budget( a, 20000 ), 11500 );
+	BOOST_CHECK( released.empty( ) );
+
+	// The caches are released first, the biggest first
+	BOOST_CHECK_EQUAL( ml::enforce_memory_budget( a, 9000 ), 9000 );
+	BOOST_REQUIRE_EQUAL( released.size( ), size_t( 2 ) );
+	BOOST_CHECK( released[ 0 ] == &shared );
+	BOOST_CHECK( released[ 1 ] == a.get( ) );
+	BOOST_CHECK_EQUAL( a->memory_usage( ), 500 );
+
+	// Then the packets - the pipeline is only reported
+	released.clear( );
+	BOOST_CHECK_EQUAL( ml::enforce_memory_budget( a, 0 ), 5500 );
+	BOOST_REQUIRE_EQUAL( released.size( ), size_t( 2 ) );
+	BOOST_CHECK( released[ 0 ] == a.get( ) );
+	BOOST_CHECK( released[ 1 ] == c.get( ) );
+	BOOST_CHECK_EQUAL( ml::graph_memory_usage( a ), 5500 );
+}
+
+BOOST_AUTO_TEST_CASE( walk_stops_at_threaded_nodes )
+{
+	boost::shared_ptr< consumer_node > a( new consumer_node( 1000, ml::memory::cache, true ) );
+	boost::shared_ptr< threaded_node > b( new threaded_node( 2000 ) );
+	boost::shared_ptr< consumer_node > c( new consumer_node( 4000, ml::memory::cache, true ) );
+
+	a->connect( b );
+	b->connect( c );
+
+	// The threaded node is reported, but what's upstream of it is neither measured nor released
+	std::vector< ml::memory_usage_type > report;
+	ml::memory_report( a, report );
+	BOOST_CHECK_EQUAL( report.size( ), size_t( 2 ) );
+	BOOST_CHECK_EQUAL( ml::graph_memory_usage( a ), 3000 );
+
+	released.clear( );
+	BOOST_CHECK_EQUAL( ml::enforce_memory_budget( a, 0 ), 2000 );
+	BOOST_REQUIRE_EQUAL( released.size( ), size_t( 1 ) );
+	BOOST_CHECK( released[ 0 ] == a.get( ) );
+	BOOST_CHECK_EQUAL( c->memory_usage( ), 4000 );
+}
+
+BOOST_AUTO_TEST_CASE( walk_stops_at_lock_and_playlist )
+{
+	ml::input_type_ptr tone = ml::create_input( L"tone:" );
+	BOOST_REQUIRE( tone );
+	tone->property( "out" ) = 100;
+
+	// Other threads fetch through a lock
+	boost::shared_ptr< consumer_node > a( new consumer_node( 1000, ml::memory::cache, true ) );
+	boost::shared_ptr< consumer_node > b( new consumer_node( 4000, ml::memory::cache, true ) );
+	ml::filter_type_ptr lock = ml::create_filter( L"lock" );
+	BOOST_REQUIRE( lock );
+
+	BOOST_REQUIRE( b->connect( tone ) );
+	BOOST_REQUIRE( lock->connect( b ) );
+	BOOST_REQUIRE( a->connect( lock ) );
+
+	std::vector< ml::memory_usage_type > report;
+	ml::memory_report( a, report );
+	BOOST_CHECK_EQUAL( report.size( ), size_t( 2 ) );
+	BOOST_CHECK_EQUAL( ml::graph_memory_usage( a ), 1000 );
+
+	released.clear( );
+	BOOST_CHECK_EQUAL( ml::enforce_memory_budget( a, 0 ), 0 );
+	BOOST_REQUIRE_EQUAL( released.size( ), size_t( 1 ) );
+	BOOST_CHECK( released[ 0 ] == a.get( ) );
+	BOOST_CHECK_EQUAL( b->memory_usage( ), 4000 );
+
+	// The upcoming slots of a playlist are prerolled by its pool
+	boost::shared_ptr< consumer_node > c( new consumer_node( 500, ml::memory::cache, true ) );
+	boost::shared_ptr< consumer_node > d( new consumer_node( 2000, ml::memory::cache, true ) );
+	ml::filter_type_ptr playlist = ml::create_filter( L"playlist" );
+	BOOST_REQUIRE( playlist );
+	playlist->property( "slots" ) = 1;
+
+	BOOST_REQUIRE( d->connect( tone ) );
+	BOOST_REQUIRE( playlist->connect( d ) );
+	BOOST_REQUIRE( c->connect( playlist ) );
+
+	ml::memory_report( c, report );
+	BOOST_CHECK_EQUAL( report.size( ), size_t( 2 ) );
+	BOOST_CHECK_EQUAL( ml::graph_memory_usage( c ), 500 );
+
+	released.clear( );
+	BOOST_CHECK_EQUAL( ml::enforce_memory_budget( c, 0 ), 0 );
+	BOOST_REQUIRE_EQUAL( released.size( ), size_t( 1 ) );
+	BOOST_CHECK( released[ 0 ] == c.get( ) );
+	BOOST_CHECK_EQUAL( d->memory_usage( ), 2000 );
+}
+
+BOOST_AUTO_TEST_CASE( frame_rate_within_budget )
+{
+	ml::input_type_ptr tone = ml::create_input( L"tone:" );
+	BOOST_REQUIRE( tone );
+	tone->property( "out" ) = 500;
+
+	ml::filter_type_ptr frame_rate = ml::create_filter( L"frame_rate" );
+	BOOST_REQUIRE( frame_rate );
+	frame_rate->property( "fps_num" ) = 30000;
+	frame_rate->property( "fps_den" ) = 1001;
+	frame_rate->connect( tone );
+
+	ml::filter_type_ptr budget = ml::create_filter( L"memory_budget" );
+	BOOST_REQUIRE( budget );
+	budget->connect( frame_rate );
+	budget->sync( );
+
+	for ( int i = 0; i < 100; i ++ )
+	{
+		budget->seek( i );
+		BOOST_REQUIRE( budget->fetch( ) );
+	}
+
+	const boost::int64_t unlimited = ml::graph_memory_usage( frame_rate );
+	BOOST_CHECK( unlimited > 0 );
+	BOOST_CHECK_EQUAL( ml::node_memory_usage( frame_rate ), unlimited );
+	BOOST_CHECK_EQUAL( budget->property( "usage" ).value< boost::int64_t >( ), unlimited );
+
+	// The cache shrinks to the frames still being consumed and playback is unaffected
+	budget->property( "limit" ) = boost::int64_t( 1 );
+	for ( int i = 100; i < 200; i ++ )
+	{
+		budget->seek( i );
+		ml::frame_type_ptr frame = budget->fetch( );
+		BOOST_REQUIRE( frame );
+		BOOST_REQUIRE( frame->get_audio( ) );
+		BOOST_CHECK_EQUAL( frame->get_audio( )->samples( ), ml::audio::samples_for_frame( i, 48000, 30000, 1001 ) );
+	}
+
+	const boost::int64_t limited = budget->property( "usage" ).value< boost::int64_t >( );
+	BOOST_CHECK( limited < unlimited );
+	BOOST_CHECK( budget->property( "peak" ).value< boost::int64_t >( ) >= unlimited );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,72 @@
+#include <boost/test/unit_test.hpp>
+#include <openmedialib/ml/frame.hpp>
+#include <openmedialib/ml/image/image.hpp>
+#include <openmedialib/ml/overlay_cache.hpp>
+
+namespace ml = olib::openmedialib::ml;
+
+namespace {
+
+ml::frame_type_ptr overlay( int width, int height )
+{
+	ml::frame_type_ptr frame( new ml::frame_type( ) );
+	frame->set_image( ml::image::allocate( _CT( "yuv420p" ), width, height ) );
+	return frame;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE( overlay_cache )
+
+BOOST_AUTO_TEST_CASE( cached_overlays_share_the_image )
+{
+	ml::overlay_cache_clear( );
+	ml::overlay_cache_set_limit( 64 * 1024 * 1024 );
+
+	const std::string key = ml::overlay_cache_key( "test", L"hello|Sans|36" );
+	BOOST_CHECK( !ml::overlay_cache_fetch( key ) );
+
+	ml::frame_type_ptr frame = overlay( 320, 64 );
+	ml::overlay_cache_insert( key, frame );
+
+	ml::frame_type_ptr first = ml::overlay_cache_fetch( key );
+	ml::frame_type_ptr second = ml::overlay_cache_fetch( key );
+	BOOST_REQUIRE( first && second );
+	BOOST_CHECK( first != second );
+	BOOST_CHECK( first->get_image( ) == frame->get_image( ) );
+
+	// Changes to a fetched copy don't affect the cached overlay
+	first->set_position( 100 );
+	BOOST_CHECK_EQUAL( ml::overlay_cache_fetch( key )->get_position( ), frame->get_position( ) );
+
+	ml::overlay_cache_stats_type stats = ml::overlay_cache_stats( );
+	BOOST_CHECK_EQUAL( stats.entries, 1 );
+	BOOST_CHECK_EQUAL( stats.bytes, boost::int64_t( frame->get_image( )->size( ) ) );
+}
+
+BOOST_AUTO_TEST_CASE( least_recently_used_overlays_are_evicted )
+{
+	ml::overlay_cache_clear( );
+
+	ml::frame_type_ptr frame = overlay( 320, 64 );
+	const size_t bytes = frame->get_image( )->size( );
+	ml::overlay_cache_set_limit( bytes * 2 );
+
+	ml::overlay_cache_insert( "a", frame );
+	ml::overlay_cache_insert( "b", overlay( 320, 64 ) );
+
+	// Touch a so that b is the oldest when c arrives
+	BOOST_CHECK( ml::overlay_cache_fetch( "a" ) );
+	ml::overlay_cache_insert( "c", overlay( 320, 64 ) );
+
+	BOOST_CHECK( ml::overlay_cache_fetch( "a" ) );
+	BOOST_CHECK( !ml::overlay_cache_fetch( "b" ) );
+	BOOST_CHECK( ml::overlay_cache_fetch( "c" ) );
+	BOOST_CHECK( ml::overlay_cache_stats( ).bytes <= boost::int64_t( bytes * 2 ) );
+
+	ml::overlay_cache_clear( );
+	ml::overlay_cache_set_limit( 64 * 1024 * 1024 );
+	BOOST_CHECK_EQUAL( ml::overlay_cache_stats( ).entries, 0 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,108 @@
+#include <boost/test/unit_test.hpp>
+#include <openpluginlib/pl/pcos/key.hpp>
+#include <openpluginlib/pl/pcos/property.hpp>
+#include <openpluginlib/pl/pcos/property_container.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace pcos = olib::openpluginlib::pcos;
+
+namespace
+{
+	std::string name( const char *prefix, int index )
+	{
+		std::ostringstream str;
+		str << prefix << index;
+		return str.str( );
+	}
+
+	// Interns the same names as the other threads in a different order
+	void intern( int seed, std::vector< std::size_t > *ids )
+	{
+		for ( int i = 0; i < int( ids->size( ) ); i ++ )
+		{
+			const int index = int( ( boost::int64_t( i ) * 7919 + seed ) % ids->size( ) );
+			const std::string text = name( "test_pcos_thread_", index );
+			pcos::key key = pcos::key::from_string( text.c_str( ) );
+			if ( text != key.as_string( ) )
+				return;
+			( *ids )[ index ] = key.id( );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE( pcos_keys )
+
+BOOST_AUTO_TEST_CASE( interned_keys )
+{
+	const std::string text = "test_pcos_key";
+	pcos::key a = pcos::key::from_string( text.c_str( ) );
+	pcos::key b = pcos::key::from_string( std::string( text ).c_str( ) );
+	pcos::key c = pcos::key::from_string( "test_pcos_key_other" );
+
+	BOOST_CHECK( a == b );
+	BOOST_CHECK_EQUAL( a.id( ), b.id( ) );
+	BOOST_CHECK( a != c );
+	BOOST_CHECK( ( a < c ) != ( c < a ) );
+
+	// The name is held by the table rather than the caller
+	BOOST_CHECK_EQUAL( std::string( a.as_string( ) ), text );
+	BOOST_CHECK( a.as_string( ) == b.as_string( ) );
+	BOOST_CHECK( a.as_string( ) != text.c_str( ) );
+}
+
+BOOST_AUTO_TEST_CASE( concurrent_interning )
+{
+	// Enough names to grow the table while the threads are reading it
+	std::vector< std::vector< std::size_t > > ids( 4, std::vector< std::size_t >( 5000, 0 ) );
+
+	boost::thread_group threads;
+	for ( size_t t = 0; t < ids.size( ); t ++ )
+		threads.create_thread( boost::bind( &intern, int( t * 13 ), &ids[ t ] ) );
+	threads.join_all( );
+
+	for ( size_t t = 1; t < ids.size( ); t ++ )
+		BOOST_CHECK( ids[ t ] == ids[ 0 ] );
+
+	std::vector< std::size_t > sorted( ids[ 0 ] );
+	std::sort( sorted.begin( ), sorted.end( ) );
+	BOOST_CHECK( std::adjacent_find( sorted.begin( ), sorted.end( ) ) == sorted.end( ) );
+}
+
+BOOST_AUTO_TEST_CASE( container_by_key )
+{
+	pcos::property_container props;
+	const char *names[ ] = { "test_pcos_z", "test_pcos_a", "test_pcos_m", "test_pcos_b" };
+
+	for ( int i = 0; i < 4; i ++ )
+		props.append( pcos::property( pcos::key::from_string( names[ i ] ) ) = i );
+
+	for ( int i = 0; i < 4; i ++ )
+		BOOST_CHECK_EQUAL( props.get_property_with_string( names[ i ] ).value< int >( ), i );
+	BOOST_CHECK( !props.get_property_with_string( "test_pcos_missing" ).valid( ) );
+
+	// Keys are reported in key order
+	pcos::key_vector keys = props.get_keys( );
+	BOOST_REQUIRE_EQUAL( keys.size( ), 4u );
+	for ( size_t i = 1; i < keys.size( ); i ++ )
+		BOOST_CHECK( keys[ i - 1 ] < keys[ i ] );
+
+	// Appending an existing key replaces the property
+	props.append( pcos::property( pcos::key::from_string( "test_pcos_m" ) ) = 10 );
+	BOOST_CHECK_EQUAL( props.get_keys( ).size( ), 4u );
+	BOOST_CHECK_EQUAL( props.get_property_with_string( "test_pcos_m" ).value< int >( ), 10 );
+
+	props.remove( props.get_property_with_string( "test_pcos_a" ) );
+	BOOST_CHECK( !props.get_property_with_string( "test_pcos_a" ).valid( ) );
+	BOOST_CHECK_EQUAL( props.get_property_with_string( "test_pcos_b" ).value< int >( ), 3 );
+	BOOST_CHECK_EQUAL( props.get_keys( ).size( ), 3u );
+}
+
+BOOST_AUTO_TEST_SUITE_END( )
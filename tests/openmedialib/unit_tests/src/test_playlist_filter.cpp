@@ -0,0 +1,124 @@
+#include <boost/test/unit_test.hpp>
+#include <openmedialib/ml/utilities.hpp>
+#include <openmedialib/ml/input.hpp>
+#include <openmedialib/ml/frame.hpp>
+#include <openmedialib/ml/filter.hpp>
+#include <openmedialib/ml/image/image.hpp>
+
+namespace ml = olib::openmedialib::ml;
+
+namespace
+{
+	// Frames in each slot - 0 leaves the slot unconnected
+	const int clip_frames[ ] = { 3, 0, 5, 1, 0, 4, 2 };
+	const int clips = sizeof( clip_frames ) / sizeof( clip_frames[ 0 ] );
+
+	ml::filter_type_ptr create_playlist( int preroll )
+	{
+		ml::filter_type_ptr playlist = ml::create_filter( L"playlist" );
+		BOOST_REQUIRE( playlist );
+		playlist->property( "slots" ) = clips;
+		playlist->property( "preroll" ) = preroll;
+		playlist->property( "preroll_clips" ) = 2;
+
+		for ( int i = 0; i < clips; i ++ )
+		{
+			if ( clip_frames[ i ] == 0 )
+				continue;
+
+			ml::input_type_ptr colour = ml::create_delayed_input( L"colour:" );
+			BOOST_REQUIRE( colour );
+			colour->property( "colourspace" ) = std::wstring( L"r8g8b8" );
+			colour->property( "out" ) = clip_frames[ i ];
+			colour->property( "r" ) = i * 10;
+			BOOST_REQUIRE( colour->init( ) );
+			BOOST_REQUIRE( playlist->connect( colour, i ) );
+		}
+
+		playlist->sync( );
+		return playlist;
+	}
+
+	// The slot each position of the playlist should come from
+	std::vector< int > expected_slots( )
+	{
+		std::vector< int > result;
+		for ( int i = 0; i < clips; i ++ )
+			for ( int j = 0; j < clip_frames[ i ]; j ++ )
+				result.push_back( i );
+		return result;
+	}
+
+	void check_playback( const ml::filter_type_ptr &playlist, const std::vector< int > &positions )
+	{
+		const std::vector< int > slots = expected_slots( );
+		BOOST_REQUIRE_EQUAL( playlist->get_frames( ), int( slots.size( ) ) );
+
+		for ( std::vector< int >::const_iterator i = positions.begin( ); i != positions.end( ); ++i )
+		{
+			playlist->seek( *i );
+			ml::frame_type_ptr frame = playlist->fetch( );
+			BOOST_REQUIRE( frame );
+			BOOST_CHECK_EQUAL( frame->get_position( ), *i );
+
+			ml::image_type_ptr image = frame->get_image( );
+			BOOST_REQUIRE( image );
+			BOOST_CHECK_EQUAL( int( *( ml::image::coerce< ml::image::image_type_8 >( image )->data( 0 ) ) ), slots[ *i ] * 10 );
+		}
+	}
+
+	std::vector< int > in_order( )
+	{
+		std::vector< int > result;
+		for ( int i = 0; i < int( expected_slots( ).size( ) ); i ++ )
+			result.push_back( i );
+		return result;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE( playlist_filter )
+
+BOOST_AUTO_TEST_CASE( positions_map_to_slots )
+{
+	ml::filter_type_ptr playlist = create_playlist( 0 );
+	check_playback( playlist, in_order( ) );
+
+	// Random access including jumps back into earlier clips
+	std::vector< int > positions;
+	positions.push_back( 14 );
+	positions.push_back( 0 );
+	positions.push_back( 8 );
+	positions.push_back( 3 );
+	positions.push_back( 2 );
+	positions.push_back( 9 );
+	check_playback( playlist, positions );
+
+	// Positions beyond the end belong to the last clip
+	playlist->seek( 100 );
+	ml::frame_type_ptr frame = playlist->fetch( );
+	BOOST_REQUIRE( frame );
+	BOOST_CHECK_EQUAL( int( *( ml::image::coerce< ml::image::image_type_8 >( frame->get_image( ) )->data( 0 ) ) ), 60 );
+}
+
+BOOST_AUTO_TEST_CASE( preroll_matches_plain_playback )
+{
+	ml::filter_type_ptr playlist = create_playlist( 2 );
+	check_playback( playlist, in_order( ) );
+
+	// One transition into each of the 4 following clips
+	BOOST_CHECK_EQUAL( playlist->property( "transitions" ).value< int >( ), 4 );
+	BOOST_CHECK( playlist->property( "max_transition_latency" ).value< double >( ) >= playlist->property( "transition_latency" ).value< double >( ) );
+
+	// Jumping around discards stale prerolls
+	std::vector< int > positions;
+	positions.push_back( 12 );
+	positions.push_back( 1 );
+	positions.push_back( 3 );
+	positions.push_back( 8 );
+	positions.push_back( 9 );
+	positions.push_back( 13 );
+	positions.push_back( 14 );
+	check_playback( playlist, positions );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,90 @@
+#include <boost/test/unit_test.hpp>
+#include <openpluginlib/pl/openpluginlib.hpp>
+#include <openmedialib/ml/openmedialib_plugin.hpp>
+#include <openmedialib/ml/utilities.hpp>
+
+#include <typeinfo>
+
+namespace pl = olib::openpluginlib;
+namespace ml = olib::openmedialib::ml;
+
+namespace {
+
+struct resolution
+{
+	const wchar_t *type;
+	const wchar_t *resource;
+};
+
+// Literal names, schemes, extensions (in both cases) and resources with no plugin at all
+const resolution resolutions[ ] =
+{
+	{ L"filter", L"chroma" },
+	{ L"filter", L"deinterlace" },
+	{ L"filter", L"avdecode" },
+	{ L"filter", L"no_such_filter" },
+	{ L"input", L"colour:" },
+	{ L"input", L"avformat:/tmp/test.mxf" },
+	{ L"input", L"/tmp/test.mov" },
+	{ L"input", L"/tmp/TEST.MOV" },
+	{ L"input", L"/tmp/test.unknown" },
+	{ L"output", L"avformat:/tmp/test.mp4" },
+	{ L"output", L"/tmp/test.wav" },
+};
+
+struct query : public pl::default_query_traits
+{
+	query( const std::wstring &type, const std::wstring &resource )
+		: type_( type )
+		, resource_( resource )
+	{ }
+
+	std::wstring to_match( ) const { return resource_; }
+	std::wstring libname( ) const { return L"openmedialib"; }
+	std::wstring type( ) const { return type_; }
+
+	const std::wstring type_;
+	const std::wstring resource_;
+};
+
+// The plugin which the merit sorted discovery picks
+pl::opl_ptr discovered( const std::wstring &type, const std::wstring &resource )
+{
+	pl::discovery< query > found( ( query( type, resource ) ) );
+	found.sort< pl::highest_merit_sort >( );
+	return found.empty( ) ? pl::opl_ptr( ) : found.begin( )->create_plugin( "" );
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE( plugin_resolution )
+
+BOOST_AUTO_TEST_CASE( resolution_matches_discovery )
+{
+	for ( size_t i = 0; i < sizeof( resolutions ) / sizeof( resolutions[ 0 ] ); i ++ )
+	{
+		pl::opl_ptr expected = discovered( resolutions[ i ].type, resolutions[ i ].resource );
+		pl::opl_ptr resolved = pl::resolve_plugin( L"openmedialib", resolutions[ i ].type, resolutions[ i ].resource );
+
+		BOOST_CHECK_EQUAL( bool( expected ), bool( resolved ) );
+		if ( expected && resolved )
+			BOOST_CHECK( typeid( *expected ) == typeid( *resolved ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( resolved_plugins_are_shared )
+{
+	pl::opl_ptr first = pl::resolve_plugin( L"openmedialib", L"filter", L"chroma" );
+	pl::opl_ptr second = pl::resolve_plugin( L"openmedialib", L"filter", L"chroma" );
+	BOOST_REQUIRE( first );
+	BOOST_CHECK( first == second );
+
+	// Different files with the same extension resolve to the same plugin instance
+	pl::opl_ptr a = pl::resolve_plugin( L"openmedialib", L"input", L"/tmp/a.mov" );
+	pl::opl_ptr b = pl::resolve_plugin( L"openmedialib", L"input", L"/tmp/b.mov" );
+	BOOST_CHECK( a == b );
+
+	BOOST_CHECK( ml::create_filter( L"chroma" ) );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,100 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <openmedialib/ml/utilities.hpp>
+#include <openmedialib/ml/store.hpp>
+#include <openmedialib/ml/frame.hpp>
+#include <openmedialib/ml/input.hpp>
+#include <openmedialib/ml/filter.hpp>
+#include <openmedialib/ml/image/image_interface.hpp>
+
+#include "../mocks/mock_store.hpp"
+
+namespace ml = olib::openmedialib::ml;
+namespace pcos = olib::openpluginlib::pcos;
+
+BOOST_AUTO_TEST_SUITE( renditions_filter )
+
+namespace
+{
+	ml::input_type_ptr create_source( )
+	{
+		ml::input_type_ptr input = ml::create_delayed_input( L"colour:" );
+		BOOST_REQUIRE( input );
+		input->property( "width" ) = 1920;
+		input->property( "height" ) = 1080;
+		input->property( "colourspace" ) = std::wstring( L"yuv420p" );
+		BOOST_REQUIRE( input->init( ) );
+		return input;
+	}
+
+	void add_rendition( ml::filter_type_ptr filter, int index, const std::wstring &store, int width, int height, const std::wstring &pf = L"" )
+	{
+		std::string prefix = "@" + boost::lexical_cast< std::string >( index ) + ".";
+
+		pcos::property prop_store( pcos::key::from_string( ( prefix + "store" ).c_str( ) ) );
+		filter->properties( ).append( prop_store = store );
+
+		pcos::property prop_width( pcos::key::from_string( ( prefix + "width" ).c_str( ) ) );
+		filter->properties( ).append( prop_width = width );
+
+		pcos::property prop_height( pcos::key::from_string( ( prefix + "height" ).c_str( ) ) );
+		filter->properties( ).append( prop_height = height );
+
+		if ( pf != L"" )
+		{
+			pcos::property prop_pf( pcos::key::from_string( ( prefix + "pf" ).c_str( ) ) );
+			filter->properties( ).append( prop_pf = pf );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( pyramid_computes_each_size_once )
+{
+	ml::filter_type_ptr filter = ml::create_filter( L"renditions" );
+	BOOST_REQUIRE( filter );
+
+	add_rendition( filter, 0, L"null:", 0, 0 );
+	add_rendition( filter, 1, L"null:", 480, 270 );
+	add_rendition( filter, 2, L"null:", 960, 540 );
+	add_rendition( filter, 3, L"null:", 960, 540, L"yuv422p" );
+	filter->connect( create_source( ) );
+
+	for ( int i = 0; i < 3; i ++ )
+	{
+		filter->seek( i );
+		ml::frame_type_ptr frame = filter->fetch( );
+		BOOST_REQUIRE( frame );
+		BOOST_CHECK_EQUAL( frame->get_image( )->width( ), 1920 );
+	}
+
+	// 960x540 and 480x270 are computed once per frame
+	BOOST_CHECK_EQUAL( filter->property( "rescales" ).value< int >( ), 6 );
+}
+
+BOOST_AUTO_TEST_CASE( rendition_store_receives_converted_frames )
+{
+	ml::frame_type_ptr dummy( new ml::frame_type );
+	boost::shared_ptr< ml::unittest::mock_store > store = boost::static_pointer_cast< ml::unittest::mock_store >( ml::create_store( L"mock:", dummy ) );
+	store->reset( );
+
+	{
+		ml::filter_type_ptr filter = ml::create_filter( L"renditions" );
+		BOOST_REQUIRE( filter );
+
+		add_rendition( filter, 0, L"mock:", 960, 540, L"yuv422p" );
+		filter->connect( create_source( ) );
+
+		filter->seek( 0 );
+		BOOST_REQUIRE( filter->fetch( ) );
+	}
+
+	// Destroying the filter drains the rendition and completes its store
+	BOOST_CHECK_EQUAL( store->m_complete, true );
+	BOOST_REQUIRE( store->m_frame );
+	BOOST_CHECK_EQUAL( store->m_frame->get_image( )->width( ), 960 );
+	BOOST_CHECK_EQUAL( store->m_frame->get_image( )->height( ), 540 );
+	BOOST_CHECK_EQUAL( store->m_frame->get_image( )->pf( ), _CT("yuv422p") );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
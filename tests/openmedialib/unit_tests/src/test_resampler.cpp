@@ -0,0 +1,222 @@
+#include <boost/test/unit_test.hpp>
+#include <openmedialib/ml/utilities.hpp>
+#include <openmedialib/ml/audio.hpp>
+#include <openmedialib/ml/audio_resampler.hpp>
+#include <openmedialib/ml/input.hpp>
+#include <openmedialib/ml/frame.hpp>
+#include <openmedialib/ml/filter.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace ml = olib::openmedialib::ml;
+
+namespace
+{
+	const double tone_frequency = 997.0;
+
+	// One second of a mono sine at half scale
+	ml::audio_type_ptr sine( int frequency )
+	{
+		ml::audio::floats_ptr audio( new ml::audio::floats( frequency, 1, frequency, false ) );
+		for ( int i = 0; i < frequency; i ++ )
+			audio->data( )[ i ] = float( 0.5 * std::sin( 2.0 * M_PI * tone_frequency * i / frequency ) );
+		return audio;
+	}
+
+	// Power of everything other than the tone relative to the tone (in dB) - the tone is located by a least
+	// squares fit of sin, cos and dc, and the edges (which are affected by the silence either side) are ignored
+	double thd_n( const ml::audio_type_ptr &input )
+	{
+		ml::audio_type_ptr audio = ml::audio::coerce( ml::audio::float_id, input );
+		const float *data = static_cast< const float * >( audio->pointer( ) );
+		const int margin = audio->frequency( ) / 20;
+		const double w = 2.0 * M_PI * tone_frequency / audio->frequency( );
+
+		// Normal equations of the fit
+		double m[ 3 ][ 4 ] = { { 0 } };
+		for ( int i = margin; i < audio->samples( ) - margin; i ++ )
+		{
+			const double basis[ 3 ] = { std::sin( w * i ), std::cos( w * i ), 1.0 };
+			for ( int r = 0; r < 3; r ++ )
+			{
+				for ( int c = 0; c < 3; c ++ )
+					m[ r ][ c ] += basis[ r ] * basis[ c ];
+				m[ r ][ 3 ] += basis[ r ] * data[ i ];
+			}
+		}
+
+		for ( int p = 0; p < 3; p ++ )
+			for ( int r = 0; r < 3; r ++ )
+				if ( r != p )
+				{
+					const double f = m[ r ][ p ] / m[ p ][ p ];
+					for ( int c = p; c < 4; c ++ )
+						m[ r ][ c ] -= f * m[ p ][ c ];
+				}
+
+		const double a = m[ 0 ][ 3 ] / m[ 0 ][ 0 ], b = m[ 1 ][ 3 ] / m[ 1 ][ 1 ], dc = m[ 2 ][ 3 ] / m[ 2 ][ 2 ];
+
+		double signal = 0.0, residual = 0.0;
+		for ( int i = margin; i < audio->samples( ) - margin; i ++ )
+		{
+			const double fit = a * std::sin( w * i ) + b * std::cos( w * i );
+			signal += fit * fit;
+			residual += ( data[ i ] - fit - dc ) * ( data[ i ] - fit - dc );
+		}
+
+		return 10.0 * std::log10( residual / signal );
+	}
+
+	// Stereo ramp of the requested type - each channel differs so that interleaving errors show
+	ml::audio_type_ptr ramp( ml::audio::identity id, int frequency, int samples )
+	{
+		ml::audio::floats_ptr audio( new ml::audio::floats( frequency, 2, samples, false ) );
+		for ( int i = 0; i < samples; i ++ )
+		{
+			audio->data( )[ i * 2 ] = float( 0.8 * std::sin( 0.01 * i ) );
+			audio->data( )[ i * 2 + 1 ] = float( 0.3 * std::cos( 0.003 * i ) );
+		}
+		return ml::audio::coerce( id, audio );
+	}
+
+	bool same_samples( const ml::audio_type_ptr &a, const ml::audio_type_ptr &b )
+	{
+		return a->id( ) == b->id( ) && a->samples( ) == b->samples( ) && a->channels( ) == b->channels( ) &&
+			   memcmp( a->pointer( ), b->pointer( ), a->size( ) ) == 0;
+	}
+
+	ml::input_type_ptr resampled_tone( int frequency )
+	{
+		ml::input_type_ptr tone = ml::create_delayed_input( L"tone:" );
+		BOOST_REQUIRE( tone );
+		tone->property( "frequency" ) = 48000;
+		tone->property( "out" ) = 25;
+		BOOST_REQUIRE( tone->init( ) );
+
+		ml::filter_type_ptr resample = ml::create_filter( L"resample" );
+		BOOST_REQUIRE( resample );
+		resample->property( "frequency" ) = frequency;
+		BOOST_REQUIRE( resample->connect( tone ) );
+		resample->sync( );
+		return resample;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE( resampler )
+
+BOOST_AUTO_TEST_CASE( sine_distortion )
+{
+	const int rates[ ][ 2 ] = { { 44100, 48000 }, { 48000, 44100 }, { 32000, 48000 }, { 48000, 32000 } };
+
+	for ( size_t i = 0; i < sizeof( rates ) / sizeof( rates[ 0 ] ); i ++ )
+	{
+		ml::audio_type_ptr output = ml::audio::resample( sine( rates[ i ][ 0 ] ), rates[ i ][ 1 ] );
+		BOOST_REQUIRE( output );
+		BOOST_CHECK_EQUAL( output->frequency( ), rates[ i ][ 1 ] );
+		BOOST_CHECK_EQUAL( output->samples( ), rates[ i ][ 1 ] );
+
+		const double result = thd_n( output );
+		BOOST_TEST_MESSAGE( "THD+N " << rates[ i ][ 0 ] << " to " << rates[ i ][ 1 ] << ": " << result << "dB" );
+		BOOST_CHECK_LT( result, -85.0 );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( sample_types )
+{
+	const ml::audio::identity ids[ ] = { ml::audio::pcm16_id, ml::audio::pcm24_id, ml::audio::pcm32_id, ml::audio::float_id };
+
+	for ( size_t i = 0; i < sizeof( ids ) / sizeof( ids[ 0 ] ); i ++ )
+	{
+		ml::audio_type_ptr output = ml::audio::resample( ramp( ids[ i ], 48000, 1920 ), 44100 );
+		BOOST_REQUIRE( output );
+		BOOST_CHECK( output->id( ) == ids[ i ] );
+		BOOST_CHECK_EQUAL( output->channels( ), 2 );
+		BOOST_CHECK_EQUAL( output->samples( ), 1764 );
+	}
+
+	// Kept as pcm16 for existing callers
+	ml::audio_type_ptr legacy = ml::audio_resample( ramp( ml::audio::float_id, 48000, 1920 ), 44100 );
+	BOOST_REQUIRE( legacy );
+	BOOST_CHECK( legacy->id( ) == ml::audio::pcm16_id );
+	BOOST_CHECK_EQUAL( legacy->samples( ), 1764 );
+}
+
+BOOST_AUTO_TEST_CASE( streaming_matches_one_shot )
+{
+	ml::audio_type_ptr input = ramp( ml::audio::float_id, 44100, 44100 );
+	const float *data = static_cast< const float * >( input->pointer( ) );
+
+	ml::audio::resampler_ptr whole = ml::audio::create_resampler( 44100, 48000, 2 );
+	whole->push( input );
+	const int count = whole->available( );
+	ml::audio_type_ptr expected = whole->pull( ml::audio::float_id, count );
+
+	// Uneven chunks, pulling as they become available
+	ml::audio::resampler_ptr stream = ml::audio::create_resampler( 44100, 48000, 2 );
+	ml::audio::floats_ptr output( new ml::audio::floats( 48000, 2, count, false ) );
+	int pushed = 0, pulled = 0;
+	for ( int chunk = 1; pushed < input->samples( ); chunk = chunk * 3 % 1999 + 1 )
+	{
+		const int samples = std::min( chunk, input->samples( ) - pushed );
+		ml::audio::floats_ptr part( new ml::audio::floats( 44100, 2, samples, false ) );
+		memcpy( part->data( ), data + pushed * 2, samples * 2 * sizeof( float ) );
+		stream->push( part );
+		pushed += samples;
+
+		ml::audio_type_ptr out = stream->pull( ml::audio::float_id, stream->available( ) );
+		memcpy( output->data( ) + pulled * 2, out->pointer( ), out->size( ) );
+		pulled += out->samples( );
+	}
+
+	BOOST_REQUIRE_EQUAL( pulled, count );
+	BOOST_CHECK( same_samples( expected, output ) );
+}
+
+BOOST_AUTO_TEST_CASE( reset_matches_continuous )
+{
+	ml::audio_type_ptr input = ramp( ml::audio::float_id, 48000, 20000 );
+
+	ml::audio::resampler_ptr whole = ml::audio::create_resampler( 48000, 44100, 2 );
+	whole->push( input );
+	whole->pull( ml::audio::float_id, 10000 );
+	ml::audio_type_ptr expected = whole->pull( ml::audio::float_id, 1000 );
+
+	ml::audio::resampler_ptr restarted = ml::audio::create_resampler( 48000, 44100, 2 );
+	const boost::int64_t next = restarted->reset( 10000 );
+	BOOST_REQUIRE( next > 0 && next < input->samples( ) );
+	restarted->push( input, int( next ) );
+	BOOST_CHECK_EQUAL( restarted->position( ), 10000 );
+	BOOST_REQUIRE( restarted->available( ) >= 1000 );
+
+	BOOST_CHECK( same_samples( expected, restarted->pull( ml::audio::float_id, 1000 ) ) );
+}
+
+BOOST_AUTO_TEST_CASE( filter_random_access )
+{
+	ml::input_type_ptr sequential = resampled_tone( 44100 );
+	ml::input_type_ptr random = resampled_tone( 44100 );
+
+	std::vector< ml::audio_type_ptr > frames;
+	for ( int i = 0; i < sequential->get_frames( ); i ++ )
+	{
+		sequential->seek( i );
+		ml::frame_type_ptr frame = sequential->fetch( );
+		BOOST_REQUIRE( frame && frame->get_audio( ) );
+		BOOST_CHECK_EQUAL( frame->get_audio( )->frequency( ), 44100 );
+		BOOST_CHECK_EQUAL( frame->get_audio( )->samples( ), ml::audio::samples_for_frame( i, 44100, 25, 1 ) );
+		frames.push_back( frame->get_audio( ) );
+	}
+
+	const int order[ ] = { 7, 3, 4, 24, 0, 12, 13, 1 };
+	for ( size_t i = 0; i < sizeof( order ) / sizeof( order[ 0 ] ); i ++ )
+	{
+		random->seek( order[ i ] );
+		ml::frame_type_ptr frame = random->fetch( );
+		BOOST_REQUIRE( frame && frame->get_audio( ) );
+		BOOST_CHECK( same_samples( frames[ order[ i ] ], frame->get_audio( ) ) );
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END( )
@@ -0,0 +1,90 @@
+#include <boost/test/unit_test.hpp>
+#include <openmedialib/ml/utilities.hpp>
+#include <openmedialib/ml/input.hpp>
+#include <openmedialib/ml/filter.hpp>
+#include <openmedialib/ml/statistics.hpp>
+#include <opencorelib/cl/str_util.hpp>
+
+#include <sstream>
+
+namespace ml = olib::openmedialib::ml;
+
+BOOST_AUTO_TEST_SUITE( fetch_statistics )
+
+ml::filter_type_ptr create_graph( )
+{
+	ml::input_type_ptr colour = ml::create_delayed_input( L"colour:" );
+	BOOST_REQUIRE( colour );
+	colour->property( "width" ) = 320;
+	colour->property( "height" ) = 240;
+	BOOST_REQUIRE( colour->init( ) );
+
+	ml::filter_type_ptr clip = ml::create_filter( L"clip" );
+	BOOST_REQUIRE( clip );
+	BOOST_REQUIRE( clip->connect( colour ) );
+	clip->sync( );
+
+	return clip;
+}
+
+BOOST_AUTO_TEST_CASE( fetch_stats_are_collected_per_node )
+{
+	ml::filter_type_ptr graph = create_graph( );
+
+	ml::enable_fetch_stats( true );
+	ml::reset_fetch_stats( graph );
+
+	for ( int i = 0; i < 10; i ++ )
+	{
+		graph->seek( i );
+		BOOST_REQUIRE( graph->fetch( ) );
+	}
+
+	ml::enable_fetch_stats( false );
+
+	ml::fetch_stats_list list = ml::collect_fetch_stats( graph );
+	BOOST_REQUIRE_EQUAL( list.size( ), 2u );
+	BOOST_CHECK_EQUAL( list[ 0 ].path, "0" );
+	BOOST_CHECK_EQUAL( list[ 1 ].path, "0.0" );
+
+	for ( ml::fetch_stats_list::iterator i = list.begin( ); i != list.end( ); ++i )
+	{
+		BOOST_CHECK_EQUAL( i->stats.calls, 10 );
+		BOOST_CHECK( i->stats.self <= i->stats.elapsed );
+		BOOST_CHECK( i->stats.maximum <= i->stats.elapsed );
+		BOOST_CHECK( i->stats.image_bytes > 0 );
+	}
+
+	// Exclusive time of the clip filter excludes the time spent in the colour input
+	BOOST_CHECK( list[ 0 ].stats.elapsed >= list[ 1 ].stats.elapsed );
+	BOOST_CHECK_EQUAL( list[ 0 ].stats.self, list[ 0 ].stats.elapsed - list[ 1 ].stats.elapsed );
+	BOOST_CHECK_EQUAL( list[ 1 ].stats.self, list[ 1 ].stats.elapsed );
+
+	// Nothing is gathered when disabled
+	graph->seek( 0 );
+	graph->fetch( );
+	BOOST_CHECK_EQUAL( graph->fetch_stats( ).calls, 10 );
+}
+
+BOOST_AUTO_TEST_CASE( fetch_trace_is_written_in_trace_event_format )
+{
+	ml::filter_type_ptr graph = create_graph( );
+
+	ml::clear_fetch_trace( );
+	ml::enable_fetch_trace( true );
+	graph->fetch( );
+	ml::enable_fetch_trace( false );
+	ml::enable_fetch_stats( false );
+
+	std::ostringstream stream;
+	BOOST_REQUIRE( ml::write_fetch_trace( stream ) );
+
+	std::string trace = stream.str( );
+	BOOST_CHECK( trace.find( "\"traceEvents\"" ) != std::string::npos );
+	BOOST_CHECK( trace.find( "\"ph\":\"X\"" ) != std::string::npos );
+	BOOST_CHECK( trace.find( olib::opencorelib::str_util::to_string( graph->get_uri( ) ) ) != std::string::npos );
+
+	ml::clear_fetch_trace( );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
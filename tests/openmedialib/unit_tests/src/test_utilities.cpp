@@ -91,4 +91,60 @@ BOOST_AUTO_TEST_CASE( test_byteswap16_inplace )
 	}
 }
 
+// The SSSE3 versions must give exactly the same output as the plain versions, including
+// the samples left over when the count isn't a multiple of the block size
+BOOST_AUTO_TEST_CASE( test_simd_matches_plain )
+{
+	const bool original = au::simd_enabled( );
+	if ( !au::set_simd_enabled( true ) )
+	{
+		BOOST_TEST_MESSAGE( "SSSE3 is not available - skipping" );
+		au::set_simd_enabled( original );
+		return;
+	}
+
+	const uint32_t counts[ ] = { 1, 15, 16, 17, 18, 33, 1920 * 8, 1920 * 8 + 7 };
+
+	for( size_t c = 0; c < sizeof( counts ) / sizeof( counts[ 0 ] ); c ++ )
+	{
+		const uint32_t count = counts[ c ];
+		std::vector< uint8_t > pcm32( count * 4 ), pcm24( count * 3 );
+		for( size_t i = 0; i < pcm32.size( ); i ++ )
+			pcm32[ i ] = uint8_t( i * 7 + 3 );
+		for( size_t i = 0; i < pcm24.size( ); i ++ )
+			pcm24[ i ] = uint8_t( i * 13 + 5 );
+
+		std::vector< uint8_t > packed_simd( count * 3 ), packed_plain( count * 3 );
+		std::vector< uint8_t > aiff_simd( count * 3 ), aiff_plain( count * 3 );
+		std::vector< uint32_t > unpacked_simd( count ), unpacked_plain( count );
+
+		au::set_simd_enabled( true );
+		au::pack_pcm24_from_pcm32( &packed_simd[ 0 ], &pcm32[ 0 ], count, 1 );
+		au::pack_aiff24_from_pcm32( &aiff_simd[ 0 ], &pcm32[ 0 ], count, 1 );
+		au::unpack_pcm24( &unpacked_simd[ 0 ], &pcm24[ 0 ], count, 1 );
+
+		au::set_simd_enabled( false );
+		au::pack_pcm24_from_pcm32( &packed_plain[ 0 ], &pcm32[ 0 ], count, 1 );
+		au::pack_aiff24_from_pcm32( &aiff_plain[ 0 ], &pcm32[ 0 ], count, 1 );
+		au::unpack_pcm24( &unpacked_plain[ 0 ], &pcm24[ 0 ], count, 1 );
+
+		BOOST_CHECK( packed_simd == packed_plain );
+		BOOST_CHECK( aiff_simd == aiff_plain );
+		BOOST_CHECK( unpacked_simd == unpacked_plain );
+	}
+
+	boost::shared_ptr< uint8_t > simd( static_cast< uint8_t * >( olib::opencorelib::utilities::aligned_alloc( 16, 80 ) ), &olib::opencorelib::utilities::aligned_free );
+	boost::shared_ptr< uint8_t > plain( static_cast< uint8_t * >( olib::opencorelib::utilities::aligned_alloc( 16, 80 ) ), &olib::opencorelib::utilities::aligned_free );
+	initialize_array( simd.get( ), 80 );
+	initialize_array( plain.get( ), 80 );
+
+	au::set_simd_enabled( true );
+	au::byteswap16_inplace( simd.get( ), 80 );
+	au::set_simd_enabled( false );
+	au::byteswap16_inplace( plain.get( ), 80 );
+	BOOST_CHECK( memcmp( simd.get( ), plain.get( ), 80 ) == 0 );
+
+	au::set_simd_enabled( original );
+}
+
 BOOST_AUTO_TEST_SUITE_END( )